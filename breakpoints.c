@@ -0,0 +1,111 @@
+#include "breakpoints.h"
+#include <stdlib.h>
+#include <string.h>
+
+void bp_init(BreakpointMap *bm) {
+    memset(bm, 0, sizeof(BreakpointMap));
+}
+
+void bp_free(BreakpointMap *bm) {
+    for (int i = 0; i < bm->capacity; i++) {
+        if (bp_live(&bm->slots[i])) {
+            free(bm->slots[i].condition);
+            free(bm->slots[i].collect);
+        }
+    }
+    free(bm->slots);
+    bp_init(bm);
+}
+
+static unsigned int bp_hash(uint64_t addr) {
+    // Fibonacci hashing spreads the low-entropy, mostly aligned code addresses
+    return (unsigned int)((addr * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+Breakpoint *bp_find(const BreakpointMap *bm, uint64_t addr) {
+    if (bm->count == 0) {
+        return NULL;
+    }
+
+    unsigned int mask = bm->capacity - 1;
+    for (unsigned int i = bp_hash(addr) & mask; ; i = (i + 1) & mask) {
+        Breakpoint *bp = &bm->slots[i];
+        if (bp->slot == BP_SLOT_EMPTY) {
+            return NULL;
+        }
+        if (bp->slot == BP_SLOT_USED && bp->addr == addr) {
+            return bp;
+        }
+    }
+}
+
+// Rebuild into a table of the given size, dropping tombstones
+static int bp_rehash(BreakpointMap *bm, int capacity) {
+    Breakpoint *slots = calloc(capacity, sizeof(Breakpoint));
+    if (!slots) {
+        return -1;
+    }
+
+    unsigned int mask = capacity - 1;
+    for (int i = 0; i < bm->capacity; i++) {
+        if (!bp_live(&bm->slots[i])) continue;
+        unsigned int j = bp_hash(bm->slots[i].addr) & mask;
+        while (slots[j].slot != BP_SLOT_EMPTY) {
+            j = (j + 1) & mask;
+        }
+        slots[j] = bm->slots[i];
+    }
+
+    free(bm->slots);
+    bm->slots = slots;
+    bm->capacity = capacity;
+    bm->used = bm->count;
+    return 0;
+}
+
+Breakpoint *bp_add(BreakpointMap *bm, uint64_t addr, int line) {
+    Breakpoint *bp = bp_find(bm, addr);
+    if (bp) {
+        return bp;
+    }
+
+    // Keep the load factor, tombstones included, under 3/4
+    if ((bm->used + 1) * 4 > bm->capacity * 3) {
+        int capacity = bm->capacity ? bm->capacity : 16;
+        while ((bm->count + 1) * 2 > capacity) {
+            capacity *= 2;
+        }
+        if (bp_rehash(bm, capacity) != 0) {
+            return NULL;
+        }
+    }
+
+    unsigned int mask = bm->capacity - 1;
+    unsigned int i = bp_hash(addr) & mask;
+    while (bm->slots[i].slot == BP_SLOT_USED) {
+        i = (i + 1) & mask;
+    }
+
+    bp = &bm->slots[i];
+    if (bp->slot == BP_SLOT_EMPTY) {
+        bm->used++;
+    }
+    memset(bp, 0, sizeof(Breakpoint));
+    bp->addr = addr;
+    bp->line = line;
+    bp->slot = BP_SLOT_USED;
+    bm->count++;
+    return bp;
+}
+
+void bp_remove(BreakpointMap *bm, uint64_t addr) {
+    Breakpoint *bp = bp_find(bm, addr);
+    if (bp) {
+        free(bp->condition);
+        free(bp->collect);
+        bp->condition = NULL;
+        bp->collect = NULL;
+        bp->slot = BP_SLOT_DELETED;
+        bm->count--;
+    }
+}
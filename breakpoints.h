@@ -0,0 +1,48 @@
+#ifndef BREAKPOINTS_H
+#define BREAKPOINTS_H
+
+#include <stdint.h>
+#include "expr.h"
+
+#define BP_SLOT_EMPTY    0
+#define BP_SLOT_USED     1
+#define BP_SLOT_DELETED  2
+
+typedef struct {
+    uint64_t addr;       // Link-time address; the load bias is added on insert
+    int line;            // Source line the user asked for
+    Expr *condition;     // Stop only when non-zero; NULL = always
+    Expr *collect;       // Tracepoint: record these and keep running
+    int collect_count;
+    unsigned long hits;  // Times the int3 fired, condition true or not
+    uint8_t orig;        // Byte under the int3 while inserted
+    uint8_t inserted;
+    uint8_t slot;
+    uint8_t reserved;
+} Breakpoint;
+
+// Open-addressing hash map from address to breakpoint, linear probing over
+// a power-of-two table. Removal leaves a tombstone so probe chains stay intact.
+typedef struct {
+    Breakpoint *slots;
+    int capacity;
+    int count;           // Live breakpoints
+    int used;            // Live breakpoints plus tombstones
+} BreakpointMap;
+
+void bp_init(BreakpointMap *bm);
+void bp_free(BreakpointMap *bm);
+
+// Breakpoint at addr, or NULL
+Breakpoint *bp_find(const BreakpointMap *bm, uint64_t addr);
+
+// Existing or new breakpoint at addr, or NULL when out of memory
+Breakpoint *bp_add(BreakpointMap *bm, uint64_t addr, int line);
+void bp_remove(BreakpointMap *bm, uint64_t addr);
+
+// Iterate with: for (int i = 0; i < bm->capacity; i++) if (bp_live(&bm->slots[i]))
+static inline int bp_live(const Breakpoint *bp) {
+    return bp->slot == BP_SLOT_USED;
+}
+
+#endif
@@ -0,0 +1,493 @@
+#include "cfi.h"
+#include "dwarf_reader.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DW_EH_PE_absptr   0x00
+#define DW_EH_PE_uleb128  0x01
+#define DW_EH_PE_udata2   0x02
+#define DW_EH_PE_udata4   0x03
+#define DW_EH_PE_udata8   0x04
+#define DW_EH_PE_sleb128  0x09
+#define DW_EH_PE_sdata2   0x0a
+#define DW_EH_PE_sdata4   0x0b
+#define DW_EH_PE_sdata8   0x0c
+#define DW_EH_PE_pcrel    0x10
+#define DW_EH_PE_omit     0xff
+
+#define DW_CFA_advance_loc         0x40
+#define DW_CFA_offset              0x80
+#define DW_CFA_restore             0xc0
+#define DW_CFA_nop                 0x00
+#define DW_CFA_set_loc             0x01
+#define DW_CFA_advance_loc1        0x02
+#define DW_CFA_advance_loc2        0x03
+#define DW_CFA_advance_loc4        0x04
+#define DW_CFA_offset_extended     0x05
+#define DW_CFA_restore_extended    0x06
+#define DW_CFA_undefined           0x07
+#define DW_CFA_same_value          0x08
+#define DW_CFA_register            0x09
+#define DW_CFA_remember_state      0x0a
+#define DW_CFA_restore_state       0x0b
+#define DW_CFA_def_cfa             0x0c
+#define DW_CFA_def_cfa_register    0x0d
+#define DW_CFA_def_cfa_offset      0x0e
+#define DW_CFA_def_cfa_expression  0x0f
+#define DW_CFA_expression          0x10
+#define DW_CFA_offset_extended_sf  0x11
+#define DW_CFA_def_cfa_sf          0x12
+#define DW_CFA_def_cfa_offset_sf   0x13
+#define DW_CFA_val_offset          0x14
+#define DW_CFA_val_offset_sf       0x15
+#define DW_CFA_val_expression      0x16
+#define DW_CFA_GNU_args_size       0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+#define CFI_STATE_STACK 8    // Depth of DW_CFA_remember_state
+
+// Common information entry: what the FDEs that point at it share
+typedef struct {
+    uint64_t code_align;
+    int64_t data_align;
+    uint64_t ra_reg;
+    int fde_encoding;        // DW_EH_PE_* of the pc range
+    int augmented;           // 'z': FDEs carry an augmentation length
+    const unsigned char *insns;
+    const unsigned char *insns_end;
+} Cie;
+
+typedef enum {
+    RULE_SAME,               // Unchanged from the callee (or never saved)
+    RULE_OFFSET,             // Saved at CFA + offset
+    RULE_UNDEFINED,
+    RULE_OTHER               // Another register or an expression
+} RuleKind;
+
+typedef struct {
+    RuleKind kind;
+    int64_t offset;
+} Rule;
+
+typedef struct {
+    uint64_t cfa_reg;
+    int64_t cfa_offset;
+    int cfa_expr;
+    Rule ra;
+    Rule rbp;
+} CfiState;
+
+void cfi_init(CfiTable *ct) {
+    memset(ct, 0, sizeof(CfiTable));
+}
+
+void cfi_free(CfiTable *ct) {
+    free(ct->fdes);
+    free(ct->rows);
+    cfi_init(ct);
+}
+
+void cfi_load(CfiTable *ct, const ElfFile *ef) {
+    cfi_free(ct);
+    ct->frame = elf_section(ef, ".eh_frame", &ct->frame_size);
+    if (ct->frame) {
+        const Elf64_Shdr *sh = elf_section_header(ef, ".eh_frame");
+        ct->frame_addr = sh ? sh->sh_addr : 0;
+        ct->is_eh = 1;
+    } else {
+        ct->frame = elf_section(ef, ".debug_frame", &ct->frame_size);
+    }
+}
+
+// Pointer in one of the DW_EH_PE_* encodings. .debug_frame always uses
+// plain addresses.
+static uint64_t read_encoded(const CfiTable *ct, DwarfCursor *c, int encoding) {
+    uint64_t base = 0;
+    if ((encoding & 0x70) == DW_EH_PE_pcrel) {
+        base = ct->frame_addr + (uint64_t)(c->p - ct->frame);
+    }
+    switch (encoding & 0x0f) {
+        case DW_EH_PE_absptr:  return base + dw_u64(c);
+        case DW_EH_PE_uleb128: return base + dw_uleb(c);
+        case DW_EH_PE_udata2:  return base + dw_u16(c);
+        case DW_EH_PE_udata4:  return base + dw_u32(c);
+        case DW_EH_PE_udata8:  return base + dw_u64(c);
+        case DW_EH_PE_sleb128: return base + (uint64_t)dw_sleb(c);
+        case DW_EH_PE_sdata2:  return base + (uint64_t)(int64_t)(int16_t)dw_u16(c);
+        case DW_EH_PE_sdata4:  return base + (uint64_t)(int64_t)(int32_t)dw_u32(c);
+        case DW_EH_PE_sdata8:  return base + dw_u64(c);
+        default:
+            c->error = 1;
+            return 0;
+    }
+}
+
+// Entry header at offset: its end, and whether it is a CIE. For an FDE,
+// cie gets the offset of its CIE. Returns -1 past the last entry.
+static int read_entry(const CfiTable *ct, DwarfCursor *c, uint64_t offset,
+                      const unsigned char **end, int *is_cie, uint64_t *cie) {
+    if (offset >= ct->frame_size) return -1;
+    dw_init(c, ct->frame + offset, ct->frame_size - offset);
+    int is64;
+    uint64_t length = dw_unit_length(c, &is64);
+    if (c->error || length == 0 || length > (uint64_t)dw_left(c)) return -1;
+    *end = c->p + length;
+
+    const unsigned char *id_at = c->p;
+    uint64_t id = dw_offset(c, is64);
+    if (ct->is_eh) {
+        *is_cie = id == 0;
+        *cie = (uint64_t)(id_at - ct->frame) - id;
+    } else {
+        *is_cie = id == (is64 ? UINT64_MAX : 0xffffffffULL);
+        *cie = id;
+    }
+    return c->error ? -1 : 0;
+}
+
+static int parse_cie(const CfiTable *ct, uint64_t offset, Cie *cie) {
+    DwarfCursor c;
+    const unsigned char *end;
+    int is_cie;
+    uint64_t unused;
+    if (read_entry(ct, &c, offset, &end, &is_cie, &unused) != 0 || !is_cie) return -1;
+
+    memset(cie, 0, sizeof(Cie));
+    int version = dw_u8(&c);
+    const char *aug = dw_str(&c);
+    if (!ct->is_eh && version >= 4) {
+        dw_skip(&c, 2);      // Address and segment selector sizes
+    }
+    cie->code_align = dw_uleb(&c);
+    cie->data_align = dw_sleb(&c);
+    cie->ra_reg = version == 1 ? dw_u8(&c) : dw_uleb(&c);
+    cie->fde_encoding = DW_EH_PE_absptr;
+
+    if (aug[0] == 'z') {
+        cie->augmented = 1;
+        uint64_t length = dw_uleb(&c);
+        const unsigned char *data_end = c.p + length;
+        for (const char *a = aug + 1; *a && c.p < data_end; a++) {
+            if (*a == 'R') {
+                cie->fde_encoding = dw_u8(&c);
+            } else if (*a == 'P') {
+                int encoding = dw_u8(&c);
+                read_encoded(ct, &c, encoding & 0x7f);
+            } else if (*a == 'L') {
+                dw_u8(&c);
+            } else if (*a != 'S' && *a != 'B') {
+                break;
+            }
+        }
+        c.p = data_end;
+    } else if (aug[0] != '\0') {
+        return -1;           // Cannot tell where the instructions start
+    }
+    if (c.error || c.p > end) return -1;
+    cie->insns = c.p;
+    cie->insns_end = end;
+    return 0;
+}
+
+static int compare_fdes(const void *a, const void *b) {
+    const CfiFde *fa = a;
+    const CfiFde *fb = b;
+    if (fa->lo != fb->lo) {
+        return fa->lo < fb->lo ? -1 : 1;
+    }
+    return 0;
+}
+
+static void build_index(CfiTable *ct) {
+    ct->indexed = 1;
+    int capacity = 0;
+    uint64_t cie_offset = UINT64_MAX;
+    Cie cie;
+
+    uint64_t offset = 0;
+    DwarfCursor c;
+    const unsigned char *end;
+    int is_cie;
+    uint64_t cie_at;
+    while (read_entry(ct, &c, offset, &end, &is_cie, &cie_at) == 0) {
+        uint64_t entry = offset;
+        offset = (uint64_t)(end - ct->frame);
+        if (is_cie) continue;
+
+        // FDEs usually follow their CIE, so one parsed CIE serves a run
+        if (cie_at != cie_offset) {
+            if (parse_cie(ct, cie_at, &cie) != 0) continue;
+            cie_offset = cie_at;
+        }
+        uint64_t lo = read_encoded(ct, &c, cie.fde_encoding);
+        uint64_t range = read_encoded(ct, &c, cie.fde_encoding & 0x0f);
+        if (c.error || range == 0 || lo == 0) continue;
+
+        if (ct->fde_count == capacity) {
+            int cap = capacity ? capacity * 2 : 64;
+            CfiFde *fdes = realloc(ct->fdes, cap * sizeof(CfiFde));
+            if (!fdes) break;
+            ct->fdes = fdes;
+            capacity = cap;
+        }
+        CfiFde *f = &ct->fdes[ct->fde_count++];
+        memset(f, 0, sizeof(CfiFde));
+        f->lo = lo;
+        f->hi = lo + range;
+        f->offset = (uint32_t)entry;
+    }
+    qsort(ct->fdes, ct->fde_count, sizeof(CfiFde), compare_fdes);
+}
+
+static void set_rule(const Cie *cie, CfiState *s, uint64_t reg, RuleKind kind, int64_t offset) {
+    Rule rule = { kind, offset };
+    if (reg == cie->ra_reg) s->ra = rule;
+    else if (reg == CFI_REG_RBP) s->rbp = rule;
+}
+
+static void restore_rule(const Cie *cie, CfiState *s, const CfiState *initial, uint64_t reg) {
+    if (reg == cie->ra_reg) s->ra = initial->ra;
+    else if (reg == CFI_REG_RBP) s->rbp = initial->rbp;
+}
+
+// Append the state in effect from loc, replacing a row at the same pc and
+// dropping one that repeats its predecessor
+static int emit_row(CfiTable *ct, CfiFde *f, uint64_t loc, const CfiState *s) {
+    CfiRow row;
+    memset(&row, 0, sizeof(row));
+    row.lo = loc;
+    row.cfa_reg = s->cfa_expr || s->cfa_reg > 127 ? -1 : (int8_t)s->cfa_reg;
+    row.cfa_offset = (int32_t)s->cfa_offset;
+    row.ra_saved = s->ra.kind == RULE_OFFSET;
+    row.ra_offset = (int16_t)s->ra.offset;
+    row.rbp_saved = s->rbp.kind == RULE_OFFSET;
+    row.rbp_offset = (int16_t)s->rbp.offset;
+    if (s->cfa_offset != row.cfa_offset || s->ra.offset != row.ra_offset ||
+        s->rbp.offset != row.rbp_offset) {
+        row.cfa_reg = -1;
+    }
+
+    CfiRow *last = f->row_count ? &ct->rows[ct->row_count - 1] : NULL;
+    if (last && last->lo == loc) {
+        *last = row;
+        return 0;
+    }
+    if (last) {
+        CfiRow same = row;
+        same.lo = last->lo;
+        if (memcmp(&same, last, sizeof(CfiRow)) == 0) return 0;
+    }
+    if (ct->row_count == ct->row_capacity) {
+        int cap = ct->row_capacity ? ct->row_capacity * 2 : 256;
+        CfiRow *rows = realloc(ct->rows, cap * sizeof(CfiRow));
+        if (!rows) return -1;
+        ct->rows = rows;
+        ct->row_capacity = cap;
+    }
+    ct->rows[ct->row_count++] = row;
+    f->row_count++;
+    return 0;
+}
+
+// Run a CFA program. With f set, rows are emitted as the location advances;
+// without it (the CIE's initial instructions) only the state is built.
+static int run_program(CfiTable *ct, const Cie *cie, DwarfCursor *c, CfiFde *f,
+                       CfiState *s, const CfiState *initial) {
+    CfiState stack[CFI_STATE_STACK];
+    int depth = 0;
+    uint64_t loc = f ? f->lo : 0;
+
+    while (dw_left(c) > 0) {
+        uint8_t op = dw_u8(c);
+        uint64_t reg, delta = 0;
+        int advance = 0;
+
+        switch (op & 0xc0) {
+            case DW_CFA_advance_loc:
+                delta = (op & 0x3f) * cie->code_align;
+                advance = 1;
+                break;
+            case DW_CFA_offset:
+                set_rule(cie, s, op & 0x3f, RULE_OFFSET, (int64_t)dw_uleb(c) * cie->data_align);
+                continue;
+            case DW_CFA_restore:
+                if (initial) restore_rule(cie, s, initial, op & 0x3f);
+                continue;
+            default:
+                break;
+        }
+
+        if (!advance) {
+            switch (op) {
+                case DW_CFA_nop:
+                    break;
+                case DW_CFA_GNU_args_size:
+                    dw_uleb(c);
+                    break;
+                case DW_CFA_set_loc: {
+                    uint64_t to = read_encoded(ct, c, cie->fde_encoding);
+                    if (to < loc) return -1;
+                    delta = to - loc;
+                    advance = 1;
+                    break;
+                }
+                case DW_CFA_advance_loc1: delta = dw_u8(c) * cie->code_align;  advance = 1; break;
+                case DW_CFA_advance_loc2: delta = dw_u16(c) * cie->code_align; advance = 1; break;
+                case DW_CFA_advance_loc4: delta = dw_u32(c) * cie->code_align; advance = 1; break;
+                case DW_CFA_offset_extended:
+                    reg = dw_uleb(c);
+                    set_rule(cie, s, reg, RULE_OFFSET, (int64_t)dw_uleb(c) * cie->data_align);
+                    break;
+                case DW_CFA_offset_extended_sf:
+                    reg = dw_uleb(c);
+                    set_rule(cie, s, reg, RULE_OFFSET, dw_sleb(c) * cie->data_align);
+                    break;
+                case DW_CFA_GNU_negative_offset_extended:
+                    reg = dw_uleb(c);
+                    set_rule(cie, s, reg, RULE_OFFSET, -(int64_t)dw_uleb(c) * cie->data_align);
+                    break;
+                case DW_CFA_restore_extended:
+                    reg = dw_uleb(c);
+                    if (initial) restore_rule(cie, s, initial, reg);
+                    break;
+                case DW_CFA_undefined:
+                    set_rule(cie, s, dw_uleb(c), RULE_UNDEFINED, 0);
+                    break;
+                case DW_CFA_same_value:
+                    set_rule(cie, s, dw_uleb(c), RULE_SAME, 0);
+                    break;
+                case DW_CFA_register:
+                    reg = dw_uleb(c);
+                    dw_uleb(c);
+                    set_rule(cie, s, reg, RULE_OTHER, 0);
+                    break;
+                case DW_CFA_remember_state:
+                    if (depth == CFI_STATE_STACK) return -1;
+                    stack[depth++] = *s;
+                    break;
+                case DW_CFA_restore_state:
+                    if (depth == 0) return -1;
+                    *s = stack[--depth];
+                    break;
+                case DW_CFA_def_cfa:
+                    s->cfa_reg = dw_uleb(c);
+                    s->cfa_offset = (int64_t)dw_uleb(c);
+                    s->cfa_expr = 0;
+                    break;
+                case DW_CFA_def_cfa_sf:
+                    s->cfa_reg = dw_uleb(c);
+                    s->cfa_offset = dw_sleb(c) * cie->data_align;
+                    s->cfa_expr = 0;
+                    break;
+                case DW_CFA_def_cfa_register:
+                    s->cfa_reg = dw_uleb(c);
+                    s->cfa_expr = 0;
+                    break;
+                case DW_CFA_def_cfa_offset:
+                    s->cfa_offset = (int64_t)dw_uleb(c);
+                    break;
+                case DW_CFA_def_cfa_offset_sf:
+                    s->cfa_offset = dw_sleb(c) * cie->data_align;
+                    break;
+                case DW_CFA_def_cfa_expression:
+                    dw_skip(c, dw_uleb(c));
+                    s->cfa_expr = 1;
+                    break;
+                case DW_CFA_expression:
+                case DW_CFA_val_expression:
+                    reg = dw_uleb(c);
+                    dw_skip(c, dw_uleb(c));
+                    set_rule(cie, s, reg, RULE_OTHER, 0);
+                    break;
+                case DW_CFA_val_offset:
+                case DW_CFA_val_offset_sf:
+                    reg = dw_uleb(c);
+                    if (op == DW_CFA_val_offset) dw_uleb(c);
+                    else dw_sleb(c);
+                    set_rule(cie, s, reg, RULE_OTHER, 0);
+                    break;
+                default:
+                    return -1;       // Vendor extension we do not know
+            }
+        }
+
+        if (advance && f) {
+            if (emit_row(ct, f, loc, s) != 0) return -1;
+            loc += delta;
+        }
+    }
+    if (c->error) return -1;
+    if (f && loc < f->hi) {
+        return emit_row(ct, f, loc, s);
+    }
+    return 0;
+}
+
+static void compile_fde(CfiTable *ct, CfiFde *f) {
+    f->compiled = 1;
+    f->first_row = ct->row_count;
+    f->row_count = 0;
+
+    DwarfCursor c;
+    const unsigned char *end;
+    int is_cie;
+    uint64_t cie_at;
+    Cie cie;
+    if (read_entry(ct, &c, f->offset, &end, &is_cie, &cie_at) != 0 || is_cie ||
+        parse_cie(ct, cie_at, &cie) != 0) {
+        return;
+    }
+    read_encoded(ct, &c, cie.fde_encoding);
+    read_encoded(ct, &c, cie.fde_encoding & 0x0f);
+    if (cie.augmented) {
+        dw_skip(&c, dw_uleb(&c));
+    }
+    if (c.error || c.p > end) return;
+
+    CfiState initial;
+    memset(&initial, 0, sizeof(initial));
+    initial.ra.kind = RULE_UNDEFINED;
+    DwarfCursor ci;
+    dw_init(&ci, cie.insns, cie.insns_end - cie.insns);
+    if (run_program(ct, &cie, &ci, NULL, &initial, NULL) != 0) return;
+
+    CfiState s = initial;
+    DwarfCursor fi;
+    dw_init(&fi, c.p, end - c.p);
+    if (run_program(ct, &cie, &fi, f, &s, &initial) != 0) {
+        // Rows that stop partway would claim the rest of the function
+        ct->row_count = f->first_row;
+        f->row_count = 0;
+    }
+}
+
+const CfiRow *cfi_lookup(CfiTable *ct, uint64_t pc) {
+    if (!ct->indexed) {
+        build_index(ct);
+    }
+
+    // Last FDE starting at or below pc
+    int lo = 0, hi = ct->fde_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ct->fdes[mid].lo <= pc) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0 || pc >= ct->fdes[lo - 1].hi) {
+        return NULL;
+    }
+    CfiFde *f = &ct->fdes[lo - 1];
+    if (!f->compiled) {
+        compile_fde(ct, f);
+    }
+
+    const CfiRow *rows = ct->rows + f->first_row;
+    lo = 0;
+    hi = f->row_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (rows[mid].lo <= pc) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo == 0 ? NULL : &rows[lo - 1];
+}
@@ -0,0 +1,60 @@
+#ifndef CFI_H
+#define CFI_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "elf_file.h"
+
+#define CFI_REG_RBP  6       // DWARF register numbers on x86-64
+#define CFI_REG_RSP  7
+
+// Where the caller's frame is, over one pc range of a function. Offsets
+// are from the canonical frame address (the caller's rsp before the call).
+typedef struct {
+    uint64_t lo;             // Link-time pc where the row starts
+    int32_t cfa_offset;      // CFA = cfa_reg + cfa_offset
+    int8_t cfa_reg;          // DWARF register, -1 if the CFA is an expression
+    int8_t ra_saved;         // 0 in the outermost frame (_start)
+    int8_t rbp_saved;        // Caller's rbp is at CFA + rbp_offset
+    int8_t pad;
+    int16_t ra_offset;
+    int16_t rbp_offset;
+} CfiRow;
+
+// Function with call frame information. Its CFA program is compiled into
+// rows the first time a pc inside it is looked up.
+typedef struct {
+    uint64_t lo, hi;         // Link-time pc range [lo, hi)
+    uint32_t offset;         // Of the FDE in its section
+    int compiled;
+    int first_row;
+    int row_count;
+} CfiFde;
+
+// Call frame information from .eh_frame, or .debug_frame when a binary has
+// no .eh_frame. Loading only finds the section; the FDE index is built on
+// the first lookup.
+typedef struct {
+    const unsigned char *frame;
+    size_t frame_size;
+    uint64_t frame_addr;     // Link-time address of .eh_frame, for pc-relative pointers
+    int is_eh;
+
+    int indexed;
+    CfiFde *fdes;            // Sorted by lo
+    int fde_count;
+    CfiRow *rows;
+    int row_count;
+    int row_capacity;
+} CfiTable;
+
+void cfi_init(CfiTable *ct);
+void cfi_free(CfiTable *ct);
+
+// Remember the frame section of ef, which must stay mapped
+void cfi_load(CfiTable *ct, const ElfFile *ef);
+
+// Row in effect at link-time pc, or NULL if no FDE covers it
+const CfiRow *cfi_lookup(CfiTable *ct, uint64_t pc);
+
+#endif
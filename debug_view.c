@@ -1,13 +1,18 @@
 #include "debug_view.h"
 #include "ui_helpers.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <poll.h>
 
 void dv_init(DebugView *dv) {
     memset(dv, 0, sizeof(DebugView));
     dbg_init(&dv->debugger);
     dv->source_loaded = 0;
     dv->scroll_offset = 0;
+    dv->asm_top = -1;
     memset(dv->compile_error, 0, sizeof(dv->compile_error));
 }
 
@@ -33,14 +38,735 @@ int dv_load_program(DebugView *dv, const char *executable_path, const char *sour
     fclose(f);
 
     dv->source_loaded = 1;
+    dv->cursor_line = 1;
 
-    return dbg_load_program(&dv->debugger, executable_path, source_path);
+    if (dbg_load_program(&dv->debugger, executable_path, source_path) != 0) {
+        return -1;
+    }
+    return eng_start(&dv->engine, &dv->debugger);
 }
 
-void dv_draw(DebugView *dv, WINDOW *win_code, WINDOW *win_output, WINDOW *win_info) {
+// Breakpoint set on a source line, or NULL
+static const Breakpoint *dv_breakpoint_on_line(DebugView *dv, int line) {
+    BreakpointMap *bm = &dv->debugger.breakpoints;
+    for (int i = 0; i < bm->capacity; i++) {
+        if (bp_live(&bm->slots[i]) && bm->slots[i].line == line) {
+            return &bm->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Open prompt, if any, at row y. Returns the next free row.
+static int dv_draw_prompt(DebugView *dv, WINDOW *win, int y, int x) {
+    const char *title;
+    switch (dv->prompt) {
+        case DV_PROMPT_CONDITION: title = "Condition for line %d (empty = none):"; break;
+        case DV_PROMPT_TRACE:     title = "Trace at line %d, e.g. $rax, *(int *)($rbp - 4):"; break;
+        case DV_PROMPT_WATCH:     title = "Watch, e.g. *(int *)($rbp - 4) (rw: also reads):"; break;
+        case DV_PROMPT_REGION:    title = "Watch range: address, size (e.g. $rbp - 4016, 4000):"; break;
+        case DV_PROMPT_MEMORY:    title = "Show memory at, e.g. $rsp or 0x404040:"; break;
+        case DV_PROMPT_EXPR:      title = "Watch expression, e.g. p->next->val or arr[i]:"; break;
+        case DV_PROMPT_FUNCTION:  title = "Break at function (again to remove):"; break;
+        case DV_PROMPT_CHECKPOINT: title = "Restart from checkpoint number (empty = newest):"; break;
+        case DV_PROMPT_ITRACE:    title = "Trace instructions into file (r: also registers):"; break;
+        case DV_PROMPT_REPLAY:    title = "Go to instruction number:"; break;
+        default: return y;
+    }
+
+    wattron(win, COLOR_PAIR(COLOR_STATUSBAR));
+    char text[96];
+    snprintf(text, sizeof(text), title, dv->cursor_line);
+    ui_safe_print(win, y++, x, text);
+    wattroff(win, COLOR_PAIR(COLOR_STATUSBAR));
+
+    char input[160];
+    snprintf(input, sizeof(input), "> %s_", dv->prompt_text);
+    ui_safe_print(win, y++, x, input);
+    return y + 1;
+}
+
+#define DV_STATUS_FRAMES 4   // Innermost frames the status view lists
+
+static void dv_format_frame(const DbgFrame *f, int index, char *out, size_t size) {
+    if (!f->function) {
+        snprintf(out, size, " #%d 0x%lx (library)", index, f->pc);
+    } else if (f->file) {
+        const char *base = strrchr(f->file, '/');
+        snprintf(out, size, " #%d %s () %s:%d", index, f->function, base ? base + 1 : f->file, f->line);
+    } else {
+        snprintf(out, size, " #%d %s () line %d", index, f->function, f->line);
+    }
+}
+
+#define DV_PROFILE_TOP 3     // Hottest functions the status view lists
+
+static void dv_draw_profile(DebugView *dv, WINDOW *win_info, int *y, int x) {
+    const Debugger *dbg = &dv->debugger;
+    const Profile *p = &dbg->profile;
+    char row[160];
+    snprintf(row, sizeof(row), "Profile: %lu samples, %.1f%% in libraries",
+             p->total, p->outside * 100.0 / p->total);
+    ui_safe_print(win_info, (*y)++, x, row);
+
+    ProfEntry top[DV_PROFILE_TOP];
+    int n = prof_top_functions(p, top, DV_PROFILE_TOP);
+    for (int i = 0; i < n; i++) {
+        const FuncSymbol *fs = sym_lookup(&dbg->symbols, top[i].key);
+        snprintf(row, sizeof(row), " %5.1f%% %s", top[i].count * 100.0 / p->total,
+                 fs ? sym_name(&dbg->symbols, fs) : "??");
+        ui_safe_print(win_info, (*y)++, x, row);
+    }
+}
+
+static void dv_draw_status(DebugView *dv, WINDOW *win_info) {
+    int start_y, start_x, height, width;
+    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
+    ui_draw_window(win_info, "DEBUG INFO");
+
+    int y = start_y;
+
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    char status[128];
+    snprintf(status, sizeof(status), "State: %s", dv_state_string(dv));
+    ui_safe_print(win_info, y++, start_x, status);
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    if (dv->debugger.error_message[0] != '\0') {
+        wattron(win_info, COLOR_PAIR(COLOR_SELECTED) | A_BOLD);
+        char error_line[256];
+        snprintf(error_line, sizeof(error_line), "ERROR: %s", dv->debugger.error_message);
+        ui_safe_print(win_info, y++, start_x, error_line);
+        wattroff(win_info, COLOR_PAIR(COLOR_SELECTED) | A_BOLD);
+    }
+    y++;
+
+    y = dv_draw_prompt(dv, win_info, y, start_x);
+
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    char exec_info[64];
+    snprintf(exec_info, sizeof(exec_info), "Line: %d / %d | Steps: %d",
+             dv->debugger.current_line, dv->source_line_count,
+             dv->debugger.instruction_count);
+    ui_safe_print(win_info, y++, start_x, exec_info);
+    if (dv_function_string(dv)) {
+        char function[160];
+        snprintf(function, sizeof(function), "Function: %s", dv_function_string(dv));
+        ui_safe_print(win_info, y++, start_x, function);
+    }
+
+    if (dv->engine.frame_count > 0) {
+        int count = dv->engine.frame_count;
+        wattron(win_info, A_BOLD);
+        ui_safe_print(win_info, y++, start_x, dv->debugger.signal_stopped ? "Crashed. Stack:" :
+                                              dv->debugger.paused ? "Paused. Stack:" : "Stack:");
+        wattroff(win_info, A_BOLD);
+        for (int i = 0; i < count && i < DV_STATUS_FRAMES; i++) {
+            char frame[160];
+            dv_format_frame(&dv->engine.frames[i], i, frame, sizeof(frame));
+            ui_safe_print(win_info, y++, start_x, frame);
+        }
+        if (count > DV_STATUS_FRAMES) {
+            char more[64];
+            snprintf(more, sizeof(more), " ... %d more (Tab to the stack view)", count - DV_STATUS_FRAMES);
+            ui_safe_print(win_info, y++, start_x, more);
+        }
+    }
+
+    if (dv->debugger.breakpoint_hit) {
+        const Breakpoint *bp = dv_breakpoint_on_line(dv, dv->debugger.breakpoint_line);
+        char bp_info[192];
+        if (bp && bp->condition) {
+            snprintf(bp_info, sizeof(bp_info), "Breakpoint: line %d if %s (hit %lu)",
+                     bp->line, bp->condition->text, bp->hits);
+        } else {
+            snprintf(bp_info, sizeof(bp_info), "Breakpoint: line %d (hit %lu)",
+                     dv->debugger.breakpoint_line, bp ? bp->hits : 0);
+        }
+        ui_safe_print(win_info, y++, start_x, bp_info);
+    }
+    if (dv->debugger.recording) {
+        const SnapshotRing *sr = &dv->debugger.snapshots;
+        char record[128];
+        snprintf(record, sizeof(record), "Recording: %d stops back (%zu KB, %d pages mirrored)",
+                 sr->count, sr->bytes / 1024, sr->shadow_count);
+        ui_safe_print(win_info, y++, start_x, record);
+    }
+    if (dv->debugger.checkpoint_count > 0) {
+        char list[128] = "Checkpoints:";
+        for (int i = 0; i < dv->debugger.checkpoint_count; i++) {
+            size_t len = strlen(list);
+            snprintf(list + len, sizeof(list) - len, " %d:L%d", i + 1,
+                     dv->debugger.checkpoints[i].line);
+        }
+        ui_safe_print(win_info, y++, start_x, list);
+    }
+    if (dv->debugger.itrace_path[0] != '\0') {
+        const Debugger *dbg = &dv->debugger;
+        char itrace[128];
+        snprintf(itrace, sizeof(itrace), "Traced %lu instructions (%lu KB) at %lu/s",
+                 dbg->itrace_count, dbg->itrace_bytes / 1024,
+                 dbg->itrace_count * 1000 / (dbg->itrace_ms > 0 ? dbg->itrace_ms : 1));
+        ui_safe_print(win_info, y++, start_x, itrace);
+    }
+    if (dv->debugger.profile.total > 0) {
+        dv_draw_profile(dv, win_info, &y, start_x);
+    }
+    char bp_count[64];
+    snprintf(bp_count, sizeof(bp_count), "Breakpoints: %d | Cursor: %d",
+             dv->debugger.breakpoints.count, dv->cursor_line);
+    ui_safe_print(win_info, y++, start_x, bp_count);
+
+    if (dv->debugger.watch_hit) {
+        const Watchpoint *w = &dv->debugger.watches[dv->debugger.watch_hit - 1];
+        char watch_info[96];
+        snprintf(watch_info, sizeof(watch_info), "Watch %d %s: %ld -> %ld",
+                 dv->debugger.watch_hit, w->kind == DBG_WATCH_ACCESS ? "accessed" : "changed",
+                 (long)dv->debugger.watch_old, (long)dv->debugger.watch_new);
+        wattron(win_info, A_BOLD);
+        ui_safe_print(win_info, y++, start_x, watch_info);
+        wattroff(win_info, A_BOLD);
+    }
+    if (dv->debugger.region_hit) {
+        char region_info[96];
+        if (dv->debugger.region_line > 0) {
+            snprintf(region_info, sizeof(region_info), "Range %d written at 0x%lx by line %d",
+                     dv->debugger.region_hit, dv->debugger.region_addr, dv->debugger.region_line);
+        } else {
+            snprintf(region_info, sizeof(region_info), "Range %d written at 0x%lx by 0x%lx",
+                     dv->debugger.region_hit, dv->debugger.region_addr, dv->debugger.region_pc);
+        }
+        wattron(win_info, A_BOLD);
+        ui_safe_print(win_info, y++, start_x, region_info);
+        wattroff(win_info, A_BOLD);
+    }
+    for (int i = 0; i < DBG_MAX_REGIONS; i++) {
+        const RegionWatch *r = &dv->debugger.regions[i];
+        if (!r->active) continue;
+        char region_line[192];
+        snprintf(region_line, sizeof(region_line), " R%d 0x%lx +%lu (hit %lu, faults %lu)", i + 1,
+                 r->addr, r->size, r->hits, dv->debugger.region_faults);
+        ui_safe_print(win_info, y++, start_x, region_line);
+    }
+    for (int i = 0; i < DBG_MAX_WATCH; i++) {
+        const Watchpoint *w = &dv->debugger.watches[i];
+        if (!w->active) continue;
+        char watch_line[192];
+        snprintf(watch_line, sizeof(watch_line), " %d%s %s = %ld (hit %lu)", i + 1,
+                 w->kind == DBG_WATCH_ACCESS ? " rw" : "", w->text, (long)w->value, w->hits);
+        ui_safe_print(win_info, y++, start_x, watch_line);
+    }
+
+    if (dv->debugger.return_valid) {
+        char ret_info[96];
+        snprintf(ret_info, sizeof(ret_info), "Returned: %ld (0x%lx)",
+                 (long)dv->debugger.return_value, dv->debugger.return_value);
+        ui_safe_print(win_info, y++, start_x, ret_info);
+    }
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+    y++;
+
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    ui_safe_print(win_info, y++, start_x, "Controls:");
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    if (dv->compile_error[0] != '\0') {
+        wattron(win_info, A_DIM);
+        ui_safe_print(win_info, y++, start_x, " r - Run/Start (fix errors first)");
+        ui_safe_print(win_info, y++, start_x, " n - Next");
+        ui_safe_print(win_info, y++, start_x, " s - Step");
+        ui_safe_print(win_info, y++, start_x, " i - Step instruction");
+        ui_safe_print(win_info, y++, start_x, " f - Finish");
+        ui_safe_print(win_info, y++, start_x, " c - Continue");
+        wattroff(win_info, A_DIM);
+    }
+    else if (dv->debugger.state == DBG_STATE_NOT_STARTED ||
+        dv->debugger.state == DBG_STATE_EXITED) {
+        wattron(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
+        ui_safe_print(win_info, y++, start_x, " r - Run/Start");
+        wattroff(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
+        wattron(win_info, A_DIM);
+        ui_safe_print(win_info, y++, start_x, " n - Next");
+        ui_safe_print(win_info, y++, start_x, " s - Step");
+        ui_safe_print(win_info, y++, start_x, " i - Step instruction");
+        ui_safe_print(win_info, y++, start_x, " f - Finish");
+        ui_safe_print(win_info, y++, start_x, " c - Continue");
+        wattroff(win_info, A_DIM);
+    } else {
+        ui_safe_print(win_info, y++, start_x, " r - Run/Start");
+        wattron(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
+        ui_safe_print(win_info, y++, start_x, " n - Next");
+        ui_safe_print(win_info, y++, start_x, " s - Step");
+        ui_safe_print(win_info, y++, start_x, " i - Step instruction");
+        ui_safe_print(win_info, y++, start_x, " f - Finish");
+        ui_safe_print(win_info, y++, start_x, " c - Continue");
+        wattroff(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
+    }
+
+    ui_safe_print(win_info, y++, start_x, dv->debugger.recording ? " m - Stop recording" : " m - Record stops");
+    ui_safe_print(win_info, y++, start_x, " u - Step back (while recording)");
+    ui_safe_print(win_info, y++, start_x, " k - Checkpoint  K - Restart from one");
+    ui_safe_print(win_info, y++, start_x, " T - Trace instructions  V - Replay trace");
+    ui_safe_print(win_info, y++, start_x, " h - Continue profiling  H - Clear profile");
+    ui_safe_print(win_info, y++, start_x, " p - Pause while running");
+    ui_safe_print(win_info, y++, start_x, " b - Toggle breakpoint");
+    ui_safe_print(win_info, y++, start_x, " B - Breakpoint condition");
+    ui_safe_print(win_info, y++, start_x, " F - Break at function");
+    ui_safe_print(win_info, y++, start_x, " t - Tracepoint values");
+    ui_safe_print(win_info, y++, start_x, " w - Watch memory");
+    ui_safe_print(win_info, y++, start_x, " W - Watch address range");
+    ui_safe_print(win_info, y++, start_x, " e - Watch expression");
+    ui_safe_print(win_info, y++, start_x, " a - Disassembly");
+    ui_safe_print(win_info, y++, start_x, " Tab - Locals, stack, code, trace, memory");
+    ui_safe_print(win_info, y++, start_x, " Up/Dn - Move cursor");
+    ui_safe_print(win_info, y++, start_x, " ESC - Exit debug mode");
+
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+}
+
+// Shown while the engine owns the debugger; nothing here reads it
+static void dv_draw_running(DebugView *dv, WINDOW *win_info) {
+    int start_y, start_x, height, width;
+    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
+    ui_draw_window(win_info, "DEBUG INFO");
+
+    int y = start_y;
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    ui_safe_print(win_info, y++, start_x, "State: Running");
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+    y++;
+
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    char cursor[64];
+    snprintf(cursor, sizeof(cursor), "Cursor: %d", dv->cursor_line);
+    ui_safe_print(win_info, y++, start_x, cursor);
+    y++;
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    ui_safe_print(win_info, y++, start_x, "Controls:");
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+    wattron(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
+    ui_safe_print(win_info, y++, start_x, " p - Pause");
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
+    ui_safe_print(win_info, y++, start_x, " Up/Dn - Move cursor");
+    ui_safe_print(win_info, y++, start_x, " ESC - Stop and exit debug mode");
+}
+
+// Source line of a traced address, 0 outside the source file
+static int dv_replay_pc_line(DebugView *dv, uint64_t pc) {
+    const LineEntry *e = lt_lookup(&dv->debugger.lines, pc - dv->replay.header->load_bias);
+    if (!e || e->file == LT_NO_FILE || (dv->replay_file >= 0 && e->file != dv->replay_file)) {
+        return 0;
+    }
+    return e->line;
+}
+
+// Where the replay is, from the trace alone
+static void dv_draw_replay(DebugView *dv, WINDOW *win_info) {
+    int start_y, start_x, height, width;
+    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
+    ui_draw_window(win_info, "DEBUG INFO - REPLAY");
+
+    int y = dv_draw_prompt(dv, win_info, start_y, start_x);
+    const Debugger *dbg = &dv->debugger;
+    const ItrCursor *c = &dv->replay_at;
+
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    const char *name = strrchr(dbg->itrace_path, '/');
+    ui_safe_print(win_info, y++, start_x, name ? name + 1 : dbg->itrace_path);
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    char row[128];
+    snprintf(row, sizeof(row), "Instruction %llu of %llu",
+             (unsigned long long)c->index + 1, (unsigned long long)dv->replay.insn_count);
+    ui_safe_print(win_info, y++, start_x, row);
+
+    uint64_t addr = c->pc - dv->replay.header->load_bias;
+    const FuncSymbol *fs = sym_lookup(&dbg->symbols, addr);
+    if (fs) {
+        snprintf(row, sizeof(row), "pc %llx %s+%llu", (unsigned long long)c->pc,
+                 sym_name(&dbg->symbols, fs), (unsigned long long)(addr - fs->addr));
+    } else {
+        snprintf(row, sizeof(row), "pc %llx (library)", (unsigned long long)c->pc);
+    }
+    ui_safe_print(win_info, y++, start_x, row);
+    int line = dv_replay_pc_line(dv, c->pc);
+    if (line > 0) {
+        snprintf(row, sizeof(row), "Line: %d", line);
+        ui_safe_print(win_info, y++, start_x, row);
+    }
+
+    if (dv->replay.header->flags & ITR_FLAG_REGS) {
+        y++;
+        wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+        ui_safe_print(win_info, y++, start_x, "Registers:");
+        wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+        for (int i = 0; i < ITR_REGS; i += 2) {
+            int len = snprintf(row, sizeof(row), " %-6s %016llx", itr_reg_names[i],
+                               (unsigned long long)c->regs[i]);
+            if (i + 1 < ITR_REGS) {
+                snprintf(row + len, sizeof(row) - len, "  %-6s %016llx", itr_reg_names[i + 1],
+                         (unsigned long long)c->regs[i + 1]);
+            }
+            ui_safe_print(win_info, y++, start_x, row);
+        }
+    }
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+    y++;
+
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    ui_safe_print(win_info, y++, start_x, "Controls:");
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    ui_safe_print(win_info, y++, start_x, " n/s - Next line  u - Previous line");
+    ui_safe_print(win_info, y++, start_x, " i - Next instruction  I - Previous one");
+    ui_safe_print(win_info, y++, start_x, " Home/End - First/last  g - Go to instruction");
+    ui_safe_print(win_info, y++, start_x, " V/ESC - Leave the replay");
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+}
+
+// Parameters and locals of the stopped function, then the registers
+static void dv_draw_locals(DebugView *dv, WINDOW *win_info) {
+    int start_y, start_x, height, width;
+    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
+    ui_draw_window(win_info, "DEBUG INFO - LOCALS");
+
+    int y = dv_draw_prompt(dv, win_info, start_y, start_x);
+    int bottom = start_y + height - 1;
+    ui_safe_print(win_info, bottom, start_x, " Tab - Call stack");
+
+    const Debugger *dbg = &dv->debugger;
+    if (dbg->state != DBG_STATE_STOPPED) {
+        wattron(win_info, A_DIM);
+        ui_safe_print(win_info, y, start_x, "(start the program to see its variables)");
+        wattroff(win_info, A_DIM);
+        return;
+    }
+
+    const FuncSymbol *fs = sym_lookup(&dbg->symbols, dbg->current_rip - dbg->load_bias);
+    char header[128];
+    snprintf(header, sizeof(header), "%s () line %d",
+             fs ? sym_name(&dbg->symbols, fs) : "??", dbg->current_line);
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    ui_safe_print(win_info, y++, start_x, header);
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    // Registers take the last ten rows when there is room for both, and
+    // watch expressions get up to half of what is left
+    int reg_rows = bottom - y > 13 ? 10 : 0;
+    int expr_rows = 0;
+    if (dbg->expr_count > 0) {
+        expr_rows = dbg->expr_count + 2;
+        if (expr_rows > (bottom - reg_rows - y) / 2) expr_rows = (bottom - reg_rows - y) / 2;
+    }
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    for (int i = 0; i < dbg->local_count && y < bottom - reg_rows - expr_rows; i++) {
+        const DbgLocal *local = &dbg->locals[i];
+        char row[192];
+        snprintf(row, sizeof(row), "%s%s = %s", local->is_param ? "(arg) " : "",
+                 local->name, local->value);
+        ui_safe_print(win_info, y++, start_x, row);
+    }
+    if (dbg->local_count == 0) {
+        wattron(win_info, A_DIM);
+        ui_safe_print(win_info, y++, start_x, "(no variables with debug info here)");
+        wattroff(win_info, A_DIM);
+    }
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+
+    if (expr_rows > 1) {
+        y++;
+        char title[64];
+        snprintf(title, sizeof(title), "Watches (%d of %d read at this stop):",
+                 dbg->exprs_evaluated, dbg->expr_count);
+        wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+        ui_safe_print(win_info, y++, start_x, title);
+        wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+        for (int i = 0; i < dbg->expr_count && y < bottom - reg_rows; i++) {
+            const WatchExpr *e = &dbg->exprs[i];
+            int attrs = e->changed ? COLOR_PAIR(COLOR_SELECTED) | A_BOLD : COLOR_PAIR(COLOR_FILE);
+            char row[256];
+            snprintf(row, sizeof(row), "%s = %s", e->text, e->valid ? e->value : "??");
+            wattron(win_info, attrs);
+            ui_safe_print(win_info, y++, start_x, row);
+            wattroff(win_info, attrs);
+        }
+    }
+
+    if (reg_rows == 0) {
+        return;
+    }
+    y = bottom - reg_rows;
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    ui_safe_print(win_info, y++, start_x, "Registers:");
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    const char *names[16] = { "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp",
+                              "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" };
+    const unsigned long values[16] = {
+        dbg->registers.rax, dbg->registers.rbx, dbg->registers.rcx, dbg->registers.rdx,
+        dbg->registers.rsi, dbg->registers.rdi, dbg->registers.rbp, dbg->registers.rsp,
+        dbg->registers.r8, dbg->registers.r9, dbg->registers.r10, dbg->registers.r11,
+        dbg->registers.r12, dbg->registers.r13, dbg->registers.r14, dbg->registers.r15 };
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    char row[96];
+    snprintf(row, sizeof(row), " rip %016lx", dbg->registers.rip);
+    ui_safe_print(win_info, y++, start_x, row);
+    for (int i = 0; i < 16 && y < bottom; i += 2) {
+        snprintf(row, sizeof(row), " %-3s %016lx  %-3s %016lx",
+                 names[i], values[i], names[i + 1], values[i + 1]);
+        ui_safe_print(win_info, y++, start_x, row);
+    }
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+}
+
+// Every frame of the last stop, from the innermost
+static void dv_draw_stack(DebugView *dv, WINDOW *win_info) {
+    int start_y, start_x, height, width;
+    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
+    ui_draw_window(win_info, "DEBUG INFO - STACK");
+
+    int y = dv_draw_prompt(dv, win_info, start_y, start_x);
+    int bottom = start_y + height - 1;
+    ui_safe_print(win_info, bottom, start_x, " PgUp/PgDn/Home/End - Scroll  Tab - Disassembly");
+
+    int count = dv->engine.frame_count;
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    char header[64];
+    snprintf(header, sizeof(header), "Frames: %d%s", count,
+             count == ENG_MAX_FRAMES ? " (more not shown)" : "");
+    ui_safe_print(win_info, y++, start_x, header);
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    dv->stack_page = bottom - y > 1 ? bottom - y : 1;
+    if (dv->stack_top > count - dv->stack_page) dv->stack_top = count - dv->stack_page;
+    if (dv->stack_top < 0) dv->stack_top = 0;
+
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    for (int i = dv->stack_top; i < count && y < bottom; i++) {
+        char frame[160];
+        dv_format_frame(&dv->engine.frames[i], i, frame, sizeof(frame));
+        ui_safe_print(win_info, y++, start_x, frame);
+    }
+    if (count == 0) {
+        wattron(win_info, A_DIM);
+        ui_safe_print(win_info, y++, start_x, "(stop the program to see its stack)");
+        wattroff(win_info, A_DIM);
+    }
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+}
+
+// Rows instruction i of df takes: its own, after the source line it starts
+static int dv_asm_rows(const DebugView *dv, const DisasmFunc *df, int i) {
+    const DisasmInsn *insns = dv->debugger.disasm.insns + df->first;
+    int starts_line = insns[i].line > 0 && (i == 0 || insns[i].line != insns[i - 1].line);
+    return starts_line ? 2 : 1;
+}
+
+// The function at the pc from the disassembly cache, each source line above
+// the instructions it compiled to. Scrolling only walks the cached rows.
+static void dv_draw_asm(DebugView *dv, WINDOW *win_info) {
+    int start_y, start_x, height, width;
+    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
+    ui_draw_window(win_info, "DEBUG INFO - DISASSEMBLY");
+
+    int y = dv_draw_prompt(dv, win_info, start_y, start_x);
+    int bottom = start_y + height - 1;
+    ui_safe_print(win_info, bottom, start_x, " i - Step insn  PgUp/PgDn/Home/End - Scroll  Tab - Trace");
+
+    const Debugger *dbg = &dv->debugger;
+    const DisasmFunc *df = dbg->current_disasm;
+    if (!df) {
+        wattron(win_info, A_DIM);
+        ui_safe_print(win_info, y, start_x, dbg->state == DBG_STATE_STOPPED ?
+                      "(outside the program)" : "(stop the program to see its code)");
+        wattroff(win_info, A_DIM);
+        return;
+    }
+
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    char header[192];
+    snprintf(header, sizeof(header), "%s: %d instructions, %llu bytes", df->name, df->count,
+             (unsigned long long)(df->hi - df->lo));
+    ui_safe_print(win_info, y++, start_x, header);
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    const DisasmInsn *insns = dbg->disasm.insns + df->first;
+    uint64_t pc = dbg->current_rip - dbg->load_bias;
+    int pc_index = dis_find(&dbg->disasm, df, pc) - df->first;
+    dv->asm_page = bottom - y > 1 ? bottom - y : 1;
+
+    // Follow the pc: a third of the page above it
+    if (dv->asm_top < 0) {
+        int top = pc_index;
+        int rows = dv_asm_rows(dv, df, top);
+        while (top > 0 && rows + dv_asm_rows(dv, df, top - 1) <= dv->asm_page / 3) {
+            rows += dv_asm_rows(dv, df, --top);
+        }
+        dv->asm_top = top;
+    }
+    if (dv->asm_top > df->count - dv->asm_page) dv->asm_top = df->count - dv->asm_page;
+    if (dv->asm_top < 0) dv->asm_top = 0;
+
+    for (int i = dv->asm_top; i < df->count && y < bottom; i++) {
+        const DisasmInsn *di = &insns[i];
+        if (dv_asm_rows(dv, df, i) == 2 || (i == dv->asm_top && di->line > 0)) {
+            char source[300];
+            int line = (int)di->line;
+            snprintf(source, sizeof(source), "%4d  %s", line,
+                     line <= dv->source_line_count ? dv->source_lines[line - 1] : "");
+            wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+            ui_safe_print(win_info, y++, start_x, source);
+            wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+            if (y >= bottom) break;
+        }
+
+        int is_pc = i == pc_index && di->addr == pc;
+        const Breakpoint *bp = bp_find(&dbg->breakpoints, di->addr);
+        char offset[24];
+        char row[256];
+        snprintf(offset, sizeof(offset), "<+%llu>", (unsigned long long)(di->addr - df->lo));
+        snprintf(row, sizeof(row), "%s%c %lx %-7s %s", is_pc ? "=>" : "  ", bp ? '*' : ' ',
+                 (unsigned long)(di->addr + dbg->load_bias), offset, dis_text(&dbg->disasm, di));
+        int attrs = is_pc ? COLOR_PAIR(COLOR_SELECTED) | A_BOLD : COLOR_PAIR(COLOR_FILE);
+        wattron(win_info, attrs);
+        ui_safe_print(win_info, y++, start_x, row);
+        wattroff(win_info, attrs);
+    }
+}
+
+// Newest tracepoint samples, oldest at the top
+static void dv_draw_trace(DebugView *dv, WINDOW *win_info) {
     int start_y, start_x, height, width;
+    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
+    ui_draw_window(win_info, "DEBUG INFO - TRACE");
+
+    int y = dv_draw_prompt(dv, win_info, start_y, start_x);
+    const TraceBuffer *tb = &dv->debugger.trace;
+    int count = tb_count(tb);
+
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    char header[96];
+    snprintf(header, sizeof(header), "Samples: %d kept / %lu recorded",
+             count, (unsigned long)tb->total);
+    ui_safe_print(win_info, y++, start_x, header);
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    int rows = start_y + height - 1 - y;
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    for (int i = count > rows ? count - rows : 0; i < count && y < start_y + height - 1; i++) {
+        const TraceSample *ts = tb_get(tb, i);
+        const Breakpoint *bp = dv_breakpoint_on_line(dv, ts->line);
+
+        char row[256];
+        int len = snprintf(row, sizeof(row), "#%lu L%d", (unsigned long)ts->seq, ts->line);
+        for (int v = 0; v < ts->count && len < (int)sizeof(row); v++) {
+            const char *label = bp && bp->collect && v < bp->collect_count ? bp->collect[v].text : "?";
+            if (ts->valid & (1 << v)) {
+                len += snprintf(row + len, sizeof(row) - len, "  %s=%ld", label, (long)ts->values[v]);
+            } else {
+                len += snprintf(row + len, sizeof(row) - len, "  %s=??", label);
+            }
+        }
+        ui_safe_print(win_info, y++, start_x, row);
+    }
+    if (count == 0) {
+        wattron(win_info, A_DIM);
+        ui_safe_print(win_info, y++, start_x, "(no samples; set one with 't')");
+        wattroff(win_info, A_DIM);
+    }
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+
+    ui_safe_print(win_info, start_y + height - 1, start_x, " Tab - Memory view");
+}
+
+static void dv_fetch_memory(DebugView *dv, int bytes, const char *expr);
+
+// Hex and ASCII rows from mem_addr, under the mapping they fall in
+static void dv_draw_memory(DebugView *dv, WINDOW *win_info) {
+    int start_y, start_x, height, width;
+    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
+    ui_draw_window(win_info, "DEBUG INFO - MEMORY");
+
+    int y = dv_draw_prompt(dv, win_info, start_y, start_x);
+    int bottom = start_y + height - 1;
+    ui_safe_print(win_info, bottom, start_x, " Up/Dn/PgUp/PgDn g:Go [ ]:Mapping Tab");
 
-    dbg_read_output(&dv->debugger);
+    if (dv->debugger.state != DBG_STATE_STOPPED) {
+        wattron(win_info, A_DIM);
+        ui_safe_print(win_info, y, start_x, "(start the program to see its memory)");
+        wattroff(win_info, A_DIM);
+        return;
+    }
+    if (dv->debugger.error_message[0] != '\0') {
+        wattron(win_info, COLOR_PAIR(COLOR_SELECTED) | A_BOLD);
+        ui_safe_print(win_info, y++, start_x, dv->debugger.error_message);
+        wattroff(win_info, COLOR_PAIR(COLOR_SELECTED) | A_BOLD);
+    }
+
+    // Address, then per byte "xx " and one ASCII column: 12 + 2 + 4n + 1
+    int per_row = width >= 15 + 4 * 16 ? 16 : 8;
+    int rows = bottom - (y + 1);
+    if (rows < 1) {
+        return;
+    }
+    int bytes = rows * per_row;
+    if (bytes > ENG_MEMORY_MAX) {
+        rows = ENG_MEMORY_MAX / per_row;
+        bytes = rows * per_row;
+    }
+    dv->mem_row_bytes = per_row;
+    dv->mem_page_bytes = bytes;
+
+    if (dv->mem_addr == 0) {
+        dv->mem_addr = dv->debugger.registers.rsp & ~15UL;
+        dv->mem_stale = 1;
+    }
+    if (dv->mem_stale || dv->mem_request != bytes || dv->engine.memory_addr != dv->mem_addr) {
+        dv_fetch_memory(dv, bytes, NULL);
+    }
+
+    const MapRegion *region = maps_find(&dv->debugger.maps, dv->mem_addr);
+    char header[sizeof(region->path) + 48];   // Two addresses, perms and the name
+    if (region) {
+        const char *name = strrchr(region->path, '/');
+        snprintf(header, sizeof(header), "%lx-%lx %s %s", region->start, region->end,
+                 region->perms, name ? name + 1 : region->path);
+    } else {
+        snprintf(header, sizeof(header), "%lx: not mapped", dv->mem_addr);
+    }
+    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
+    ui_safe_print(win_info, y++, start_x, header);
+    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+
+    const uint8_t *data = dv->engine.memory;
+    int have = dv->engine.memory_length;
+    wattron(win_info, COLOR_PAIR(COLOR_FILE));
+    for (int r = 0; r < rows; r++) {
+        char row[128];
+        char ascii[17];
+        int len = snprintf(row, sizeof(row), "%012lx  ", dv->mem_addr + (unsigned long)r * per_row);
+        for (int i = 0; i < per_row; i++) {
+            int at = r * per_row + i;
+            if (at < have) {
+                len += snprintf(row + len, sizeof(row) - len, "%02x ", data[at]);
+                ascii[i] = isprint(data[at]) ? data[at] : '.';
+            } else {
+                len += snprintf(row + len, sizeof(row) - len, "?? ");
+                ascii[i] = ' ';
+            }
+        }
+        ascii[per_row] = '\0';
+        snprintf(row + len, sizeof(row) - len, "%s", ascii);
+        ui_safe_print(win_info, y++, start_x, row);
+    }
+    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+}
+
+void dv_draw(DebugView *dv, WINDOW *win_code, WINDOW *win_output, WINDOW *win_info) {
+    int start_y, start_x, height, width;
 
     ui_get_usable_area(win_code, &start_y, &start_x, &height, &width);
     ui_draw_window(win_code, "SOURCE CODE");
@@ -50,27 +776,62 @@ void dv_draw(DebugView *dv, WINDOW *win_code, WINDOW *win_output, WINDOW *win_in
         ui_safe_print(win_code, start_y + height/2, start_x, "No source loaded");
         wattroff(win_code, COLOR_PAIR(COLOR_FILE) | A_DIM);
     } else {
+        // Lines with a breakpoint, gathered in one pass over the map
+        static unsigned char has_bp[2001];
+        memset(has_bp, 0, sizeof(has_bp));
+        BreakpointMap *bm = &dv->debugger.breakpoints;
+        for (int i = 0; i < bm->capacity; i++) {
+            if (bp_live(&bm->slots[i]) && bm->slots[i].line > 0 && bm->slots[i].line <= 2000) {
+                has_bp[bm->slots[i].line] = 1;
+            }
+        }
+
+        int current = dv->replaying ? dv_replay_pc_line(dv, dv->replay_at.pc) :
+                      dv->engine.busy ? 0 : dv->debugger.current_line;
+        // With a profile, each line's share of the samples after its number.
+        // Not while the engine owns the debugger: a profiled run is adding to it.
+        const Profile *profile = dv->engine.busy ? NULL : &dv->debugger.profile;
+        int profile_file = profile && profile->total > 0 ?
+            lt_find_file(&dv->debugger.lines, dv->debugger.source_path) : 0;
+
         for (int i = 0; i < height && (dv->scroll_offset + i) < dv->source_line_count; i++) {
             int line_num = dv->scroll_offset + i + 1;
-            int is_current = (line_num == dv->debugger.current_line);
+            int is_current = line_num == current;
+            char mark = has_bp[line_num] ? '*' : ' ';
+
+            char heat[16] = "";
+            int hot = 0;
+            if (profile && profile->total > 0) {
+                unsigned long samples = prof_line(profile, profile_file, line_num);
+                double share = samples * 100.0 / profile->total;
+                if (samples > 0) {
+                    snprintf(heat, sizeof(heat), "%5.1f%% ", share);
+                } else {
+                    snprintf(heat, sizeof(heat), "%7s", "");
+                }
+                hot = share >= 10.0;
+            }
 
             char line_buf[512];
-            snprintf(line_buf, sizeof(line_buf), " %3d  %s",
-                    line_num, dv->source_lines[dv->scroll_offset + i]);
+            snprintf(line_buf, sizeof(line_buf), "%c%3d  %s%s",
+                    mark, line_num, heat, dv->source_lines[dv->scroll_offset + i]);
 
             if (is_current) {
                 wattron(win_code, COLOR_PAIR(COLOR_SELECTED) | A_BOLD | A_REVERSE);
                 char arrow_line[512];
-                snprintf(arrow_line, sizeof(arrow_line), ">>> %3d  %s",
-                        line_num, dv->source_lines[dv->scroll_offset + i]);
+                snprintf(arrow_line, sizeof(arrow_line), ">>>%c%3d  %s%s",
+                        mark, line_num, heat, dv->source_lines[dv->scroll_offset + i]);
 
                 int max_x = getmaxx(win_code);
                 mvwprintw(win_code, start_y + i, 1, "%-*s", max_x - 2, arrow_line);
                 wattroff(win_code, COLOR_PAIR(COLOR_SELECTED) | A_BOLD | A_REVERSE);
             } else {
-                wattron(win_code, COLOR_PAIR(COLOR_FILE));
+                attr_t attrs = COLOR_PAIR(has_bp[line_num] ? COLOR_DIR : COLOR_FILE);
+                if (line_num == dv->cursor_line) attrs |= A_UNDERLINE;
+                if (hot) attrs |= A_BOLD;
+                wattron(win_code, attrs);
                 ui_safe_print(win_code, start_y + i, start_x, line_buf);
-                wattroff(win_code, COLOR_PAIR(COLOR_FILE));
+                wattroff(win_code, attrs);
             }
         }
     }
@@ -101,12 +862,12 @@ void dv_draw(DebugView *dv, WINDOW *win_code, WINDOW *win_output, WINDOW *win_in
         }
         wattroff(win_output, COLOR_PAIR(COLOR_FILE));
     }
-    else if (dv->debugger.output_length > 0) {
+    else if (dv->output_length > 0) {
         int y = start_y;
-        char *line_start = dv->debugger.output_buffer;
+        char *line_start = dv->output;
         char *line_end;
 
-        while (y < start_y + height && line_start < dv->debugger.output_buffer + dv->debugger.output_length) {
+        while (y < start_y + height && line_start < dv->output + dv->output_length) {
             line_end = strchr(line_start, '\n');
             if (line_end) {
                 *line_end = '\0';
@@ -123,75 +884,597 @@ void dv_draw(DebugView *dv, WINDOW *win_code, WINDOW *win_output, WINDOW *win_in
         ui_safe_print(win_output, start_y, start_x, "(no output yet)");
         wattroff(win_output, A_DIM);
     }
-    ui_get_usable_area(win_info, &start_y, &start_x, &height, &width);
-    ui_draw_window(win_info, "DEBUG INFO");
+    if (dv->engine.busy) {
+        dv_draw_running(dv, win_info);
+        return;
+    }
+    if (dv->replaying) {
+        dv_draw_replay(dv, win_info);
+        return;
+    }
+    switch (dv->info_view) {
+        case DV_INFO_LOCALS:
+            dv_draw_locals(dv, win_info);
+            break;
+        case DV_INFO_STACK:
+            dv_draw_stack(dv, win_info);
+            break;
+        case DV_INFO_ASM:
+            dv_draw_asm(dv, win_info);
+            break;
+        case DV_INFO_TRACE:
+            dv_draw_trace(dv, win_info);
+            break;
+        case DV_INFO_MEMORY:
+            dv_draw_memory(dv, win_info);
+            break;
+        default:
+            dv_draw_status(dv, win_info);
+            break;
+    }
+}
 
-    int y = start_y;
+// Keep the current line visible after it moved
+static void dv_follow_line(DebugView *dv, int line) {
+    if (line > dv->scroll_offset + 20) {
+        dv->scroll_offset = line - 10;
+    }
+    if (line <= dv->scroll_offset) {
+        dv->scroll_offset = line - 10;
+        if (dv->scroll_offset < 0) dv->scroll_offset = 0;
+    }
+}
 
-    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
-    char status[128];
-    snprintf(status, sizeof(status), "State: %s", dbg_state_string(dv->debugger.state));
-    ui_safe_print(win_info, y++, start_x, status);
-    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+// Scroll just enough to keep the cursor line visible
+static void dv_show_cursor(DebugView *dv) {
+    if (dv->cursor_line > dv->scroll_offset + 20) {
+        dv->scroll_offset = dv->cursor_line - 20;
+    }
+    if (dv->cursor_line <= dv->scroll_offset) {
+        dv->scroll_offset = dv->cursor_line - 1;
+    }
+    if (dv->scroll_offset < 0) dv->scroll_offset = 0;
+}
 
-    if (dv->debugger.error_message[0] != '\0') {
-        wattron(win_info, COLOR_PAIR(COLOR_SELECTED) | A_BOLD);
-        char error_line[256];
-        snprintf(error_line, sizeof(error_line), "ERROR: %s", dv->debugger.error_message);
-        ui_safe_print(win_info, y++, start_x, error_line);
-        wattroff(win_info, COLOR_PAIR(COLOR_SELECTED) | A_BOLD);
+const char *dv_state_string(DebugView *dv) {
+    if (dv->replaying) {
+        return "Replaying trace";
     }
-    y++;
+    return dv->engine.busy ? "Running" : dbg_state_string(dv->debugger.state);
+}
 
-    wattron(win_info, COLOR_PAIR(COLOR_FILE));
-    char exec_info[64];
-    snprintf(exec_info, sizeof(exec_info), "Line: %d / %d | Steps: %d",
-             dv->debugger.current_line, dv->source_line_count,
-             dv->debugger.instruction_count);
-    ui_safe_print(win_info, y++, start_x, exec_info);
-    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
-    y++;
+const char *dv_function_string(DebugView *dv) {
+    if (dv->replaying) {
+        const SymbolTable *st = &dv->debugger.symbols;
+        const FuncSymbol *fs = sym_lookup(st, dv->replay_at.pc - dv->replay.header->load_bias);
+        return fs ? sym_name(st, fs) : NULL;
+    }
+    if (dv->engine.busy || (dv->debugger.state != DBG_STATE_STOPPED && !dv->debugger.signal_stopped)) {
+        return NULL;
+    }
+    return dv->debugger.current_function;
+}
 
-    wattron(win_info, COLOR_PAIR(COLOR_HEADER));
-    ui_safe_print(win_info, y++, start_x, "Controls:");
-    wattroff(win_info, COLOR_PAIR(COLOR_HEADER));
+// Output arrives in pieces while the program runs; keep the newest like
+// dbg_read_output does
+static void dv_append_output(DebugView *dv, const char *text, int length) {
+    int room = sizeof(dv->output) - dv->output_length - 1;
+    if (length > room) {
+        int keep = dv->output_length / 2;
+        memmove(dv->output, dv->output + dv->output_length - keep, keep);
+        dv->output_length = keep;
+        if (length > (int)sizeof(dv->output) - keep - 1) {
+            length = sizeof(dv->output) - keep - 1;
+        }
+    }
+    memcpy(dv->output + dv->output_length, text, length);
+    dv->output_length += length;
+    dv->output[dv->output_length] = '\0';
+}
 
-    if (dv->compile_error[0] != '\0') {
-        wattron(win_info, A_DIM);
-        ui_safe_print(win_info, y++, start_x, " r - Run/Start (fix errors first)");
-        ui_safe_print(win_info, y++, start_x, " n - Next");
-        ui_safe_print(win_info, y++, start_x, " s - Step");
-        wattroff(win_info, A_DIM);
+// A command is done and the debugger is ours again: move the view to
+// where it left the program
+static void dv_command_done(DebugView *dv, const EngineEvent *ev) {
+    Debugger *dbg = &dv->debugger;
+
+    memcpy(dv->output, dbg->output_buffer, dbg->output_length + 1);
+    dv->output_length = dbg->output_length;
+
+    switch (ev->cmd) {
+        case ENG_CMD_START:
+        case ENG_CMD_RESTORE:
+            if (dbg->current_line > 0 && dbg->current_line <= dv->source_line_count) {
+                dv->scroll_offset = dbg->current_line - 1;
+                dv->cursor_line = dbg->current_line;
+            }
+            dv->mem_addr = 0;
+            dv->asm_top = -1;
+            break;
+        case ENG_CMD_STEP:
+        case ENG_CMD_NEXT:
+        case ENG_CMD_STEP_INSN:
+        case ENG_CMD_BACK:
+        case ENG_CMD_FINISH:
+        case ENG_CMD_CONTINUE:
+        case ENG_CMD_PROFILE:
+        case ENG_CMD_TRACE_INSNS:
+            dv_follow_line(dv, dbg->current_line);
+            dv->mem_stale = 1;
+            dv->stack_top = 0;
+            dv->asm_top = -1;
+            break;
+        case ENG_CMD_BREAK_FUNCTION:
+            if (ev->result >= 0) {
+                dbg->error_message[0] = '\0';
+            }
+            // fall through
+        case ENG_CMD_TOGGLE_BREAKPOINT:
+            if (ev->result > 0) {
+                dv->cursor_line = ev->result;
+                dv_show_cursor(dv);
+            }
+            break;
+        case ENG_CMD_CONDITION:
+        case ENG_CMD_TRACEPOINT:
+            if (ev->result > 0) {
+                dv->cursor_line = ev->result;
+                dbg->error_message[0] = '\0';
+            }
+            break;
+        case ENG_CMD_WATCH:
+        case ENG_CMD_WATCH_REGION:
+            if (ev->result >= 0) {
+                dbg->error_message[0] = '\0';
+            }
+            break;
+        case ENG_CMD_READ_MEMORY:
+            dv->mem_stale = 0;
+            if (ev->result >= 0) {
+                dv->mem_addr = dv->engine.memory_addr;
+                dbg->error_message[0] = '\0';
+            }
+            break;
+        default:
+            break;
     }
-    else if (dv->debugger.state == DBG_STATE_NOT_STARTED ||
-        dv->debugger.state == DBG_STATE_EXITED) {
-        wattron(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
-        ui_safe_print(win_info, y++, start_x, " r - Run/Start");
-        wattroff(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
-        wattron(win_info, A_DIM);
-        ui_safe_print(win_info, y++, start_x, " n - Next");
-        ui_safe_print(win_info, y++, start_x, " s - Step");
-        wattroff(win_info, A_DIM);
+}
+
+static void dv_poll_events(DebugView *dv) {
+    EngineEvent ev;
+    while (eng_poll(&dv->engine, &ev) == 0) {
+        if (ev.type == ENG_EV_OUTPUT) {
+            dv_append_output(dv, ev.text, ev.length);
+        } else {
+            dv_command_done(dv, &ev);
+        }
+    }
+}
+
+int dv_wait_input(DebugView *dv) {
+    struct pollfd fds[2] = {
+        { STDIN_FILENO, POLLIN, 0 },
+        { dv->engine.started ? dv->engine.event_fd : -1, POLLIN, 0 },
+    };
+    if (poll(fds, 2, -1) < 0) {
+        return 1;   // Interrupted, e.g. by SIGWINCH: getch() reports the resize
+    }
+    if (fds[1].revents & POLLIN) {
+        dv_poll_events(dv);
+    }
+    return (fds[0].revents & POLLIN) != 0;
+}
+
+// Start a command that moves the program; the view follows when it is done
+static void dv_run(DebugView *dv, EngineCmdType cmd) {
+    if (!dv->engine.busy && dv->debugger.state == DBG_STATE_STOPPED) {
+        eng_send(&dv->engine, cmd, 0, NULL);
+    }
+}
+
+// Commands that leave the program stopped finish at once. Wait for them,
+// so the next frame can read the debugger again.
+static void dv_wait_command(DebugView *dv) {
+    while (dv->engine.busy) {
+        struct pollfd pfd = { dv->engine.event_fd, POLLIN, 0 };
+        poll(&pfd, 1, -1);
+        dv_poll_events(dv);
+    }
+}
+
+static void dv_command(DebugView *dv, EngineCmdType cmd, int arg, const char *text) {
+    if (eng_send(&dv->engine, cmd, arg, text) == 0) {
+        dv_wait_command(dv);
+    }
+}
+
+// Read what the memory view shows, from mem_addr or from expr
+static void dv_fetch_memory(DebugView *dv, int bytes, const char *expr) {
+    dv->mem_request = bytes;
+    if (eng_send_read(&dv->engine, dv->mem_addr, bytes, expr) == 0) {
+        dv_wait_command(dv);
+    }
+}
+
+void dv_handle_mouse(DebugView *dv, MEVENT *ev, int code_width) {
+    if (!(ev->bstate & BUTTON1_PRESSED) || !dv->source_loaded) return;
+    if (ev->x < 0 || ev->x >= code_width) return;
+
+    // Source rows start at y=2, see ui_get_usable_area
+    int line = dv->scroll_offset + (ev->y - 2) + 1;
+    if (ev->y < 2 || line > dv->source_line_count) return;
+
+    // The gutter is the breakpoint marker plus the line number
+    dv->cursor_line = line;
+    if (ev->x < 2 + 4 && dv->compile_error[0] == '\0') {
+        dv_command(dv, ENG_CMD_TOGGLE_BREAKPOINT, line, NULL);
+    }
+}
+
+static void dv_open_prompt(DebugView *dv, DvPrompt prompt, const char *initial) {
+    dv->prompt = prompt;
+    snprintf(dv->prompt_text, sizeof(dv->prompt_text), "%s", initial ? initial : "");
+    dv->prompt_len = strlen(dv->prompt_text);
+}
+
+// Up/Down and PgUp/PgDn move the source cursor
+static void dv_cursor_key(DebugView *dv, int key) {
+    switch (key) {
+        case KEY_UP:    dv->cursor_line--; break;
+        case KEY_DOWN:  dv->cursor_line++; break;
+        case KEY_NPAGE: dv->cursor_line += 10; break;
+        case KEY_PPAGE: dv->cursor_line -= 10; break;
+    }
+    if (dv->cursor_line > dv->source_line_count) dv->cursor_line = dv->source_line_count;
+    if (dv->cursor_line < 1) dv->cursor_line = 1;
+    dv_show_cursor(dv);
+}
+
+// Source line of instruction index of the replay. The addresses of its
+// chunk are decoded once, so walking a line costs a lookup per instruction.
+static int dv_replay_line(DebugView *dv, uint64_t index) {
+    uint64_t chunk = itr_chunk_of(&dv->replay, index);
+    if (chunk != dv->replay_chunk) {
+        dv->replay_chunk = UINT64_MAX;
+        if (itr_chunk_pcs(&dv->replay, chunk, dv->replay_pcs) < 0) {
+            return 0;
+        }
+        dv->replay_chunk = chunk;
+    }
+    return dv_replay_pc_line(dv, dv->replay_pcs[index - dv->replay.index[chunk].first_index]);
+}
+
+static void dv_replay_go(DebugView *dv, uint64_t index) {
+    if (index >= dv->replay.insn_count) {
+        index = dv->replay.insn_count - 1;
+    }
+    if (itr_seek(&dv->replay, index, &dv->replay_at) != 0) {
+        return;
+    }
+    int line = dv_replay_pc_line(dv, dv->replay_at.pc);
+    if (line > 0) {
+        dv_follow_line(dv, line);
+    }
+}
+
+// To the first instruction of the next source line, or of the previous
+// one. Instructions outside the source file, e.g. in library calls, belong
+// to the line around them.
+static void dv_replay_move_line(DebugView *dv, int forward) {
+    uint64_t last = dv->replay.insn_count - 1;
+    uint64_t i = dv->replay_at.index;
+    int from = dv_replay_line(dv, i);
+    int line;
+
+    if (forward) {
+        while (i < last) {
+            line = dv_replay_line(dv, ++i);
+            if (line != 0 && line != from) break;
+        }
+        dv_replay_go(dv, i);
+        return;
+    }
+
+    uint64_t start = i;
+    while (i > 0 && ((line = dv_replay_line(dv, i)) == 0 || line == from)) {
+        i--;
+    }
+    int prev = dv_replay_line(dv, i);
+    if (prev != 0 && prev != from) {
+        while (i > 0 && ((line = dv_replay_line(dv, i - 1)) == 0 || line == prev)) {
+            i--;
+        }
+        while (i < start && dv_replay_line(dv, i) == 0) {
+            i++;
+        }
+    }
+    dv_replay_go(dv, i);
+}
+
+// Trace file 'T' offers and 'V' opens: the last one written, else the
+// executable's name with .itrace
+static void dv_itrace_path(DebugView *dv, char *path, size_t size) {
+    const Debugger *dbg = &dv->debugger;
+    if (dbg->itrace_path[0] != '\0') {
+        snprintf(path, size, "%s", dbg->itrace_path);
     } else {
-        ui_safe_print(win_info, y++, start_x, " r - Run/Start");
-        wattron(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
-        ui_safe_print(win_info, y++, start_x, " n - Next");
-        ui_safe_print(win_info, y++, start_x, " s - Step");
-        wattroff(win_info, COLOR_PAIR(COLOR_FILE) | A_BOLD);
+        snprintf(path, size, "%s.itrace", dbg->executable_path);
     }
+}
 
-    ui_safe_print(win_info, y++, start_x, " Up/Dn - Navigate");
-    ui_safe_print(win_info, y++, start_x, " ESC - Exit debug mode");
+static void dv_replay_open(DebugView *dv) {
+    Debugger *dbg = &dv->debugger;
+    char path[sizeof(dbg->itrace_path)];
+    dv_itrace_path(dv, path, sizeof(path));
 
-    wattroff(win_info, COLOR_PAIR(COLOR_FILE));
+    if (itr_open(&dv->replay, path) != 0 || dv->replay.insn_count == 0) {
+        itr_close(&dv->replay);
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "No instruction trace in %.200s; record one with 'T'", path);
+        return;
+    }
+    dv->replay_pcs = malloc(ITR_CHUNK_INSNS * sizeof(*dv->replay_pcs));
+    if (!dv->replay_pcs) {
+        itr_close(&dv->replay);
+        return;
+    }
+    snprintf(dbg->itrace_path, sizeof(dbg->itrace_path), "%s", path);
+    dbg->error_message[0] = '\0';
+    dv->replay_chunk = UINT64_MAX;
+    dv->replay_file = lt_find_file(&dbg->lines, dbg->source_path);
+    dv->replaying = 1;
+    dv_replay_go(dv, 0);
+}
+
+static void dv_replay_close(DebugView *dv) {
+    itr_close(&dv->replay);
+    free(dv->replay_pcs);
+    dv->replay_pcs = NULL;
+    dv->replaying = 0;
+    if (dv->debugger.state == DBG_STATE_STOPPED) {
+        dv_follow_line(dv, dv->debugger.current_line);
+    }
+}
+
+// Keys of the replay; returns 1 if the key was used
+static int dv_replay_key(DebugView *dv, int key) {
+    uint64_t pos = dv->replay_at.index;
+    switch (key) {
+        case 'n': case 'N':
+        case 's': case 'S': dv_replay_move_line(dv, 1); return 1;
+        case 'u':           dv_replay_move_line(dv, 0); return 1;
+        case 'i':           dv_replay_go(dv, pos + 1); return 1;
+        case 'I':           dv_replay_go(dv, pos > 0 ? pos - 1 : 0); return 1;
+        case KEY_HOME:      dv_replay_go(dv, 0); return 1;
+        case KEY_END:       dv_replay_go(dv, dv->replay.insn_count - 1); return 1;
+        case 'g':           dv_open_prompt(dv, DV_PROMPT_REPLAY, NULL); return 1;
+        case 'V': case 27:  dv_replay_close(dv); return 1;
+    }
+    return 0;
+}
+
+// "rw:" in front watches reads too; an expression already watched is
+// removed, and an empty one removes every watch
+static void dv_submit_watch(DebugView *dv, const char *text) {
+    Debugger *dbg = &dv->debugger;
+    int access = strncmp(text, "rw:", 3) == 0;
+    if (access) text += 3;
+    while (*text == ' ') text++;
+
+    if (*text == '\0') {
+        dv_command(dv, ENG_CMD_UNWATCH, -1, NULL);
+        return;
+    }
+    for (int i = 0; i < DBG_MAX_WATCH; i++) {
+        if (dbg->watches[i].active && strcmp(dbg->watches[i].text, text) == 0) {
+            dv_command(dv, ENG_CMD_UNWATCH, i, NULL);
+            return;
+        }
+    }
+    dv_command(dv, ENG_CMD_WATCH, access, text);
+}
+
+// Same rules as dv_submit_watch, for "address, size" ranges
+static void dv_submit_region(DebugView *dv, const char *text) {
+    Debugger *dbg = &dv->debugger;
+    while (*text == ' ') text++;
+
+    if (*text == '\0') {
+        dv_command(dv, ENG_CMD_UNWATCH_REGION, -1, NULL);
+        return;
+    }
+    for (int i = 0; i < DBG_MAX_REGIONS; i++) {
+        if (dbg->regions[i].active && strcmp(dbg->regions[i].text, text) == 0) {
+            dv_command(dv, ENG_CMD_UNWATCH_REGION, i, NULL);
+            return;
+        }
+    }
+    dv_command(dv, ENG_CMD_WATCH_REGION, 0, text);
+}
+
+// Same rules again for watch expressions, which are kept across restarts
+static void dv_submit_expr(DebugView *dv, const char *text) {
+    Debugger *dbg = &dv->debugger;
+    while (*text == ' ') text++;
+
+    if (*text == '\0') {
+        dv_command(dv, ENG_CMD_UNWATCH_EXPR, -1, NULL);
+        return;
+    }
+    for (int i = 0; i < dbg->expr_count; i++) {
+        if (strcmp(dbg->exprs[i].text, text) == 0) {
+            dv_command(dv, ENG_CMD_UNWATCH_EXPR, i, NULL);
+            return;
+        }
+    }
+    dv_command(dv, ENG_CMD_WATCH_EXPR, 0, text);
+}
+
+// "r:" in front traces the registers too, like "rw:" for watches
+static void dv_submit_itrace(DebugView *dv, const char *text) {
+    int regs = strncmp(text, "r:", 2) == 0;
+    if (regs) text += 2;
+    while (*text == ' ') text++;
+
+    if (*text != '\0' && !dv->engine.busy && dv->debugger.state == DBG_STATE_STOPPED) {
+        eng_send(&dv->engine, ENG_CMD_TRACE_INSNS, regs, text);
+    }
+}
+
+static void dv_submit_prompt(DebugView *dv) {
+    switch (dv->prompt) {
+        case DV_PROMPT_CONDITION:
+        case DV_PROMPT_TRACE:
+            dv_command(dv, dv->prompt == DV_PROMPT_CONDITION ? ENG_CMD_CONDITION : ENG_CMD_TRACEPOINT,
+                       dv->cursor_line, dv->prompt_text);
+            break;
+        case DV_PROMPT_WATCH:
+            dv_submit_watch(dv, dv->prompt_text);
+            break;
+        case DV_PROMPT_REGION:
+            dv_submit_region(dv, dv->prompt_text);
+            break;
+        case DV_PROMPT_MEMORY:
+            dv_fetch_memory(dv, dv->mem_page_bytes, dv->prompt_text);
+            break;
+        case DV_PROMPT_EXPR:
+            dv_submit_expr(dv, dv->prompt_text);
+            break;
+        case DV_PROMPT_FUNCTION:
+            if (dv->prompt_text[0] != '\0') {
+                dv_command(dv, ENG_CMD_BREAK_FUNCTION, 0, dv->prompt_text);
+            }
+            break;
+        case DV_PROMPT_CHECKPOINT:
+            dv_command(dv, ENG_CMD_RESTORE,
+                       dv->prompt_text[0] != '\0' ? atoi(dv->prompt_text) - 1 : -1, NULL);
+            break;
+        case DV_PROMPT_ITRACE:
+            dv_submit_itrace(dv, dv->prompt_text);
+            break;
+        case DV_PROMPT_REPLAY:
+            if (dv->replaying && dv->prompt_text[0] != '\0') {
+                unsigned long long n = strtoull(dv->prompt_text, NULL, 10);
+                dv_replay_go(dv, n > 0 ? n - 1 : 0);
+            }
+            break;
+        default:
+            break;
+    }
+    dv->prompt = DV_PROMPT_NONE;
+}
+
+static void dv_prompt_key(DebugView *dv, int key) {
+    if (key == 27) {
+        dv->prompt = DV_PROMPT_NONE;
+    } else if (key == '\n' || key == KEY_ENTER) {
+        dv_submit_prompt(dv);
+    } else if (key == KEY_BACKSPACE || key == 127 || key == 8) {
+        if (dv->prompt_len > 0) {
+            dv->prompt_text[--dv->prompt_len] = '\0';
+        }
+    } else if (isprint(key) && dv->prompt_len < (int)sizeof(dv->prompt_text) - 1) {
+        dv->prompt_text[dv->prompt_len++] = key;
+        dv->prompt_text[dv->prompt_len] = '\0';
+    }
+}
+
+// Scroll to the start of the next mapping, or of the current/previous one
+static void dv_jump_mapping(DebugView *dv, int forward) {
+    const MapsTable *mt = &dv->debugger.maps;
+    int i = maps_index(mt, dv->mem_addr);
+    int inside = i < mt->count && mt->regions[i].start <= dv->mem_addr;
+    if (forward) {
+        i += inside;
+    } else if (!inside || mt->regions[i].start == dv->mem_addr) {
+        i--;
+    }
+    if (i >= 0 && i < mt->count) {
+        dv->mem_addr = mt->regions[i].start;
+    }
+}
+
+// Keys of the memory view; returns 1 if the key was used
+static int dv_memory_key(DebugView *dv, int key) {
+    if (dv->debugger.state != DBG_STATE_STOPPED) {
+        return 0;
+    }
+    switch (key) {
+        case KEY_UP:    dv->mem_addr -= dv->mem_row_bytes; return 1;
+        case KEY_DOWN:  dv->mem_addr += dv->mem_row_bytes; return 1;
+        case KEY_PPAGE: dv->mem_addr -= dv->mem_page_bytes; return 1;
+        case KEY_NPAGE: dv->mem_addr += dv->mem_page_bytes; return 1;
+        case '[':       dv_jump_mapping(dv, 0); return 1;
+        case ']':       dv_jump_mapping(dv, 1); return 1;
+        case 'g':       dv_open_prompt(dv, DV_PROMPT_MEMORY, NULL); return 1;
+    }
+    return 0;
+}
+
+// Keys of the stack view; returns 1 if the key was used
+static int dv_stack_key(DebugView *dv, int key) {
+    switch (key) {
+        case KEY_PPAGE: dv->stack_top -= dv->stack_page; return 1;
+        case KEY_NPAGE: dv->stack_top += dv->stack_page; return 1;
+        case KEY_HOME:  dv->stack_top = 0; return 1;
+        case KEY_END:   dv->stack_top = dv->engine.frame_count; return 1;
+    }
+    return 0;
+}
+
+// Keys of the disassembly view; returns 1 if the key was used
+static int dv_asm_key(DebugView *dv, int key) {
+    const DisasmFunc *df = dv->debugger.current_disasm;
+    switch (key) {
+        case KEY_PPAGE: dv->asm_top -= dv->asm_page; return 1;
+        case KEY_NPAGE: dv->asm_top += dv->asm_page; return 1;
+        case KEY_HOME:  dv->asm_top = 0; return 1;
+        case KEY_END:   dv->asm_top = df ? df->count : 0; return 1;
+    }
+    return 0;
 }
 
 int dv_handle_key(DebugView *dv, int key) {
+    if (dv->prompt != DV_PROMPT_NONE) {
+        dv_prompt_key(dv, key);
+        return 0;
+    }
+
+    // The replay leaves the program alone; only the cursor moves besides
+    if (dv->replaying) {
+        if (!dv_replay_key(dv, key) && (key == KEY_UP || key == KEY_DOWN ||
+                                        key == KEY_NPAGE || key == KEY_PPAGE)) {
+            dv_cursor_key(dv, key);
+        }
+        return 0;
+    }
+
+    // While a command runs only pausing, leaving and moving the cursor work
+    if (dv->engine.busy && key != 27 && key != 'p' && key != 'P' &&
+        key != KEY_UP && key != KEY_DOWN && key != KEY_NPAGE && key != KEY_PPAGE) {
+        return 0;
+    }
+    if (dv->info_view == DV_INFO_MEMORY && !dv->engine.busy && dv_memory_key(dv, key)) {
+        return 0;
+    }
+    if (dv->info_view == DV_INFO_STACK && !dv->engine.busy && dv_stack_key(dv, key)) {
+        return 0;
+    }
+    if (dv->info_view == DV_INFO_ASM && !dv->engine.busy && dv_asm_key(dv, key)) {
+        return 0;
+    }
+
     switch (key) {
         case 27:
-            dbg_stop(&dv->debugger);
+            eng_shutdown(&dv->engine);
             return 1;
 
+        case 'p':
+        case 'P':
+            if (dv->engine.busy) {
+                eng_send(&dv->engine, ENG_CMD_PAUSE, 0, NULL);
+            }
+            return 0;
+
         case 'r':
         case 'R':
             if (dv->compile_error[0] != '\0') {
@@ -199,61 +1482,149 @@ int dv_handle_key(DebugView *dv, int key) {
             }
             if (dv->debugger.state == DBG_STATE_NOT_STARTED ||
                 dv->debugger.state == DBG_STATE_EXITED) {
-                dbg_start(&dv->debugger);
-                if (dv->debugger.current_line > 0 && dv->debugger.current_line <= dv->source_line_count) {
-                    dv->scroll_offset = dv->debugger.current_line - 1;
-                    if (dv->scroll_offset < 0) dv->scroll_offset = 0;
-                }
+                dv->output_length = 0;
+                dv->output[0] = '\0';
+                eng_send(&dv->engine, ENG_CMD_START, 0, NULL);
             }
             return 0;
 
         case 'n':
         case 'N':
-            if (dv->debugger.state == DBG_STATE_STOPPED) {
-                dbg_step_line(&dv->debugger);
-                if (dv->debugger.current_line > dv->scroll_offset + 20) {
-                    dv->scroll_offset = dv->debugger.current_line - 10;
-                }
-            }
+            dv_run(dv, ENG_CMD_NEXT);
             return 0;
 
         case 's':
         case 'S':
+            dv_run(dv, ENG_CMD_STEP);
+            return 0;
+
+        case 'i':
+            dv_run(dv, ENG_CMD_STEP_INSN);
+            return 0;
+
+        case 'a':
+            dv->info_view = DV_INFO_ASM;
+            return 0;
+
+        case 'm':
+            dv_command(dv, ENG_CMD_RECORD, !dv->debugger.recording, NULL);
+            return 0;
+
+        case 'u':
+            // Also from a crash, back to the stop before it
+            if (dv->debugger.state == DBG_STATE_STOPPED || dv->debugger.signal_stopped) {
+                dv_command(dv, ENG_CMD_BACK, 0, NULL);
+            }
+            return 0;
+
+        case 'k':
             if (dv->debugger.state == DBG_STATE_STOPPED) {
-                dbg_step_line(&dv->debugger);
-                if (dv->debugger.current_line > dv->scroll_offset + 20) {
-                    dv->scroll_offset = dv->debugger.current_line - 10;
-                }
+                dv_command(dv, ENG_CMD_CHECKPOINT, 0, NULL);
             }
             return 0;
 
-        case KEY_UP:
-            if (dv->scroll_offset > 0) {
-                dv->scroll_offset--;
+        case 'K':
+            // Also once the program has exited or crashed
+            if (!dv->engine.busy && dv->debugger.checkpoint_count > 0) {
+                dv_open_prompt(dv, DV_PROMPT_CHECKPOINT, NULL);
             }
             return 0;
 
-        case KEY_DOWN:
-            if (dv->scroll_offset < dv->source_line_count - 20) {
-                dv->scroll_offset++;
+        case 'f':
+            dv_run(dv, ENG_CMD_FINISH);
+            return 0;
+
+        case 'T':
+            if (!dv->engine.busy && dv->debugger.state == DBG_STATE_STOPPED) {
+                char path[sizeof(dv->prompt_text)];
+                dv_itrace_path(dv, path, sizeof(path));
+                dv_open_prompt(dv, DV_PROMPT_ITRACE, path);
             }
             return 0;
 
-        case KEY_NPAGE:
-            dv->scroll_offset += 10;
-            if (dv->scroll_offset > dv->source_line_count - 20) {
-                dv->scroll_offset = dv->source_line_count - 20;
+        case 'V':
+            // Needs no program, also not a running one
+            if (!dv->engine.busy && dv->source_loaded) {
+                dv_replay_open(dv);
+            }
+            return 0;
+
+        case 'F':
+            if (dv->compile_error[0] == '\0' && dv->source_loaded) {
+                dv_open_prompt(dv, DV_PROMPT_FUNCTION, NULL);
+            }
+            return 0;
+
+        case 'c':
+        case 'C':
+            dv_run(dv, ENG_CMD_CONTINUE);
+            return 0;
+
+        case 'h':
+            dv_run(dv, ENG_CMD_PROFILE);
+            return 0;
+
+        case 'H':
+            dv_command(dv, ENG_CMD_PROFILE_CLEAR, 0, NULL);
+            return 0;
+
+        case 'b':
+            if (dv->compile_error[0] == '\0' && dv->source_loaded) {
+                dv_command(dv, ENG_CMD_TOGGLE_BREAKPOINT, dv->cursor_line, NULL);
+            }
+            return 0;
+
+        case 'B':
+            if (dv->compile_error[0] == '\0' && dv->source_loaded) {
+                const Breakpoint *bp = dv_breakpoint_on_line(dv, dv->cursor_line);
+                dv_open_prompt(dv, DV_PROMPT_CONDITION,
+                               bp && bp->condition ? bp->condition->text : NULL);
+            }
+            return 0;
+
+        case 't':
+            if (dv->compile_error[0] == '\0' && dv->source_loaded) {
+                const Breakpoint *bp = dv_breakpoint_on_line(dv, dv->cursor_line);
+                char current[128] = "";
+                for (int i = 0; bp && i < bp->collect_count; i++) {
+                    size_t len = strlen(current);
+                    snprintf(current + len, sizeof(current) - len, "%s%s",
+                             i ? ", " : "", bp->collect[i].text);
+                }
+                dv_open_prompt(dv, DV_PROMPT_TRACE, current);
+            }
+            return 0;
+
+        case 'w':
+            if (dv->debugger.state == DBG_STATE_STOPPED) {
+                dv_open_prompt(dv, DV_PROMPT_WATCH, NULL);
+            }
+            return 0;
+
+        case 'W':
+            if (dv->debugger.state == DBG_STATE_STOPPED) {
+                dv_open_prompt(dv, DV_PROMPT_REGION, NULL);
             }
-            if (dv->scroll_offset < 0) dv->scroll_offset = 0;
             return 0;
 
+        case 'e':
+            dv_open_prompt(dv, DV_PROMPT_EXPR, NULL);
+            dv->info_view = DV_INFO_LOCALS;
+            return 0;
+
+        case '\t':
+            dv->info_view = (dv->info_view + 1) % DV_INFO_VIEW_COUNT;
+            return 0;
+
+        case KEY_UP:
+        case KEY_DOWN:
+        case KEY_NPAGE:
         case KEY_PPAGE:
-            dv->scroll_offset -= 10;
-            if (dv->scroll_offset < 0) dv->scroll_offset = 0;
+            dv_cursor_key(dv, key);
             return 0;
     }
 
-    if (dv->debugger.state == DBG_STATE_EXITED) {
+    if (!dv->engine.busy && dv->debugger.state == DBG_STATE_EXITED) {
         return 2;
     }
 
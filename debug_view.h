@@ -3,12 +3,71 @@
 
 #include <ncurses.h>
 #include "debugger.h"
+#include "engine.h"
+#include "insn_trace.h"
+
+// One-line text input shown in the DEBUG INFO panel
+typedef enum {
+    DV_PROMPT_NONE,
+    DV_PROMPT_CONDITION,     // Breakpoint condition for the cursor line
+    DV_PROMPT_TRACE,         // Tracepoint values for the cursor line
+    DV_PROMPT_WATCH,         // Memory to watch with a debug register
+    DV_PROMPT_REGION,        // Address range to watch by page protection
+    DV_PROMPT_MEMORY,        // Address for the memory view
+    DV_PROMPT_EXPR,          // Expression to show at every stop
+    DV_PROMPT_FUNCTION,      // Function to break at
+    DV_PROMPT_CHECKPOINT,    // Checkpoint to restart from
+    DV_PROMPT_ITRACE,        // File to trace instructions into
+    DV_PROMPT_REPLAY         // Instruction of the replay to go to
+} DvPrompt;
+
+// What the DEBUG INFO panel shows; Tab cycles through them
+typedef enum {
+    DV_INFO_STATUS,
+    DV_INFO_LOCALS,
+    DV_INFO_STACK,
+    DV_INFO_ASM,
+    DV_INFO_TRACE,
+    DV_INFO_MEMORY,
+    DV_INFO_VIEW_COUNT
+} DvInfoView;
 
 typedef struct {
-    Debugger debugger;
+    Debugger debugger;         // Owned by the engine while engine.busy is set
+    Engine engine;
+    char output[4096];         // Program output as the engine reported it
+    int output_length;
     char source_lines[2000][256];
     int source_line_count;
     int scroll_offset;
+    int cursor_line;           // 1-based line that 'b' toggles
+
+    DvInfoView info_view;
+
+    // Memory view: first address shown, 0 = take $rsp. What is on screen is
+    // fetched in one read, again once stale or resized.
+    unsigned long mem_addr;
+    int mem_stale;
+    int mem_request;           // Bytes asked for by the last fetch
+    int mem_row_bytes;         // Layout at the last draw, for scrolling
+    int mem_page_bytes;
+
+    int stack_top;             // Stack view: first frame shown
+    int stack_page;            // Frames that fit, for scrolling
+    int asm_top;               // Disassembly view: first instruction shown, -1 = near the pc
+    int asm_page;
+    // Replay of an instruction trace file: the source view follows a
+    // position in the trace instead of the program, which is left alone
+    int replaying;
+    ItrReader replay;
+    ItrCursor replay_at;       // Decoded position, registers included
+    uint64_t *replay_pcs;      // Addresses of chunk replay_chunk, for line moves
+    uint64_t replay_chunk;
+    int replay_file;           // Line table file of the source, -1 if unknown
+
+    DvPrompt prompt;
+    char prompt_text[128];
+    int prompt_len;
     int source_loaded;
     char compile_error[4096];  // Store gcc compilation errors
 } DebugView;
@@ -18,7 +77,21 @@ int dv_load_program(DebugView *dv, const char *executable_path, const char *sour
 void dv_set_compile_error(DebugView *dv, const char *error_msg);
 void dv_draw(DebugView *dv, WINDOW *win_code, WINDOW *win_output, WINDOW *win_info);
 
+// Debugger state for the status bar; "Running" while a command is out
+const char *dv_state_string(DebugView *dv);
+
+// Function the program is stopped in, or NULL
+const char *dv_function_string(DebugView *dv);
+
+// Wait for a key or an engine event, applying events as they come.
+// Returns 1 when a key is ready for getch().
+int dv_wait_input(DebugView *dv);
+
 // Returns: 0=nothing, 1=exit debug mode, 2=program exited
 int dv_handle_key(DebugView *dv, int key);
 
+// Click in the source panel: moves the cursor, or toggles a breakpoint
+// when the click lands in the line number gutter
+void dv_handle_mouse(DebugView *dv, MEVENT *ev, int code_width);
+
 #endif
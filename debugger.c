@@ -6,10 +6,22 @@
 #include <sys/ptrace.h>
 #include <sys/wait.h>
 #include <sys/user.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <linux/sched.h>
+#include <poll.h>
+#include <time.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <ctype.h>
+#include <elf.h>
+#include <stddef.h>
+#include <limits.h>
+#include "x86_decode.h"
+#include "insn_trace.h"
 
 void dbg_init(Debugger *dbg) {
     memset(dbg, 0, sizeof(Debugger));
@@ -18,18 +30,31 @@ void dbg_init(Debugger *dbg) {
     dbg->instruction_count = 0;
     dbg->stdout_pipe[0] = -1;
     dbg->stdout_pipe[1] = -1;
+    dbg->input_fd = -1;
     dbg->output_length = 0;
     dbg->current_line = 1;
     memset(dbg->output_buffer, 0, sizeof(dbg->output_buffer));
-    dbg->addr2line_in = NULL;
-    dbg->addr2line_out = NULL;
-    dbg->addr2line_pid = -1;
+    lt_init(&dbg->lines);
+    sym_init(&dbg->symbols);
+    var_init(&dbg->vars);
+    cfi_init(&dbg->cfi);
+    dis_init(&dbg->disasm);
+    ic_init(&dbg->index);
+    maps_init(&dbg->maps);
+    tc_init(&dbg->mem);
+    bp_init(&dbg->breakpoints);
+    tb_init(&dbg->trace);
+    snap_init(&dbg->snapshots);
+    prof_init(&dbg->profile);
+    dbg->profile_fd = -1;
     memset(dbg->error_message, 0, sizeof(dbg->error_message));
     dbg->error_signal = 0;
 }
 
 // Helper function to ensure clean state when restarting
 static void cleanup_child_resources(Debugger *dbg) {
+    tc_detach(&dbg->mem);
+
     // Drain and close stdout pipe
     if (dbg->stdout_pipe[0] != -1) {
         char discard_buf[4096];
@@ -51,71 +76,6 @@ static void cleanup_child_resources(Debugger *dbg) {
     memset(dbg->output_buffer, 0, sizeof(dbg->output_buffer));
 }
 
-// Start persistent addr2line process
-static int start_addr2line(Debugger *dbg) {
-    int pipe_in[2];
-    int pipe_out[2];
-
-    if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1) {
-        return -1;
-    }
-
-    pid_t pid = fork();
-    if (pid == -1) {
-        close(pipe_in[0]); close(pipe_in[1]);
-        close(pipe_out[0]); close(pipe_out[1]);
-        return -1;
-    }
-
-    if (pid == 0) {
-        close(pipe_in[1]);
-        close(pipe_out[0]);
-
-        dup2(pipe_in[0], STDIN_FILENO);
-        dup2(pipe_out[1], STDOUT_FILENO);
-
-        close(pipe_in[0]);
-        close(pipe_out[1]);
-
-        execlp("addr2line", "addr2line", "-f", "-e", dbg->executable_path, NULL);
-        perror("execlp addr2line");
-        exit(1);
-    } else {
-        close(pipe_in[0]);
-        close(pipe_out[1]);
-
-        dbg->addr2line_in = fdopen(pipe_in[1], "w");
-        dbg->addr2line_out = fdopen(pipe_out[0], "r");
-        dbg->addr2line_pid = pid;
-
-        if (!dbg->addr2line_in || !dbg->addr2line_out) {
-            return -1;
-        }
-
-        setbuf(dbg->addr2line_in, NULL);
-        setbuf(dbg->addr2line_out, NULL);
-
-        return 0;
-    }
-}
-
-// Stop persistent addr2line process
-static void stop_addr2line(Debugger *dbg) {
-    if (dbg->addr2line_in) {
-        fclose(dbg->addr2line_in);
-        dbg->addr2line_in = NULL;
-    }
-    if (dbg->addr2line_out) {
-        fclose(dbg->addr2line_out);
-        dbg->addr2line_out = NULL;
-    }
-    if (dbg->addr2line_pid > 0) {
-        kill(dbg->addr2line_pid, SIGTERM);
-        waitpid(dbg->addr2line_pid, NULL, 0);
-        dbg->addr2line_pid = -1;
-    }
-}
-
 // Set error message based on signal number
 static void set_signal_error(Debugger *dbg, int signal_num) {
     dbg->error_signal = signal_num;
@@ -141,6 +101,48 @@ static void set_signal_error(Debugger *dbg, int signal_num) {
     }
 }
 
+static void release_debug_info(Debugger *dbg) {
+    lt_free(&dbg->lines);
+    sym_free(&dbg->symbols);
+    var_free(&dbg->vars);
+    cfi_free(&dbg->cfi);
+    dis_free(&dbg->disasm);
+    dbg->current_disasm = NULL;
+    ic_close(&dbg->index);
+    elf_close(&dbg->elf);
+}
+
+// Map the cached index for this binary, or decode it and refresh the cache
+static int load_debug_info(Debugger *dbg, const char *executable_path) {
+    release_debug_info(dbg);
+    // Line and function keys of another build mean nothing
+    prof_clear(&dbg->profile);
+
+    if (elf_open(&dbg->elf, executable_path) != 0) {
+        return -1;
+    }
+
+    // Variables are not cached; their index is built at the first stop
+    var_load(&dbg->vars, &dbg->elf);
+    cfi_load(&dbg->cfi, &dbg->elf);
+
+    ic_make_key(&dbg->index, &dbg->elf, executable_path);
+    if (ic_load(&dbg->index, &dbg->lines, &dbg->symbols) != 0) {
+        if (lt_load(&dbg->lines, &dbg->elf) != 0 ||
+            sym_load(&dbg->symbols, &dbg->elf) != 0) {
+            release_debug_info(dbg);
+            return -1;
+        }
+
+        // A read-only or missing cache directory only costs the next load
+        ic_save(&dbg->index, &dbg->lines, &dbg->symbols);
+    }
+
+    // Functions are disassembled from the mapping the first time a stop lands in one
+    dis_load(&dbg->disasm, &dbg->elf, &dbg->symbols, &dbg->lines,
+             lt_find_file(&dbg->lines, dbg->source_path));
+    return 0;
+}
 
 int dbg_load_program(Debugger *dbg, const char *executable_path, const char *source_path) {
     strncpy(dbg->executable_path, executable_path, 1023);
@@ -150,13 +152,425 @@ int dbg_load_program(Debugger *dbg, const char *executable_path, const char *sou
     dbg->output_length = 0;
     memset(dbg->output_buffer, 0, sizeof(dbg->output_buffer));
 
-    if (start_addr2line(dbg) != 0) {
+    if (load_debug_info(dbg, executable_path) != 0) {
+        return -1;
+    }
+    if (!realpath(executable_path, dbg->exe_realpath)) {
+        snprintf(dbg->exe_realpath, sizeof(dbg->exe_realpath), "%s", executable_path);
+    }
+
+    // Per-project skip list next to the source file
+    char skip_path[1100];
+    const char *slash = strrchr(source_path, '/');
+    if (slash) {
+        snprintf(skip_path, sizeof(skip_path), "%.*s/.dbgskip", (int)(slash - source_path), source_path);
+    } else {
+        snprintf(skip_path, sizeof(skip_path), ".dbgskip");
+    }
+    dbg->skip_count = 0;
+    dbg_skip_load(dbg, skip_path);
+
+    return 0;
+}
+
+int dbg_skip_add(Debugger *dbg, const char *spec) {
+    while (isspace((unsigned char)*spec)) spec++;
+    if (*spec == 0 || *spec == '#') {
+        return 0;
+    }
+    if (dbg->skip_count >= DBG_MAX_SKIP) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Skip list is full");
+        return -1;
+    }
+
+    SkipEntry *se = &dbg->skip_list[dbg->skip_count];
+    se->is_object = 0;
+    if (strncmp(spec, "object ", 7) == 0) {
+        se->is_object = 1;
+        spec += 7;
+    } else if (strncmp(spec, "function ", 9) == 0) {
+        spec += 9;
+    }
+    while (isspace((unsigned char)*spec)) spec++;
+
+    snprintf(se->pattern, sizeof(se->pattern), "%s", spec);
+    se->pattern[strcspn(se->pattern, " \t\r\n")] = 0;
+    if (se->pattern[0] == 0) {
+        return 0;
+    }
+    dbg->skip_count++;
+    return 0;
+}
+
+int dbg_skip_load(Debugger *dbg, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+
+    char line[256];
+    int result = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (dbg_skip_add(dbg, line) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+// Replace the byte at addr, optionally returning the previous one
+static int poke_byte(Debugger *dbg, unsigned long addr, uint8_t value, uint8_t *old) {
+    if (old && tc_read(&dbg->mem, addr, old, 1) != 1) {
+        return -1;
+    }
+    return tc_write(&dbg->mem, addr, &value, 1) == 1 ? 0 : -1;
+}
+
+// AT_ENTRY from the auxiliary vector, i.e. the relocated e_entry
+static unsigned long read_auxv_entry(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/auxv", (int)pid);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+
+    unsigned long entry = 0;
+    Elf64_auxv_t aux;
+    while (read(fd, &aux, sizeof(aux)) == sizeof(aux) && aux.a_type != AT_NULL) {
+        if (aux.a_type == AT_ENTRY) {
+            entry = aux.a_un.a_val;
+            break;
+        }
+    }
+    close(fd);
+    return entry;
+}
+
+// From the exec stop, plant a one-shot int3 on main (or the entry point if
+// there is no symbol) and let the loader run at native speed.
+static int run_to_entry(Debugger *dbg, int *status) {
+    pid_t pid = dbg->child_pid;
+
+    unsigned long entry = read_auxv_entry(pid);
+    if (entry == 0 || !dbg->elf.ehdr) {
+        return -1;
+    }
+    dbg->load_bias = entry - dbg->elf.ehdr->e_entry;
+
+    unsigned long target = entry;
+    const FuncSymbol *main_sym = sym_find(&dbg->symbols, "main");
+    if (main_sym) {
+        target = main_sym->addr + dbg->load_bias;
+    }
+
+    uint8_t saved;
+    if (poke_byte(dbg, target, 0xcc, &saved) != 0) {
+        return -1;
+    }
+
+    tc_invalidate(&dbg->mem);
+    if (ptrace(PTRACE_CONT, pid, NULL, NULL) == -1) {
+        return -1;
+    }
+    waitpid(pid, status, 0);
+
+    if (!WIFSTOPPED(*status) || WSTOPSIG(*status) != SIGTRAP) {
+        return -1;
+    }
+
+    struct user_regs_struct regs;
+    if (tc_get_regs(&dbg->mem, &regs) == -1 || regs.rip != target + 1) {
         return -1;
     }
 
+    // Undo the trap and rewind over it
+    regs.rip = target;
+    if (poke_byte(dbg, target, saved, NULL) != 0 ||
+        tc_set_regs(&dbg->mem, &regs) != 0) {
+        return -1;
+    }
     return 0;
 }
 
+// Inserted user breakpoint at a runtime address, or NULL
+static Breakpoint *inserted_breakpoint(Debugger *dbg, unsigned long addr) {
+    Breakpoint *bp = bp_find(&dbg->breakpoints, addr - dbg->load_bias);
+    return bp && bp->inserted ? bp : NULL;
+}
+
+static void insert_breakpoint(Debugger *dbg, Breakpoint *bp) {
+    if (!bp->inserted &&
+        poke_byte(dbg, bp->addr + dbg->load_bias, 0xcc, &bp->orig) == 0) {
+        bp->inserted = 1;
+    }
+}
+
+static void remove_breakpoint(Debugger *dbg, Breakpoint *bp) {
+    if (bp->inserted) {
+        poke_byte(dbg, bp->addr + dbg->load_bias, bp->orig, NULL);
+        bp->inserted = 0;
+    }
+}
+
+// A fresh process has none of the previous run's int3s
+static void insert_breakpoints(Debugger *dbg) {
+    BreakpointMap *bm = &dbg->breakpoints;
+    for (int i = 0; i < bm->capacity; i++) {
+        if (bp_live(&bm->slots[i])) {
+            bm->slots[i].inserted = 0;
+            insert_breakpoint(dbg, &bm->slots[i]);
+        }
+    }
+}
+
+int dbg_toggle_breakpoint(Debugger *dbg, int line) {
+    int file = lt_find_file(&dbg->lines, dbg->source_path);
+    uint64_t addr;
+    if (file < 0 || (line = lt_line_address(&dbg->lines, file, line, &addr)) < 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "No code at or after that line");
+        return -1;
+    }
+
+    Breakpoint *bp = bp_find(&dbg->breakpoints, addr);
+    if (bp) {
+        if (dbg->state == DBG_STATE_STOPPED) {
+            remove_breakpoint(dbg, bp);
+        }
+        bp_remove(&dbg->breakpoints, addr);
+        return 0;
+    }
+
+    bp = bp_add(&dbg->breakpoints, addr, line);
+    if (!bp) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Out of memory");
+        return -1;
+    }
+    if (dbg->state == DBG_STATE_STOPPED) {
+        insert_breakpoint(dbg, bp);
+    }
+    return line;
+}
+
+int dbg_break_function(Debugger *dbg, const char *name) {
+    const FuncSymbol *fs = sym_find(&dbg->symbols, name);
+    if (!fs) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "No function %s", name);
+        return -1;
+    }
+
+    // The prologue has its own row on the opening line; the body starts at
+    // the next address with a row of its own
+    const LineEntry *e = lt_lookup(&dbg->lines, fs->addr);
+    const LineEntry *end = dbg->lines.entries + dbg->lines.count;
+    if (e && e->addr == fs->addr) {
+        const LineEntry *body = e;
+        while (body + 1 < end && body->addr == fs->addr) {
+            body++;
+        }
+        if (body->addr > fs->addr && body->addr < fs->addr + fs->size) {
+            e = body;
+        }
+    }
+    int file = lt_find_file(&dbg->lines, dbg->source_path);
+    if (!e || e->addr < fs->addr || file < 0 || e->file == LT_NO_FILE ||
+        strcmp(lt_file_name(&dbg->lines, e->file), lt_file_name(&dbg->lines, file)) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "%s is not in this source", name);
+        return -1;
+    }
+    return dbg_toggle_breakpoint(dbg, e->line);
+}
+
+// Existing or new breakpoint for a source line; line is moved to the line
+// actually used
+static Breakpoint *line_breakpoint(Debugger *dbg, int *line) {
+    int file = lt_find_file(&dbg->lines, dbg->source_path);
+    uint64_t addr;
+    if (file < 0 || (*line = lt_line_address(&dbg->lines, file, *line, &addr)) < 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "No code at or after that line");
+        return NULL;
+    }
+
+    Breakpoint *bp = bp_add(&dbg->breakpoints, addr, *line);
+    if (!bp) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Out of memory");
+        return NULL;
+    }
+    if (dbg->state == DBG_STATE_STOPPED) {
+        insert_breakpoint(dbg, bp);
+    }
+    return bp;
+}
+
+int dbg_set_condition(Debugger *dbg, int line, const char *condition) {
+    Expr *expr = NULL;
+    while (isspace((unsigned char)*condition)) condition++;
+    if (*condition) {
+        expr = malloc(sizeof(Expr));
+        if (!expr) {
+            snprintf(dbg->error_message, sizeof(dbg->error_message), "Out of memory");
+            return -1;
+        }
+        char error[128];
+        if (expr_compile(expr, condition, NULL, error, sizeof(error)) != 0) {
+            snprintf(dbg->error_message, sizeof(dbg->error_message), "Condition: %s", error);
+            free(expr);
+            return -1;
+        }
+    }
+
+    Breakpoint *bp = line_breakpoint(dbg, &line);
+    if (!bp) {
+        free(expr);
+        return -1;
+    }
+    free(bp->condition);
+    bp->condition = expr;
+    return line;
+}
+
+int dbg_set_tracepoint(Debugger *dbg, int line, const char *exprs) {
+    Expr *collect = calloc(TRACE_MAX_VALUES, sizeof(Expr));
+    if (!collect || tb_alloc(&dbg->trace, 4096) != 0) {
+        free(collect);
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Out of memory");
+        return -1;
+    }
+
+    // Split on commas outside parentheses
+    int count = 0;
+    const char *p = exprs;
+    while (*p) {
+        char text[128];
+        int len = 0, depth = 0;
+        while (*p && (depth > 0 || *p != ',')) {
+            if (*p == '(') depth++;
+            if (*p == ')') depth--;
+            if (len < (int)sizeof(text) - 1) text[len++] = *p;
+            p++;
+        }
+        text[len] = 0;
+        if (*p == ',') p++;
+
+        const char *t = text;
+        while (isspace((unsigned char)*t)) t++;
+        if (!*t) continue;
+
+        char error[128];
+        if (count == TRACE_MAX_VALUES) {
+            snprintf(dbg->error_message, sizeof(dbg->error_message),
+                     "At most %d trace values", TRACE_MAX_VALUES);
+            free(collect);
+            return -1;
+        }
+        if (expr_compile(&collect[count], t, NULL, error, sizeof(error)) != 0) {
+            snprintf(dbg->error_message, sizeof(dbg->error_message), "Trace: %s", error);
+            free(collect);
+            return -1;
+        }
+        count++;
+    }
+
+    Breakpoint *bp = line_breakpoint(dbg, &line);
+    if (!bp) {
+        free(collect);
+        return -1;
+    }
+    free(bp->collect);
+    bp->collect = count > 0 ? collect : NULL;
+    bp->collect_count = count;
+    if (count == 0) {
+        free(collect);
+    }
+    return line;
+}
+
+// Forks the program makes itself are not followed
+#define TRACE_OPTIONS (PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL)
+
+// SIGCHLD writes a byte here so that waiting for a running program can
+// poll() it together with the output pipe and the terminal
+static int sigchld_pipe[2] = { -1, -1 };
+
+static void on_sigchld(int sig) {
+    (void)sig;
+    int saved = errno;
+    ssize_t n = write(sigchld_pipe[1], "c", 1);
+    (void)n;
+    errno = saved;
+}
+
+static int sigchld_init(void) {
+    if (sigchld_pipe[0] != -1) {
+        return 0;
+    }
+    if (pipe(sigchld_pipe) == -1) {
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(sigchld_pipe[i], F_SETFL, O_NONBLOCK);
+        fcntl(sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    // No SA_NOCLDSTOP: ptrace stops are what we want to hear about
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(SIGCHLD, &sa, NULL);
+}
+
+void dbg_set_pause_hook(Debugger *dbg, int input_fd, int (*hook)(void *ctx), void *ctx) {
+    dbg->input_fd = input_fd;
+    dbg->pause_hook = hook;
+    dbg->pause_ctx = ctx;
+}
+
+ssize_t dbg_read_memory(Debugger *dbg, unsigned long addr, void *buf, size_t len) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return -1;
+    }
+    return tc_read(&dbg->mem, addr, buf, len);
+}
+
+ssize_t dbg_write_memory(Debugger *dbg, unsigned long addr, const void *buf, size_t len) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return -1;
+    }
+    // A write from here may not leave a soft-dirty mark
+    dbg->exprs_tracked = 0;
+    return tc_write(&dbg->mem, addr, buf, len);
+}
+
+// What a new process, fresh or from a checkpoint, starts without
+static void reset_run_state(Debugger *dbg) {
+    memset(dbg->error_message, 0, sizeof(dbg->error_message));
+    dbg->error_signal = 0;
+    dbg->signal_stopped = 0;
+    dbg->return_valid = 0;
+    dbg->breakpoint_hit = 0;
+    dbg->watch_hit = 0;
+    memset(dbg->watches, 0, sizeof(dbg->watches));
+    dbg->region_hit = 0;
+    dbg->region_pending = 0;
+    dbg->region_faults = 0;
+    dbg->pause_requested = 0;
+    dbg->paused = 0;
+    memset(dbg->regions, 0, sizeof(dbg->regions));
+    tb_clear(&dbg->trace);
+    for (int i = 0; i < dbg->expr_count; i++) {
+        dbg->exprs[i].valid = 0;
+        dbg->exprs[i].changed = 0;
+    }
+    dbg->exprs_tracked = 0;
+    snap_clear(&dbg->snapshots);
+    dbg->record_based = 0;
+}
+
 int dbg_start(Debugger *dbg) {
     if (dbg->state != DBG_STATE_NOT_STARTED && dbg->state != DBG_STATE_EXITED) {
         return -1;
@@ -164,11 +578,17 @@ int dbg_start(Debugger *dbg) {
 
     // Clean up any leftover resources from previous run
     cleanup_child_resources(dbg);
+    reset_run_state(dbg);
 
-    memset(dbg->error_message, 0, sizeof(dbg->error_message));
-    dbg->error_signal = 0;
-
-    if (pipe(dbg->stdout_pipe) == -1) {
+    // The child waits on go_pipe until it is seized, then execs
+    int go_pipe[2];
+    if (sigchld_init() != 0 || pipe(dbg->stdout_pipe) == -1) {
+        dbg->state = DBG_STATE_ERROR;
+        return -1;
+    }
+    if (pipe(go_pipe) == -1) {
+        close(dbg->stdout_pipe[0]);
+        close(dbg->stdout_pipe[1]);
         dbg->state = DBG_STATE_ERROR;
         return -1;
     }
@@ -177,6 +597,8 @@ int dbg_start(Debugger *dbg) {
     if (pid == -1) {
         close(dbg->stdout_pipe[0]);
         close(dbg->stdout_pipe[1]);
+        close(go_pipe[0]);
+        close(go_pipe[1]);
         dbg->state = DBG_STATE_ERROR;
         return -1;
     }
@@ -187,10 +609,12 @@ int dbg_start(Debugger *dbg) {
         dup2(dbg->stdout_pipe[1], STDERR_FILENO);
         close(dbg->stdout_pipe[1]);
 
-        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) {
-            perror("ptrace TRACEME");
+        char go;
+        close(go_pipe[1]);
+        if (read(go_pipe[0], &go, 1) != 1) {
             exit(1);
         }
+        close(go_pipe[0]);
 
         char *args[] = {dbg->executable_path, NULL};
         execv(dbg->executable_path, args);
@@ -198,42 +622,54 @@ int dbg_start(Debugger *dbg) {
         exit(1);
     } else {
         close(dbg->stdout_pipe[1]);
+        close(go_pipe[0]);
         dbg->child_pid = pid;
 
         int flags = fcntl(dbg->stdout_pipe[0], F_GETFL, 0);
         fcntl(dbg->stdout_pipe[0], F_SETFL, flags | O_NONBLOCK);
 
+        // Seizing (rather than PTRACE_TRACEME) allows PTRACE_INTERRUPT later.
+        // The exec is reported as an event stop; EXITKILL takes the program
+        // down with us.
+        int seized = ptrace(PTRACE_SEIZE, pid, NULL, (void *)TRACE_OPTIONS) == 0;
+        if (seized) {
+            seized = write(go_pipe[1], "g", 1) == 1;
+        }
+        close(go_pipe[1]);
+
         int status;
         waitpid(pid, &status, 0);
 
-        if (!WIFSTOPPED(status)) {
+        if (!seized || !WIFSTOPPED(status) || status >> 8 != (SIGTRAP | (PTRACE_EVENT_EXEC << 8))) {
             dbg->state = DBG_STATE_ERROR;
             return -1;
         }
+        // The new address space only exists after the exec
+        tc_attach(&dbg->mem, pid);
 
-        struct user_regs_struct regs;
-        while (1) {
+        // Run straight to main instead of singlestepping the dynamic loader
+        if (run_to_entry(dbg, &status) != 0) {
             if (WIFEXITED(status)) {
                 dbg->state = DBG_STATE_EXITED;
-                return -1;
-            }
-
-            if (WIFSIGNALED(status)) {
+            } else if (WIFSIGNALED(status)) {
                 dbg->state = DBG_STATE_ERROR;
                 set_signal_error(dbg, WTERMSIG(status));
-                return -1;
-            }
-
-            ptrace(PTRACE_GETREGS, pid, NULL, &regs);
-
-            if (regs.rip >= 0x400000 && regs.rip < 0x700000000000) {
-                break;
+            } else if (WIFSTOPPED(status) && WSTOPSIG(status) != SIGTRAP) {
+                dbg->state = DBG_STATE_ERROR;
+                dbg->signal_stopped = 1;
+                set_signal_error(dbg, WSTOPSIG(status));
+            } else {
+                dbg->state = DBG_STATE_ERROR;
+                snprintf(dbg->error_message, sizeof(dbg->error_message), "no entry point");
             }
-
-            ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL);
-            waitpid(pid, &status, 0);
+            return -1;
         }
 
+        // The executable is mapped by now; library code is everything else
+        maps_load(&dbg->maps, pid);
+        dbg->maps_gen = dbg->mem.gen;
+        insert_breakpoints(dbg);
+
         dbg->state = DBG_STATE_STOPPED;
         update_regs(dbg);
 
@@ -241,6 +677,8 @@ int dbg_start(Debugger *dbg) {
     }
 }
 
+static void drop_checkpoint(Debugger *dbg, int index);
+
 int dbg_stop(Debugger *dbg) {
     // Kill the child process first
     if (dbg->child_pid > 0) {
@@ -249,62 +687,1913 @@ int dbg_stop(Debugger *dbg) {
         dbg->child_pid = -1;
     }
 
+    while (dbg->checkpoint_count > 0) {
+        drop_checkpoint(dbg, 0);
+    }
+
     // Clean up child resources (pipes and buffers)
     cleanup_child_resources(dbg);
 
-    stop_addr2line(dbg);
+    release_debug_info(dbg);
+    maps_free(&dbg->maps);
+    bp_free(&dbg->breakpoints);
+    tb_free(&dbg->trace);
+    snap_free(&dbg->snapshots);
+    prof_free(&dbg->profile);
+    dbg->recording = 0;
 
     dbg->state = DBG_STATE_NOT_STARTED;
+    dbg->signal_stopped = 0;
+    dbg->current_function = NULL;   // Its string went with the symbols
+    dbg->current_disasm = NULL;
     return 0;
 }
-int dbg_step_line(Debugger *dbg) {
-    if (dbg->state != DBG_STATE_STOPPED) {
-        return -1;
+// Classify a waitpid status. Returns 1 for a SIGTRAP stop the caller should
+// handle; otherwise updates the state for exit, death or another signal.
+static int check_stop(Debugger *dbg, int status) {
+    if (WIFEXITED(status)) {
+        dbg->state = DBG_STATE_EXITED;
+        return 0;
     }
 
-    int start_line = dbg->current_line;
-    int status;
-    int max_steps = 10000;
+    if (WIFSIGNALED(status)) {
+        dbg->state = DBG_STATE_ERROR;
+        set_signal_error(dbg, WTERMSIG(status));
+        return 0;
+    }
 
-    for (int i = 0; i < max_steps; i++) {
-        if (ptrace(PTRACE_SINGLESTEP, dbg->child_pid, NULL, NULL) == -1) {
-            dbg->state = DBG_STATE_ERROR;
-            return -1;
-        }
+    if (!WIFSTOPPED(status)) {
+        dbg->state = DBG_STATE_ERROR;
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "bad status");
+        return 0;
+    }
 
-        waitpid(dbg->child_pid, &status, 0);
+    int stop_signal = WSTOPSIG(status);
+    if (stop_signal != SIGTRAP) {
+        dbg->state = DBG_STATE_ERROR;
+        dbg->signal_stopped = 1;
+        set_signal_error(dbg, stop_signal);
+        return 0;
+    }
 
-        if (WIFEXITED(status)) {
-            dbg->state = DBG_STATE_EXITED;
-            return 0;
-        }
+    return 1;
+}
 
-        if (WIFSIGNALED(status)) {
-            dbg->state = DBG_STATE_ERROR;
-            set_signal_error(dbg, WTERMSIG(status));
-            return 0;
-        }
+static unsigned long get_pc(Debugger *dbg) {
+    unsigned long pc;
+    return tc_read_reg(&dbg->mem, TC_REG(rip), &pc) == 0 ? pc : (unsigned long)-1;
+}
 
-        if (!WIFSTOPPED(status)) {
-            dbg->state = DBG_STATE_ERROR;
-            snprintf(dbg->error_message, sizeof(dbg->error_message), "bad status");
-            return -1;
-        }
+static int set_pc(Debugger *dbg, unsigned long pc) {
+    return tc_write_reg(&dbg->mem, TC_REG(rip), pc);
+}
 
-        int stop_signal = WSTOPSIG(status);
-        if (stop_signal != SIGTRAP) {
-            dbg->state = DBG_STATE_ERROR;
-            set_signal_error(dbg, stop_signal);
+static int read_tracee(Debugger *dbg, unsigned long addr, void *buf, size_t len) {
+    return tc_read(&dbg->mem, addr, buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+static int has_line_info(Debugger *dbg, unsigned long addr) {
+    const LineEntry *e = lt_lookup(&dbg->lines, addr - dbg->load_bias);
+    return e && e->file != LT_NO_FILE;
+}
+
+static int in_executable(Debugger *dbg, unsigned long addr) {
+    if (dbg->maps.count == 0) {
+        return 1;
+    }
+    const MapRegion *r = maps_find(&dbg->maps, addr);
+    return r && strcmp(r->path, dbg->exe_realpath) == 0;
+}
+
+// Step into runs calls to target instead of stopping in them
+static int skip_call_target(Debugger *dbg, unsigned long target) {
+    if (!in_executable(dbg, target) || !has_line_info(dbg, target)) {
+        return 1;
+    }
+
+    const FuncSymbol *fs = sym_lookup(&dbg->symbols, target - dbg->load_bias);
+    const LineEntry *e = lt_lookup(&dbg->lines, target - dbg->load_bias);
+    const char *file = e ? lt_file_name(&dbg->lines, e->file) : "";
+
+    for (int i = 0; i < dbg->skip_count; i++) {
+        const SkipEntry *se = &dbg->skip_list[i];
+        if (se->is_object) {
+            if (strstr(file, se->pattern) || strstr(dbg->exe_realpath, se->pattern)) {
+                return 1;
+            }
+        } else if (fs && strcmp(sym_name(&dbg->symbols, fs), se->pattern) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#define MAX_STEP_TRAPS 256
+#define MAX_LINE_BYTES 4096
+
+// Temporary int3 planted while running through one source line
+typedef struct {
+    unsigned long addr;
+    uint8_t orig;
+    int in_range;    // Indirect branch inside the line: singlestep it
+    X86Flow flow;
+} StepTrap;
+
+typedef struct {
+    StepTrap traps[MAX_STEP_TRAPS];
+    int count;
+} TrapSet;
+
+static int add_trap(TrapSet *set, unsigned long addr, int in_range, X86Flow flow) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->traps[i].addr == addr) return 0;
+    }
+    if (set->count == MAX_STEP_TRAPS) return -1;
+    StepTrap *t = &set->traps[set->count++];
+    t->addr = addr;
+    t->in_range = in_range;
+    t->flow = flow;
+    return 0;
+}
+
+static StepTrap *find_trap(TrapSet *set, unsigned long addr) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->traps[i].addr == addr) return &set->traps[i];
+    }
+    return NULL;
+}
+
+static int insert_traps(Debugger *dbg, TrapSet *set) {
+    for (int i = 0; i < set->count; i++) {
+        if (poke_byte(dbg, set->traps[i].addr, 0xcc, &set->traps[i].orig) != 0) {
+            // Unwritable target (e.g. unmapped): drop it
+            set->traps[i] = set->traps[--set->count];
+            i--;
+        }
+    }
+    return 0;
+}
+
+static void remove_traps(Debugger *dbg, TrapSet *set) {
+    for (int i = set->count - 1; i >= 0; i--) {
+        poke_byte(dbg, set->traps[i].addr, set->traps[i].orig, NULL);
+    }
+}
+
+static int watch_hit(Debugger *dbg);
+
+// Stop requested with PTRACE_INTERRUPT
+static int interrupt_stop(int status) {
+    return WIFSTOPPED(status) && (status >> 16) == PTRACE_EVENT_STOP;
+}
+
+// Single-step with no classification, for the debugger's own use. A stale
+// pause stop (see run_tracee) is stepped past.
+static int step_once(Debugger *dbg, int *status) {
+    pid_t pid = dbg->child_pid;
+    do {
+        tc_invalidate(&dbg->mem);
+        if (ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL) == -1 ||
+            waitpid(pid, status, 0) != pid) {
+            return -1;
+        }
+    } while (interrupt_stop(*status));
+    return 0;
+}
+
+// Run one system call in the tracee: a syscall instruction is written at
+// the aligned word holding the pc and stepped, then the code and registers
+// are put back. Returns the raw result (-errno on failure).
+static long inject_syscall(Debugger *dbg, long nr, unsigned long a1,
+                           unsigned long a2, unsigned long a3) {
+    struct user_regs_struct saved, regs;
+    if (tc_get_regs(&dbg->mem, &saved) == -1) {
+        return -EIO;
+    }
+
+    static const uint8_t syscall_insn[2] = { 0x0f, 0x05 };
+    unsigned long at = saved.rip & ~7UL;
+    uint8_t code[2];
+    if (read_tracee(dbg, at, code, sizeof(code)) != 0 ||
+        tc_write(&dbg->mem, at, syscall_insn, sizeof(syscall_insn)) != sizeof(syscall_insn)) {
+        return -EIO;
+    }
+
+    regs = saved;
+    regs.rip = at;
+    regs.rax = nr;
+    regs.rdi = a1;
+    regs.rsi = a2;
+    regs.rdx = a3;
+    // Keep the kernel from restarting a system call the stop interrupted
+    regs.orig_rax = -1;
+
+    long result = -EIO;
+    int status;
+    int stepped = tc_set_regs(&dbg->mem, &regs) == 0 && step_once(dbg, &status) == 0;
+    // A traced clone reports an event stop before the call returns
+    while (stepped && WIFSTOPPED(status) && status >> 16 == PTRACE_EVENT_CLONE) {
+        stepped = step_once(dbg, &status) == 0;
+    }
+    if (stepped && WIFSTOPPED(status) && tc_get_regs(&dbg->mem, &regs) == 0) {
+        result = (long)regs.rax;
+    }
+
+    tc_write(&dbg->mem, at, code, sizeof(code));
+    tc_set_regs(&dbg->mem, &saved);
+    return result;
+}
+
+static int protect_pages(Debugger *dbg, unsigned long start, unsigned long end, int prot) {
+    return inject_syscall(dbg, SYS_mprotect, start, end - start, prot) == 0 ? 0 : -1;
+}
+
+static RegionWatch *region_on_page(Debugger *dbg, unsigned long addr) {
+    for (int i = 0; i < DBG_MAX_REGIONS; i++) {
+        RegionWatch *r = &dbg->regions[i];
+        if (r->active && addr >= r->page_lo && addr < r->page_hi) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+// Protection the page had before the watch covered it
+static int region_prot(const RegionWatch *w, unsigned long page) {
+    for (int i = 0; i < w->part_count; i++) {
+        if (page >= w->parts[i].lo && page < w->parts[i].hi) {
+            return w->parts[i].prot;
+        }
+    }
+    return PROT_READ | PROT_WRITE;
+}
+
+// Give the pages of a watch their own protection back, or with the write
+// bit cleared when armed
+static int protect_region(Debugger *dbg, const RegionWatch *w, int armed) {
+    int r = 0;
+    for (int i = 0; i < w->part_count; i++) {
+        const RegionPart *p = &w->parts[i];
+        r |= protect_pages(dbg, p->lo, p->hi, armed ? p->prot & ~PROT_WRITE : p->prot);
+    }
+    return r;
+}
+
+// The tracee stopped with SIGSEGV. If the write hit a page protected for a
+// region watch, lift the protection from that page, step the instruction,
+// and protect it again; an instruction writing to several protected pages
+// faults once per page. A write inside a watched range marks the stop as a
+// region hit. Returns 1 if handled (status then holds the stop after the
+// step), 0 if the fault is the program's own.
+static int region_fault(Debugger *dbg, int *status) {
+    pid_t pid = dbg->child_pid;
+    unsigned long page_size = sysconf(_SC_PAGESIZE);
+    unsigned long pc = get_pc(dbg);
+    unsigned long pages[4];
+    int prots[4];
+    int count = 0;
+
+    while (count < 4 && WIFSTOPPED(*status) && WSTOPSIG(*status) == SIGSEGV) {
+        siginfo_t si;
+        if (ptrace(PTRACE_GETSIGINFO, pid, NULL, &si) == -1 || si.si_code != SEGV_ACCERR) {
+            break;
+        }
+        unsigned long addr = (unsigned long)si.si_addr;
+        RegionWatch *owner = region_on_page(dbg, addr);
+        if (!owner) {
+            break;
+        }
+
+        for (int i = 0; i < DBG_MAX_REGIONS && !dbg->region_pending; i++) {
+            RegionWatch *r = &dbg->regions[i];
+            if (r->active && addr >= r->addr && addr < r->addr + r->size) {
+                r->hits++;
+                dbg->region_hit = i + 1;
+                dbg->region_pending = 1;
+                dbg->region_addr = addr;
+                dbg->region_pc = pc;
+                const LineEntry *e = lt_lookup(&dbg->lines, pc - dbg->load_bias);
+                dbg->region_line = e && e->file != LT_NO_FILE ? (int)e->line : 0;
+            }
+        }
+
+        dbg->region_faults++;
+        pages[count] = addr & ~(page_size - 1);
+        prots[count] = region_prot(owner, pages[count]);
+        if (protect_pages(dbg, pages[count], pages[count] + page_size, prots[count]) != 0) {
+            break;
+        }
+        count++;
+
+        if (step_once(dbg, status) != 0) {
+            break;
+        }
+    }
+
+    if (WIFSTOPPED(*status)) {
+        for (int i = 0; i < count; i++) {
+            protect_pages(dbg, pages[i], pages[i] + page_size, prots[i] & ~PROT_WRITE);
+        }
+    }
+    return count > 0;
+}
+
+static long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+// Wait for a program that runs freely. Its output is drained as it comes,
+// so it never blocks on a full pipe, and the pause hook gets to look at
+// the terminal; when it asks for a pause the program is interrupted.
+static int wait_running(Debugger *dbg, int *status) {
+    pid_t pid = dbg->child_pid;
+    if (!dbg->pause_hook && dbg->profile_fd < 0) {
+        return waitpid(pid, status, 0) == pid ? 0 : -1;
+    }
+
+    int output_open = 1;
+    long last_hook = monotonic_ms();
+    for (;;) {
+        pid_t r = waitpid(pid, status, WNOHANG);
+        if (r == pid) {
+            return 0;
+        }
+        if (r == -1 && errno != EINTR) {
+            return -1;
+        }
+
+        struct pollfd fds[4] = {
+            { sigchld_pipe[0], POLLIN, 0 },
+            { output_open ? dbg->stdout_pipe[0] : -1, POLLIN, 0 },
+            { dbg->input_fd, POLLIN, 0 },
+            { dbg->profile_fd, POLLIN, 0 },
+        };
+        int n = poll(fds, 4, DBG_POLL_MS);
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+
+        char drain[64];
+        while (read(sigchld_pipe[0], drain, sizeof(drain)) > 0) {
+        }
+        if (fds[1].revents & POLLIN) {
+            dbg_read_output(dbg);
+        } else if (fds[1].revents & (POLLHUP | POLLERR)) {
+            output_open = 0;
+        }
+
+        // Time for a sample; run_tracee takes it at the interrupt stop.
+        // Ticks missed while one was pending are dropped.
+        uint64_t ticks;
+        if ((fds[3].revents & POLLIN) && read(dbg->profile_fd, &ticks, sizeof(ticks)) > 0 &&
+            !dbg->sample_pending && !dbg->pause_requested) {
+            dbg->sample_pending = 1;
+            ptrace(PTRACE_INTERRUPT, pid, NULL, NULL);
+        }
+
+        // Output can keep poll() busy, so the period is measured, not timed out
+        long now = monotonic_ms();
+        if (!dbg->pause_hook || dbg->pause_requested ||
+            (now - last_hook < DBG_POLL_MS && !(fds[2].revents & POLLIN))) {
+            continue;
+        }
+        last_hook = now;
+        if (dbg->pause_hook(dbg->pause_ctx)) {
+            dbg->pause_requested = 1;
+            ptrace(PTRACE_INTERRUPT, pid, NULL, NULL);
+        }
+    }
+}
+
+// Count the pc of an interrupted program against its line and function.
+// Only rip is read, not the whole register set.
+static void take_sample(Debugger *dbg) {
+    errno = 0;
+    unsigned long pc = ptrace(PTRACE_PEEKUSER, dbg->child_pid,
+                              (void *)offsetof(struct user_regs_struct, rip), NULL);
+    if (errno != 0) {
+        return;
+    }
+    uint64_t addr = pc - dbg->load_bias;
+    const LineEntry *e = lt_lookup(&dbg->lines, addr);
+    if (e && e->file == LT_NO_FILE) {
+        e = NULL;   // Counted outside the source
+    }
+    const FuncSymbol *fs = sym_lookup(&dbg->symbols, addr);
+    prof_add(&dbg->profile, e ? e->file : 0, e ? (int)e->line : 0, fs ? fs->addr : 0);
+}
+
+// Resume with request (PTRACE_CONT or PTRACE_SINGLESTEP) and wait for the
+// next stop. Faults on pages protected for region watches are dealt with
+// here: callers see a write into a watched range as a SIGTRAP stop after
+// it, and never see the others. A pause shows up as a SIGTRAP stop with
+// dbg->paused set.
+static int run_tracee(Debugger *dbg, int request, int *status) {
+    pid_t pid = dbg->child_pid;
+    for (;;) {
+        tc_invalidate(&dbg->mem);
+        if (ptrace(request, pid, NULL, NULL) == -1) {
+            return -1;
+        }
+        if (request == PTRACE_CONT ? wait_running(dbg, status) != 0
+                                   : waitpid(pid, status, 0) != pid) {
+            return -1;
+        }
+
+        // A pause that lost the race against another stop is delivered
+        // after the next resume; only the one asked for now counts
+        if (interrupt_stop(*status)) {
+            dbg->sample_pending = 0;
+            if (dbg->pause_requested) {
+                dbg->paused = 1;
+                return 0;
+            }
+            if (dbg->profile_fd >= 0) {
+                take_sample(dbg);
+            }
+            continue;
+        }
+
+        if (!WIFSTOPPED(*status) || WSTOPSIG(*status) != SIGSEGV ||
+            !region_fault(dbg, status)) {
+            return 0;
+        }
+        // The fault handler's own step already did what a single step asks
+        if (!WIFSTOPPED(*status) || WSTOPSIG(*status) != SIGTRAP ||
+            dbg->region_pending || request == PTRACE_SINGLESTEP) {
+            return 0;
+        }
+    }
+}
+
+// Execute the instruction at pc, the current program counter. A user
+// breakpoint there gets its original byte back for the step and is
+// reinserted afterwards. Returns 1 if the tracee exited or a watchpoint
+// fired.
+static int step_at(Debugger *dbg, unsigned long pc, int *status) {
+    Breakpoint *bp = inserted_breakpoint(dbg, pc);
+    if (bp && poke_byte(dbg, pc, bp->orig, NULL) != 0) {
+        return -1;
+    }
+
+    if (run_tracee(dbg, PTRACE_SINGLESTEP, status) != 0) {
+        return -1;
+    }
+
+    if (bp && WIFSTOPPED(*status)) {
+        poke_byte(dbg, pc, 0xcc, NULL);
+    }
+    if (!check_stop(dbg, *status)) {
+        return 1;
+    }
+    return watch_hit(dbg) > 0 ? 1 : 0;
+}
+
+static int single_step(Debugger *dbg, int *status) {
+    return step_at(dbg, get_pc(dbg), status);
+}
+
+// Plant the trap set and continue. A user breakpoint under the pc that no
+// trap covers is stepped over first; otherwise from receives the pc, whose
+// int3 fires again at once and is not a breakpoint hit. Returns 0 once the
+// tracee stopped again, 1 if the step off the breakpoint ended the run, -1
+// on failure.
+static int resume(Debugger *dbg, TrapSet *set, unsigned long *from, int *status) {
+    *from = get_pc(dbg);
+
+    if (!find_trap(set, *from) && inserted_breakpoint(dbg, *from)) {
+        int r = step_at(dbg, *from, status);
+        if (r != 0) {
+            return r;
+        }
+        *from = 0;
+    }
+
+    insert_traps(dbg, set);
+    if (run_tracee(dbg, PTRACE_CONT, status) != 0) {
+        remove_traps(dbg, set);
+        return -1;
+    }
+    if (WIFSTOPPED(*status)) {
+        remove_traps(dbg, set);
+    }
+    return 0;
+}
+
+// Lazy operand access for breakpoint conditions: registers and memory come
+// from the per-stop cache, so each is fetched at most once, and only if the
+// bytecode reaches it
+typedef struct {
+    Debugger *dbg;
+} CondEnv;
+
+static int cond_read_reg(void *ctx, int reg, uint64_t *value) {
+    CondEnv *env = ctx;
+    unsigned long word;
+    if (tc_read_reg(&env->dbg->mem, reg, &word) != 0) {
+        return -1;
+    }
+    *value = word;
+    return 0;
+}
+
+static int cond_read_mem(void *ctx, uint64_t addr, void *buf, int size) {
+    CondEnv *env = ctx;
+    return read_tracee(env->dbg, addr, buf, size);
+}
+
+static unsigned long frame_cfa(Debugger *dbg, const struct user_regs_struct *regs);
+
+static int cond_frame_base(void *ctx, uint64_t *cfa) {
+    CondEnv *env = ctx;
+    struct user_regs_struct regs;
+    if (tc_get_regs(&env->dbg->mem, &regs) == -1) {
+        return -1;
+    }
+    *cfa = frame_cfa(env->dbg, &regs);
+    return 0;
+}
+
+int dbg_evaluate(Debugger *dbg, const char *text, int64_t *value) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "The program is not stopped");
+        return -1;
+    }
+
+    Expr e;
+    char error[128];
+    if (expr_compile(&e, text, NULL, error, sizeof(error)) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "%s", error);
+        return -1;
+    }
+    CondEnv env = { .dbg = dbg };
+    ExprEnv ops = { cond_read_reg, cond_read_mem, cond_frame_base, &env };
+    if (expr_eval(&e, &ops, value) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Cannot evaluate '%s'", text);
+        return -1;
+    }
+    return 0;
+}
+
+const MapsTable *dbg_maps(Debugger *dbg) {
+    if (dbg->maps_gen != dbg->mem.gen && dbg->child_pid > 0) {
+        maps_load(&dbg->maps, dbg->child_pid);
+        dbg->maps_gen = dbg->mem.gen;
+    }
+    return &dbg->maps;
+}
+
+#define DBG_LOCALS_SPAN 8192   // Largest frame range fetched in one read
+
+// Runtime address of a variable kept in memory, or 0
+static unsigned long local_address(Debugger *dbg, const Variable *var, unsigned long base,
+                                   const struct user_regs_struct *regs) {
+    const unsigned long *words = (const unsigned long *)regs;
+    switch (var->loc) {
+        case VAR_LOC_FRAME:      return base + var->offset;
+        case VAR_LOC_REG_OFFSET: return words[var->reg] + var->offset;
+        case VAR_LOC_ADDR:       return (unsigned long)var->offset + dbg->load_bias;
+        default:                 return 0;
+    }
+}
+
+// Registers, link-time pc, function and its frame base at this stop
+typedef struct {
+    struct user_regs_struct regs;
+    uint64_t pc;
+    const VarFunction *f;    // NULL outside functions with debug info
+    unsigned long base;      // 0 without f
+} StopScope;
+
+static int stop_scope(Debugger *dbg, StopScope *scope) {
+    if (tc_get_regs(&dbg->mem, &scope->regs) == -1) {
+        return -1;
+    }
+    scope->pc = scope->regs.rip - dbg->load_bias;
+    scope->f = var_function(&dbg->vars, scope->pc);
+    scope->base = 0;
+    if (scope->f) {
+        const VarFunction *f = scope->f;
+        scope->base = f->base_reg < 0 ? frame_cfa(dbg, &scope->regs)
+                                      : ((unsigned long *)&scope->regs)[f->base_reg] + f->base_offset;
+    }
+    return 0;
+}
+
+int dbg_locals(Debugger *dbg) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        dbg->local_count = 0;
+        return 0;
+    }
+    if (dbg->locals_gen == dbg->mem.gen) {
+        return dbg->local_count;
+    }
+    dbg->locals_gen = dbg->mem.gen;
+    dbg->local_count = 0;
+
+    StopScope scope;
+    if (stop_scope(dbg, &scope) != 0 || !scope.f) {
+        return 0;
+    }
+    const struct user_regs_struct regs = scope.regs;
+    const VarFunction *f = scope.f;
+    uint64_t pc = scope.pc;
+    unsigned long base = scope.base;
+
+    // Pick what is in scope and the stack range covering all of it
+    const Variable *shown[DBG_MAX_LOCALS];
+    unsigned long addrs[DBG_MAX_LOCALS];
+    int lengths[DBG_MAX_LOCALS];
+    int count = 0;
+    unsigned long lo = ULONG_MAX, hi = 0;
+    for (int i = 0; i < f->var_count && count < DBG_MAX_LOCALS; i++) {
+        const Variable *var = &dbg->vars.vars[f->first_var + i];
+        if (pc < var->lo || pc >= var->hi) continue;
+
+        int size = var->type >= 0 ? dbg->vars.types[var->type].size : 0;
+        shown[count] = var;
+        addrs[count] = local_address(dbg, var, base, &regs);
+        lengths[count] = size < DBG_LOCAL_BYTES ? size : DBG_LOCAL_BYTES;
+        if (addrs[count] && var->loc != VAR_LOC_ADDR) {
+            if (addrs[count] < lo) lo = addrs[count];
+            if (addrs[count] + lengths[count] > hi) hi = addrs[count] + lengths[count];
+        }
+        count++;
+    }
+
+    uint8_t frame[DBG_LOCALS_SPAN];
+    ssize_t got = 0;
+    if (hi > lo && hi - lo <= DBG_LOCALS_SPAN) {
+        got = tc_read(&dbg->mem, lo, frame, hi - lo);
+        if (got < 0) got = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const Variable *var = shown[i];
+        DbgLocal *local = &dbg->locals[i];
+        local->name = var->name;
+        local->is_param = var->is_param;
+
+        uint8_t scratch[DBG_LOCAL_BYTES];
+        const uint8_t *bytes = scratch;
+        int avail = 0;
+        if (var->loc == VAR_LOC_REG) {
+            unsigned long word = ((unsigned long *)&regs)[var->reg];
+            memcpy(scratch, &word, sizeof(word));
+            avail = sizeof(word);
+        } else if (addrs[i] >= lo && addrs[i] + lengths[i] <= hi && got > 0) {
+            bytes = frame + (addrs[i] - lo);
+            avail = (long)got - (long)(addrs[i] - lo);
+            if (avail < 0) avail = 0;
+            if (avail > lengths[i]) avail = lengths[i];
+        } else if (addrs[i]) {
+            // Static locals, or a frame too spread out for one read
+            ssize_t n = tc_read(&dbg->mem, addrs[i], scratch, lengths[i]);
+            avail = n > 0 ? (int)n : 0;
+        } else {
+            snprintf(local->value, sizeof(local->value), "<optimized out>");
+            continue;
+        }
+        var_format(&dbg->vars, var->type, bytes, avail, local->value, sizeof(local->value));
+    }
+    dbg->local_count = count;
+    return count;
+}
+
+int dbg_watch_expr(Debugger *dbg, const char *text) {
+    while (*text == ' ') text++;
+    if (*text == '\0') {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Empty expression");
+        return -1;
+    }
+    if (dbg->expr_count == DBG_MAX_EXPRS) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "All %d watch expressions are in use", DBG_MAX_EXPRS);
+        return -1;
+    }
+
+    WatchExpr *e = &dbg->exprs[dbg->expr_count];
+    memset(e, 0, sizeof(WatchExpr));
+    snprintf(e->text, sizeof(e->text), "%s", text);
+    e->page_count = -1;
+    return dbg->expr_count++;
+}
+
+int dbg_unwatch_expr(Debugger *dbg, int index) {
+    if (index == -1) {
+        dbg->expr_count = 0;
+        return 0;
+    }
+    if (index < 0 || index >= dbg->expr_count) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "No watch expression %d", index);
+        return -1;
+    }
+    memmove(&dbg->exprs[index], &dbg->exprs[index + 1],
+            (dbg->expr_count - index - 1) * sizeof(WatchExpr));
+    dbg->expr_count--;
+    return 0;
+}
+
+// Memory access for one evaluation, noting the pages it touched
+typedef struct {
+    Debugger *dbg;
+    WatchExpr *e;
+} ExprReader;
+
+static int expr_read_mem(void *ctx, uint64_t addr, void *buf, int size) {
+    ExprReader *r = ctx;
+    WatchExpr *e = r->e;
+    unsigned long first = addr & ~(unsigned long)(TC_PAGE_SIZE - 1);
+    unsigned long last = (addr + (size ? size - 1 : 0)) & ~(unsigned long)(TC_PAGE_SIZE - 1);
+    for (unsigned long page = first; page <= last && e->page_count >= 0; page += TC_PAGE_SIZE) {
+        int seen = 0;
+        for (int i = 0; i < e->page_count && !seen; i++) {
+            seen = e->pages[i] == page;
+        }
+        if (seen) continue;
+        if (e->page_count == DBG_EXPR_PAGES) {
+            e->page_count = -1;    // Too spread out to track
+        } else {
+            e->pages[e->page_count++] = page;
+        }
+    }
+    ssize_t n = tc_read(&r->dbg->mem, addr, buf, size);
+    return n < 0 ? -1 : (int)n;
+}
+
+static int compare_pages(const void *a, const void *b) {
+    unsigned long pa = *(const unsigned long *)a;
+    unsigned long pb = *(const unsigned long *)b;
+    return pa < pb ? -1 : pa > pb;
+}
+
+// Its value at the last stop still holds: the names resolve as they did,
+// and nothing it read has been written since
+static int expr_current(const Debugger *dbg, const WatchExpr *e, uint64_t binding,
+                        const unsigned long *pages, const uint8_t *dirty, int count) {
+    if (!dbg->exprs_tracked || !e->valid || e->page_count < 0 || e->binding != binding) {
+        return 0;
+    }
+    for (int i = 0; i < e->page_count; i++) {
+        const unsigned long *at = bsearch(&e->pages[i], pages, count, sizeof(unsigned long),
+                                          compare_pages);
+        if (!at || dirty[at - pages]) return 0;
+    }
+    return 1;
+}
+
+int dbg_refresh_exprs(Debugger *dbg) {
+    if (dbg->state != DBG_STATE_STOPPED || dbg->expr_count == 0) {
+        return 0;
+    }
+    // At the same stop, only expressions added since need a value
+    int same_stop = dbg->exprs_gen == dbg->mem.gen;
+    int fresh = 0;
+    for (int i = 0; i < dbg->expr_count; i++) {
+        fresh += !dbg->exprs[i].valid;
+    }
+    if (same_stop && fresh == 0) {
+        return 0;
+    }
+    dbg->exprs_gen = dbg->mem.gen;
+
+    StopScope scope;
+    if (stop_scope(dbg, &scope) != 0) {
+        return 0;
+    }
+    ExprReader reader = { dbg, NULL };
+    VarEnv env = { expr_read_mem, &reader, (const unsigned long *)&scope.regs,
+                   scope.base, dbg->load_bias };
+
+    // Ask the page map about every page the reusable values came from
+    uint64_t bindings[DBG_MAX_EXPRS];
+    unsigned long pages[DBG_MAX_EXPRS * DBG_EXPR_PAGES];
+    uint8_t dirty[DBG_MAX_EXPRS * DBG_EXPR_PAGES];
+    int count = 0;
+    for (int i = 0; i < dbg->expr_count; i++) {
+        WatchExpr *e = &dbg->exprs[i];
+        bindings[i] = var_binding(&dbg->vars, scope.pc, e->text, &env);
+        if (!same_stop && dbg->exprs_tracked && e->valid && e->binding == bindings[i] &&
+            e->page_count > 0) {
+            memcpy(&pages[count], e->pages, e->page_count * sizeof(unsigned long));
+            count += e->page_count;
+        }
+    }
+    if (count > 0) {
+        qsort(pages, count, sizeof(unsigned long), compare_pages);
+        int unique = 1;
+        for (int i = 1; i < count; i++) {
+            if (pages[i] != pages[unique - 1]) pages[unique++] = pages[i];
+        }
+        count = unique;
+        if (tc_dirty_pages(&dbg->mem, pages, count, dirty) != 0) {
+            dbg->exprs_tracked = 0;
+        }
+    }
+
+    int evaluated = 0;
+    for (int i = 0; i < dbg->expr_count; i++) {
+        WatchExpr *e = &dbg->exprs[i];
+        if (same_stop && e->valid) {
+            continue;
+        }
+        if (expr_current(dbg, e, bindings[i], pages, dirty, count)) {
+            e->changed = 0;
+            continue;
+        }
+
+        char value[sizeof(e->value)];
+        reader.e = e;
+        e->page_count = 0;
+        var_eval(&dbg->vars, scope.pc, e->text, &env, value, sizeof(value));
+        e->changed = e->valid && strcmp(value, e->value) != 0;
+        memcpy(e->value, value, sizeof(value));
+        e->binding = bindings[i];
+        e->valid = 1;
+        evaluated++;
+    }
+    if (same_stop) {
+        dbg->exprs_evaluated += evaluated;
+        return evaluated;
+    }
+    dbg->exprs_evaluated = evaluated;
+
+    // Start the next interval; without soft-dirty bits everything is
+    // evaluated again at the next stop
+    dbg->exprs_tracked = tc_clear_dirty(&dbg->mem) == 0;
+    return evaluated;
+}
+
+#define DBG_RECORD_BATCH 64    // Pages per page map query and memory read
+
+// Mappings the program can write without a system call: private and
+// writable, or made read-only by a range watch for now
+static int recorded_region(Debugger *dbg, const MapRegion *r) {
+    if (r->perms[3] != 'p') {
+        return 0;
+    }
+    if (r->perms[1] == 'w') {
+        return 1;
+    }
+    for (int i = 0; i < DBG_MAX_REGIONS; i++) {
+        const RegionWatch *w = &dbg->regions[i];
+        if (w->active && w->page_lo < r->end && w->page_hi > r->start) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Page worth reading: for the first copy every resident page, and every
+// page of a file mapping (untouched, it holds the file rather than zeros);
+// after that only the pages written since the last stop
+static int record_wanted(Debugger *dbg, uint8_t flags, int undo, int file) {
+    if (!undo) {
+        return (flags & TC_PAGE_RESIDENT) || file;
+    }
+    return (flags & TC_PAGE_RESIDENT) && (!dbg->record_tracked || (flags & TC_PAGE_DIRTY));
+}
+
+// Bring the shadow up to date with the tracee. With undo set, the old
+// bytes of each changed range also join the pending undo record; pages that
+// were written but hold what they held are left out.
+static int record_scan(Debugger *dbg, int undo) {
+    SnapshotRing *sr = &dbg->snapshots;
+    const MapsTable *maps = dbg_maps(dbg);
+    static uint8_t flags[DBG_RECORD_BATCH];
+    static uint8_t pages[DBG_RECORD_BATCH * SNAP_PAGE_SIZE];
+    static const uint8_t zero[SNAP_PAGE_SIZE];
+
+    for (int m = 0; m < maps->count; m++) {
+        const MapRegion *r = &maps->regions[m];
+        if (!recorded_region(dbg, r)) continue;
+        int file = r->path[0] == '/';
+
+        for (unsigned long batch = r->start; batch < r->end; batch += DBG_RECORD_BATCH * SNAP_PAGE_SIZE) {
+            int count = (int)((r->end - batch) / SNAP_PAGE_SIZE);
+            if (count > DBG_RECORD_BATCH) count = DBG_RECORD_BATCH;
+            if (tc_page_flags(&dbg->mem, batch, count, flags) != 0) {
+                return -1;
+            }
+
+            // Each run of wanted pages comes in with one transfer
+            for (int i = 0; i < count; ) {
+                if (!record_wanted(dbg, flags[i], undo, file)) {
+                    i++;
+                    continue;
+                }
+                int run = 1;
+                while (i + run < count && record_wanted(dbg, flags[i + run], undo, file)) {
+                    run++;
+                }
+                unsigned long addr = batch + (unsigned long)i * SNAP_PAGE_SIZE;
+                ssize_t n = tc_read(&dbg->mem, addr, pages, (size_t)run * SNAP_PAGE_SIZE);
+                int got = n > 0 ? (int)(n / SNAP_PAGE_SIZE) : 0;
+                i += run;
+
+                for (int p = 0; p < got; p++) {
+                    const uint8_t *now = pages + (size_t)p * SNAP_PAGE_SIZE;
+                    unsigned long page = addr + (unsigned long)p * SNAP_PAGE_SIZE;
+                    uint8_t *copy = snap_shadow(sr, page, 0);
+                    const uint8_t *old = copy ? copy : zero;
+
+                    if (memcmp(old, now, SNAP_PAGE_SIZE) == 0) {
+                        continue;
+                    }
+                    int lo = 0, hi = SNAP_PAGE_SIZE;
+                    while (old[lo] == now[lo]) lo++;
+                    while (old[hi - 1] == now[hi - 1]) hi--;
+
+                    if (undo && snap_add(sr, page + lo, old + lo, (uint32_t)(hi - lo)) != 0) {
+                        return -1;
+                    }
+                    if (!copy && !(copy = snap_shadow(sr, page, 1))) {
+                        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                                 "Recording stopped: over %d pages of writable memory",
+                                 DBG_RECORD_PAGES);
+                        return -1;
+                    }
+                    memcpy(copy + lo, now + lo, hi - lo);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int dbg_record(Debugger *dbg, int on) {
+    if (!on) {
+        snap_free(&dbg->snapshots);
+        dbg->recording = 0;
+        return 0;
+    }
+    if (snap_alloc(&dbg->snapshots, DBG_RECORD_BYTES, DBG_RECORD_PAGES) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Out of memory for recording");
+        return -1;
+    }
+    dbg->recording = 1;
+    dbg->record_based = 0;
+    return 0;
+}
+
+int dbg_record_stop(Debugger *dbg) {
+    if (!dbg->recording) {
+        return 0;
+    }
+    if (dbg->state != DBG_STATE_STOPPED && !dbg->signal_stopped) {
+        // The next run starts over from a fresh copy
+        snap_clear(&dbg->snapshots);
+        dbg->record_based = 0;
+        return 0;
+    }
+    if (dbg->record_based && dbg->record_gen == dbg->mem.gen) {
+        return 0;
+    }
+
+    struct user_regs_struct regs;
+    if (tc_get_regs(&dbg->mem, &regs) != 0) {
+        return -1;
+    }
+    // The first stop of a run only takes the copy later stops compare with
+    int undo = dbg->record_based;
+    if (!undo) {
+        snap_clear(&dbg->snapshots);
+        dbg->exprs_tracked = 0;    // The clear below ends their interval early
+    } else if (snap_begin(&dbg->snapshots, &dbg->record_regs) != 0) {
+        return -1;
+    }
+    if (record_scan(dbg, undo) != 0) {
+        if (dbg->error_message[0] == '\0') {
+            snprintf(dbg->error_message, sizeof(dbg->error_message),
+                     "Recording stopped: cannot read the program's memory");
+        }
+        dbg_record(dbg, 0);
+        return -1;
+    }
+    // A stop where nothing moved is not worth a step back
+    const SnapRecord *rec = (const SnapRecord *)dbg->snapshots.pending;
+    if (undo && (rec->delta_count > 0 || memcmp(&regs, &dbg->record_regs, sizeof(regs)) != 0)) {
+        snap_commit(&dbg->snapshots);
+    }
+
+    dbg->record_regs = regs;
+    dbg->record_gen = dbg->mem.gen;
+    dbg->record_based = 1;
+    // Watch expressions start the next soft-dirty interval after reading
+    // the same bits; with none, start it here. Skipping a clear only makes
+    // the next scan read more pages.
+    if (!undo || dbg->expr_count == 0) {
+        dbg->record_tracked = tc_clear_dirty(&dbg->mem) == 0;
+    }
+    return 0;
+}
+
+int dbg_step_back(Debugger *dbg) {
+    if (!dbg->recording || (dbg->state != DBG_STATE_STOPPED && !dbg->signal_stopped)) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Turn on recording and stop the program to step back");
+        return -1;
+    }
+    const SnapRecord *rec = snap_newest(&dbg->snapshots);
+    if (!rec) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "No earlier stop recorded");
+        return -1;
+    }
+
+    for (const SnapDelta *d = snap_next_delta(rec, NULL); d; d = snap_next_delta(rec, d)) {
+        const uint8_t *bytes = snap_delta_bytes(d);
+        // A range the program has since unmapped stays as it is
+        tc_write(&dbg->mem, d->addr, bytes, d->len);
+        uint8_t *copy = snap_shadow(&dbg->snapshots, d->addr & ~(uint64_t)(SNAP_PAGE_SIZE - 1), 1);
+        if (copy) {
+            memcpy(copy + (d->addr & (SNAP_PAGE_SIZE - 1)), bytes, d->len);
+        }
+    }
+    if (tc_set_regs(&dbg->mem, &rec->regs) != 0) {
+        dbg->state = DBG_STATE_ERROR;
+        return -1;
+    }
+    dbg->record_regs = rec->regs;
+    snap_pop(&dbg->snapshots);
+
+    dbg->return_valid = 0;
+    dbg->breakpoint_hit = 0;
+    dbg->watch_hit = 0;
+    dbg->region_hit = 0;
+    dbg->paused = 0;
+    dbg->signal_stopped = 0;
+    dbg->error_message[0] = '\0';
+    dbg->state = DBG_STATE_STOPPED;
+
+    // Everything read at this stop is stale; the restore counts as a stop
+    // of its own, already recorded
+    dbg->exprs_tracked = 0;
+    tc_invalidate(&dbg->mem);
+    dbg->record_gen = dbg->mem.gen;
+    update_regs(dbg);
+    return 0;
+}
+
+#define DR_OFFSET(n) offsetof(struct user, u_debugreg[n])
+#define DR6_HIT_MASK 0xfUL
+
+static int set_debugreg(pid_t pid, int n, unsigned long value) {
+    return ptrace(PTRACE_POKEUSER, pid, (void *)DR_OFFSET(n), (void *)value) == -1 ? -1 : 0;
+}
+
+// DR7 for the active watches: a local enable bit per slot, and the R/W
+// (01 write, 11 read/write) and LEN (00 1, 01 2, 11 4, 10 8 bytes) fields
+static unsigned long watch_dr7(Debugger *dbg) {
+    static const unsigned long len_bits[9] = { [1] = 0, [2] = 1, [4] = 3, [8] = 2 };
+    unsigned long dr7 = 0;
+    for (int i = 0; i < DBG_MAX_WATCH; i++) {
+        const Watchpoint *w = &dbg->watches[i];
+        if (!w->active) continue;
+        unsigned long rw = w->kind == DBG_WATCH_ACCESS ? 3 : 1;
+        dr7 |= 1UL << (i * 2);
+        dr7 |= (rw | len_bits[w->size] << 2) << (16 + i * 4);
+    }
+    return dr7;
+}
+
+int dbg_watch(Debugger *dbg, const char *text, int access) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Start the program before setting a watch");
+        return -1;
+    }
+
+    int slot = 0;
+    while (slot < DBG_MAX_WATCH && dbg->watches[slot].active) slot++;
+    if (slot == DBG_MAX_WATCH) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "All %d debug registers are in use", DBG_MAX_WATCH);
+        return -1;
+    }
+
+    Expr e;
+    char error[128];
+    if (expr_compile(&e, text, NULL, error, sizeof(error)) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Watch: %s", error);
+        return -1;
+    }
+    int size = expr_address_of(&e);
+    if (size < 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Watch needs a memory read, e.g. *(int *)($rbp - 4)");
+        return -1;
+    }
+
+    pid_t pid = dbg->child_pid;
+    CondEnv env = { .dbg = dbg };
+    ExprEnv ops = { cond_read_reg, cond_read_mem, cond_frame_base, &env };
+    int64_t addr;
+    uint64_t value = 0;
+    if (expr_eval(&e, &ops, &addr) != 0 ||
+        read_tracee(dbg, (unsigned long)addr, (uint8_t *)&value, size) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Cannot read the memory of '%s'", text);
+        return -1;
+    }
+    // The debug registers only match naturally aligned ranges
+    if (addr % size != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Watch address 0x%lx is not %d-byte aligned", (unsigned long)addr, size);
+        return -1;
+    }
+
+    Watchpoint *w = &dbg->watches[slot];
+    memset(w, 0, sizeof(Watchpoint));
+    w->active = 1;
+    w->kind = access ? DBG_WATCH_ACCESS : DBG_WATCH_WRITE;
+    w->addr = (unsigned long)addr;
+    w->size = size;
+    w->value = value;
+    snprintf(w->text, sizeof(w->text), "%s", text);
+
+    // The address goes in first: the kernel checks it when DR7 enables it
+    if (set_debugreg(pid, slot, w->addr) != 0 || set_debugreg(pid, 7, watch_dr7(dbg)) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Cannot set debug register: %s", strerror(errno));
+        w->active = 0;
+        set_debugreg(pid, 7, watch_dr7(dbg));
+        return -1;
+    }
+    return slot;
+}
+
+int dbg_unwatch(Debugger *dbg, int slot) {
+    if (slot < 0 || slot >= DBG_MAX_WATCH || !dbg->watches[slot].active) {
+        return -1;
+    }
+    dbg->watches[slot].active = 0;
+    if (dbg->state == DBG_STATE_STOPPED) {
+        set_debugreg(dbg->child_pid, 7, watch_dr7(dbg));
+        set_debugreg(dbg->child_pid, slot, 0);
+    }
+    return 0;
+}
+
+// Cover the pages of every active region except skip, write bit cleared
+static int protect_regions(Debugger *dbg, int skip) {
+    int r = 0;
+    for (int i = 0; i < DBG_MAX_REGIONS; i++) {
+        const RegionWatch *w = &dbg->regions[i];
+        if (w->active && i != skip) {
+            r |= protect_region(dbg, w, 1);
+        }
+    }
+    return r;
+}
+
+int dbg_watch_region(Debugger *dbg, const char *spec) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Start the program before setting a watch");
+        return -1;
+    }
+
+    int index = 0;
+    while (index < DBG_MAX_REGIONS && dbg->regions[index].active) index++;
+    if (index == DBG_MAX_REGIONS) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "At most %d range watches", DBG_MAX_REGIONS);
+        return -1;
+    }
+
+    // "address, size": split at the last comma outside parentheses
+    char text[128];
+    snprintf(text, sizeof(text), "%s", spec);
+    char *comma = NULL;
+    int depth = 0;
+    for (char *p = text; *p; p++) {
+        if (*p == '(') depth++;
+        else if (*p == ')') depth--;
+        else if (*p == ',' && depth == 0) comma = p;
+    }
+    if (!comma) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Range watch needs 'address, size'");
+        return -1;
+    }
+    *comma = '\0';
+
+    Expr addr_expr, size_expr;
+    char error[128];
+    if (expr_compile(&addr_expr, text, NULL, error, sizeof(error)) != 0 ||
+        expr_compile(&size_expr, comma + 1, NULL, error, sizeof(error)) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Watch: %s", error);
+        return -1;
+    }
+
+    CondEnv env = { .dbg = dbg };
+    ExprEnv ops = { cond_read_reg, cond_read_mem, cond_frame_base, &env };
+    int64_t addr, size;
+    if (expr_eval(&addr_expr, &ops, &addr) != 0 || expr_eval(&size_expr, &ops, &size) != 0 ||
+        size <= 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Cannot evaluate range '%s'", spec);
+        return -1;
+    }
+
+    unsigned long page_size = sysconf(_SC_PAGESIZE);
+    RegionWatch *w = &dbg->regions[index];
+    memset(w, 0, sizeof(RegionWatch));
+    w->addr = (unsigned long)addr;
+    w->size = (unsigned long)size;
+    w->page_lo = w->addr & ~(page_size - 1);
+    w->page_hi = (w->addr + w->size + page_size - 1) & ~(page_size - 1);
+    snprintf(w->text, sizeof(w->text), "%s", spec);
+
+    // The pages must be covered by writable mappings with no gap between
+    // them; each part gets its mapping's protection back when the watch
+    // is removed
+    dbg_maps(dbg);
+    int at = maps_index(&dbg->maps, w->page_lo);
+    for (unsigned long lo = w->page_lo; lo < w->page_hi; at++) {
+        const MapRegion *m = at < dbg->maps.count ? &dbg->maps.regions[at] : NULL;
+        if (!m || m->start > lo || m->perms[1] != 'w' || w->part_count == DBG_REGION_PARTS) {
+            snprintf(dbg->error_message, sizeof(dbg->error_message),
+                     "0x%lx-0x%lx is not covered by writable mappings", w->addr, w->addr + w->size);
+            return -1;
+        }
+        RegionPart *p = &w->parts[w->part_count++];
+        p->lo = lo;
+        p->hi = m->end < w->page_hi ? m->end : w->page_hi;
+        p->prot = (m->perms[0] == 'r' ? PROT_READ : 0) | PROT_WRITE |
+                  (m->perms[2] == 'x' ? PROT_EXEC : 0);
+        lo = p->hi;
+    }
+
+    if (protect_region(dbg, w, 1) != 0) {
+        protect_region(dbg, w, 0);
+        protect_regions(dbg, index);
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "mprotect in the program failed");
+        return -1;
+    }
+    w->active = 1;
+    return index;
+}
+
+int dbg_unwatch_region(Debugger *dbg, int index) {
+    if (index < 0 || index >= DBG_MAX_REGIONS || !dbg->regions[index].active) {
+        return -1;
+    }
+    RegionWatch *w = &dbg->regions[index];
+    w->active = 0;
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return 0;
+    }
+    // Pages shared with another watch are protected again right after
+    protect_region(dbg, w, 0);
+    return protect_regions(dbg, index);
+}
+
+// Fork the stopped tracee with an injected clone(). Following clones only
+// for this call, the copy is traced from birth and is left in its first
+// stop, just past the syscall instruction. CLONE_PARENT makes it our child
+// like the program, so we reap it; with no exit signal the program never
+// hears of it. Returns its pid or -1.
+static pid_t fork_tracee(Debugger *dbg) {
+    pid_t pid = dbg->child_pid;
+    if (ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)(TRACE_OPTIONS | PTRACE_O_TRACECLONE)) == -1) {
+        return -1;
+    }
+    long copy = inject_syscall(dbg, SYS_clone, CLONE_PARENT, 0, 0);
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)TRACE_OPTIONS);
+    if (copy <= 0) {
+        return -1;
+    }
+
+    int status;
+    if (waitpid((pid_t)copy, &status, __WALL) != (pid_t)copy || !WIFSTOPPED(status)) {
+        kill((pid_t)copy, SIGKILL);
+        return -1;
+    }
+    return (pid_t)copy;
+}
+
+static void drop_checkpoint(Debugger *dbg, int index) {
+    Checkpoint *cp = &dbg->checkpoints[index];
+    kill(cp->pid, SIGKILL);
+    waitpid(cp->pid, NULL, __WALL);
+    close(cp->output_fd);
+    memmove(cp, cp + 1, (dbg->checkpoint_count - index - 1) * sizeof(*cp));
+    dbg->checkpoint_count--;
+}
+
+int dbg_checkpoint(Debugger *dbg) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Stop the program to take a checkpoint");
+        return -1;
+    }
+    if (dbg->checkpoint_count == DBG_MAX_CHECKPOINTS) {
+        drop_checkpoint(dbg, 0);
+    }
+
+    Checkpoint *cp = &dbg->checkpoints[dbg->checkpoint_count];
+    if (tc_get_regs(&dbg->mem, &cp->regs) != 0) {
+        return -1;
+    }
+
+    // The copy gets the code and page protections of a fresh process, so
+    // that a restart can set up breakpoints and watches of its own
+    BreakpointMap *bm = &dbg->breakpoints;
+    for (int i = 0; i < bm->capacity; i++) {
+        if (bp_live(&bm->slots[i])) {
+            remove_breakpoint(dbg, &bm->slots[i]);
+        }
+    }
+    // The code the injected syscall covers, read without our int3s in it
+    int code_read = read_tracee(dbg, cp->regs.rip & ~7UL, cp->code, sizeof(cp->code)) == 0;
+    for (int i = 0; i < DBG_MAX_REGIONS; i++) {
+        const RegionWatch *w = &dbg->regions[i];
+        if (w->active) {
+            protect_region(dbg, w, 0);
+        }
+    }
+    pid_t pid = code_read ? fork_tracee(dbg) : -1;
+    protect_regions(dbg, -1);
+    for (int i = 0; i < bm->capacity; i++) {
+        if (bp_live(&bm->slots[i])) {
+            insert_breakpoint(dbg, &bm->slots[i]);
+        }
+    }
+
+    int fd = pid > 0 ? fcntl(dbg->stdout_pipe[0], F_DUPFD_CLOEXEC, 0) : -1;
+    if (fd == -1) {
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, __WALL);
+        }
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Cannot fork a checkpoint: %s", strerror(errno));
+        return -1;
+    }
+
+    cp->pid = pid;
+    cp->output_fd = fd;
+    cp->load_bias = dbg->load_bias;
+    cp->line = dbg->current_line;
+    cp->instruction_count = dbg->instruction_count;
+    memcpy(cp->output, dbg->output_buffer, sizeof(cp->output));
+    cp->output_length = dbg->output_length;
+    return dbg->checkpoint_count++;
+}
+
+int dbg_restore_checkpoint(Debugger *dbg, int index) {
+    if (index < 0) {
+        index = dbg->checkpoint_count - 1;
+    }
+    if (index < 0 || index >= dbg->checkpoint_count) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "No checkpoint %d", index + 1);
+        return -1;
+    }
+    Checkpoint *cp = &dbg->checkpoints[index];
+
+    // An exited program is already reaped
+    if (dbg->state == DBG_STATE_STOPPED || dbg->signal_stopped) {
+        kill(dbg->child_pid, SIGKILL);
+        waitpid(dbg->child_pid, NULL, __WALL);
+    }
+    dbg->child_pid = -1;
+
+    // Output the old program left in the pipe is not the copy's. The copy
+    // writes where the checkpointed program did, which after a restart is
+    // an older pipe.
+    if (dbg->stdout_pipe[0] != -1) {
+        char discard[4096];
+        while (read(dbg->stdout_pipe[0], discard, sizeof(discard)) > 0) {
+        }
+        close(dbg->stdout_pipe[0]);
+    }
+    dbg->stdout_pipe[0] = fcntl(cp->output_fd, F_DUPFD_CLOEXEC, 0);
+    memcpy(dbg->output_buffer, cp->output, sizeof(dbg->output_buffer));
+    dbg->output_length = cp->output_length;
+    reset_run_state(dbg);
+
+    // The checkpoint forks again, and the copy is put back to where the
+    // checkpoint was taken: before the syscall, with the code it covered
+    dbg->child_pid = cp->pid;
+    tc_attach(&dbg->mem, cp->pid);
+    pid_t pid = fork_tracee(dbg);
+    if (pid > 0) {
+        dbg->child_pid = pid;
+        tc_attach(&dbg->mem, pid);
+    }
+    if (pid <= 0 ||
+        tc_write(&dbg->mem, cp->regs.rip & ~7UL, cp->code, sizeof(cp->code)) != sizeof(cp->code) ||
+        tc_set_regs(&dbg->mem, &cp->regs) != 0) {
+        tc_detach(&dbg->mem);
+        dbg->child_pid = -1;
+        dbg->state = DBG_STATE_ERROR;
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Cannot restart from checkpoint %d", index + 1);
+        return -1;
+    }
+    set_debugreg(pid, 7, 0);
+
+    // A restart since may have loaded the program elsewhere
+    dbg->load_bias = cp->load_bias;
+    maps_load(&dbg->maps, pid);
+    dbg->maps_gen = dbg->mem.gen;
+    insert_breakpoints(dbg);
+    dbg->state = DBG_STATE_STOPPED;
+    update_regs(dbg);
+    dbg->instruction_count = cp->instruction_count;
+    return 0;
+}
+
+// After a SIGTRAP: if DR6 says a debug register fired, record which watch
+// and its contents before and after the access. Watches trap after the
+// instruction, so the pc is left alone. A region write noted by the fault
+// handler also counts. Returns 1 to stop, -1 for writes that stored the
+// same value, 0 if no watch fired.
+static int watch_hit(Debugger *dbg) {
+    if (dbg->region_pending) {
+        dbg->region_pending = 0;
+        return 1;
+    }
+
+    int armed = 0;
+    for (int i = 0; i < DBG_MAX_WATCH; i++) {
+        armed |= dbg->watches[i].active;
+    }
+    if (!armed) {
+        return 0;
+    }
+
+    pid_t pid = dbg->child_pid;
+    errno = 0;
+    unsigned long dr6 = ptrace(PTRACE_PEEKUSER, pid, (void *)DR_OFFSET(6), NULL);
+    if (errno != 0 || !(dr6 & DR6_HIT_MASK)) {
+        return 0;
+    }
+    // Only debug exceptions rewrite DR6, so clear it for the next int3 stop
+    set_debugreg(pid, 6, 0);
+
+    int stop = 0;
+    for (int i = 0; i < DBG_MAX_WATCH; i++) {
+        Watchpoint *w = &dbg->watches[i];
+        if (!w->active || !(dr6 & (1UL << i))) continue;
+
+        uint64_t value = 0;
+        read_tracee(dbg, w->addr, (uint8_t *)&value, w->size);
+        if (w->kind == DBG_WATCH_WRITE && value == w->value) {
+            continue;
+        }
+        w->hits++;
+        if (!stop) {
+            dbg->watch_hit = i + 1;
+            dbg->watch_old = w->value;
+            dbg->watch_new = value;
+            stop = 1;
+        }
+        w->value = value;
+    }
+    return stop ? 1 : -1;
+}
+
+static int breakpoint_stops(Debugger *dbg, Breakpoint *bp);
+
+// After a SIGTRAP from resume: if the tracee ran into a user breakpoint,
+// rewind onto it, evaluate its condition and record tracepoint values.
+// Returns 1 for a hit to stop at, -1 to keep running (false condition or
+// tracepoint, pc rewound; or an unchanged write watch), 0 if the stop was
+// neither a user breakpoint, a watch nor a pause.
+static int breakpoint_hit(Debugger *dbg, unsigned long from) {
+    // Paused wherever the program happened to be
+    if (dbg->paused) {
+        return 1;
+    }
+
+    int watch = watch_hit(dbg);
+    if (watch != 0) {
+        return watch;
+    }
+
+    unsigned long pc = get_pc(dbg) - 1;
+    Breakpoint *bp = inserted_breakpoint(dbg, pc);
+    if (pc == from || !bp) {
+        return 0;
+    }
+
+    set_pc(dbg, pc);
+    return breakpoint_stops(dbg, bp);
+}
+
+// The tracee is at user breakpoint bp: count the hit, evaluate its
+// condition and record tracepoint values. Returns 1 to stop, -1 to keep
+// running.
+static int breakpoint_stops(Debugger *dbg, Breakpoint *bp) {
+    bp->hits++;
+
+    CondEnv env = { .dbg = dbg };
+    ExprEnv ops = { cond_read_reg, cond_read_mem, cond_frame_base, &env };
+
+    if (bp->condition) {
+        int64_t value;
+        if (expr_eval(bp->condition, &ops, &value) != 0) {
+            snprintf(dbg->error_message, sizeof(dbg->error_message),
+                     "Condition at line %d failed", bp->line);
+        } else if (value == 0) {
+            return -1;
+        }
+    }
+
+    // Tracepoints record into the preallocated ring and keep going
+    if (bp->collect) {
+        TraceSample *sample = tb_next(&dbg->trace);
+        sample->line = bp->line;
+        sample->count = bp->collect_count;
+        sample->valid = 0;
+        for (int i = 0; i < bp->collect_count; i++) {
+            if (expr_eval(&bp->collect[i], &ops, &sample->values[i]) == 0) {
+                sample->valid |= 1 << i;
+            }
+        }
+        return -1;
+    }
+
+    dbg->breakpoint_hit = 1;
+    dbg->breakpoint_line = bp->line;
+    return 1;
+}
+
+// Instruction bytes at a runtime address, preferably from the executable
+// file so that our own int3s never show up in them
+static const uint8_t *code_bytes(Debugger *dbg, unsigned long addr, size_t len, uint8_t *scratch) {
+    size_t avail;
+    const unsigned char *p = elf_code_at(&dbg->elf, addr - dbg->load_bias, &avail);
+    if (p && avail >= len) {
+        return p;
+    }
+    if (read_tracee(dbg, addr, scratch, len) == 0) {
+        return scratch;
+    }
+    return NULL;
+}
+
+// Canonical frame address (rsp before the call that entered the function),
+// assuming the frame-pointer prologue gcc emits at -O0:
+//   [endbr64]  push %rbp  mov %rsp,%rbp
+static unsigned long frame_cfa(Debugger *dbg, const struct user_regs_struct *regs) {
+    const FuncSymbol *fs = sym_lookup(&dbg->symbols, regs->rip - dbg->load_bias);
+    if (!fs) {
+        return regs->rsp;
+    }
+
+    uint8_t scratch[64];
+    unsigned long start = fs->addr + dbg->load_bias;
+    const uint8_t *code = code_bytes(dbg, start, sizeof(scratch), scratch);
+    const uint8_t *here = code_bytes(dbg, regs->rip, 1, scratch + 32);
+    if (!code || !here) {
+        return regs->rbp + 16;
+    }
+
+    // At a return the frame is already torn down
+    if (*here == 0xc3 || *here == 0xc2) {
+        return regs->rsp + 8;
+    }
+
+    int pushed = 0;
+    unsigned long a = start;
+    for (int i = 0; i < 4 && a < regs->rip; i++) {
+        X86Insn insn;
+        int len = x86_decode(code + (a - start), sizeof(scratch) - (a - start), a, &insn);
+        if (len < 0) break;
+
+        if (insn.map == X86_MAP_ONE && insn.opcode == 0x55 && !insn.rex) {
+            pushed = 1;
+        } else if (pushed && insn.map == X86_MAP_ONE && insn.opcode == 0x89 &&
+                   (insn.rex & 0x08) && insn.modrm == 0xe5) {
+            return regs->rbp + 16;
+        } else if (!(insn.prefix_f3 && insn.map == X86_MAP_0F && insn.opcode == 0x1e)) {
+            // Not a standard prologue: assume the frame pointer is set up
+            return pushed ? regs->rsp + 16 : regs->rbp + 16;
+        }
+        a += len;
+    }
+    return pushed ? regs->rsp + 16 : regs->rsp + 8;
+}
+
+// Run the current function until it returns to ret_addr in the frame whose
+// CFA is cfa, with one breakpoint. Hits from deeper recursive calls are
+// stepped past. Returns 0 when stopped at the return address, 1 if the
+// tracee stopped for another reason, -1 on failure.
+static int run_to_return(Debugger *dbg, unsigned long ret_addr, unsigned long cfa, int *status) {
+    TrapSet set;
+    set.count = 0;
+    add_trap(&set, ret_addr, 0, X86_FLOW_RET);
+
+    for (;;) {
+        unsigned long from;
+        int r = resume(dbg, &set, &from, status);
+        if (r != 0) {
+            return r;
+        }
+        if (!check_stop(dbg, *status)) {
+            return 1;
+        }
+
+        struct user_regs_struct regs;
+        if (tc_get_regs(&dbg->mem, &regs) == -1) {
+            return -1;
+        }
+        if (regs.rip - 1 != ret_addr) {
+            if (breakpoint_hit(dbg, from) < 0) {
+                continue;
+            }
+            return 1;
+        }
+        regs.rip--;
+        set_pc(dbg, regs.rip);
+
+        // A deeper recursive call returning to the same address
+        if (regs.rsp < cfa) {
+            r = single_step(dbg, status);
+            if (r != 0) {
+                return r;
+            }
+            continue;
+        }
+        return 0;
+    }
+}
+
+// A return address must follow a call: e8 rel32, or ff /2 with any of its
+// addressing forms
+static int is_return_site(Debugger *dbg, unsigned long addr) {
+    static const int call_lengths[] = { 5, 2, 3, 6, 7 };
+    uint8_t scratch[16];
+
+    for (size_t i = 0; i < sizeof(call_lengths) / sizeof(call_lengths[0]); i++) {
+        unsigned long a = addr - call_lengths[i];
+        const uint8_t *code = code_bytes(dbg, a, call_lengths[i], scratch);
+        X86Insn insn;
+        if (code && x86_decode(code, call_lengths[i], a, &insn) == call_lengths[i] &&
+            (insn.flow == X86_FLOW_CALL || insn.flow == X86_FLOW_CALL_IND)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Trap every line-table row of the executable and continue. Used when the
+// pc is in library code with no usable return address, e.g. a callback
+// from qsort or the exit path after main returns.
+static int run_to_any_line(Debugger *dbg, int *status) {
+    int count = 0;
+    unsigned long *addrs = malloc(dbg->lines.count * sizeof(unsigned long) + 1);
+    uint8_t *orig = malloc(dbg->lines.count + 1);
+    if (!addrs || !orig) {
+        free(addrs);
+        free(orig);
+        return -1;
+    }
+
+    for (int i = 0; i < dbg->lines.count; i++) {
+        const LineEntry *e = &dbg->lines.entries[i];
+        unsigned long a = e->addr + dbg->load_bias;
+        if ((e->flags & LT_FLAG_END_SEQ) || (count > 0 && addrs[count - 1] == a)) {
+            continue;
+        }
+        if (poke_byte(dbg, a, 0xcc, &orig[count]) == 0) {
+            addrs[count++] = a;
+        }
+    }
+
+    // The pc is in library code, never under a user breakpoint, so a plain
+    // continue is safe
+    unsigned long from = get_pc(dbg);
+    int r = -1;
+    if (count > 0 && run_tracee(dbg, PTRACE_CONT, status) == 0) {
+        r = 0;
+    }
+    if (r == 0 && !WIFSTOPPED(*status)) {
+        count = 0;
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        poke_byte(dbg, addrs[i], orig[i], NULL);
+    }
+
+    if (r == 0) {
+        int hit;
+        if (!check_stop(dbg, *status)) {
+            r = 1;
+        } else if ((hit = breakpoint_hit(dbg, from)) > 0) {
+            r = 1;
+        } else if (hit == 0) {
+            unsigned long pc = get_pc(dbg) - 1;
+            for (int i = 0; i < count; i++) {
+                if (addrs[i] == pc) {
+                    set_pc(dbg, pc);
+                    break;
+                }
+            }
+        }
+    }
+
+    free(addrs);
+    free(orig);
+    return r;
+}
+
+// Leave code without line info. Library functions entered by a call run
+// back to the caller with one breakpoint; PLT stubs and other code in the
+// executable are singlestepped.
+static int step_no_line(Debugger *dbg, int *status) {
+    struct user_regs_struct regs;
+    if (tc_get_regs(&dbg->mem, &regs) == -1) {
+        return -1;
+    }
+    if (in_executable(dbg, regs.rip)) {
+        return single_step(dbg, status);
+    }
+
+    unsigned long ret_addr;
+    if (read_tracee(dbg, regs.rsp, (uint8_t *)&ret_addr, sizeof(ret_addr)) == 0 &&
+        in_executable(dbg, ret_addr) && has_line_info(dbg, ret_addr) &&
+        is_return_site(dbg, ret_addr)) {
+        return run_to_return(dbg, ret_addr, regs.rsp + 8, status);
+    }
+    return run_to_any_line(dbg, status);
+}
+
+// Run until the pc leaves the current line's address range. Every exit is
+// covered by a temporary int3: the fallthrough address, direct branch targets
+// outside the line, entries of called functions with line info (step into
+// only), and the line's own indirect branches/returns (singlestepped on hit).
+// Traps hit by a deeper frame of the same function (recursion) are stepped
+// over. Returns 0 when the pc left the range, 1 if the tracee stopped for
+// another reason (state updated), -1 if the line cannot be range-stepped.
+static int step_range(Debugger *dbg, int over, unsigned long start_cfa, int *status) {
+    unsigned long pc = get_pc(dbg);
+
+    uint64_t lo, hi;
+    if (lt_line_range(&dbg->lines, pc - dbg->load_bias, &lo, &hi) != 0) {
+        return -1;
+    }
+    lo += dbg->load_bias;
+    hi += dbg->load_bias;
+    if (hi <= lo || hi - lo > MAX_LINE_BYTES) {
+        return -1;
+    }
+
+    static uint8_t scratch[MAX_LINE_BYTES];
+    const uint8_t *code = code_bytes(dbg, lo, hi - lo, scratch);
+    if (!code) {
+        return -1;
+    }
+
+    static TrapSet set;
+    set.count = 0;
+
+    for (unsigned long a = lo; a < hi; ) {
+        X86Insn insn;
+        int len = x86_decode(code + (a - lo), hi - a, a, &insn);
+        if (len < 0) {
+            return -1;
+        }
+
+        int err = 0;
+        switch (insn.flow) {
+            case X86_FLOW_JMP:
+            case X86_FLOW_JCC:
+                if (insn.target < lo || insn.target >= hi) {
+                    err = add_trap(&set, insn.target, 0, insn.flow);
+                }
+                break;
+            case X86_FLOW_CALL:
+                if (!over && !skip_call_target(dbg, insn.target)) {
+                    err = add_trap(&set, insn.target, 0, insn.flow);
+                }
+                break;
+            case X86_FLOW_CALL_IND:
+            case X86_FLOW_JMP_IND:
+            case X86_FLOW_RET:
+            case X86_FLOW_TRAP:
+                err = add_trap(&set, a, 1, insn.flow);
+                break;
+            default:
+                break;
+        }
+        if (err != 0) {
+            return -1;
+        }
+        a += len;
+    }
+    if (add_trap(&set, hi, 0, X86_FLOW_NONE) != 0) {
+        return -1;
+    }
+
+    for (;;) {
+        unsigned long from;
+        int r = resume(dbg, &set, &from, status);
+        if (r != 0) {
+            return r;
+        }
+        if (!check_stop(dbg, *status)) {
+            return 1;
+        }
+        int hit = breakpoint_hit(dbg, from);
+        if (hit > 0) {
+            return 1;
+        }
+
+        struct user_regs_struct regs;
+        if (tc_get_regs(&dbg->mem, &regs) == -1) {
+            return -1;
+        }
+        // A breakpoint with a false condition has already rewound the pc
+        if (hit == 0) {
+            regs.rip--;
+        }
+        StepTrap *t = find_trap(&set, regs.rip);
+        if (!t) {
+            if (hit < 0) {
+                continue;
+            }
             return 0;
         }
+        set_pc(dbg, regs.rip);
 
-        update_regs(dbg);
+        // Entering a called function is the point of stepping into it
+        if (t->flow == X86_FLOW_CALL) {
+            return 0;
+        }
+
+        int deeper = frame_cfa(dbg, &regs) < start_cfa;
+        if (!t->in_range && !deeper) {
+            return 0;
+        }
+
+        r = single_step(dbg, status);
+        if (r != 0) {
+            return r;
+        }
+        if (deeper) {
+            continue;
+        }
 
-        if (dbg->registers.rip >= 0x700000000000) {
+        pc = get_pc(dbg);
+        if (pc >= lo && pc < hi) {
+            continue;
+        }
+        // Run the callee of an indirect call back to this line when stepping
+        // over it, or when it is library code or on the skip list
+        if (t->flow == X86_FLOW_CALL_IND && (over || skip_call_target(dbg, pc))) {
             continue;
         }
+        return 0;
+    }
+}
+
+static int step_line(Debugger *dbg, int over) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return -1;
+    }
+    dbg->return_valid = 0;
+    dbg->breakpoint_hit = 0;
+    dbg->watch_hit = 0;
+    dbg->region_hit = 0;
+    dbg->pause_requested = 0;
+    dbg->paused = 0;
+
+    struct user_regs_struct regs;
+    if (tc_get_regs(&dbg->mem, &regs) == -1) {
+        dbg->state = DBG_STATE_ERROR;
+        return -1;
+    }
+    unsigned long start_cfa = frame_cfa(dbg, &regs);
+
+    int start_line = dbg->current_line;
+    int status;
+    int max_rounds = 10000;
+
+    for (int i = 0; i < max_rounds; i++) {
+        int r = step_range(dbg, over, start_cfa, &status);
+        if (r < 0) {
+            // No line info here or undecodable code
+            r = step_no_line(dbg, &status);
+        }
+        if (r < 0) {
+            dbg->state = DBG_STATE_ERROR;
+            return -1;
+        }
+        if (r > 0) {
+            if (dbg->state == DBG_STATE_STOPPED) {
+                update_regs(dbg);
+            }
+            return 0;
+        }
 
-        if (dbg->current_line != start_line && dbg->current_line > 0) {
+        update_regs(dbg);
+
+        if (has_line_info(dbg, dbg->current_rip) && dbg->current_line != start_line) {
             break;
         }
     }
@@ -314,13 +2603,380 @@ int dbg_step_line(Debugger *dbg) {
     return 0;
 }
 
+int dbg_step_line(Debugger *dbg) {
+    return step_line(dbg, 0);
+}
+
+int dbg_next_line(Debugger *dbg) {
+    return step_line(dbg, 1);
+}
+
+int dbg_step_instruction(Debugger *dbg) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return -1;
+    }
+    dbg->return_valid = 0;
+    dbg->breakpoint_hit = 0;
+    dbg->watch_hit = 0;
+    dbg->region_hit = 0;
+    dbg->pause_requested = 0;
+    dbg->paused = 0;
+
+    int status;
+    if (single_step(dbg, &status) < 0) {
+        dbg->state = DBG_STATE_ERROR;
+        return -1;
+    }
+    if (dbg->state == DBG_STATE_STOPPED) {
+        update_regs(dbg);
+    }
+    return 0;
+}
+
+int dbg_finish(Debugger *dbg) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return -1;
+    }
+    dbg->return_valid = 0;
+    dbg->breakpoint_hit = 0;
+    dbg->watch_hit = 0;
+    dbg->region_hit = 0;
+    dbg->pause_requested = 0;
+    dbg->paused = 0;
+
+    struct user_regs_struct regs;
+    if (tc_get_regs(&dbg->mem, &regs) == -1) {
+        dbg->state = DBG_STATE_ERROR;
+        return -1;
+    }
+
+    // The return address sits just below the caller's stack pointer
+    if (!sym_lookup(&dbg->symbols, regs.rip - dbg->load_bias)) {
+        return -1;
+    }
+    unsigned long cfa = frame_cfa(dbg, &regs);
+    unsigned long ret_addr;
+    if (read_tracee(dbg, cfa - 8, (uint8_t *)&ret_addr, sizeof(ret_addr)) != 0) {
+        return -1;
+    }
+
+    int status;
+    int r = run_to_return(dbg, ret_addr, cfa, &status);
+    if (r < 0) {
+        dbg->state = DBG_STATE_ERROR;
+        return -1;
+    }
+    if (r == 0) {
+        tc_get_regs(&dbg->mem, &regs);
+        dbg->return_value = regs.rax;
+        dbg->return_valid = 1;
+    } else if (dbg->state != DBG_STATE_STOPPED) {
+        return 0;
+    }
+
+    dbg->state = DBG_STATE_STOPPED;
+    update_regs(dbg);
+    return 0;
+}
+
+int dbg_continue(Debugger *dbg) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return -1;
+    }
+    dbg->return_valid = 0;
+    dbg->breakpoint_hit = 0;
+    dbg->watch_hit = 0;
+    dbg->region_hit = 0;
+    dbg->pause_requested = 0;
+    dbg->paused = 0;
+
+    // Breakpoints whose condition is false resume right here, without a
+    // round trip through the UI
+    static TrapSet none;
+    for (unsigned long resumes = 1; ; resumes++) {
+        // Empty the output pipe now and then; a program printing in a
+        // traced loop would otherwise fill it and block in write()
+        if ((resumes & 255) == 0) {
+            dbg_read_output(dbg);
+        }
+
+        unsigned long from;
+        int status;
+        int r = resume(dbg, &none, &from, &status);
+        if (r < 0) {
+            dbg->state = DBG_STATE_ERROR;
+            return -1;
+        }
+        if (r > 0 || !check_stop(dbg, status)) {
+            // A watch can fire while stepping off a breakpoint
+            if (dbg->state == DBG_STATE_STOPPED) {
+                break;
+            }
+            return 0;
+        }
+        if (breakpoint_hit(dbg, from) >= 0) {
+            break;
+        }
+    }
+
+    update_regs(dbg);
+    return 0;
+}
+
+// Code outside the executable, read a page at a time while tracing
+typedef struct {
+    unsigned long base;      // 0 = nothing read
+    uint8_t bytes[4096];
+} CodePage;
+
+// Whether the instruction at pc is a syscall (0f 05)
+static int at_syscall(Debugger *dbg, unsigned long pc, CodePage *page) {
+    size_t avail;
+    const uint8_t *code = elf_code_at(&dbg->elf, pc - dbg->load_bias, &avail);
+    if (!code || avail < 2) {
+        unsigned long base = pc & ~(sizeof(page->bytes) - 1);
+        uint8_t scratch[2];
+        if (pc - base > sizeof(page->bytes) - 2) {
+            code = code_bytes(dbg, pc, 2, scratch);
+        } else {
+            if (page->base != base) {
+                page->base = 0;
+                if (read_tracee(dbg, base, page->bytes, sizeof(page->bytes)) != 0) {
+                    return 0;
+                }
+                page->base = base;
+            }
+            code = page->bytes + (pc - base);
+        }
+        if (!code) {
+            return 0;
+        }
+    }
+    return code[0] == 0x0f && code[1] == 0x05;
+}
+
+int dbg_trace_instructions(Debugger *dbg, const char *path, int with_regs) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return -1;
+    }
+    dbg->return_valid = 0;
+    dbg->breakpoint_hit = 0;
+    dbg->watch_hit = 0;
+    dbg->region_hit = 0;
+    dbg->pause_requested = 0;
+    dbg->paused = 0;
+
+    ItrWriter w;
+    if (itr_create(&w, path, dbg->load_bias, with_regs ? ITR_FLAG_REGS : 0) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Cannot create %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    static CodePage page;
+    page.base = 0;
+    long start = monotonic_ms();
+    long last_poll = start;
+    int r = 0;
+    for (unsigned long steps = 1; ; steps++) {
+        struct user_regs_struct regs;
+        if (tc_get_regs(&dbg->mem, &regs) == -1) {
+            r = -1;
+            break;
+        }
+        uint64_t values[ITR_REGS];
+        if (with_regs) {
+            itr_regs(&regs, values);
+        }
+        if (itr_append(&w, regs.rip, values) != 0) {
+            break;
+        }
+
+        // A syscall may block, so it runs to the instruction after it
+        // instead of under a single step, which would hold off signals and
+        // the pause. rt_sigreturn does not come back there.
+        int status;
+        if (regs.rax != SYS_rt_sigreturn && at_syscall(dbg, regs.rip, &page)) {
+            r = run_to_return(dbg, regs.rip + 2, regs.rsp, &status);
+            // It may have mapped or unmapped code
+            page.base = 0;
+        } else {
+            r = step_at(dbg, regs.rip, &status);
+        }
+        if (r != 0) {
+            break;
+        }
+
+        Breakpoint *bp = inserted_breakpoint(dbg, get_pc(dbg));
+        if (bp && breakpoint_stops(dbg, bp) > 0) {
+            break;
+        }
+
+        // Drain output and let the UI pause us now and then
+        if ((steps & 1023) == 0) {
+            long now = monotonic_ms();
+            if (now - last_poll >= DBG_POLL_MS) {
+                last_poll = now;
+                dbg_read_output(dbg);
+                if (dbg->pause_hook && dbg->pause_hook(dbg->pause_ctx)) {
+                    dbg->paused = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    dbg->itrace_count = w.count;
+    dbg->itrace_ms = monotonic_ms() - start;
+    int failed = itr_finish(&w) != 0;
+    struct stat st;
+    dbg->itrace_bytes = stat(path, &st) == 0 ? (unsigned long)st.st_size : 0;
+    snprintf(dbg->itrace_path, sizeof(dbg->itrace_path), "%s", path);
+
+    if (r < 0) {
+        dbg->state = DBG_STATE_ERROR;
+        return -1;
+    }
+    if (dbg->state == DBG_STATE_STOPPED) {
+        update_regs(dbg);
+    }
+    if (failed) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Writing %s failed; the trace is incomplete", path);
+        return -1;
+    }
+    return 0;
+}
+
+int dbg_profile(Debugger *dbg) {
+    if (dbg->state != DBG_STATE_STOPPED) {
+        return -1;
+    }
+    dbg->profile_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (dbg->profile_fd == -1) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message),
+                 "Cannot start the sampling timer: %s", strerror(errno));
+        return -1;
+    }
+    struct itimerspec period = {
+        .it_interval = { 0, 1000000000L / PROF_HZ },
+        .it_value = { 0, 1000000000L / PROF_HZ },
+    };
+    timerfd_settime(dbg->profile_fd, 0, &period, NULL);
+    dbg->sample_pending = 0;
+
+    int r = dbg_continue(dbg);
+
+    close(dbg->profile_fd);
+    dbg->profile_fd = -1;
+    return r;
+}
+
+void dbg_profile_clear(Debugger *dbg) {
+    prof_clear(&dbg->profile);
+}
+
+// One step of the unwind by call frame information: the CFA of the frame
+// at pc and the caller's pc and rbp. Returns 0, 1 at the outermost frame,
+// or -1 where the CFI is missing or uses a register we no longer know.
+static int cfi_step(Debugger *dbg, unsigned long pc, int innermost, unsigned long rsp,
+                    unsigned long *rbp, unsigned long *cfa, unsigned long *ret) {
+    // A return address may be just past the last instruction of a call
+    // to a function that never returns, so look up the call itself
+    const CfiRow *row = cfi_lookup(&dbg->cfi, pc - dbg->load_bias - (innermost ? 0 : 1));
+    if (!row || (row->cfa_reg != CFI_REG_RSP && row->cfa_reg != CFI_REG_RBP)) {
+        return -1;
+    }
+    *cfa = (row->cfa_reg == CFI_REG_RSP ? rsp : *rbp) + row->cfa_offset;
+    if (!row->ra_saved) {
+        return 1;
+    }
+    if (read_tracee(dbg, *cfa + row->ra_offset, ret, sizeof(*ret)) != 0) {
+        return -1;
+    }
+    if (row->rbp_saved && read_tracee(dbg, *cfa + row->rbp_offset, rbp, sizeof(*rbp)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int dbg_backtrace(Debugger *dbg, DbgFrame *frames, int max) {
+    if ((dbg->state != DBG_STATE_STOPPED && !dbg->signal_stopped) || max <= 0) {
+        return 0;
+    }
+    struct user_regs_struct regs;
+    if (tc_get_regs(&dbg->mem, &regs) == -1) {
+        return 0;
+    }
+
+    int n = 0;
+    unsigned long pc = regs.rip;
+    unsigned long rsp = regs.rsp;
+    unsigned long rbp = regs.rbp;
+
+    if (!in_executable(dbg, pc) || !sym_lookup(&dbg->symbols, pc - dbg->load_bias)) {
+        // Library CFI is not loaded; the innermost frame of the program is
+        // the one whose return address is nearest the stack top
+        frames[n++] = (DbgFrame){ pc, regs.rsp, 0, NULL, NULL };
+        pc = 0;
+        for (unsigned long sp = regs.rsp; sp < regs.rsp + 4096; sp += 8) {
+            unsigned long word;
+            if (read_tracee(dbg, sp, (uint8_t *)&word, sizeof(word)) != 0) {
+                break;
+            }
+            if (in_executable(dbg, word) && has_line_info(dbg, word) && is_return_site(dbg, word)) {
+                pc = word;
+                rsp = sp + 8;
+                break;
+            }
+        }
+        // rbp is callee-saved, so it still holds that function's frame
+    }
+
+    unsigned long prev_cfa = 0;
+    while (pc && n < max) {
+        const FuncSymbol *fs = sym_lookup(&dbg->symbols, pc - dbg->load_bias);
+        if (!fs || !in_executable(dbg, pc)) {
+            break;
+        }
+
+        unsigned long cfa, ret = 0;
+        int r = cfi_step(dbg, pc, n == 0, rsp, &rbp, &cfa, &ret);
+        if (r < 0) {
+            // No usable CFI: follow the frame pointer chain. The return
+            // address sits below the CFA; past the prologue the caller's
+            // rbp was pushed just under it.
+            cfa = n == 0 ? frame_cfa(dbg, &regs) : rbp + 16;
+            if (read_tracee(dbg, cfa - 8, (uint8_t *)&ret, sizeof(ret)) != 0) {
+                ret = 0;
+            } else if (rbp + 16 == cfa && read_tracee(dbg, rbp, (uint8_t *)&rbp, sizeof(rbp)) != 0) {
+                ret = 0;
+            }
+        }
+        if (cfa <= prev_cfa) {
+            break;           // Not moving up the stack: a bad rule or garbage
+        }
+
+        const LineEntry *e = lt_lookup(&dbg->lines, pc - dbg->load_bias);
+        if (e && e->file == LT_NO_FILE) {
+            e = NULL;
+        }
+        frames[n++] = (DbgFrame){ pc, cfa, e ? (int)e->line : 0, sym_name(&dbg->symbols, fs),
+                                  e ? lt_file_name(&dbg->lines, e->file) : NULL };
+        pc = ret;
+        rsp = cfa;
+        prev_cfa = cfa;
+    }
+    return n;
+}
+
 int update_regs(Debugger *dbg) {
     if (dbg->child_pid <= 0) {
         return -1;
     }
 
     struct user_regs_struct regs;
-    if (ptrace(PTRACE_GETREGS, dbg->child_pid, NULL, &regs) == -1) {
+    if (tc_get_regs(&dbg->mem, &regs) == -1) {
         return -1;
     }
 
@@ -351,35 +3007,25 @@ int update_regs(Debugger *dbg) {
 }
 
 void dbg_get_current_line(Debugger *dbg) {
-    if (dbg->child_pid <= 0 || !dbg->addr2line_in || !dbg->addr2line_out) {
-        return;
-    }
-
-    fprintf(dbg->addr2line_in, "0x%llx\n", (unsigned long long)dbg->current_rip);
-
-    char func_line[256];
-    char result[1024];
-
-    if (!fgets(func_line, sizeof(func_line), dbg->addr2line_out)) {
+    if (dbg->child_pid <= 0) {
         return;
     }
 
-    if (!fgets(result, sizeof(result), dbg->addr2line_out)) {
-        return;
+    const LineEntry *e = lt_lookup(&dbg->lines, dbg->current_rip - dbg->load_bias);
+    if (e && e->line > 0 && e->file != LT_NO_FILE) {
+        dbg->current_line = e->line;
     }
+    const FuncSymbol *fs = sym_lookup(&dbg->symbols, dbg->current_rip - dbg->load_bias);
+    dbg->current_function = fs && in_executable(dbg, dbg->current_rip) ? sym_name(&dbg->symbols, fs) : NULL;
+}
 
-    result[strcspn(result, "\n")] = 0;
-
-    char *colon = strchr(result, ':');
-    if (colon) {
-        *colon = 0;
-        if (strcmp(result, "??") != 0) {
-            int new_line = atoi(colon + 1);
-            if (new_line > 0) {
-                dbg->current_line = new_line;
-            }
-        }
+int dbg_disassemble(Debugger *dbg) {
+    dbg->current_disasm = NULL;
+    if (dbg->child_pid <= 0 || !in_executable(dbg, dbg->current_rip)) {
+        return -1;
     }
+    dbg->current_disasm = dis_function(&dbg->disasm, dbg->current_rip - dbg->load_bias);
+    return dbg->current_disasm ? 0 : -1;
 }
 
 void dbg_read_output(Debugger *dbg) {
@@ -391,16 +3037,20 @@ void dbg_read_output(Debugger *dbg) {
     ssize_t n;
 
     while ((n = read(dbg->stdout_pipe[0], temp_buf, sizeof(temp_buf) - 1)) > 0) {
+        // Keep the newest output: drop the oldest half once the buffer is
+        // full, so the pipe keeps draining and the program never blocks
         int remaining = sizeof(dbg->output_buffer) - dbg->output_length - 1;
         if (n > remaining) {
-            n = remaining;
-        }
-        if (n > 0) {
-            memcpy(dbg->output_buffer + dbg->output_length, temp_buf, n);
-            dbg->output_length += n;
-            dbg->output_buffer[dbg->output_length] = '\0';
+            int keep = dbg->output_length / 2;
+            char *cut = memchr(dbg->output_buffer + dbg->output_length - keep, '\n', keep);
+            keep = cut ? (int)(dbg->output_buffer + dbg->output_length - cut - 1) : 0;
+            memmove(dbg->output_buffer, dbg->output_buffer + dbg->output_length - keep, keep);
+            dbg->output_length = keep;
         }
-        if (remaining <= 0) break;
+        memcpy(dbg->output_buffer + dbg->output_length, temp_buf, n);
+        dbg->output_length += n;
+        dbg->output_total += n;
+        dbg->output_buffer[dbg->output_length] = '\0';
     }
 }
 
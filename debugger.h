@@ -4,6 +4,122 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "elf_file.h"
+#include "line_table.h"
+#include "symbols.h"
+#include "index_cache.h"
+#include "proc_maps.h"
+#include "breakpoints.h"
+#include "trace_buffer.h"
+#include "tracee_cache.h"
+#include "variables.h"
+#include "cfi.h"
+#include "disasm.h"
+#include "snapshot.h"
+#include "profile.h"
+
+#define DBG_MAX_SKIP 32
+
+// Step into never stops inside a skipped function or object
+typedef struct {
+    int is_object;       // Match the source file or mapped object path
+    char pattern[128];   // Function name, or substring of the path
+} SkipEntry;
+
+#define DBG_MAX_WATCH 4   // One per debug address register, DR0-DR3
+
+typedef enum {
+    DBG_WATCH_WRITE,
+    DBG_WATCH_ACCESS     // Reads as well as writes
+} WatchKind;
+
+// Hardware watchpoint held in a debug register
+typedef struct {
+    int active;
+    WatchKind kind;
+    unsigned long addr;  // Runtime address, aligned to size
+    int size;            // 1, 2, 4 or 8
+    uint64_t value;      // Contents when last checked
+    unsigned long hits;
+    char text[128];      // Expression as entered
+} Watchpoint;
+
+#define DBG_MAX_REGIONS 8
+#define DBG_REGION_PARTS 8
+
+// Pages of a watched range that lie in one mapping
+typedef struct {
+    unsigned long lo;
+    unsigned long hi;
+    int prot;                 // Protection of the mapping before the watch
+} RegionPart;
+
+// Range watched by write-protecting the pages that cover it
+typedef struct {
+    int active;
+    unsigned long addr;
+    unsigned long size;
+    unsigned long page_lo;    // Page-aligned cover of [addr, addr + size)
+    unsigned long page_hi;
+    RegionPart parts[DBG_REGION_PARTS];  // One per mapping, in address order
+    int part_count;
+    unsigned long hits;
+    char text[128];
+} RegionWatch;
+
+#define DBG_RECORD_BYTES (32UL << 20)  // Undo records kept for stepping back
+#define DBG_RECORD_PAGES 65536          // Writable memory recording can mirror
+
+#define DBG_MAX_CHECKPOINTS 8
+
+// Copy of the program forked at a stop. It waits in a ptrace stop for as
+// long as the session lasts; each restart from it forks it once more.
+typedef struct {
+    pid_t pid;
+    int output_fd;               // Read end of the pipe its output goes to
+    struct user_regs_struct regs;    // At the stop, before the fork
+    uint8_t code[2];             // Under the syscall instruction at regs.rip & ~7
+    unsigned long load_bias;
+    int line;
+    int instruction_count;
+    char output[4096];           // Program output shown at the stop
+    int output_length;
+} Checkpoint;
+
+#define DBG_POLL_MS 100  // Pause hook period while the program runs
+
+// One call stack entry, innermost first
+typedef struct {
+    unsigned long pc;
+    unsigned long cfa;
+    int line;                // 0 without line info
+    const char *function;    // NULL outside the program's symbols
+    const char *file;        // Source file of line, NULL without line info
+} DbgFrame;
+
+#define DBG_MAX_LOCALS  32
+#define DBG_LOCAL_BYTES 256    // Bytes of each value fetched for display
+
+// Parameter or local variable in scope at the current stop
+typedef struct {
+    const char *name;        // Points into the ELF mapping
+    int is_param;
+    char value[120];         // Formatted by type, "??" if unreadable
+} DbgLocal;
+
+#define DBG_MAX_EXPRS   256
+#define DBG_EXPR_PAGES  8      // Pages an evaluation may read and still be reused
+
+// Expression shown at every stop, such as "p->next->val"
+typedef struct {
+    char text[128];
+    char value[120];         // Formatted result, or why there is none
+    int changed;             // Value differs from the one at the previous stop
+    int valid;               // value comes from a stop of this run
+    uint64_t binding;        // var_binding() when value was computed
+    unsigned long pages[DBG_EXPR_PAGES];   // Tracee pages the evaluation read
+    int page_count;          // -1 if it read more than DBG_EXPR_PAGES
+} WatchExpr;
 
 typedef enum {
     DBG_STATE_NOT_STARTED,
@@ -20,10 +136,16 @@ typedef struct {
     char source_path[1024];
 
     // Current execution state
+    unsigned long load_bias;   // Runtime address minus link-time address
     unsigned long current_rip;
     int current_line;
+    const char *current_function;  // Symbol containing current_rip, NULL outside the program
     int instruction_count;
 
+    // Value in rax after the last finish
+    unsigned long return_value;
+    int return_valid;
+
     // Registers (current)
     struct {
         unsigned long rax, rbx, rcx, rdx;
@@ -35,15 +157,104 @@ typedef struct {
     int stdout_pipe[2];
     char output_buffer[4096];
     int output_length;
+    unsigned long output_total;  // Bytes ever read, so readers can tell what is new
+
+    // Debug info decoded once at load time (or mapped from the index cache)
+    ElfFile elf;
+    LineTable lines;
+    SymbolTable symbols;
+    IndexCache index;
+    VarTable vars;             // Variables and types, decoded per function on first stop
+    CfiTable cfi;              // Unwind rules, compiled per function on first unwind
+    DisasmCache disasm;        // Instructions, decoded per function on first stop in it
+
+    // Memory and registers of the stopped tracee, dropped on every resume
+    TraceeCache mem;
+
+    // Address space layout, read when the program reaches main
+    MapsTable maps;
+    unsigned long maps_gen;    // mem.gen when maps was last read
+    char exe_realpath[1024];
+
+    // Function containing current_rip as disassembled, NULL outside the program
+    const DisasmFunc *current_disasm;
+
+    // Locals of the function at this stop, read at most once per stop
+    DbgLocal locals[DBG_MAX_LOCALS];
+    int local_count;
+    unsigned long locals_gen;  // mem.gen when locals were read
+
+    // Watch expressions, kept across restarts. A value is evaluated again
+    // only if a page it read has its soft-dirty bit set or a name in it
+    // now means something else.
+    WatchExpr exprs[DBG_MAX_EXPRS];
+    int expr_count;
+    unsigned long exprs_gen;       // mem.gen when exprs were refreshed
+    int exprs_tracked;             // Soft-dirty bits were cleared at that stop
+    int exprs_evaluated;           // Evaluated at this stop, reused values excluded
+
+    SkipEntry skip_list[DBG_MAX_SKIP];
+    int skip_count;
 
-    // Persistent addr2line process for fast address lookup
-    FILE *addr2line_in;   // Write addresses here
-    FILE *addr2line_out;  // Read results from here
-    pid_t addr2line_pid;
+    // User breakpoints, kept inserted while the tracee is stopped
+    BreakpointMap breakpoints;
+    int breakpoint_hit;        // Last stop was a user breakpoint
+    int breakpoint_line;
+
+    // Samples recorded by tracepoints during this run
+    TraceBuffer trace;
+
+    // Hardware watchpoints, dropped when the program restarts
+    Watchpoint watches[DBG_MAX_WATCH];
+    int watch_hit;             // 1 + slot of the watch behind the last stop, or 0
+    uint64_t watch_old;        // Contents before and after that access
+    uint64_t watch_new;
+
+    // Page-protection watches over arrays and structs, dropped on restart
+    RegionWatch regions[DBG_MAX_REGIONS];
+    int region_hit;              // 1 + index of the region written at the last stop, or 0
+    int region_pending;          // Write seen, stop not classified yet
+    unsigned long region_addr;   // Address written, and the instruction that wrote it
+    unsigned long region_pc;
+    int region_line;             // 0 if the writer has no line info
+    unsigned long region_faults; // Protection faults taken, unrelated writes included
+
+    // Record mode, kept across restarts: an undo record at every stop
+    SnapshotRing snapshots;
+    int recording;
+    int record_based;              // Shadow holds this run's memory
+    int record_tracked;            // Soft-dirty bits were cleared at the newest stop
+    unsigned long record_gen;      // mem.gen of the newest recorded stop
+    struct user_regs_struct record_regs;   // Registers at that stop
+
+    // Checkpoints, kept across restarts until the session ends
+    Checkpoint checkpoints[DBG_MAX_CHECKPOINTS];
+    int checkpoint_count;
+
+    // Samples of profiled runs, kept across restarts until cleared
+    Profile profile;
+    int profile_fd;            // timerfd ticking at PROF_HZ during a profiled run, else -1
+    int sample_pending;        // Interrupted for a sample, stop not seen yet
+
+    // Last instruction trace written, for the status and the replay view
+    char itrace_path[1024];
+    unsigned long itrace_count;
+    unsigned long itrace_bytes;
+    long itrace_ms;
+
+    // While the program runs freely, called whenever input_fd is readable
+    // and every DBG_POLL_MS. A non-zero return interrupts the program.
+    int (*pause_hook)(void *ctx);
+    void *pause_ctx;
+    int input_fd;
+    int pause_requested;
+    int paused;                // Last stop came from the pause hook
 
     // Error information
     char error_message[256];
     int error_signal;
+    int signal_stopped;        // ERROR from a signal stop: the tracee is still there
+                               // with its registers and memory, e.g. after a crash
 
 } Debugger;
 
@@ -54,11 +265,147 @@ int dbg_start(Debugger *dbg);
 int dbg_stop(Debugger *dbg);
 
 // Step execution - steps until source line changes
-int dbg_step_line(Debugger *dbg);
+int dbg_step_line(Debugger *dbg);   // Enters called functions that have line info
+int dbg_next_line(Debugger *dbg);   // Runs calls to completion in this frame
+
+// Execute exactly one machine instruction, entering calls
+int dbg_step_instruction(Debugger *dbg);
+
+// Run until the current function returns to its caller
+int dbg_finish(Debugger *dbg);
+
+// Toggle the breakpoint on a source line of the program, moving forward to
+// the next line with code. Returns the line set, 0 if one was removed, or
+// -1 if no code follows.
+int dbg_toggle_breakpoint(Debugger *dbg, int line);
+
+// Toggle the breakpoint on the first line of a function's body, past its
+// prologue, found by name in the symbol table. Returns as above, -1 if
+// there is no such function in the source.
+int dbg_break_function(Debugger *dbg, const char *name);
+
+// Set a breakpoint on line (or the next line with code) that only stops
+// when condition is non-zero, e.g. "*(int *)($rbp - 20) == 9999". An empty
+// condition makes it unconditional. Returns the line set or -1.
+int dbg_set_condition(Debugger *dbg, int line, const char *condition);
+
+// Turn the breakpoint on line into a tracepoint that records the
+// comma-separated expressions (up to TRACE_MAX_VALUES) and keeps running.
+// An empty list makes it a stopping breakpoint again. Returns the line
+// set or -1.
+int dbg_set_tracepoint(Debugger *dbg, int line, const char *exprs);
+
+// Watch the memory an expression reads, e.g. "*(int *)($rbp - 4)"; the
+// cast gives the width. The program runs at native speed and stops after
+// an instruction that changes the value (or, with access set, touches it
+// at all). Needs a running program. Returns the slot used or -1.
+int dbg_watch(Debugger *dbg, const char *expr, int access);
+int dbg_unwatch(Debugger *dbg, int slot);
+
+// Watch a whole range given as "address, size", e.g. "$rbp - 4016, 4000".
+// The pages covering it are made read-only in the tracee; each write into
+// the range stops the program after the writing instruction, and writes
+// elsewhere on those pages cost one fault. Returns the index or -1.
+int dbg_watch_region(Debugger *dbg, const char *spec);
+int dbg_unwatch_region(Debugger *dbg, int index);
+
+// Tracee memory through the per-stop cache, one system call per transfer
+// however long. Returns the bytes moved, which stop short at an unmapped
+// page, or -1. Only while the program is stopped.
+ssize_t dbg_read_memory(Debugger *dbg, unsigned long addr, void *buf, size_t len);
+ssize_t dbg_write_memory(Debugger *dbg, unsigned long addr, const void *buf, size_t len);
+
+// Address space at this stop, read from /proc/pid/maps at most once per stop
+const MapsTable *dbg_maps(Debugger *dbg);
+
+// Value of an expression such as "$rbp - 16" at this stop. Returns 0, or
+// -1 with error_message set.
+int dbg_evaluate(Debugger *dbg, const char *text, int64_t *value);
+
+// Parameters and locals in scope at this stop, formatted by their DWARF
+// types into locals. The frame slots of all of them come in with one read,
+// whatever their number. Returns local_count.
+int dbg_locals(Debugger *dbg);
+
+// Keep an expression over variables, e.g. "p->next->val" or "arr[i]", and
+// show its value at every stop. Returns its index or -1.
+int dbg_watch_expr(Debugger *dbg, const char *text);
+int dbg_unwatch_expr(Debugger *dbg, int index);   // -1 removes all
+
+// Bring the watch expressions up to date with this stop, at most once per
+// stop. Only values whose memory was written since the last refresh are
+// evaluated again. Returns the number evaluated.
+int dbg_refresh_exprs(Debugger *dbg);
+
+// Record mode. Turning it on copies the program's writable memory once;
+// from then on every stop keeps the registers and the old contents of the
+// bytes written since the previous stop, dropping the oldest records past
+// DBG_RECORD_BYTES. Returns 0 or -1.
+int dbg_record(Debugger *dbg, int on);
+
+// Keep the undo record for this stop. Pages are compared only where the
+// kernel's soft-dirty bit says they were written, so the cost follows what
+// the program changed. Called after every command; at most once per stop.
+int dbg_record_stop(Debugger *dbg);
+
+// Put the program's registers and memory back as they were at the previous
+// recorded stop, also after a crash. Files, output and mappings the
+// program changed are not undone. Returns 0, or -1 with error_message set.
+int dbg_step_back(Debugger *dbg);
+
+// Fork the stopped program into a checkpoint: a frozen copy that a
+// restart can carry on from without running the program again. Past
+// DBG_MAX_CHECKPOINTS the oldest is dropped. Returns its index or -1.
+int dbg_checkpoint(Debugger *dbg);
+
+// Kill the program and carry on from a fresh fork of checkpoint index (-1
+// for the newest), with the registers, memory and output it had then. The
+// checkpoint stays for later restarts. Breakpoints stay too; watches are
+// dropped as on a restart. Returns 0, or -1 with error_message set.
+int dbg_restore_checkpoint(Debugger *dbg, int index);
+
+// Run at full speed until a breakpoint, a watchpoint, a signal or exit
+int dbg_continue(Debugger *dbg);
+
+// Continue with sampling: PROF_HZ times a second the program is
+// interrupted, its pc read and counted against its line and function in
+// profile, then resumed. Samples add up over profiled runs.
+int dbg_profile(Debugger *dbg);
+
+// Forget the samples
+void dbg_profile_clear(Debugger *dbg);
+
+// Single-step the program until a breakpoint, a watchpoint, a signal,
+// exit or a pause, writing the address of every instruction executed (and
+// with with_regs the registers each one changed) to a trace file at path;
+// see insn_trace.h. Syscalls run at full speed to the instruction after
+// them, so one that blocks does not hold up a pause. Returns 0, or -1 with
+// error_message set.
+int dbg_trace_instructions(Debugger *dbg, const char *path, int with_regs);
+
+// Let the UI pause a running program: hook is polled while the program
+// runs (see pause_hook) and input_fd, e.g. the terminal, wakes it early
+void dbg_set_pause_hook(Debugger *dbg, int input_fd, int (*hook)(void *ctx), void *ctx);
+
+// Call stack at the current stop, or at the signal that stopped the
+// program, innermost first. Frames are unwound with the executable's
+// .eh_frame rules, falling back to the frame pointer chain where there are
+// none. Returns the number of frames stored.
+int dbg_backtrace(Debugger *dbg, DbgFrame *frames, int max);
+
+// Disassemble the function at this stop into current_disasm. Each function
+// is decoded from the executable once; stops in it later only look it up.
+// Returns 0, or -1 if the pc is outside the program's functions.
+int dbg_disassemble(Debugger *dbg);
+
+// Skip list: "function NAME" or "object PATTERN", one entry per line.
+// Loading a missing file is not an error.
+int dbg_skip_add(Debugger *dbg, const char *spec);
+int dbg_skip_load(Debugger *dbg, const char *path);
 
 // Information retrieval
 int update_regs(Debugger *dbg);
-void dbg_get_current_line(Debugger *dbg);  // Use addr2line
+void dbg_get_current_line(Debugger *dbg);  // Binary searches in the line and symbol tables
 void dbg_read_output(Debugger *dbg);
 const char* dbg_state_string(DebuggerState state);
 
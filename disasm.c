@@ -0,0 +1,198 @@
+#include "disasm.h"
+#include "x86_decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIS_MAX_FUNC_BYTES (1 << 20)   // Longest function decoded
+
+void dis_init(DisasmCache *dc) {
+    memset(dc, 0, sizeof(*dc));
+    dc->file = -1;
+}
+
+void dis_free(DisasmCache *dc) {
+    free(dc->funcs);
+    free(dc->insns);
+    free(dc->strings);
+    dis_init(dc);
+}
+
+void dis_load(DisasmCache *dc, const ElfFile *ef, const SymbolTable *st,
+              const LineTable *lt, int file) {
+    dis_free(dc);
+    dc->elf = ef;
+    dc->symbols = st;
+    dc->lines = lt;
+    dc->file = file;
+}
+
+static int add_string(DisasmCache *dc, const char *s, uint32_t *offset) {
+    size_t len = strlen(s) + 1;
+    if (dc->strings_size + len > dc->strings_capacity) {
+        size_t cap = dc->strings_capacity ? dc->strings_capacity * 2 : 16384;
+        while (cap < dc->strings_size + len) {
+            cap *= 2;
+        }
+        char *strings = realloc(dc->strings, cap);
+        if (!strings) {
+            return -1;
+        }
+        dc->strings = strings;
+        dc->strings_capacity = cap;
+    }
+    memcpy(dc->strings + dc->strings_size, s, len);
+    *offset = (uint32_t)dc->strings_size;
+    dc->strings_size += len;
+    return 0;
+}
+
+static DisasmInsn *add_insn(DisasmCache *dc) {
+    if (dc->insn_count == dc->insn_capacity) {
+        int cap = dc->insn_capacity ? dc->insn_capacity * 2 : 1024;
+        DisasmInsn *insns = realloc(dc->insns, cap * sizeof(DisasmInsn));
+        if (!insns) {
+            return NULL;
+        }
+        dc->insns = insns;
+        dc->insn_capacity = cap;
+    }
+    return &dc->insns[dc->insn_count++];
+}
+
+// Binary search for the first function with hi > pc
+static int func_slot(const DisasmCache *dc, uint64_t pc) {
+    int lo = 0, hi = dc->func_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (dc->funcs[mid].hi <= pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Text for one instruction, with the symbol a direct branch or call reaches
+static void format_insn(DisasmCache *dc, const X86Insn *insn, char *out, size_t size) {
+    int len = x86_format(insn, out, size);
+    if (insn->flow != X86_FLOW_JMP && insn->flow != X86_FLOW_JCC && insn->flow != X86_FLOW_CALL) {
+        return;
+    }
+    const FuncSymbol *fs = sym_lookup(dc->symbols, insn->target);
+    if (!fs || len >= (int)size) {
+        return;
+    }
+    const char *name = sym_name(dc->symbols, fs);
+    if (insn->target == fs->addr) {
+        snprintf(out + len, size - len, " <%s>", name);
+    } else {
+        snprintf(out + len, size - len, " <%s+0x%llx>", name,
+                 (unsigned long long)(insn->target - fs->addr));
+    }
+}
+
+// Decode [lo, hi) into consecutive insns. Bytes that are not an instruction
+// become one-byte "(bad)" entries, so decoding resynchronises.
+static int decode_range(DisasmCache *dc, const unsigned char *code, uint64_t lo, uint64_t hi) {
+    uint64_t addr = lo;
+    while (addr < hi) {
+        X86Insn insn;
+        char text[160];
+        int n = x86_decode(code + (addr - lo), hi - addr, addr, &insn);
+        if (n <= 0) {
+            n = 1;
+            snprintf(text, sizeof(text), "(bad)");
+        } else {
+            format_insn(dc, &insn, text, sizeof(text));
+        }
+
+        DisasmInsn *di = add_insn(dc);
+        if (!di || add_string(dc, text, &di->text) != 0) {
+            return -1;
+        }
+        const LineEntry *e = lt_lookup(dc->lines, addr);
+        di->addr = addr;
+        di->length = n;
+        di->line = e && dc->file >= 0 && e->file == dc->file ? e->line : 0;
+        addr += n;
+    }
+    return 0;
+}
+
+const DisasmFunc *dis_function(DisasmCache *dc, uint64_t pc) {
+    int slot = func_slot(dc, pc);
+    if (slot < dc->func_count && dc->funcs[slot].lo <= pc) {
+        return &dc->funcs[slot];
+    }
+    if (!dc->elf || !dc->symbols) {
+        return NULL;
+    }
+
+    const FuncSymbol *fs = sym_lookup(dc->symbols, pc);
+    if (!fs) {
+        return NULL;
+    }
+    size_t avail;
+    const unsigned char *code = elf_code_at(dc->elf, fs->addr, &avail);
+    if (!code) {
+        return NULL;
+    }
+    // A symbol without a size runs to the next one
+    uint64_t size = fs->size;
+    const FuncSymbol *end = dc->symbols->funcs + dc->symbols->count;
+    if (size == 0) {
+        size = fs + 1 < end ? fs[1].addr - fs->addr : avail;
+    }
+    if (size > avail) {
+        size = avail;
+    }
+    if (size == 0 || size > DIS_MAX_FUNC_BYTES || pc >= fs->addr + size) {
+        return NULL;
+    }
+
+    if (dc->func_count == dc->func_capacity) {
+        int cap = dc->func_capacity ? dc->func_capacity * 2 : 32;
+        DisasmFunc *funcs = realloc(dc->funcs, cap * sizeof(DisasmFunc));
+        if (!funcs) {
+            return NULL;
+        }
+        dc->funcs = funcs;
+        dc->func_capacity = cap;
+    }
+
+    int first = dc->insn_count;
+    if (decode_range(dc, code, fs->addr, fs->addr + size) != 0) {
+        dc->insn_count = first;
+        return NULL;
+    }
+
+    slot = func_slot(dc, fs->addr);
+    memmove(&dc->funcs[slot + 1], &dc->funcs[slot], (dc->func_count - slot) * sizeof(DisasmFunc));
+    DisasmFunc *df = &dc->funcs[slot];
+    df->lo = fs->addr;
+    df->hi = fs->addr + size;
+    df->name = sym_name(dc->symbols, fs);
+    df->first = first;
+    df->count = dc->insn_count - first;
+    dc->func_count++;
+    return df;
+}
+
+int dis_find(const DisasmCache *dc, const DisasmFunc *df, uint64_t pc) {
+    int lo = df->first, hi = df->first + df->count;
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        if (dc->insns[mid].addr <= pc) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+const char *dis_text(const DisasmCache *dc, const DisasmInsn *insn) {
+    return dc->strings + insn->text;
+}
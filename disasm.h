@@ -0,0 +1,63 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "elf_file.h"
+#include "symbols.h"
+#include "line_table.h"
+
+typedef struct {
+    uint64_t addr;           // Link-time
+    uint32_t text;           // Offset into strings, e.g. "call   401136 <add>"
+    uint32_t line;           // Line in the source file, 0 for other files
+    int length;
+} DisasmInsn;
+
+// Function decoded the first time a stop lands in it. Its instructions are
+// the consecutive entries [first, first + count) of insns.
+typedef struct {
+    uint64_t lo, hi;         // Link-time pc range [lo, hi)
+    const char *name;
+    int first;
+    int count;
+} DisasmFunc;
+
+// Disassembly of the program's own code, read from the ELF mapping rather
+// than the tracee, so it costs no system calls and survives restarts.
+// Breakpoints never show up as int3 in it.
+typedef struct {
+    const ElfFile *elf;
+    const SymbolTable *symbols;
+    const LineTable *lines;
+    int file;                // Line table index of the source file, -1 if none
+
+    DisasmFunc *funcs;       // Sorted by lo
+    int func_count;
+    int func_capacity;
+    DisasmInsn *insns;
+    int insn_count;
+    int insn_capacity;
+    char *strings;
+    size_t strings_size;
+    size_t strings_capacity;
+} DisasmCache;
+
+void dis_init(DisasmCache *dc);
+void dis_free(DisasmCache *dc);
+
+// Decode from ef, which must stay mapped, naming branch targets from st and
+// marking lines of file (a line table index) from lt
+void dis_load(DisasmCache *dc, const ElfFile *ef, const SymbolTable *st,
+              const LineTable *lt, int file);
+
+// Function containing link-time pc, decoded on first use, or NULL if pc is
+// outside every function symbol
+const DisasmFunc *dis_function(DisasmCache *dc, uint64_t pc);
+
+// Index within insns of the instruction at or just before link-time pc
+int dis_find(const DisasmCache *dc, const DisasmFunc *df, uint64_t pc);
+
+const char *dis_text(const DisasmCache *dc, const DisasmInsn *insn);
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef DWARF_READER_H
+#define DWARF_READER_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Attribute forms, DWARF 2 through 5
+#define DW_FORM_addr           0x01
+#define DW_FORM_block2         0x03
+#define DW_FORM_block4         0x04
+#define DW_FORM_data2          0x05
+#define DW_FORM_data4          0x06
+#define DW_FORM_data8          0x07
+#define DW_FORM_string         0x08
+#define DW_FORM_block          0x09
+#define DW_FORM_block1         0x0a
+#define DW_FORM_data1          0x0b
+#define DW_FORM_flag           0x0c
+#define DW_FORM_sdata          0x0d
+#define DW_FORM_strp           0x0e
+#define DW_FORM_udata          0x0f
+#define DW_FORM_ref_addr       0x10
+#define DW_FORM_ref1           0x11
+#define DW_FORM_ref2           0x12
+#define DW_FORM_ref4           0x13
+#define DW_FORM_ref8           0x14
+#define DW_FORM_ref_udata      0x15
+#define DW_FORM_indirect       0x16
+#define DW_FORM_sec_offset     0x17
+#define DW_FORM_exprloc        0x18
+#define DW_FORM_flag_present   0x19
+#define DW_FORM_strx           0x1a
+#define DW_FORM_addrx          0x1b
+#define DW_FORM_ref_sup4       0x1c
+#define DW_FORM_strp_sup       0x1d
+#define DW_FORM_data16         0x1e
+#define DW_FORM_line_strp      0x1f
+#define DW_FORM_ref_sig8       0x20
+#define DW_FORM_implicit_const 0x21
+#define DW_FORM_loclistx       0x22
+#define DW_FORM_rnglistx       0x23
+#define DW_FORM_ref_sup8       0x24
+#define DW_FORM_strx1          0x25
+#define DW_FORM_strx2          0x26
+#define DW_FORM_strx3          0x27
+#define DW_FORM_strx4          0x28
+#define DW_FORM_addrx1         0x29
+#define DW_FORM_addrx2         0x2a
+#define DW_FORM_addrx3         0x2b
+#define DW_FORM_addrx4         0x2c
+
+// Bounds-checked cursor over a DWARF section. Reads past the end return 0
+// and set the error flag instead of faulting.
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    int error;
+} DwarfCursor;
+
+static inline void dw_init(DwarfCursor *c, const unsigned char *p, size_t size) {
+    c->p = p;
+    c->end = p + size;
+    c->error = (p == NULL);
+}
+
+static inline int dw_left(const DwarfCursor *c) {
+    return c->error ? 0 : (int)(c->end - c->p);
+}
+
+static inline int dw_need(DwarfCursor *c, size_t n) {
+    if (c->error || (size_t)(c->end - c->p) < n) {
+        c->error = 1;
+        c->p = c->end;
+        return 0;
+    }
+    return 1;
+}
+
+static inline void dw_skip(DwarfCursor *c, size_t n) {
+    if (dw_need(c, n)) c->p += n;
+}
+
+static inline uint8_t dw_u8(DwarfCursor *c) {
+    if (!dw_need(c, 1)) return 0;
+    return *c->p++;
+}
+
+static inline uint16_t dw_u16(DwarfCursor *c) {
+    uint16_t v = 0;
+    if (!dw_need(c, 2)) return 0;
+    memcpy(&v, c->p, 2);
+    c->p += 2;
+    return v;
+}
+
+static inline uint32_t dw_u32(DwarfCursor *c) {
+    uint32_t v = 0;
+    if (!dw_need(c, 4)) return 0;
+    memcpy(&v, c->p, 4);
+    c->p += 4;
+    return v;
+}
+
+static inline uint64_t dw_u64(DwarfCursor *c) {
+    uint64_t v = 0;
+    if (!dw_need(c, 8)) return 0;
+    memcpy(&v, c->p, 8);
+    c->p += 8;
+    return v;
+}
+
+static inline uint64_t dw_uleb(DwarfCursor *c) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (dw_need(c, 1)) {
+        uint8_t b = *c->p++;
+        if (shift < 64) v |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80)) break;
+    }
+    return v;
+}
+
+static inline int64_t dw_sleb(DwarfCursor *c) {
+    int64_t v = 0;
+    int shift = 0;
+    uint8_t b = 0;
+    while (dw_need(c, 1)) {
+        b = *c->p++;
+        if (shift < 64) v |= (int64_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80)) break;
+    }
+    if (shift < 64 && (b & 0x40)) v |= -((int64_t)1 << shift);
+    return v;
+}
+
+static inline const char *dw_str(DwarfCursor *c) {
+    const char *s = (const char *)c->p;
+    while (dw_need(c, 1)) {
+        if (*c->p++ == 0) return s;
+    }
+    return "";
+}
+
+// Initial length field; sets *is64 for the 64-bit DWARF format
+static inline uint64_t dw_unit_length(DwarfCursor *c, int *is64) {
+    uint64_t len = dw_u32(c);
+    *is64 = 0;
+    if (len == 0xffffffff) {
+        len = dw_u64(c);
+        *is64 = 1;
+    }
+    return len;
+}
+
+static inline uint64_t dw_offset(DwarfCursor *c, int is64) {
+    return is64 ? dw_u64(c) : dw_u32(c);
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "elf_file.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int elf_open(ElfFile *ef, const char *path) {
+    memset(ef, 0, sizeof(ElfFile));
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(Elf64_Ehdr)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    ef->map = map;
+    ef->size = st.st_size;
+    ef->ehdr = (const Elf64_Ehdr *)ef->map;
+
+    if (memcmp(ef->ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ef->ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ef->ehdr->e_shoff == 0 ||
+        ef->ehdr->e_shoff + (size_t)ef->ehdr->e_shnum * sizeof(Elf64_Shdr) > ef->size) {
+        elf_close(ef);
+        return -1;
+    }
+
+    ef->shdrs = (const Elf64_Shdr *)(ef->map + ef->ehdr->e_shoff);
+    ef->shnum = ef->ehdr->e_shnum;
+
+    if (ef->ehdr->e_shstrndx < ef->shnum) {
+        const Elf64_Shdr *sh = &ef->shdrs[ef->ehdr->e_shstrndx];
+        if (sh->sh_offset + sh->sh_size <= ef->size) {
+            ef->shstrtab = (const char *)(ef->map + sh->sh_offset);
+        }
+    }
+
+    return 0;
+}
+
+void elf_close(ElfFile *ef) {
+    if (ef->map) {
+        munmap(ef->map, ef->size);
+    }
+    memset(ef, 0, sizeof(ElfFile));
+}
+
+const Elf64_Shdr *elf_section_header(const ElfFile *ef, const char *name) {
+    if (!ef->map || !ef->shstrtab) {
+        return NULL;
+    }
+
+    for (int i = 0; i < ef->shnum; i++) {
+        if (strcmp(ef->shstrtab + ef->shdrs[i].sh_name, name) == 0) {
+            return &ef->shdrs[i];
+        }
+    }
+    return NULL;
+}
+
+const unsigned char *elf_section(const ElfFile *ef, const char *name, size_t *size) {
+    const Elf64_Shdr *sh = elf_section_header(ef, name);
+    *size = 0;
+
+    if (!sh || sh->sh_type == SHT_NOBITS ||
+        sh->sh_offset + sh->sh_size > ef->size) {
+        return NULL;
+    }
+
+    *size = sh->sh_size;
+    return ef->map + sh->sh_offset;
+}
+
+const unsigned char *elf_code_at(const ElfFile *ef, uint64_t vaddr, size_t *avail) {
+    *avail = 0;
+    if (!ef->map || ef->ehdr->e_phoff == 0 ||
+        ef->ehdr->e_phoff + (size_t)ef->ehdr->e_phnum * sizeof(Elf64_Phdr) > ef->size) {
+        return NULL;
+    }
+
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(ef->map + ef->ehdr->e_phoff);
+    for (int i = 0; i < ef->ehdr->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD || vaddr < ph[i].p_vaddr ||
+            vaddr >= ph[i].p_vaddr + ph[i].p_filesz) {
+            continue;
+        }
+        uint64_t off = ph[i].p_offset + (vaddr - ph[i].p_vaddr);
+        if (off >= ef->size) {
+            return NULL;
+        }
+        uint64_t end = ph[i].p_offset + ph[i].p_filesz;
+        if (end > ef->size) end = ef->size;
+        *avail = end - off;
+        return ef->map + off;
+    }
+    return NULL;
+}
+
+int elf_build_id(const ElfFile *ef, char *out, size_t out_size) {
+    size_t size;
+    const unsigned char *note = elf_section(ef, ".note.gnu.build-id", &size);
+    if (!note || size < sizeof(Elf64_Nhdr)) {
+        return -1;
+    }
+
+    const Elf64_Nhdr *nh = (const Elf64_Nhdr *)note;
+    size_t name_size = (nh->n_namesz + 3) & ~3u;
+    if (nh->n_type != NT_GNU_BUILD_ID ||
+        sizeof(Elf64_Nhdr) + name_size + nh->n_descsz > size ||
+        nh->n_descsz * 2 + 1 > out_size) {
+        return -1;
+    }
+
+    const unsigned char *desc = note + sizeof(Elf64_Nhdr) + name_size;
+    for (Elf64_Word i = 0; i < nh->n_descsz; i++) {
+        snprintf(out + i * 2, 3, "%02x", desc[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef ELF_FILE_H
+#define ELF_FILE_H
+
+#include <elf.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only mapping of an ELF64 executable
+typedef struct {
+    unsigned char *map;
+    size_t size;
+
+    const Elf64_Ehdr *ehdr;
+    const Elf64_Shdr *shdrs;
+    int shnum;
+    const char *shstrtab;
+} ElfFile;
+
+// Map the file and validate the header. Returns 0 on success
+int elf_open(ElfFile *ef, const char *path);
+void elf_close(ElfFile *ef);
+
+// Section contents by name, or NULL if missing (size is set to 0)
+const unsigned char *elf_section(const ElfFile *ef, const char *name, size_t *size);
+const Elf64_Shdr *elf_section_header(const ElfFile *ef, const char *name);
+
+// File bytes backing link-time address vaddr in a PT_LOAD segment, with the
+// number of bytes available from there. NULL if vaddr is not file-backed.
+const unsigned char *elf_code_at(const ElfFile *ef, uint64_t vaddr, size_t *avail);
+
+// GNU build-id as a hex string. Returns 0 if the note is present
+int elf_build_id(const ElfFile *ef, char *out, size_t out_size);
+
+#endif
@@ -0,0 +1,313 @@
+#include "engine.h"
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define ENG_QUEUE_COMMANDS 16
+#define ENG_QUEUE_EVENTS   64
+
+static void signal_fd(int fd) {
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n;
+}
+
+// Reset the counter; the queue, not the count, says what is pending
+static void clear_fd(int fd) {
+    uint64_t count;
+    ssize_t n = read(fd, &count, sizeof(count));
+    (void)n;
+}
+
+static int post_event(Engine *eng, const EngineEvent *ev) {
+    if (spsc_push(&eng->events, ev) != 0) {
+        return -1;
+    }
+    signal_fd(eng->event_fd);
+    return 0;
+}
+
+// Send output read since the last call. When the queue is full the rest is
+// dropped; the UI copies the whole buffer again once the command is done.
+static void forward_output(Engine *eng) {
+    Debugger *dbg = eng->dbg;
+    unsigned long fresh = dbg->output_total - eng->output_sent;
+    if (fresh > (unsigned long)dbg->output_length) {
+        fresh = dbg->output_length;
+    }
+    eng->output_sent = dbg->output_total;
+
+    const char *p = dbg->output_buffer + dbg->output_length - fresh;
+    EngineEvent ev;
+    ev.type = ENG_EV_OUTPUT;
+    while (fresh > 0) {
+        ev.length = fresh < sizeof(ev.text) ? (int)fresh : (int)sizeof(ev.text);
+        memcpy(ev.text, p, ev.length);
+        if (post_event(eng, &ev) != 0) {
+            return;
+        }
+        p += ev.length;
+        fresh -= ev.length;
+    }
+}
+
+// Debugger pause hook, run on the engine thread while the program runs:
+// streams output and looks for PAUSE or QUIT. Nothing else can be queued
+// during a run, see eng_send.
+static int engine_pause_hook(void *ctx) {
+    Engine *eng = ctx;
+    clear_fd(eng->command_fd);
+    forward_output(eng);
+
+    int pause = 0;
+    EngineCmd cmd;
+    while (spsc_pop(&eng->commands, &cmd) == 0) {
+        if (cmd.type == ENG_CMD_QUIT) {
+            eng->quit = 1;
+            pause = 1;
+        } else if (cmd.type == ENG_CMD_PAUSE) {
+            pause = 1;
+        }
+    }
+    return pause;
+}
+
+static int unwatch_all(Debugger *dbg, int regions) {
+    int max = regions ? DBG_MAX_REGIONS : DBG_MAX_WATCH;
+    for (int i = 0; i < max; i++) {
+        if (regions && dbg->regions[i].active) {
+            dbg_unwatch_region(dbg, i);
+        } else if (!regions && dbg->watches[i].active) {
+            dbg_unwatch(dbg, i);
+        }
+    }
+    return 0;
+}
+
+static int read_memory(Engine *eng, const EngineCmd *cmd) {
+    Debugger *dbg = eng->dbg;
+    unsigned long addr = cmd->addr;
+    if (cmd->text[0] != '\0') {
+        int64_t value;
+        if (dbg_evaluate(dbg, cmd->text, &value) != 0) {
+            return -1;
+        }
+        addr = (unsigned long)value;
+    }
+
+    int length = cmd->arg < ENG_MEMORY_MAX ? cmd->arg : ENG_MEMORY_MAX;
+    ssize_t n = dbg_read_memory(dbg, addr, eng->memory, length);
+    eng->memory_addr = addr;
+    eng->memory_length = n > 0 ? (int)n : 0;
+    dbg_maps(dbg);
+    return eng->memory_length;
+}
+
+static int run_command(Engine *eng, const EngineCmd *cmd) {
+    Debugger *dbg = eng->dbg;
+    switch (cmd->type) {
+        case ENG_CMD_START:             return dbg_start(dbg);
+        case ENG_CMD_STEP:              return dbg_step_line(dbg);
+        case ENG_CMD_NEXT:              return dbg_next_line(dbg);
+        case ENG_CMD_STEP_INSN:         return dbg_step_instruction(dbg);
+        case ENG_CMD_BACK:              return dbg_step_back(dbg);
+        case ENG_CMD_FINISH:            return dbg_finish(dbg);
+        case ENG_CMD_CONTINUE:          return dbg_continue(dbg);
+        case ENG_CMD_PROFILE:           return dbg_profile(dbg);
+        case ENG_CMD_PROFILE_CLEAR:     dbg_profile_clear(dbg); return 0;
+        case ENG_CMD_TOGGLE_BREAKPOINT: return dbg_toggle_breakpoint(dbg, cmd->arg);
+        case ENG_CMD_BREAK_FUNCTION:    return dbg_break_function(dbg, cmd->text);
+        case ENG_CMD_CONDITION:         return dbg_set_condition(dbg, cmd->arg, cmd->text);
+        case ENG_CMD_TRACEPOINT:        return dbg_set_tracepoint(dbg, cmd->arg, cmd->text);
+        case ENG_CMD_WATCH:             return dbg_watch(dbg, cmd->text, cmd->arg);
+        case ENG_CMD_WATCH_REGION:      return dbg_watch_region(dbg, cmd->text);
+        case ENG_CMD_WATCH_EXPR:        return dbg_watch_expr(dbg, cmd->text);
+        case ENG_CMD_UNWATCH_EXPR:      return dbg_unwatch_expr(dbg, cmd->arg);
+        case ENG_CMD_RECORD:            return dbg_record(dbg, cmd->arg);
+        case ENG_CMD_CHECKPOINT:        return dbg_checkpoint(dbg);
+        case ENG_CMD_RESTORE:           return dbg_restore_checkpoint(dbg, cmd->arg);
+        case ENG_CMD_TRACE_INSNS:       return dbg_trace_instructions(dbg, cmd->text, cmd->arg);
+        case ENG_CMD_UNWATCH:
+            return cmd->arg < 0 ? unwatch_all(dbg, 0) : dbg_unwatch(dbg, cmd->arg);
+        case ENG_CMD_UNWATCH_REGION:
+            return cmd->arg < 0 ? unwatch_all(dbg, 1) : dbg_unwatch_region(dbg, cmd->arg);
+        case ENG_CMD_READ_MEMORY:
+            return read_memory(eng, cmd);
+        default:
+            return 0;
+    }
+}
+
+static void *engine_main(void *arg) {
+    Engine *eng = arg;
+    Debugger *dbg = eng->dbg;
+
+    // The UI thread blocks SIGCHLD so the debugger's handler runs here,
+    // but threads started later inherit that mask
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    pthread_sigmask(SIG_UNBLOCK, &chld, NULL);
+
+    dbg_set_pause_hook(dbg, eng->command_fd, engine_pause_hook, eng);
+
+    while (!eng->quit) {
+        EngineCmd cmd;
+        if (spsc_pop(&eng->commands, &cmd) != 0) {
+            struct pollfd pfd = { eng->command_fd, POLLIN, 0 };
+            poll(&pfd, 1, -1);
+            clear_fd(eng->command_fd);
+            continue;
+        }
+        if (cmd.type == ENG_CMD_QUIT) {
+            break;
+        }
+        if (cmd.type == ENG_CMD_PAUSE) {
+            continue;   // Came in after the run it was meant for
+        }
+
+        EngineEvent ev;
+        ev.type = ENG_EV_DONE;
+        ev.cmd = cmd.type;
+        ev.result = run_command(eng, &cmd);
+        ev.length = 0;
+
+        dbg_read_output(dbg);
+        eng->output_sent = dbg->output_total;
+        eng->frame_count = 0;
+        if (dbg->state == DBG_STATE_STOPPED || dbg->signal_stopped) {
+            eng->frame_count = dbg_backtrace(dbg, eng->frames, ENG_MAX_FRAMES);
+        }
+        dbg_locals(dbg);
+        dbg_record_stop(dbg);        // Reads the soft-dirty bits the expressions then clear
+        dbg_refresh_exprs(dbg);
+        dbg_disassemble(dbg);
+
+        // The UI waits for this one, so it may not be dropped
+        while (post_event(eng, &ev) != 0 && !eng->quit) {
+            usleep(1000);
+        }
+    }
+
+    dbg_stop(dbg);
+    __atomic_store_n(&eng->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int eng_start(Engine *eng, Debugger *dbg) {
+    memset(eng, 0, sizeof(Engine));
+    eng->dbg = dbg;
+    eng->command_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    eng->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eng->command_fd == -1 || eng->event_fd == -1 ||
+        spsc_init(&eng->commands, ENG_QUEUE_COMMANDS, sizeof(EngineCmd)) != 0 ||
+        spsc_init(&eng->events, ENG_QUEUE_EVENTS, sizeof(EngineEvent)) != 0 ||
+        !(eng->frames = malloc(ENG_MAX_FRAMES * sizeof(DbgFrame)))) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Cannot set up the engine queues");
+        goto fail;
+    }
+    if (pthread_create(&eng->thread, NULL, engine_main, eng) != 0) {
+        snprintf(dbg->error_message, sizeof(dbg->error_message), "Cannot start the engine thread");
+        goto fail;
+    }
+
+    // Leave child signals to the engine, which owns the tracee
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &chld, NULL);
+
+    eng->started = 1;
+    return 0;
+
+fail:
+    if (eng->command_fd != -1) close(eng->command_fd);
+    if (eng->event_fd != -1) close(eng->event_fd);
+    spsc_free(&eng->commands);
+    spsc_free(&eng->events);
+    free(eng->frames);
+    eng->frames = NULL;
+    eng->command_fd = eng->event_fd = -1;
+    return -1;
+}
+
+void eng_shutdown(Engine *eng) {
+    if (!eng->started) {
+        return;
+    }
+    eng_send(eng, ENG_CMD_QUIT, 0, NULL);
+
+    // Keep draining so the thread never waits on a full event queue
+    EngineEvent ev;
+    while (!__atomic_load_n(&eng->finished, __ATOMIC_ACQUIRE)) {
+        while (eng_poll(eng, &ev) == 0) {
+        }
+        struct pollfd pfd = { eng->event_fd, POLLIN, 0 };
+        poll(&pfd, 1, 10);
+    }
+    pthread_join(eng->thread, NULL);
+
+    close(eng->command_fd);
+    close(eng->event_fd);
+    spsc_free(&eng->commands);
+    spsc_free(&eng->events);
+    free(eng->frames);
+    eng->frames = NULL;
+    eng->command_fd = eng->event_fd = -1;
+    eng->started = 0;
+    eng->busy = 0;
+}
+
+static int send_command(Engine *eng, const EngineCmd *cmd) {
+    int control = cmd->type == ENG_CMD_PAUSE || cmd->type == ENG_CMD_QUIT;
+    if (!eng->started || (eng->busy && !control)) {
+        return -1;
+    }
+    if (spsc_push(&eng->commands, cmd) != 0) {
+        return -1;
+    }
+    signal_fd(eng->command_fd);
+
+    if (!control) {
+        eng->busy = 1;
+        eng->pending = cmd->type;
+    }
+    return 0;
+}
+
+int eng_send(Engine *eng, EngineCmdType type, int arg, const char *text) {
+    EngineCmd cmd;
+    cmd.type = type;
+    cmd.arg = arg;
+    cmd.addr = 0;
+    snprintf(cmd.text, sizeof(cmd.text), "%s", text ? text : "");
+    return send_command(eng, &cmd);
+}
+
+int eng_send_read(Engine *eng, unsigned long addr, int length, const char *expr) {
+    EngineCmd cmd;
+    cmd.type = ENG_CMD_READ_MEMORY;
+    cmd.arg = length;
+    cmd.addr = addr;
+    snprintf(cmd.text, sizeof(cmd.text), "%s", expr ? expr : "");
+    return send_command(eng, &cmd);
+}
+
+int eng_poll(Engine *eng, EngineEvent *ev) {
+    if (spsc_pop(&eng->events, ev) != 0) {
+        // Clear first, then look again, so a push in between is not missed
+        clear_fd(eng->event_fd);
+        if (spsc_pop(&eng->events, ev) != 0) {
+            return -1;
+        }
+    }
+    if (ev->type == ENG_EV_DONE) {
+        eng->busy = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <pthread.h>
+#include "debugger.h"
+#include "spsc_queue.h"
+
+#define ENG_MAX_FRAMES 16384
+#define ENG_MEMORY_MAX 4096
+
+// Work the UI hands to the engine thread. Only PAUSE and QUIT may be sent
+// while another command is still running.
+typedef enum {
+    ENG_CMD_START,
+    ENG_CMD_STEP,
+    ENG_CMD_NEXT,
+    ENG_CMD_STEP_INSN,
+    ENG_CMD_BACK,                // Back to the previous recorded stop
+    ENG_CMD_FINISH,
+    ENG_CMD_CONTINUE,
+    ENG_CMD_PROFILE,             // Continue, sampling where the program is
+    ENG_CMD_PROFILE_CLEAR,
+    ENG_CMD_PAUSE,
+    ENG_CMD_TOGGLE_BREAKPOINT,   // arg = line
+    ENG_CMD_BREAK_FUNCTION,      // text = function name
+    ENG_CMD_CONDITION,           // arg = line, text = condition
+    ENG_CMD_TRACEPOINT,          // arg = line, text = expressions
+    ENG_CMD_WATCH,               // arg = 1 to watch reads too, text = expression
+    ENG_CMD_UNWATCH,             // arg = slot, or -1 for all
+    ENG_CMD_WATCH_REGION,        // text = "address, size"
+    ENG_CMD_UNWATCH_REGION,      // arg = index, or -1 for all
+    ENG_CMD_READ_MEMORY,         // arg = length, at addr or text if given
+    ENG_CMD_WATCH_EXPR,          // text = expression
+    ENG_CMD_UNWATCH_EXPR,        // arg = index, or -1 for all
+    ENG_CMD_RECORD,              // arg = 1 to record stops, 0 to stop
+    ENG_CMD_CHECKPOINT,
+    ENG_CMD_RESTORE,             // arg = checkpoint index, or -1 for the newest
+    ENG_CMD_TRACE_INSNS,         // arg = 1 to trace registers too, text = file
+    ENG_CMD_QUIT                 // Pause, kill the program and end the thread
+} EngineCmdType;
+
+typedef struct {
+    EngineCmdType type;
+    int arg;
+    unsigned long addr;
+    char text[128];
+} EngineCmd;
+
+typedef enum {
+    ENG_EV_OUTPUT,               // Program output read while it runs
+    ENG_EV_DONE                  // A command finished; the debugger is idle
+} EngineEventType;
+
+typedef struct {
+    EngineEventType type;
+    EngineCmdType cmd;           // DONE: the command and what it returned
+    int result;
+    int length;                  // OUTPUT: bytes in text, not terminated
+    char text[240];
+} EngineEvent;
+
+// Runs the Debugger on its own thread, which also owns every ptrace call,
+// so the UI keeps drawing and reading keys while the program runs. The UI
+// sends commands and reads events through two single-producer queues; an
+// eventfd beside each one makes it pollable.
+//
+// While busy is set the Debugger belongs to the engine and the UI reads only
+// what the engine leaves alone during a run: breakpoint lines and source
+// data. Once the DONE event arrives the UI may read the Debugger again.
+typedef struct {
+    Debugger *dbg;
+    pthread_t thread;
+    int started;
+    SpscQueue commands;          // UI -> engine
+    SpscQueue events;            // Engine -> UI
+    int command_fd;              // Counts pushes onto each queue
+    int event_fd;
+
+    // UI side
+    int busy;                    // A command is out and its DONE has not arrived
+    EngineCmdType pending;
+
+    // Engine side
+    int quit;
+    int finished;                // Set by the thread as it returns
+    unsigned long output_sent;   // Debugger output_total already sent as events
+
+    // Stack at the last stop or crash, taken on the engine thread after the
+    // command. Deep recursion fills thousands of frames, so it is on the heap.
+    DbgFrame *frames;
+    int frame_count;
+
+    // Result of the last READ_MEMORY; the maps are read for the same stop
+    uint8_t memory[ENG_MEMORY_MAX];
+    unsigned long memory_addr;
+    int memory_length;
+} Engine;
+
+// Start the thread for an already loaded debugger. Returns 0 or -1.
+int eng_start(Engine *eng, Debugger *dbg);
+
+// Pause and kill the program, then end the thread
+void eng_shutdown(Engine *eng);
+
+// Queue a command. Returns -1 while another command is running (except for
+// PAUSE and QUIT), or if the engine is not started.
+int eng_send(Engine *eng, EngineCmdType type, int arg, const char *text);
+
+// READ_MEMORY of length bytes from addr, or from the value of expr when it
+// is not empty. DONE carries the bytes read, or -1 if expr failed.
+int eng_send_read(Engine *eng, unsigned long addr, int length, const char *expr);
+
+// Next event, or -1 when there is none. A DONE event clears busy.
+int eng_poll(Engine *eng, EngineEvent *ev);
+
+#endif
@@ -0,0 +1,488 @@
+#include "expr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <sys/user.h>
+
+enum {
+    OP_CONST = 1,   // 8-byte immediate
+    OP_CONST8,      // 1-byte signed immediate
+    OP_REG,         // 1-byte register word index
+    OP_FRAME,       // Canonical frame address
+    OP_LOAD,        // 1-byte size, 0x80 = sign-extend
+    OP_CAST,        // Same operand as OP_LOAD
+    OP_NEG, OP_NOT, OP_BNOT,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_SHL, OP_SHR, OP_AND, OP_OR, OP_XOR,
+    OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+    OP_JFALSE,      // 2-byte forward offset; pops unless the value is 0
+    OP_JTRUE,       // 2-byte forward offset; pops unless the value is non-0
+    OP_BOOL
+};
+
+#define REG(name) { #name, offsetof(struct user_regs_struct, name) / 8 }
+
+static const struct {
+    const char *name;
+    int index;
+} registers[] = {
+    REG(rax), REG(rbx), REG(rcx), REG(rdx), REG(rsi), REG(rdi),
+    REG(rbp), REG(rsp), REG(rip), REG(r8), REG(r9), REG(r10),
+    REG(r11), REG(r12), REG(r13), REG(r14), REG(r15), REG(eflags),
+    { "pc", offsetof(struct user_regs_struct, rip) / 8 },
+    { "sp", offsetof(struct user_regs_struct, rsp) / 8 },
+    { "fp", offsetof(struct user_regs_struct, rbp) / 8 },
+};
+
+// A typed pointer remembers what dereferencing it reads
+typedef struct {
+    int size;        // 0 = plain integer, deref reads 8 bytes
+    int is_signed;
+} Pointee;
+
+typedef struct {
+    const char *p;
+    Expr *e;
+    const ExprResolver *resolver;
+    int depth;
+    char *error;
+    int error_size;
+    int failed;
+} Parser;
+
+static void fail(Parser *ps, const char *msg) {
+    if (!ps->failed) {
+        snprintf(ps->error, ps->error_size, "%s near '%.12s'", msg, ps->p);
+        ps->failed = 1;
+    }
+}
+
+static void skip_space(Parser *ps) {
+    while (isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+static int accept(Parser *ps, const char *tok) {
+    skip_space(ps);
+    size_t n = strlen(tok);
+    if (strncmp(ps->p, tok, n) != 0) return 0;
+    // Keep '&&' from matching '&', '<<' from '<', and so on
+    if (n == 1 && strchr("&|<>", tok[0]) && ps->p[1] == tok[0]) return 0;
+    if (n == 1 && strchr("<>!=", tok[0]) && ps->p[1] == '=') return 0;
+    ps->p += n;
+    return 1;
+}
+
+// Emit op with len operand bytes; adjust is the stack effect
+static void emit(Parser *ps, int op, const void *operand, int len, int adjust) {
+    Expr *e = ps->e;
+    if (e->length + 1 + len > EXPR_MAX_CODE) {
+        fail(ps, "expression too long");
+        return;
+    }
+    e->last_op = e->length;
+    e->code[e->length++] = (uint8_t)op;
+    if (len > 0) {
+        memcpy(e->code + e->length, operand, len);
+        e->length += len;
+    }
+
+    ps->depth += adjust;
+    if (ps->depth > EXPR_MAX_STACK) {
+        fail(ps, "expression too deep");
+    }
+}
+
+static void emit_const(Parser *ps, int64_t v) {
+    if (v >= -128 && v <= 127) {
+        int8_t b = (int8_t)v;
+        emit(ps, OP_CONST8, &b, 1, 1);
+    } else {
+        emit(ps, OP_CONST, &v, 8, 1);
+    }
+}
+
+static void emit_sized(Parser *ps, int op, int size, int is_signed) {
+    uint8_t operand = (uint8_t)(size | (is_signed ? 0x80 : 0));
+    emit(ps, op, &operand, 1, 0);
+}
+
+static Pointee parse_lor(Parser *ps);
+static Pointee parse_unary(Parser *ps);
+
+// "(int *)", "(unsigned char)" and friends after the opening parenthesis.
+// Returns 0 if the text is not a type name.
+static int parse_type(Parser *ps, int *size, int *is_signed, int *is_pointer) {
+    const char *save = ps->p;
+    int seen = 0;
+    *size = 4;
+    *is_signed = 1;
+
+    for (;;) {
+        skip_space(ps);
+        const char *w = ps->p;
+        while (isalnum((unsigned char)*ps->p) || *ps->p == '_') ps->p++;
+        size_t n = ps->p - w;
+
+        if (n == 8 && strncmp(w, "unsigned", 8) == 0) { *is_signed = 0; }
+        else if (n == 6 && strncmp(w, "signed", 6) == 0) { *is_signed = 1; }
+        else if (n == 4 && strncmp(w, "char", 4) == 0) { *size = 1; }
+        else if (n == 5 && strncmp(w, "short", 5) == 0) { *size = 2; }
+        else if (n == 3 && strncmp(w, "int", 3) == 0) { }
+        else if (n == 4 && strncmp(w, "long", 4) == 0) { *size = 8; }
+        else {
+            ps->p = w;
+            break;
+        }
+        seen = 1;
+    }
+
+    // intN_t / uintN_t
+    if (!seen) {
+        static const struct { const char *name; int size, is_signed; } fixed[] = {
+            { "int8_t", 1, 1 }, { "int16_t", 2, 1 }, { "int32_t", 4, 1 }, { "int64_t", 8, 1 },
+            { "uint8_t", 1, 0 }, { "uint16_t", 2, 0 }, { "uint32_t", 4, 0 }, { "uint64_t", 8, 0 },
+        };
+        for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+            size_t n = strlen(fixed[i].name);
+            if (strncmp(ps->p, fixed[i].name, n) == 0 &&
+                !isalnum((unsigned char)ps->p[n]) && ps->p[n] != '_') {
+                ps->p += n;
+                *size = fixed[i].size;
+                *is_signed = fixed[i].is_signed;
+                seen = 1;
+                break;
+            }
+        }
+    }
+
+    if (!seen) {
+        ps->p = save;
+        return 0;
+    }
+
+    *is_pointer = accept(ps, "*");
+    if (!accept(ps, ")")) {
+        fail(ps, "expected ')' after type");
+    }
+    return 1;
+}
+
+static Pointee parse_primary(Parser *ps) {
+    Pointee none = { 0, 0 };
+    skip_space(ps);
+
+    if (accept(ps, "(")) {
+        Pointee t = parse_lor(ps);
+        if (!accept(ps, ")")) {
+            fail(ps, "expected ')'");
+        }
+        return t;
+    }
+
+    if (isdigit((unsigned char)*ps->p)) {
+        char *end;
+        unsigned long long v = strtoull(ps->p, &end, 0);
+        ps->p = end;
+        emit_const(ps, (int64_t)v);
+        return none;
+    }
+
+    if (*ps->p == '$') {
+        ps->p++;
+        for (size_t i = 0; i < sizeof(registers) / sizeof(registers[0]); i++) {
+            size_t n = strlen(registers[i].name);
+            if (strncmp(ps->p, registers[i].name, n) == 0 && !isalnum((unsigned char)ps->p[n])) {
+                ps->p += n;
+                uint8_t reg = (uint8_t)registers[i].index;
+                emit(ps, OP_REG, &reg, 1, 1);
+                ps->e->reg_mask |= 1u << reg;
+                return none;
+            }
+        }
+        fail(ps, "unknown register");
+        return none;
+    }
+
+    if (isalpha((unsigned char)*ps->p) || *ps->p == '_') {
+        char name[64];
+        int n = 0;
+        while ((isalnum((unsigned char)*ps->p) || *ps->p == '_') && n < (int)sizeof(name) - 1) {
+            name[n++] = *ps->p++;
+        }
+        name[n] = 0;
+
+        ExprVar var;
+        if (!ps->resolver || !ps->resolver->resolve ||
+            ps->resolver->resolve(ps->resolver->ctx, name, &var) != 0) {
+            ps->p -= n;
+            fail(ps, "unknown name");
+            return none;
+        }
+
+        if (var.base == EXPR_BASE_FRAME) {
+            emit(ps, OP_FRAME, NULL, 0, 1);
+            ps->e->uses_frame = 1;
+            emit_const(ps, var.offset);
+            emit(ps, OP_ADD, NULL, 0, -1);
+        } else {
+            emit_const(ps, var.offset);
+        }
+        emit_sized(ps, OP_LOAD, var.size, var.is_signed);
+        return none;
+    }
+
+    fail(ps, "expected a value");
+    return none;
+}
+
+static Pointee parse_unary(Parser *ps) {
+    Pointee none = { 0, 0 };
+
+    if (accept(ps, "-")) {
+        parse_unary(ps);
+        emit(ps, OP_NEG, NULL, 0, 0);
+        return none;
+    }
+    if (accept(ps, "!")) {
+        parse_unary(ps);
+        emit(ps, OP_NOT, NULL, 0, 0);
+        return none;
+    }
+    if (accept(ps, "~")) {
+        parse_unary(ps);
+        emit(ps, OP_BNOT, NULL, 0, 0);
+        return none;
+    }
+    if (accept(ps, "*")) {
+        Pointee t = parse_unary(ps);
+        emit_sized(ps, OP_LOAD, t.size ? t.size : 8, t.size ? t.is_signed : 1);
+        return none;
+    }
+
+    skip_space(ps);
+    if (*ps->p == '(') {
+        const char *save = ps->p;
+        ps->p++;
+        int size, is_signed, is_pointer;
+        if (parse_type(ps, &size, &is_signed, &is_pointer)) {
+            parse_unary(ps);
+            if (is_pointer) {
+                Pointee t = { size, is_signed };
+                return t;
+            }
+            emit_sized(ps, OP_CAST, size, is_signed);
+            return none;
+        }
+        ps->p = save;
+    }
+    return parse_primary(ps);
+}
+
+// One precedence level of left-associative binary operators
+typedef struct {
+    const char *tok;
+    int op;
+} BinaryOp;
+
+static Pointee parse_binary(Parser *ps, int level);
+
+static const BinaryOp levels[][5] = {
+    { { "|", OP_OR } },
+    { { "^", OP_XOR } },
+    { { "&", OP_AND } },
+    { { "==", OP_EQ }, { "!=", OP_NE } },
+    { { "<=", OP_LE }, { ">=", OP_GE }, { "<", OP_LT }, { ">", OP_GT } },
+    { { "<<", OP_SHL }, { ">>", OP_SHR } },
+    { { "+", OP_ADD }, { "-", OP_SUB } },
+    { { "*", OP_MUL }, { "/", OP_DIV }, { "%", OP_MOD } },
+};
+#define LEVEL_COUNT (int)(sizeof(levels) / sizeof(levels[0]))
+
+static Pointee parse_operand(Parser *ps, int level) {
+    return level + 1 < LEVEL_COUNT ? parse_binary(ps, level + 1) : parse_unary(ps);
+}
+
+static Pointee parse_binary(Parser *ps, int level) {
+    Pointee t = parse_operand(ps, level);
+
+    for (int matched = 1; matched && !ps->failed; ) {
+        matched = 0;
+        for (int i = 0; i < 5 && levels[level][i].tok; i++) {
+            if (accept(ps, levels[level][i].tok)) {
+                parse_operand(ps, level);
+                emit(ps, levels[level][i].op, NULL, 0, -1);
+                t.size = 0;
+                matched = 1;
+                break;
+            }
+        }
+    }
+    return t;
+}
+
+// && and || only evaluate the right side when it matters, so a guard like
+// "$rdi != 0 && *$rdi == 5" never reads through a null pointer
+static Pointee parse_logical(Parser *ps, const char *tok, int jump_op) {
+    Pointee t = jump_op == OP_JTRUE ? parse_logical(ps, "&&", OP_JFALSE) : parse_binary(ps, 0);
+
+    while (!ps->failed && accept(ps, tok)) {
+        int at = ps->e->length + 1;
+        uint16_t offset = 0;
+        emit(ps, jump_op, &offset, 2, 0);
+
+        // The jump pops on fallthrough, so the right side starts one lower
+        ps->depth--;
+        if (jump_op == OP_JTRUE) {
+            parse_logical(ps, "&&", OP_JFALSE);
+        } else {
+            parse_binary(ps, 0);
+        }
+        emit(ps, OP_BOOL, NULL, 0, 0);
+
+        if (!ps->failed) {
+            offset = (uint16_t)(ps->e->length - (at + 2));
+            memcpy(ps->e->code + at, &offset, 2);
+        }
+        t.size = 0;
+    }
+    return t;
+}
+
+static Pointee parse_lor(Parser *ps) {
+    return parse_logical(ps, "||", OP_JTRUE);
+}
+
+int expr_compile(Expr *e, const char *text, const ExprResolver *resolver,
+                 char *error, int error_size) {
+    memset(e, 0, sizeof(Expr));
+    snprintf(e->text, sizeof(e->text), "%s", text);
+
+    Parser ps = { text, e, resolver, 0, error, error_size, 0 };
+    parse_lor(&ps);
+    skip_space(&ps);
+    if (!ps.failed && *ps.p) {
+        fail(&ps, "unexpected text");
+    }
+    if (!ps.failed && e->length == 0) {
+        fail(&ps, "empty expression");
+    }
+    return ps.failed ? -1 : 0;
+}
+
+int expr_address_of(Expr *e) {
+    if (e->length == 0 || e->code[e->last_op] != OP_LOAD) {
+        return -1;
+    }
+    int size = e->code[e->last_op + 1] & 0x0f;
+    e->length = e->last_op;
+    return size;
+}
+
+static uint64_t fit(uint64_t v, int operand) {
+    int size = operand & 0x0f;
+    if (size >= 8) return v;
+
+    int bits = size * 8;
+    uint64_t mask = (1ULL << bits) - 1;
+    v &= mask;
+    if ((operand & 0x80) && (v >> (bits - 1))) {
+        v |= ~mask;
+    }
+    return v;
+}
+
+int expr_eval(const Expr *e, const ExprEnv *env, int64_t *result) {
+    uint64_t stack[EXPR_MAX_STACK];
+    int sp = 0;
+    const uint8_t *pc = e->code;
+    const uint8_t *end = e->code + e->length;
+
+    while (pc < end) {
+        int op = *pc++;
+        uint64_t a, b;
+
+        switch (op) {
+            case OP_CONST:
+                memcpy(&stack[sp++], pc, 8);
+                pc += 8;
+                break;
+            case OP_CONST8:
+                stack[sp++] = (uint64_t)(int64_t)(int8_t)*pc++;
+                break;
+            case OP_REG:
+                if (env->read_reg(env->ctx, *pc++, &stack[sp]) != 0) return -1;
+                sp++;
+                break;
+            case OP_FRAME:
+                if (env->frame_base(env->ctx, &stack[sp]) != 0) return -1;
+                sp++;
+                break;
+            case OP_LOAD: {
+                uint64_t v = 0;
+                if (env->read_mem(env->ctx, stack[sp - 1], &v, *pc & 0x0f) != 0) return -1;
+                stack[sp - 1] = fit(v, *pc++);
+                break;
+            }
+            case OP_CAST:
+                stack[sp - 1] = fit(stack[sp - 1], *pc++);
+                break;
+            case OP_NEG:  stack[sp - 1] = -stack[sp - 1]; break;
+            case OP_NOT:  stack[sp - 1] = !stack[sp - 1]; break;
+            case OP_BNOT: stack[sp - 1] = ~stack[sp - 1]; break;
+            case OP_BOOL: stack[sp - 1] = stack[sp - 1] != 0; break;
+
+            case OP_JFALSE:
+            case OP_JTRUE: {
+                uint16_t offset;
+                memcpy(&offset, pc, 2);
+                pc += 2;
+                int truth = stack[sp - 1] != 0;
+                if (truth == (op == OP_JTRUE)) {
+                    stack[sp - 1] = truth;
+                    pc += offset;
+                } else {
+                    sp--;
+                }
+                break;
+            }
+
+            default:
+                b = stack[--sp];
+                a = stack[sp - 1];
+                switch (op) {
+                    case OP_ADD: a += b; break;
+                    case OP_SUB: a -= b; break;
+                    case OP_MUL: a *= b; break;
+                    case OP_DIV:
+                    case OP_MOD:
+                        if (b == 0) return -1;
+                        if ((int64_t)b == -1) {
+                            a = op == OP_DIV ? -a : 0;
+                        } else {
+                            a = op == OP_DIV ? (uint64_t)((int64_t)a / (int64_t)b)
+                                             : (uint64_t)((int64_t)a % (int64_t)b);
+                        }
+                        break;
+                    case OP_SHL: a <<= (b & 63); break;
+                    case OP_SHR: a = (uint64_t)((int64_t)a >> (b & 63)); break;
+                    case OP_AND: a &= b; break;
+                    case OP_OR:  a |= b; break;
+                    case OP_XOR: a ^= b; break;
+                    case OP_EQ:  a = a == b; break;
+                    case OP_NE:  a = a != b; break;
+                    case OP_LT:  a = (int64_t)a <  (int64_t)b; break;
+                    case OP_LE:  a = (int64_t)a <= (int64_t)b; break;
+                    case OP_GT:  a = (int64_t)a >  (int64_t)b; break;
+                    case OP_GE:  a = (int64_t)a >= (int64_t)b; break;
+                    default: return -1;
+                }
+                stack[sp - 1] = a;
+                break;
+        }
+    }
+
+    *result = sp > 0 ? (int64_t)stack[sp - 1] : 0;
+    return 0;
+}
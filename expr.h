@@ -0,0 +1,61 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stdint.h>
+
+#define EXPR_MAX_CODE   256
+#define EXPR_MAX_STACK  32
+
+// Where a named variable lives
+typedef enum {
+    EXPR_BASE_ADDR,      // Absolute address (globals)
+    EXPR_BASE_FRAME      // Offset from the frame's canonical frame address
+} ExprBase;
+
+typedef struct {
+    ExprBase base;
+    int64_t offset;
+    int size;            // 1, 2, 4 or 8
+    int is_signed;
+} ExprVar;
+
+// Maps identifiers to variables at compile time. Returns 0 if name is known.
+typedef struct {
+    int (*resolve)(void *ctx, const char *name, ExprVar *var);
+    void *ctx;
+} ExprResolver;
+
+// Condition compiled to stack bytecode. reg_mask has bit n set for every
+// user_regs_struct word n the code reads.
+typedef struct {
+    uint8_t code[EXPR_MAX_CODE];
+    int length;
+    int last_op;         // Offset of the final instruction
+    uint32_t reg_mask;
+    int uses_frame;
+    char text[128];
+} Expr;
+
+// Operand access during evaluation. Each callback returns 0 on success.
+// reg is a word index into struct user_regs_struct.
+typedef struct {
+    int (*read_reg)(void *ctx, int reg, uint64_t *value);
+    int (*read_mem)(void *ctx, uint64_t addr, void *buf, int size);
+    int (*frame_base)(void *ctx, uint64_t *cfa);
+    void *ctx;
+} ExprEnv;
+
+// Parse text once. On failure returns -1 with a message in error.
+int expr_compile(Expr *e, const char *text, const ExprResolver *resolver,
+                 char *error, int error_size);
+
+// Make an expression that reads memory, like "*(int *)($rbp - 4)", yield
+// the address it reads instead. Returns the access size, or -1 if the
+// outermost operation is not a memory read.
+int expr_address_of(Expr *e);
+
+// Run the bytecode. Returns -1 if an operand could not be read or the
+// expression divided by zero.
+int expr_eval(const Expr *e, const ExprEnv *env, int64_t *result);
+
+#endif
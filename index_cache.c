@@ -0,0 +1,270 @@
+#include "index_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IC_MAGIC   "DBGIDX\0\0"
+#define IC_VERSION 3
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+
+    uint64_t line_offset;
+    uint64_t line_count;
+    uint64_t file_offset;
+    uint64_t file_count;
+    uint64_t line_strings_offset;
+    uint64_t line_strings_size;
+
+    uint64_t func_offset;
+    uint64_t func_count;
+    uint64_t sym_strings_offset;
+    uint64_t sym_strings_size;
+    uint64_t sym_names_offset;
+    uint64_t sym_names_count;
+
+    uint64_t total_size;
+} IndexHeader;
+
+void ic_init(IndexCache *ic) {
+    memset(ic, 0, sizeof(IndexCache));
+}
+
+void ic_close(IndexCache *ic) {
+    if (ic->map) {
+        munmap(ic->map, ic->size);
+    }
+    ic->map = NULL;
+    ic->size = 0;
+}
+
+static int cache_dir(char *out, size_t size) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char base[1024];
+
+    if (xdg && xdg[0]) {
+        snprintf(base, sizeof(base), "%s", xdg);
+    } else if (home && home[0]) {
+        snprintf(base, sizeof(base), "%s/.cache", home);
+    } else {
+        return -1;
+    }
+
+    mkdir(base, 0755);
+    snprintf(out, size, "%s/filebrowser", base);
+    if (mkdir(out, 0755) == -1 && access(out, W_OK) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int cache_path(const IndexCache *ic, char *out, size_t size) {
+    char dir[1024];
+    if (!ic->key[0] || cache_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(out, size, "%s/%s.idx", dir, ic->key);
+    return 0;
+}
+
+int ic_make_key(IndexCache *ic, const ElfFile *ef, const char *path) {
+    char build_id[96];
+    if (elf_build_id(ef, build_id, sizeof(build_id)) == 0) {
+        snprintf(ic->key, sizeof(ic->key), "b-%s", build_id);
+        return 0;
+    }
+
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        ic->key[0] = '\0';
+        return -1;
+    }
+    snprintf(ic->key, sizeof(ic->key), "m-%lx-%lx-%lx-%lx.%09ld",
+             (unsigned long)st.st_dev, (unsigned long)st.st_ino,
+             (unsigned long)st.st_size, (unsigned long)st.st_mtim.tv_sec,
+             (long)st.st_mtim.tv_nsec);
+    return 0;
+}
+
+static int range_ok(const IndexHeader *h, uint64_t off, uint64_t count, uint64_t elem) {
+    if (off % 8 != 0 || off > h->total_size) return 0;
+    if (elem && count > (h->total_size - off) / elem) return 0;
+    return 1;
+}
+
+int ic_load(IndexCache *ic, LineTable *lt, SymbolTable *st) {
+    char path[1280];
+    if (cache_path(ic, path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || sb.st_size < (off_t)sizeof(IndexHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const IndexHeader *h = map;
+    const unsigned char *base = map;
+    int ok = memcmp(h->magic, IC_MAGIC, 8) == 0 &&
+             h->version == IC_VERSION &&
+             h->header_size == sizeof(IndexHeader) &&
+             h->total_size == (uint64_t)sb.st_size &&
+             range_ok(h, h->line_offset, h->line_count, sizeof(LineEntry)) &&
+             range_ok(h, h->file_offset, h->file_count, sizeof(uint32_t)) &&
+             range_ok(h, h->line_strings_offset, h->line_strings_size, 1) &&
+             range_ok(h, h->func_offset, h->func_count, sizeof(FuncSymbol)) &&
+             range_ok(h, h->sym_strings_offset, h->sym_strings_size, 1) &&
+             range_ok(h, h->sym_names_offset, h->sym_names_count, sizeof(uint32_t));
+    if (ok && h->line_strings_size > 0) {
+        ok = base[h->line_strings_offset + h->line_strings_size - 1] == '\0';
+    }
+    if (ok && h->sym_strings_size > 0) {
+        ok = base[h->sym_strings_offset + h->sym_strings_size - 1] == '\0';
+    }
+    // Name lookups probe until an empty slot and index funcs with what they find
+    if (ok && h->sym_names_count > 0) {
+        ok = (h->sym_names_count & (h->sym_names_count - 1)) == 0 &&
+             h->sym_names_count > h->func_count;
+        const uint32_t *names = (const uint32_t *)(base + h->sym_names_offset);
+        for (uint64_t i = 0; ok && i < h->sym_names_count; i++) {
+            ok = names[i] <= h->func_count;
+        }
+    }
+    // Offsets and file numbers are used as they are, so each must land
+    // inside its table; a row may also name no file at all
+    if (ok) {
+        ok = h->file_count < LT_NO_FILE;
+        const uint32_t *files = (const uint32_t *)(base + h->file_offset);
+        for (uint64_t i = 0; ok && i < h->file_count; i++) {
+            ok = files[i] < h->line_strings_size;
+        }
+        const LineEntry *entries = (const LineEntry *)(base + h->line_offset);
+        for (uint64_t i = 0; ok && i < h->line_count; i++) {
+            ok = entries[i].file < h->file_count || entries[i].file == LT_NO_FILE;
+        }
+        const FuncSymbol *funcs = (const FuncSymbol *)(base + h->func_offset);
+        for (uint64_t i = 0; ok && i < h->func_count; i++) {
+            ok = funcs[i].name < h->sym_strings_size;
+        }
+    }
+    if (!ok) {
+        munmap(map, sb.st_size);
+        return -1;
+    }
+
+    ic_close(ic);
+    ic->map = map;
+    ic->size = sb.st_size;
+
+    lt_init(lt);
+    lt->entries = (LineEntry *)(base + h->line_offset);
+    lt->count = (int)h->line_count;
+    lt->file_names = (uint32_t *)(base + h->file_offset);
+    lt->file_count = (int)h->file_count;
+    lt->strings = (char *)(base + h->line_strings_offset);
+    lt->strings_size = h->line_strings_size;
+
+    sym_init(st);
+    st->funcs = (FuncSymbol *)(base + h->func_offset);
+    st->count = (int)h->func_count;
+    st->strings = (char *)(base + h->sym_strings_offset);
+    st->strings_size = h->sym_strings_size;
+    st->names = (uint32_t *)(base + h->sym_names_offset);
+    st->name_capacity = (int)h->sym_names_count;
+
+    return 0;
+}
+
+static uint64_t align8(uint64_t v) {
+    return (v + 7) & ~(uint64_t)7;
+}
+
+static int write_at(int fd, uint64_t off, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n <= 0) return -1;
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int ic_save(const IndexCache *ic, const LineTable *lt, const SymbolTable *st) {
+    char path[1280];
+    char tmp[1300];
+    if (cache_path(ic, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+    IndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, IC_MAGIC, 8);
+    h.version = IC_VERSION;
+    h.header_size = sizeof(IndexHeader);
+
+    uint64_t off = align8(sizeof(IndexHeader));
+    h.line_offset = off;
+    h.line_count = lt->count;
+    off = align8(off + h.line_count * sizeof(LineEntry));
+    h.file_offset = off;
+    h.file_count = lt->file_count;
+    off = align8(off + h.file_count * sizeof(uint32_t));
+    h.line_strings_offset = off;
+    h.line_strings_size = lt->strings_size;
+    off = align8(off + h.line_strings_size);
+    h.func_offset = off;
+    h.func_count = st->count;
+    off = align8(off + h.func_count * sizeof(FuncSymbol));
+    h.sym_strings_offset = off;
+    h.sym_strings_size = st->strings_size;
+    off = align8(off + h.sym_strings_size);
+    h.sym_names_offset = off;
+    h.sym_names_count = st->name_capacity;
+    off = align8(off + h.sym_names_count * sizeof(uint32_t));
+    h.total_size = off;
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+
+    int err = ftruncate(fd, h.total_size) != 0 ||
+              write_at(fd, 0, &h, sizeof(h)) != 0 ||
+              write_at(fd, h.line_offset, lt->entries, h.line_count * sizeof(LineEntry)) != 0 ||
+              write_at(fd, h.file_offset, lt->file_names, h.file_count * sizeof(uint32_t)) != 0 ||
+              write_at(fd, h.line_strings_offset, lt->strings, h.line_strings_size) != 0 ||
+              write_at(fd, h.func_offset, st->funcs, h.func_count * sizeof(FuncSymbol)) != 0 ||
+              write_at(fd, h.sym_strings_offset, st->strings, h.sym_strings_size) != 0 ||
+              write_at(fd, h.sym_names_offset, st->names, h.sym_names_count * sizeof(uint32_t)) != 0;
+    close(fd);
+
+    // Rename last so a reader never maps a half-written index
+    if (err || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
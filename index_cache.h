@@ -0,0 +1,30 @@
+#ifndef INDEX_CACHE_H
+#define INDEX_CACHE_H
+
+#include <stddef.h>
+#include "elf_file.h"
+#include "line_table.h"
+#include "symbols.h"
+
+// On-disk image of the line table, file table and function symbols.
+// A cache hit maps the file read-only and points the tables into it, so
+// reopening an unchanged binary costs a page-in instead of a DWARF decode.
+typedef struct {
+    void *map;
+    size_t size;
+    char key[128];
+} IndexCache;
+
+void ic_init(IndexCache *ic);
+void ic_close(IndexCache *ic);
+
+// Derive the cache key from the build-id, or path identity if there is none
+int ic_make_key(IndexCache *ic, const ElfFile *ef, const char *path);
+
+// Map a cached index into lt/st (not owned). Returns 0 on a valid hit
+int ic_load(IndexCache *ic, LineTable *lt, SymbolTable *st);
+
+// Write freshly decoded tables for the next session
+int ic_save(const IndexCache *ic, const LineTable *lt, const SymbolTable *st);
+
+#endif
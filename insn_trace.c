@@ -0,0 +1,407 @@
+#include "insn_trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ITR_MAGIC    "DBGITR\0\0"
+#define ITR_VERSION  1
+#define ITR_MAX_ENCODED  (10 + 3 + ITR_REGS * 10)   // One instruction at most
+
+const char *const itr_reg_names[ITR_REGS] = {
+    "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "eflags"
+};
+
+void itr_regs(const struct user_regs_struct *regs, uint64_t *out) {
+    out[0] = regs->rax;  out[1] = regs->rbx;  out[2] = regs->rcx;  out[3] = regs->rdx;
+    out[4] = regs->rsi;  out[5] = regs->rdi;  out[6] = regs->rbp;  out[7] = regs->rsp;
+    out[8] = regs->r8;   out[9] = regs->r9;   out[10] = regs->r10; out[11] = regs->r11;
+    out[12] = regs->r12; out[13] = regs->r13; out[14] = regs->r14; out[15] = regs->r15;
+    out[16] = regs->eflags;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        result |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Small differences either way become small unsigned numbers
+static uint64_t zigzag(uint64_t delta) {
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static uint64_t unzigzag(uint64_t v) {
+    return (v >> 1) ^ -(v & 1);
+}
+
+static void signal_fd(int fd) {
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n;
+}
+
+// Block until the other side has pushed since the last wait
+static void wait_fd(int fd) {
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) == -1 && errno == EINTR) {
+    }
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int add_index(ItrWriter *w, uint64_t first_index, uint64_t offset) {
+    if (w->index_count == w->index_capacity) {
+        uint64_t capacity = w->index_capacity ? w->index_capacity * 2 : 256;
+        ItrIndexEntry *index = realloc(w->index, capacity * sizeof(*index));
+        if (!index) {
+            return -1;
+        }
+        w->index = index;
+        w->index_capacity = capacity;
+    }
+    w->index[w->index_count].first_index = first_index;
+    w->index[w->index_count].offset = offset;
+    w->index_count++;
+    return 0;
+}
+
+// Writer thread: write each full chunk and hand its buffer back. After a
+// failure chunks are still handed back, so stepping never waits forever.
+static void *writer_main(void *arg) {
+    ItrWriter *w = arg;
+
+    // Signals are for the threads that asked for them
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+    for (;;) {
+        ItrChunk *chunk;
+        if (spsc_pop(&w->full, &chunk) != 0) {
+            wait_fd(w->full_fd);
+            continue;
+        }
+        if (!chunk) {
+            break;
+        }
+
+        size_t len = sizeof(*chunk) + chunk->size;
+        if (!__atomic_load_n(&w->failed, __ATOMIC_RELAXED)) {
+            if (write_all(w->fd, chunk, len) != 0 ||
+                add_index(w, chunk->first_index, w->offset) != 0) {
+                __atomic_store_n(&w->failed, 1, __ATOMIC_RELAXED);
+            }
+            w->offset += len;
+        }
+        spsc_push(&w->empty, &chunk);
+        signal_fd(w->empty_fd);
+    }
+    return NULL;
+}
+
+static void release(ItrWriter *w) {
+    if (w->fd != -1) close(w->fd);
+    if (w->full_fd != -1) close(w->full_fd);
+    if (w->empty_fd != -1) close(w->empty_fd);
+    spsc_free(&w->full);
+    spsc_free(&w->empty);
+    free(w->pool);
+    free(w->index);
+    memset(w, 0, sizeof(*w));
+    w->fd = w->full_fd = w->empty_fd = -1;
+}
+
+int itr_create(ItrWriter *w, const char *path, unsigned long load_bias, uint32_t flags) {
+    memset(w, 0, sizeof(*w));
+    w->fd = w->full_fd = w->empty_fd = -1;
+    w->flags = flags;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    w->full_fd = eventfd(0, EFD_CLOEXEC);
+    w->empty_fd = eventfd(0, EFD_CLOEXEC);
+    w->pool = malloc((size_t)ITR_BUFFERS * ITR_CHUNK_BYTES);
+    if (w->fd == -1 || w->full_fd == -1 || w->empty_fd == -1 || !w->pool ||
+        spsc_init(&w->full, ITR_BUFFERS * 2, sizeof(ItrChunk *)) != 0 ||
+        spsc_init(&w->empty, ITR_BUFFERS * 2, sizeof(ItrChunk *)) != 0) {
+        release(w);
+        return -1;
+    }
+    for (int i = 0; i < ITR_BUFFERS; i++) {
+        ItrChunk *chunk = (ItrChunk *)(w->pool + (size_t)i * ITR_CHUNK_BYTES);
+        spsc_push(&w->empty, &chunk);
+    }
+
+    ItrFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, ITR_MAGIC, 8);
+    h.version = ITR_VERSION;
+    h.flags = flags;
+    h.load_bias = load_bias;
+    if (write_all(w->fd, &h, sizeof(h)) != 0 ||
+        pthread_create(&w->thread, NULL, writer_main, w) != 0) {
+        release(w);
+        return -1;
+    }
+    w->offset = sizeof(h);
+    w->started = 1;
+    return 0;
+}
+
+static void submit(ItrWriter *w, ItrChunk *chunk) {
+    spsc_push(&w->full, &chunk);
+    signal_fd(w->full_fd);
+}
+
+int itr_append(ItrWriter *w, uint64_t pc, const uint64_t *regs) {
+    ItrChunk *chunk = w->chunk;
+    int with_regs = (w->flags & ITR_FLAG_REGS) != 0;
+
+    if (chunk && chunk->count < ITR_CHUNK_INSNS &&
+        w->out + ITR_MAX_ENCODED <= (uint8_t *)chunk + ITR_CHUNK_BYTES) {
+        uint8_t *p = put_varint(w->out, zigzag(pc - w->prev_pc));
+        if (with_regs) {
+            uint32_t mask = 0;
+            for (int i = 0; i < ITR_REGS; i++) {
+                if (regs[i] != w->prev_regs[i]) mask |= 1u << i;
+            }
+            p = put_varint(p, mask);
+            for (int i = 0; mask; i++, mask >>= 1) {
+                if (mask & 1) {
+                    p = put_varint(p, zigzag(regs[i] - w->prev_regs[i]));
+                    w->prev_regs[i] = regs[i];
+                }
+            }
+        }
+        w->out = p;
+        w->prev_pc = pc;
+        chunk->count++;
+        w->count++;
+        return 0;
+    }
+
+    // Start a chunk, waiting for a buffer if the writer is that far behind
+    if (chunk) {
+        chunk->size = (uint32_t)(w->out - (uint8_t *)(chunk + 1));
+        submit(w, chunk);
+        w->chunk = NULL;
+    }
+    while (spsc_pop(&w->empty, &chunk) != 0) {
+        wait_fd(w->empty_fd);
+    }
+    if (__atomic_load_n(&w->failed, __ATOMIC_RELAXED)) {
+        spsc_push(&w->empty, &chunk);
+        return -1;
+    }
+
+    memset(chunk, 0, sizeof(*chunk));
+    chunk->first_index = w->count;
+    chunk->first_pc = pc;
+    if (with_regs) {
+        memcpy(chunk->regs, regs, sizeof(chunk->regs));
+        memcpy(w->prev_regs, regs, sizeof(w->prev_regs));
+    }
+    chunk->count = 1;
+    w->chunk = chunk;
+    w->out = (uint8_t *)(chunk + 1);
+    w->prev_pc = pc;
+    w->count++;
+    return 0;
+}
+
+int itr_finish(ItrWriter *w) {
+    if (!w->started) {
+        return -1;
+    }
+    if (w->chunk) {
+        w->chunk->size = (uint32_t)(w->out - (uint8_t *)(w->chunk + 1));
+        submit(w, w->chunk);
+        w->chunk = NULL;
+    }
+    submit(w, NULL);
+    pthread_join(w->thread, NULL);
+
+    ItrFooter f;
+    memset(&f, 0, sizeof(f));
+    f.index_offset = w->offset;
+    f.chunk_count = w->index_count;
+    f.insn_count = w->count;
+    memcpy(f.magic, ITR_MAGIC, 8);
+    int r = w->failed ||
+            write_all(w->fd, w->index, w->index_count * sizeof(*w->index)) != 0 ||
+            write_all(w->fd, &f, sizeof(f)) != 0 ? -1 : 0;
+    release(w);
+    return r;
+}
+
+void itr_init(ItrReader *r) {
+    memset(r, 0, sizeof(*r));
+}
+
+int itr_open(ItrReader *r, const char *path) {
+    itr_close(r);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)(sizeof(ItrFileHeader) + sizeof(ItrFooter))) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    r->map = map;
+    r->size = st.st_size;
+
+    // A trace cut short has no footer and is refused
+    const ItrFileHeader *h = map;
+    const ItrFooter *f = (const ItrFooter *)(r->map + r->size - sizeof(*f));
+    if (memcmp(h->magic, ITR_MAGIC, 8) != 0 || h->version != ITR_VERSION ||
+        memcmp(f->magic, ITR_MAGIC, 8) != 0 || f->index_offset > r->size ||
+        f->chunk_count > (r->size - f->index_offset) / sizeof(ItrIndexEntry) ||
+        f->index_offset + f->chunk_count * sizeof(ItrIndexEntry) + sizeof(*f) != r->size) {
+        itr_close(r);
+        return -1;
+    }
+    r->header = h;
+    r->index = (const ItrIndexEntry *)(r->map + f->index_offset);
+    r->chunk_count = f->chunk_count;
+    r->insn_count = f->insn_count;
+    return 0;
+}
+
+void itr_close(ItrReader *r) {
+    if (r->map) {
+        munmap((void *)r->map, r->size);
+    }
+    memset(r, 0, sizeof(*r));
+}
+
+uint64_t itr_chunk_of(const ItrReader *r, uint64_t index) {
+    uint64_t lo = 0, hi = r->chunk_count;
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (r->index[mid].first_index <= index) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Position c on the first instruction of a chunk
+static int enter_chunk(const ItrReader *r, uint64_t chunk, ItrCursor *c) {
+    uint64_t offset = r->index[chunk].offset;
+    if (offset + sizeof(ItrChunk) > r->size) {
+        return -1;
+    }
+    const ItrChunk *h = (const ItrChunk *)(r->map + offset);
+    if (h->count == 0 || offset + sizeof(*h) + h->size > r->size) {
+        return -1;
+    }
+    c->index = h->first_index;
+    c->pc = h->first_pc;
+    memcpy(c->regs, h->regs, sizeof(c->regs));
+    c->chunk = chunk;
+    c->left = h->count - 1;
+    c->next = (const uint8_t *)(h + 1);
+    c->end = c->next + h->size;
+    return 0;
+}
+
+int itr_next(const ItrReader *r, ItrCursor *c) {
+    if (c->left == 0) {
+        return c->chunk + 1 < r->chunk_count ? enter_chunk(r, c->chunk + 1, c) : -1;
+    }
+
+    uint64_t v;
+    const uint8_t *p = get_varint(c->next, c->end, &v);
+    if (!p) {
+        return -1;
+    }
+    c->pc += unzigzag(v);
+    if (r->header->flags & ITR_FLAG_REGS) {
+        uint64_t mask;
+        if (!(p = get_varint(p, c->end, &mask))) {
+            return -1;
+        }
+        for (int i = 0; mask && i < ITR_REGS; i++, mask >>= 1) {
+            if (!(mask & 1)) continue;
+            if (!(p = get_varint(p, c->end, &v))) {
+                return -1;
+            }
+            c->regs[i] += unzigzag(v);
+        }
+    }
+    c->next = p;
+    c->left--;
+    c->index++;
+    return 0;
+}
+
+int itr_seek(const ItrReader *r, uint64_t index, ItrCursor *c) {
+    if (index >= r->insn_count || enter_chunk(r, itr_chunk_of(r, index), c) != 0) {
+        return -1;
+    }
+    while (c->index < index) {
+        if (itr_next(r, c) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int itr_chunk_pcs(const ItrReader *r, uint64_t chunk, uint64_t *pcs) {
+    ItrCursor c;
+    if (chunk >= r->chunk_count || enter_chunk(r, chunk, &c) != 0) {
+        return -1;
+    }
+    int n = 0;
+    pcs[n++] = c.pc;
+    while (c.left > 0 && n < ITR_CHUNK_INSNS) {
+        if (itr_next(r, &c) != 0) {
+            return -1;
+        }
+        pcs[n++] = c.pc;
+    }
+    return n;
+}
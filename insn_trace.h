@@ -0,0 +1,135 @@
+#ifndef INSN_TRACE_H
+#define INSN_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/user.h>
+#include "spsc_queue.h"
+
+#define ITR_REGS         17           // rax..r15 and eflags, see itr_reg_names
+#define ITR_FLAG_REGS    0x1          // Register changes follow every address
+#define ITR_CHUNK_INSNS  65536        // Instructions per chunk at most
+#define ITR_CHUNK_BYTES  (256 << 10)  // Chunk buffer, header included
+#define ITR_BUFFERS      16           // Chunks the writer may fall behind by
+
+// Trace file: an ItrFileHeader, chunks, the chunk index and an ItrFooter.
+// Each chunk holds its first instruction in full; every later one is the
+// zigzag varint of its address minus the previous one, and with
+// ITR_FLAG_REGS a varint mask of the registers it changed followed by the
+// zigzag varint of each change. Straight-line code takes a byte per
+// instruction. The index gives the chunk holding any instruction number, so
+// a reader maps the file and seeks without reading what comes before.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t load_bias;      // Of the traced program, for pc-to-line lookups
+} ItrFileHeader;
+
+typedef struct {
+    uint64_t first_index;    // Number of the first instruction in the trace
+    uint64_t first_pc;
+    uint64_t regs[ITR_REGS]; // At the first instruction, with ITR_FLAG_REGS
+    uint32_t count;
+    uint32_t size;           // Payload bytes after this header
+} ItrChunk;
+
+typedef struct {
+    uint64_t first_index;
+    uint64_t offset;         // Of the ItrChunk in the file
+} ItrIndexEntry;
+
+typedef struct {
+    uint64_t index_offset;
+    uint64_t chunk_count;
+    uint64_t insn_count;
+    char magic[8];
+} ItrFooter;
+
+extern const char *const itr_reg_names[ITR_REGS];
+
+// The traced registers out of a full register set
+void itr_regs(const struct user_regs_struct *regs, uint64_t *out);
+
+// Appends instructions from the stepping thread. Full chunks go to a writer
+// thread through a queue, and come back empty through another, so stepping
+// waits only if the disk falls ITR_BUFFERS chunks behind.
+typedef struct {
+    int fd;
+    uint32_t flags;
+    pthread_t thread;
+    int started;
+    SpscQueue full;          // ItrChunk pointers, stepping -> writer; NULL ends
+    SpscQueue empty;         // Written chunks back
+    int full_fd;             // eventfds counting pushes onto each queue
+    int empty_fd;
+    uint8_t *pool;
+
+    // Stepping side
+    ItrChunk *chunk;         // Being filled, NULL until the first instruction
+    uint8_t *out;            // Next payload byte
+    uint64_t count;          // Instructions appended
+    uint64_t prev_pc;
+    uint64_t prev_regs[ITR_REGS];
+
+    // Writer side, read by the stepping side only after the join
+    uint64_t offset;         // File size so far
+    ItrIndexEntry *index;
+    uint64_t index_count;
+    uint64_t index_capacity;
+    int failed;
+} ItrWriter;
+
+// Create path and start the writer thread. Returns 0 or -1.
+int itr_create(ItrWriter *w, const char *path, unsigned long load_bias, uint32_t flags);
+
+// Record the next instruction; regs (ITR_REGS values) only with
+// ITR_FLAG_REGS. Returns 0, or -1 once writing has failed.
+int itr_append(ItrWriter *w, uint64_t pc, const uint64_t *regs);
+
+// Hand over the last chunk, wait for the writer, then write the index and
+// close the file. Returns 0, or -1 if anything was lost.
+int itr_finish(ItrWriter *w);
+
+// Trace file mapped for reading
+typedef struct {
+    const uint8_t *map;
+    size_t size;
+    const ItrFileHeader *header;
+    const ItrIndexEntry *index;
+    uint64_t chunk_count;
+    uint64_t insn_count;
+} ItrReader;
+
+// Position in a trace, decoded up to instruction index
+typedef struct {
+    uint64_t index;
+    uint64_t pc;
+    uint64_t regs[ITR_REGS];
+    uint64_t chunk;          // Number of the chunk holding it
+    uint32_t left;           // Instructions after it in the chunk
+    const uint8_t *next;     // Encoding of the one after it
+    const uint8_t *end;      // Of the chunk's payload
+} ItrCursor;
+
+void itr_init(ItrReader *r);
+int itr_open(ItrReader *r, const char *path);
+void itr_close(ItrReader *r);
+
+// Chunk holding instruction index, by binary search in the index
+uint64_t itr_chunk_of(const ItrReader *r, uint64_t index);
+
+// Decode from the start of index's chunk up to it. Returns 0, or -1 past
+// the end.
+int itr_seek(const ItrReader *r, uint64_t index, ItrCursor *c);
+
+// Advance to the next instruction, into the next chunk if need be.
+// Returns 0, or -1 at the end of the trace.
+int itr_next(const ItrReader *r, ItrCursor *c);
+
+// Addresses of every instruction of a chunk, into pcs (ITR_CHUNK_INSNS
+// entries). Returns how many there are, or -1.
+int itr_chunk_pcs(const ItrReader *r, uint64_t chunk, uint64_t *pcs);
+
+#endif
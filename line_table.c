@@ -0,0 +1,468 @@
+#include "line_table.h"
+#include "dwarf_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// DWARF 5 line header content types
+#define DW_LNCT_path            0x1
+#define DW_LNCT_directory_index 0x2
+
+
+typedef struct {
+    LineEntry entry;
+    uint32_t order;
+} SortRow;
+
+typedef struct {
+    SortRow *rows;
+    int count;
+    int capacity;
+} RowBuffer;
+
+typedef struct {
+    const unsigned char *debug_str;
+    size_t debug_str_size;
+    const unsigned char *line_str;
+    size_t line_str_size;
+} StringSections;
+
+void lt_init(LineTable *lt) {
+    memset(lt, 0, sizeof(LineTable));
+}
+
+void lt_free(LineTable *lt) {
+    if (lt->owned) {
+        free(lt->entries);
+        free(lt->file_names);
+        free(lt->strings);
+    }
+    lt_init(lt);
+}
+
+static int push_row(RowBuffer *buf, uint64_t addr, uint32_t line, int file, int flags) {
+    if (buf->count == buf->capacity) {
+        int cap = buf->capacity ? buf->capacity * 2 : 256;
+        SortRow *rows = realloc(buf->rows, cap * sizeof(SortRow));
+        if (!rows) return -1;
+        buf->rows = rows;
+        buf->capacity = cap;
+    }
+    SortRow *r = &buf->rows[buf->count];
+    r->entry.addr = addr;
+    r->entry.line = line;
+    r->entry.file = (uint16_t)(file < 0 || file >= LT_NO_FILE ? LT_NO_FILE : file);
+    r->entry.flags = (uint16_t)flags;
+    r->order = buf->count++;
+    return 0;
+}
+
+// Intern a path into the global file table and return its index
+static int add_file(LineTable *lt, const char *dir, const char *name) {
+    if (lt->file_count == LT_NO_FILE) return -1;
+
+    char path[PATH_MAX];
+    if (name[0] == '/' || !dir || !dir[0]) {
+        snprintf(path, sizeof(path), "%s", name);
+    } else {
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+    }
+
+    for (int i = 0; i < lt->file_count; i++) {
+        if (strcmp(lt->strings + lt->file_names[i], path) == 0) {
+            return i;
+        }
+    }
+
+    size_t len = strlen(path) + 1;
+    char *strings = realloc(lt->strings, lt->strings_size + len);
+    uint32_t *names = realloc(lt->file_names, (lt->file_count + 1) * sizeof(uint32_t));
+    if (strings) lt->strings = strings;
+    if (names) lt->file_names = names;
+    if (!strings || !names) return -1;
+
+    memcpy(lt->strings + lt->strings_size, path, len);
+    lt->file_names[lt->file_count] = (uint32_t)lt->strings_size;
+    lt->strings_size += len;
+    return lt->file_count++;
+}
+
+static const char *section_string(const unsigned char *sec, size_t size, uint64_t off) {
+    if (!sec || off >= size) return "";
+    if (!memchr(sec + off, 0, size - off)) return "";
+    return (const char *)sec + off;
+}
+
+// Read one attribute of a v5 directory/file entry. Strings are returned in
+// *str, integers in *val; everything else is skipped.
+static void read_entry_form(DwarfCursor *c, uint64_t form, int is64,
+                            const StringSections *ss, const char **str, uint64_t *val) {
+    *str = NULL;
+    *val = 0;
+    switch (form) {
+        case DW_FORM_string:    *str = dw_str(c); break;
+        case DW_FORM_line_strp: *str = section_string(ss->line_str, ss->line_str_size, dw_offset(c, is64)); break;
+        case DW_FORM_strp:      *str = section_string(ss->debug_str, ss->debug_str_size, dw_offset(c, is64)); break;
+        case DW_FORM_udata:     *val = dw_uleb(c); break;
+        case DW_FORM_sdata:     *val = (uint64_t)dw_sleb(c); break;
+        case DW_FORM_data1:     *val = dw_u8(c); break;
+        case DW_FORM_data2:     *val = dw_u16(c); break;
+        case DW_FORM_data4:     *val = dw_u32(c); break;
+        case DW_FORM_data8:     *val = dw_u64(c); break;
+        case DW_FORM_data16:    dw_skip(c, 16); break;
+        case DW_FORM_block:     dw_skip(c, dw_uleb(c)); break;
+        case DW_FORM_block1:    dw_skip(c, dw_u8(c)); break;
+        case DW_FORM_block2:    dw_skip(c, dw_u16(c)); break;
+        case DW_FORM_block4:    dw_skip(c, dw_u32(c)); break;
+        default:                c->error = 1; break;
+    }
+}
+
+// Parse a DWARF 5 directory or file name table. For directories, names are
+// stored in out_names; for files, the directory index goes to out_dirs.
+static int read_v5_table(DwarfCursor *c, int is64, const StringSections *ss,
+                         const char ***out_names, uint64_t **out_dirs) {
+    uint8_t format_count = dw_u8(c);
+    uint64_t formats[32][2];
+    if (format_count > 32) return -1;
+    for (int i = 0; i < format_count; i++) {
+        formats[i][0] = dw_uleb(c);
+        formats[i][1] = dw_uleb(c);
+    }
+
+    uint64_t count = dw_uleb(c);
+    if (c->error || count > 65535) return -1;
+
+    const char **names = calloc(count + 1, sizeof(char *));
+    uint64_t *dirs = calloc(count + 1, sizeof(uint64_t));
+    if (!names || !dirs) {
+        free(names);
+        free(dirs);
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < count && !c->error; i++) {
+        names[i] = "";
+        for (int f = 0; f < format_count; f++) {
+            const char *str;
+            uint64_t val;
+            read_entry_form(c, formats[f][1], is64, ss, &str, &val);
+            if (formats[f][0] == DW_LNCT_path && str) names[i] = str;
+            else if (formats[f][0] == DW_LNCT_directory_index) dirs[i] = val;
+        }
+    }
+
+    *out_names = names;
+    if (out_dirs) *out_dirs = dirs;
+    else free(dirs);
+    return (int)count;
+}
+
+// Decode one line number program unit; c is positioned after unit_length
+static int decode_unit(LineTable *lt, RowBuffer *buf, DwarfCursor *c, int is64,
+                       const StringSections *ss) {
+    uint16_t version = dw_u16(c);
+    if (version < 2 || version > 5) return -1;
+
+    if (version >= 5) {
+        dw_u8(c);   // address_size
+        dw_u8(c);   // segment_selector_size
+    }
+
+    uint64_t header_length = dw_offset(c, is64);
+    const unsigned char *program = c->p + header_length;
+
+    uint8_t min_inst_length = dw_u8(c);
+    if (version >= 4) dw_u8(c);   // maximum_operations_per_instruction
+    uint8_t default_is_stmt = dw_u8(c);
+    int8_t line_base = (int8_t)dw_u8(c);
+    uint8_t line_range = dw_u8(c);
+    uint8_t opcode_base = dw_u8(c);
+    uint8_t std_lengths[256] = {0};
+    for (int i = 1; i < opcode_base; i++) {
+        std_lengths[i] = dw_u8(c);
+    }
+    if (c->error || line_range == 0) return -1;
+
+    // Map unit-local file numbers to global file indices
+    int file_map[1024];
+    int file_count = 0;
+
+    if (version >= 5) {
+        const char **dir_names = NULL;
+        const char **file_names = NULL;
+        uint64_t *file_dirs = NULL;
+        int dir_count = read_v5_table(c, is64, ss, &dir_names, NULL);
+        int n = dir_count < 0 ? -1 : read_v5_table(c, is64, ss, &file_names, &file_dirs);
+        for (int i = 0; i < n && file_count < 1024; i++) {
+            const char *dir = file_dirs[i] < (uint64_t)dir_count ? dir_names[file_dirs[i]] : NULL;
+            file_map[file_count++] = add_file(lt, dir, file_names[i]);
+        }
+        free(dir_names);
+        free(file_names);
+        free(file_dirs);
+        if (n < 0) return -1;
+    } else {
+        const char *dirs[256];
+        int dir_count = 1;
+        dirs[0] = NULL;   // Compilation directory is not recorded here
+        while (!c->error) {
+            const char *d = dw_str(c);
+            if (!d[0]) break;
+            if (dir_count < 256) dirs[dir_count++] = d;
+        }
+        // File numbers start at 1 before DWARF 5
+        file_map[file_count++] = -1;
+        while (!c->error) {
+            const char *name = dw_str(c);
+            if (!name[0]) break;
+            uint64_t dir = dw_uleb(c);
+            dw_uleb(c);   // mtime
+            dw_uleb(c);   // length
+            if (file_count < 1024) {
+                file_map[file_count++] = add_file(lt, dir < (uint64_t)dir_count ? dirs[dir] : NULL, name);
+            }
+        }
+    }
+
+    if (program < c->p || program > c->end) return -1;
+    c->p = program;
+
+    // State machine registers
+    uint64_t addr = 0;
+    int64_t line = 1;
+    uint64_t file = 1;
+    int is_stmt = default_is_stmt;
+
+#define CUR_FILE() (file < (uint64_t)file_count ? file_map[file] : -1)
+#define CUR_FLAGS() (is_stmt ? LT_FLAG_STMT : 0)
+
+    while (!c->error && c->p < c->end) {
+        uint8_t op = dw_u8(c);
+
+        if (op >= opcode_base) {
+            int adj = op - opcode_base;
+            addr += (uint64_t)(adj / line_range) * min_inst_length;
+            line += line_base + (adj % line_range);
+            if (push_row(buf, addr, (uint32_t)line, CUR_FILE(), CUR_FLAGS()) != 0) return -1;
+            continue;
+        }
+
+        switch (op) {
+            case 0: {
+                uint64_t len = dw_uleb(c);
+                const unsigned char *next = c->p + len;
+                if (len == 0 || len > (uint64_t)dw_left(c)) return -1;
+                uint8_t sub = dw_u8(c);
+                if (sub == 1) {          // DW_LNE_end_sequence
+                    if (push_row(buf, addr, (uint32_t)line, CUR_FILE(), LT_FLAG_END_SEQ) != 0) return -1;
+                    addr = 0;
+                    line = 1;
+                    file = 1;
+                    is_stmt = default_is_stmt;
+                } else if (sub == 2) {   // DW_LNE_set_address
+                    addr = (len - 1 >= 8) ? dw_u64(c) : dw_u32(c);
+                } else if (sub == 3 && version < 5) {   // DW_LNE_define_file
+                    const char *name = dw_str(c);
+                    if (file_count < 1024) file_map[file_count++] = add_file(lt, NULL, name);
+                }
+                c->p = next;
+                break;
+            }
+            case 1:   // DW_LNS_copy
+                if (push_row(buf, addr, (uint32_t)line, CUR_FILE(), CUR_FLAGS()) != 0) return -1;
+                break;
+            case 2:   // DW_LNS_advance_pc
+                addr += dw_uleb(c) * min_inst_length;
+                break;
+            case 3:   // DW_LNS_advance_line
+                line += dw_sleb(c);
+                break;
+            case 4:   // DW_LNS_set_file
+                file = dw_uleb(c);
+                break;
+            case 6:   // DW_LNS_negate_stmt
+                is_stmt = !is_stmt;
+                break;
+            case 8:   // DW_LNS_const_add_pc
+                addr += (uint64_t)((255 - opcode_base) / line_range) * min_inst_length;
+                break;
+            case 9:   // DW_LNS_fixed_advance_pc
+                addr += dw_u16(c);
+                break;
+            default:
+                // set_column, basic_block, prologue_end, ... and unknown
+                // standard opcodes: skip their ULEB operands
+                for (int i = 0; i < std_lengths[op]; i++) {
+                    dw_uleb(c);
+                }
+                break;
+        }
+    }
+
+#undef CUR_FILE
+#undef CUR_FLAGS
+
+    return c->error ? -1 : 0;
+}
+
+static int compare_rows(const void *a, const void *b) {
+    const SortRow *ra = a;
+    const SortRow *rb = b;
+    if (ra->entry.addr != rb->entry.addr) {
+        return ra->entry.addr < rb->entry.addr ? -1 : 1;
+    }
+    // A sequence ending where another begins must sort first
+    int ea = (ra->entry.flags & LT_FLAG_END_SEQ) != 0;
+    int eb = (rb->entry.flags & LT_FLAG_END_SEQ) != 0;
+    if (ea != eb) {
+        return ea ? -1 : 1;
+    }
+    return ra->order < rb->order ? -1 : (ra->order > rb->order);
+}
+
+int lt_load(LineTable *lt, const ElfFile *ef) {
+    lt_init(lt);
+    lt->owned = 1;
+
+    size_t size;
+    const unsigned char *sec = elf_section(ef, ".debug_line", &size);
+    if (!sec) {
+        return 0;
+    }
+
+    StringSections ss;
+    ss.debug_str = elf_section(ef, ".debug_str", &ss.debug_str_size);
+    ss.line_str = elf_section(ef, ".debug_line_str", &ss.line_str_size);
+
+    RowBuffer buf = {0};
+    DwarfCursor c;
+    dw_init(&c, sec, size);
+
+    while (dw_left(&c) > 0) {
+        int is64;
+        uint64_t unit_length = dw_unit_length(&c, &is64);
+        if (c.error || unit_length > (uint64_t)dw_left(&c)) break;
+
+        DwarfCursor unit;
+        dw_init(&unit, c.p, unit_length);
+        c.p += unit_length;
+
+        // A broken unit only loses its own rows
+        int before = buf.count;
+        if (decode_unit(lt, &buf, &unit, is64, &ss) != 0) {
+            buf.count = before;
+        }
+    }
+
+    qsort(buf.rows, buf.count, sizeof(SortRow), compare_rows);
+
+    lt->entries = malloc((buf.count ? buf.count : 1) * sizeof(LineEntry));
+    if (!lt->entries) {
+        free(buf.rows);
+        lt_free(lt);
+        return -1;
+    }
+    for (int i = 0; i < buf.count; i++) {
+        lt->entries[i] = buf.rows[i].entry;
+    }
+    lt->count = buf.count;
+    free(buf.rows);
+
+    return 0;
+}
+
+const LineEntry *lt_lookup(const LineTable *lt, uint64_t addr) {
+    // Last row with entry.addr <= addr
+    int lo = 0, hi = lt->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (lt->entries[mid].addr <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+
+    if (lo == 0) return NULL;
+    const LineEntry *e = &lt->entries[lo - 1];
+    if (e->flags & LT_FLAG_END_SEQ) return NULL;
+    return e;
+}
+
+int lt_line_range(const LineTable *lt, uint64_t addr, uint64_t *lo, uint64_t *hi) {
+    const LineEntry *e = lt_lookup(lt, addr);
+    if (!e) return -1;
+
+    const LineEntry *first = lt->entries;
+    const LineEntry *last = lt->entries + lt->count;
+
+    const LineEntry *b = e;
+    while (b > first && !((b - 1)->flags & LT_FLAG_END_SEQ) &&
+           (b - 1)->line == e->line && (b - 1)->file == e->file) {
+        b--;
+    }
+
+    const LineEntry *n = e + 1;
+    while (n < last && !(n->flags & LT_FLAG_END_SEQ) &&
+           (n->line == e->line && n->file == e->file)) {
+        n++;
+    }
+    if (n == last) return -1;
+
+    *lo = b->addr;
+    *hi = n->addr;
+    return 0;
+}
+
+int lt_line_address(const LineTable *lt, int file, int line, uint64_t *addr) {
+    const char *name = lt_file_name(lt, file);
+    int best_line = -1;
+    uint64_t best_addr = 0;
+
+    for (int i = 0; i < lt->count; i++) {
+        const LineEntry *e = &lt->entries[i];
+        if ((e->flags & LT_FLAG_END_SEQ) || (int)e->line < line) continue;
+        if (best_line != -1 && (int)e->line > best_line) continue;
+        if (e->file == LT_NO_FILE) continue;
+        if (e->file != file && strcmp(lt_file_name(lt, e->file), name) != 0) continue;
+
+        if ((int)e->line < best_line || best_line == -1 || e->addr < best_addr) {
+            best_line = e->line;
+            best_addr = e->addr;
+        }
+    }
+
+    if (best_line != -1) {
+        *addr = best_addr;
+    }
+    return best_line;
+}
+
+const char *lt_file_name(const LineTable *lt, int file) {
+    if (file < 0 || file == LT_NO_FILE || file >= lt->file_count) return "";
+    return lt->strings + lt->file_names[file];
+}
+
+int lt_find_file(const LineTable *lt, const char *path) {
+    char want[PATH_MAX];
+    char have[PATH_MAX];
+    int by_name = -1;
+
+    if (!realpath(path, want)) {
+        snprintf(want, sizeof(want), "%s", path);
+    }
+    const char *want_base = strrchr(want, '/');
+    want_base = want_base ? want_base + 1 : want;
+
+    for (int i = 0; i < lt->file_count; i++) {
+        const char *name = lt_file_name(lt, i);
+        if (realpath(name, have) && strcmp(have, want) == 0) {
+            return i;
+        }
+        const char *base = strrchr(name, '/');
+        base = base ? base + 1 : name;
+        if (by_name < 0 && strcmp(base, want_base) == 0) {
+            by_name = i;
+        }
+    }
+    return by_name;
+}
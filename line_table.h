@@ -0,0 +1,59 @@
+#ifndef LINE_TABLE_H
+#define LINE_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "elf_file.h"
+
+#define LT_FLAG_STMT     0x1   // Row is a recommended breakpoint location
+#define LT_FLAG_END_SEQ  0x2   // First address past a contiguous sequence
+
+#define LT_NO_FILE UINT16_MAX   // Row whose file number names no file table entry
+
+typedef struct {
+    uint64_t addr;
+    uint32_t line;
+    uint16_t file;
+    uint16_t flags;
+} LineEntry;
+
+// Address-sorted rows decoded from .debug_line, with a global file table.
+// File names live in a string pool and are referenced by offset.
+typedef struct {
+    LineEntry *entries;
+    int count;
+
+    uint32_t *file_names;   // Offsets into strings
+    int file_count;
+
+    char *strings;
+    size_t strings_size;
+
+    int owned;              // Arrays were malloc'd by lt_load
+} LineTable;
+
+void lt_init(LineTable *lt);
+void lt_free(LineTable *lt);
+
+// Decode every .debug_line unit once. A binary without line info yields an
+// empty table and still returns 0.
+int lt_load(LineTable *lt, const ElfFile *ef);
+
+// Row covering addr, or NULL if addr is outside every sequence
+const LineEntry *lt_lookup(const LineTable *lt, uint64_t addr);
+
+// Contiguous address range [lo, hi) of the line containing addr.
+// Returns 0 on success, -1 if addr has no line info.
+int lt_line_range(const LineTable *lt, uint64_t addr, uint64_t *lo, uint64_t *hi);
+
+// Path of a file table entry; "" for LT_NO_FILE
+const char *lt_file_name(const LineTable *lt, int file);
+
+// Lowest address of the first line at or after line in file that has code.
+// Returns that line, or -1 if there is none.
+int lt_line_address(const LineTable *lt, int file, int line, uint64_t *addr);
+
+// Index of the file table entry naming the same file as path, or -1
+int lt_find_file(const LineTable *lt, const char *path);
+
+#endif
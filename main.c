@@ -121,8 +121,12 @@ int main(void) {
             wrefresh(winright);
 
             char status[1024];
-            snprintf(status, sizeof(status), " DEBUG MODE | State: %s | ESC:Exit | r:Run n:Next s:Step",
-                     dbg_state_string(dv.debugger.state));
+            char where[160] = "";
+            if (dv_function_string(&dv)) {
+                snprintf(where, sizeof(where), " in %s()", dv_function_string(&dv));
+            }
+            snprintf(status, sizeof(status), " DEBUG MODE | State: %s%s | ESC:Exit | r:Run n:Next s:Step i:Insn u:Back f:Finish c:Cont p:Pause b/B/F:Break t:Trace w/W:Watch e:Expr a:Asm m:Record k/K:Checkpoint T/V:Insn trace h/H:Profile",
+                     dv_state_string(&dv), where);
             draw_statusbar(LINES - 1, status);
             refresh();
         } else {
@@ -145,9 +149,19 @@ int main(void) {
             refresh();
         }
 
+        // In debug mode engine events redraw the screen as well as keys
+        if (mode == MODE_DEBUG && !dv_wait_input(&dv)) {
+            continue;
+        }
         ch = getch();
 
         if (mode == MODE_DEBUG) {
+            if (ch == KEY_MOUSE) {
+                if (getmouse(&ev) == OK) {
+                    dv_handle_mouse(&dv, &ev, left_width);
+                }
+                continue;
+            }
             int result = dv_handle_key(&dv, ch);
             if (result == 1) {
                 mode = MODE_BROWSE;
@@ -0,0 +1,68 @@
+#include "proc_maps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void maps_init(MapsTable *mt) {
+    memset(mt, 0, sizeof(MapsTable));
+}
+
+void maps_free(MapsTable *mt) {
+    free(mt->regions);
+    maps_init(mt);
+}
+
+int maps_load(MapsTable *mt, pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        mt->count = 0;
+        return -1;
+    }
+
+    mt->count = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        if (mt->count == mt->capacity) {
+            int cap = mt->capacity ? mt->capacity * 2 : 64;
+            MapRegion *regions = realloc(mt->regions, cap * sizeof(MapRegion));
+            if (!regions) break;
+            mt->regions = regions;
+            mt->capacity = cap;
+        }
+
+        MapRegion *r = &mt->regions[mt->count];
+        int name_pos = 0;
+        if (sscanf(line, "%lx-%lx %4s %lx %*s %*s %n",
+                   &r->start, &r->end, r->perms, &r->offset, &name_pos) < 4) {
+            continue;
+        }
+
+        line[strcspn(line, "\n")] = 0;
+        snprintf(r->path, sizeof(r->path), "%s", name_pos > 0 ? line + name_pos : "");
+        mt->count++;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+int maps_index(const MapsTable *mt, unsigned long addr) {
+    int lo = 0, hi = mt->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (mt->regions[mid].end <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+const MapRegion *maps_find(const MapsTable *mt, unsigned long addr) {
+    int i = maps_index(mt, addr);
+    if (i < mt->count && mt->regions[i].start <= addr) {
+        return &mt->regions[i];
+    }
+    return NULL;
+}
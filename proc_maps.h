@@ -0,0 +1,31 @@
+#ifndef PROC_MAPS_H
+#define PROC_MAPS_H
+
+#include <sys/types.h>
+
+typedef struct {
+    unsigned long start;
+    unsigned long end;
+    unsigned long offset;
+    char perms[5];
+    char path[256];
+} MapRegion;
+
+// Snapshot of /proc/pid/maps, sorted by address as the kernel reports it
+typedef struct {
+    MapRegion *regions;
+    int count;
+    int capacity;
+} MapsTable;
+
+void maps_init(MapsTable *mt);
+void maps_free(MapsTable *mt);
+int maps_load(MapsTable *mt, pid_t pid);
+
+// Index of the first region ending above addr; count if there is none
+int maps_index(const MapsTable *mt, unsigned long addr);
+
+// Region containing addr, or NULL
+const MapRegion *maps_find(const MapsTable *mt, unsigned long addr);
+
+#endif
@@ -0,0 +1,125 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Line keys have the top bit set; function addresses never do
+#define PROF_LINE_KEY(file, line) \
+    ((1ULL << 63) | ((uint64_t)(uint32_t)(file) << 32) | (uint32_t)(line))
+
+void prof_init(Profile *p) {
+    memset(p, 0, sizeof(Profile));
+}
+
+void prof_free(Profile *p) {
+    free(p->slots);
+    prof_init(p);
+}
+
+void prof_clear(Profile *p) {
+    if (p->slots) {
+        memset(p->slots, 0, p->capacity * sizeof(ProfEntry));
+    }
+    p->count = 0;
+    p->total = 0;
+    p->outside = 0;
+}
+
+static unsigned int prof_hash(uint64_t key) {
+    // Same Fibonacci hashing as the breakpoint map
+    return (unsigned int)((key * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+static const ProfEntry *prof_find(const Profile *p, uint64_t key) {
+    if (p->count == 0) {
+        return NULL;
+    }
+    unsigned int mask = p->capacity - 1;
+    for (unsigned int i = prof_hash(key) & mask; ; i = (i + 1) & mask) {
+        if (p->slots[i].key == key) {
+            return &p->slots[i];
+        }
+        if (p->slots[i].key == 0) {
+            return NULL;
+        }
+    }
+}
+
+static int prof_rehash(Profile *p, int capacity) {
+    ProfEntry *slots = calloc(capacity, sizeof(ProfEntry));
+    if (!slots) {
+        return -1;
+    }
+    unsigned int mask = capacity - 1;
+    for (int i = 0; i < p->capacity; i++) {
+        if (p->slots[i].key == 0) continue;
+        unsigned int j = prof_hash(p->slots[i].key) & mask;
+        while (slots[j].key != 0) {
+            j = (j + 1) & mask;
+        }
+        slots[j] = p->slots[i];
+    }
+    free(p->slots);
+    p->slots = slots;
+    p->capacity = capacity;
+    return 0;
+}
+
+static int prof_count(Profile *p, uint64_t key) {
+    // Load factor under 1/2 keeps probe chains short
+    if ((p->count + 1) * 2 > p->capacity &&
+        prof_rehash(p, p->capacity ? p->capacity * 2 : 256) != 0) {
+        return -1;
+    }
+
+    unsigned int mask = p->capacity - 1;
+    unsigned int i = prof_hash(key) & mask;
+    while (p->slots[i].key != 0 && p->slots[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    if (p->slots[i].key == 0) {
+        p->slots[i].key = key;
+        p->count++;
+    }
+    p->slots[i].count++;
+    return 0;
+}
+
+int prof_add(Profile *p, int file, int line, uint64_t function) {
+    p->total++;
+    if (line <= 0) {
+        p->outside++;
+    } else if (prof_count(p, PROF_LINE_KEY(file, line)) != 0) {
+        return -1;
+    }
+    if (function != 0 && prof_count(p, function) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+unsigned long prof_line(const Profile *p, int file, int line) {
+    const ProfEntry *e = prof_find(p, PROF_LINE_KEY(file, line));
+    return e ? e->count : 0;
+}
+
+unsigned long prof_function(const Profile *p, uint64_t function) {
+    const ProfEntry *e = prof_find(p, function);
+    return e ? e->count : 0;
+}
+
+int prof_top_functions(const Profile *p, ProfEntry *out, int max) {
+    int n = 0;
+    for (int i = 0; i < p->capacity; i++) {
+        const ProfEntry *e = &p->slots[i];
+        if (e->key == 0 || (e->key >> 63)) continue;
+
+        // Insertion into the short sorted list
+        int j = n < max ? n++ : max;
+        while (j > 0 && out[j - 1].count < e->count) {
+            if (j < max) out[j] = out[j - 1];
+            j--;
+        }
+        if (j < max) out[j] = *e;
+    }
+    return n;
+}
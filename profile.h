@@ -0,0 +1,41 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#define PROF_HZ 1000     // Samples per second while profiling
+
+typedef struct {
+    uint64_t key;        // 0 = empty slot
+    unsigned long count;
+} ProfEntry;
+
+// Samples of where a program spent its time, counted per source line and
+// per function in one open-addressing table with linear probing. A sample
+// costs two increments; nothing is removed until the profile is cleared.
+typedef struct {
+    ProfEntry *slots;
+    int capacity;
+    int count;
+    unsigned long total;     // Samples taken
+    unsigned long outside;   // Of those, in code without line info (libraries)
+} Profile;
+
+void prof_init(Profile *p);
+void prof_free(Profile *p);
+
+// Forget the samples, keeping the table
+void prof_clear(Profile *p);
+
+// Count a sample at line of file (line 0 = no line info) in the function
+// starting at function (0 = none). Returns 0, or -1 when out of memory.
+int prof_add(Profile *p, int file, int line, uint64_t function);
+
+unsigned long prof_line(const Profile *p, int file, int line);
+unsigned long prof_function(const Profile *p, uint64_t function);
+
+// Functions with the most samples, largest first, into out: the entry key
+// is the function's address. Returns how many, at most max.
+int prof_top_functions(const Profile *p, ProfEntry *out, int max);
+
+#endif
@@ -0,0 +1,224 @@
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAP_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+void snap_init(SnapshotRing *sr) {
+    memset(sr, 0, sizeof(SnapshotRing));
+}
+
+void snap_free(SnapshotRing *sr) {
+    free(sr->ring);
+    free(sr->pending);
+    free(sr->shadow_keys);
+    free(sr->shadow_index);
+    free(sr->shadow_pages);
+    snap_init(sr);
+}
+
+int snap_alloc(SnapshotRing *sr, size_t ring_size, int max_pages) {
+    if (sr->ring_size != ring_size) {
+        uint8_t *ring = malloc(ring_size);
+        if (!ring) {
+            return -1;
+        }
+        free(sr->ring);
+        sr->ring = ring;
+        sr->ring_size = ring_size;
+    }
+    sr->shadow_max = max_pages;
+    snap_clear(sr);
+    return 0;
+}
+
+void snap_clear(SnapshotRing *sr) {
+    sr->first = 0;
+    sr->count = 0;
+    sr->bytes = 0;
+    sr->pending_size = 0;
+    if (sr->shadow_keys) {
+        memset(sr->shadow_keys, 0, sr->shadow_capacity * sizeof(uint64_t));
+    }
+    sr->shadow_count = 0;
+}
+
+static unsigned int page_hash(uint64_t addr) {
+    return (unsigned int)(((addr / SNAP_PAGE_SIZE) * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+// Double the key table, keeping the page copies where they are
+static int grow_shadow(SnapshotRing *sr) {
+    int capacity = sr->shadow_capacity ? sr->shadow_capacity * 2 : 1024;
+    uint64_t *keys = calloc(capacity, sizeof(uint64_t));
+    uint32_t *index = malloc(capacity * sizeof(uint32_t));
+    uint8_t *pages = realloc(sr->shadow_pages, (size_t)(capacity / 2) * SNAP_PAGE_SIZE);
+    if (!keys || !index || !pages) {
+        free(keys);
+        free(index);
+        if (pages) sr->shadow_pages = pages;
+        return -1;
+    }
+    sr->shadow_pages = pages;
+
+    unsigned int mask = capacity - 1;
+    for (int i = 0; i < sr->shadow_capacity; i++) {
+        if (!sr->shadow_keys[i]) continue;
+        unsigned int j = page_hash(sr->shadow_keys[i] - 1) & mask;
+        while (keys[j]) {
+            j = (j + 1) & mask;
+        }
+        keys[j] = sr->shadow_keys[i];
+        index[j] = sr->shadow_index[i];
+    }
+    free(sr->shadow_keys);
+    free(sr->shadow_index);
+    sr->shadow_keys = keys;
+    sr->shadow_index = index;
+    sr->shadow_capacity = capacity;
+    return 0;
+}
+
+uint8_t *snap_shadow(SnapshotRing *sr, uint64_t addr, int create) {
+    if (sr->shadow_capacity) {
+        unsigned int mask = sr->shadow_capacity - 1;
+        for (unsigned int i = page_hash(addr) & mask; sr->shadow_keys[i]; i = (i + 1) & mask) {
+            if (sr->shadow_keys[i] == addr + 1) {
+                return sr->shadow_pages + (size_t)sr->shadow_index[i] * SNAP_PAGE_SIZE;
+            }
+        }
+    }
+    if (!create || sr->shadow_count >= sr->shadow_max) {
+        return NULL;
+    }
+
+    // At most half full, so the pages array (capacity / 2) always has room
+    if ((sr->shadow_count + 1) * 2 > sr->shadow_capacity && grow_shadow(sr) != 0) {
+        return NULL;
+    }
+    unsigned int mask = sr->shadow_capacity - 1;
+    unsigned int i = page_hash(addr) & mask;
+    while (sr->shadow_keys[i]) {
+        i = (i + 1) & mask;
+    }
+    sr->shadow_keys[i] = addr + 1;
+    sr->shadow_index[i] = sr->shadow_count++;
+    uint8_t *page = sr->shadow_pages + (size_t)sr->shadow_index[i] * SNAP_PAGE_SIZE;
+    memset(page, 0, SNAP_PAGE_SIZE);
+    return page;
+}
+
+static int reserve_pending(SnapshotRing *sr, size_t more) {
+    if (sr->pending_size + more <= sr->pending_capacity) {
+        return 0;
+    }
+    size_t capacity = sr->pending_capacity ? sr->pending_capacity : 65536;
+    while (capacity < sr->pending_size + more) {
+        capacity *= 2;
+    }
+    uint8_t *pending = realloc(sr->pending, capacity);
+    if (!pending) {
+        return -1;
+    }
+    sr->pending = pending;
+    sr->pending_capacity = capacity;
+    return 0;
+}
+
+int snap_begin(SnapshotRing *sr, const struct user_regs_struct *regs) {
+    sr->pending_size = 0;
+    if (reserve_pending(sr, sizeof(SnapRecord)) != 0) {
+        return -1;
+    }
+    SnapRecord *rec = (SnapRecord *)sr->pending;
+    memset(rec, 0, sizeof(*rec));
+    rec->regs = *regs;
+    sr->pending_size = sizeof(SnapRecord);
+    return 0;
+}
+
+int snap_add(SnapshotRing *sr, uint64_t addr, const void *old, uint32_t len) {
+    size_t size = sizeof(SnapDelta) + SNAP_ALIGN(len);
+    if (reserve_pending(sr, size) != 0) {
+        return -1;
+    }
+    SnapDelta *d = (SnapDelta *)(sr->pending + sr->pending_size);
+    d->addr = addr;
+    d->len = len;
+    d->reserved = 0;
+    memcpy(d + 1, old, len);
+    memset((uint8_t *)(d + 1) + len, 0, SNAP_ALIGN(len) - len);
+    sr->pending_size += size;
+    ((SnapRecord *)sr->pending)->delta_count++;
+    return 0;
+}
+
+static const SnapRecord *record_at(const SnapshotRing *sr, int i) {
+    return (const SnapRecord *)(sr->ring + sr->offsets[(sr->first + i) % SNAP_MAX_STOPS]);
+}
+
+static void drop_oldest(SnapshotRing *sr) {
+    sr->bytes -= record_at(sr, 0)->size;
+    sr->first = (sr->first + 1) % SNAP_MAX_STOPS;
+    sr->count--;
+}
+
+// Where a record of size bytes goes without overwriting a held one: after
+// the newest, or at the start of the ring once the end is too close.
+// Returns the offset, or -1.
+static long find_room(const SnapshotRing *sr, size_t size) {
+    if (sr->count == 0) {
+        return size <= sr->ring_size ? 0 : -1;
+    }
+    const SnapRecord *oldest = record_at(sr, 0);
+    const SnapRecord *newest = record_at(sr, sr->count - 1);
+    size_t lo = (const uint8_t *)oldest - sr->ring;
+    size_t end = (const uint8_t *)newest - sr->ring + newest->size;
+    if (lo >= end) {
+        // Held records wrap around: the free space lies between them
+        return end + size <= lo ? (long)end : -1;
+    }
+    if (end + size <= sr->ring_size) {
+        return (long)end;
+    }
+    return size <= lo ? 0 : -1;
+}
+
+int snap_commit(SnapshotRing *sr) {
+    size_t size = sr->pending_size;
+    sr->pending_size = 0;
+    if (size > sr->ring_size || size > UINT32_MAX) {
+        // The stops before this one cannot be reached without it
+        sr->count = 0;
+        sr->bytes = 0;
+        return -1;
+    }
+    ((SnapRecord *)sr->pending)->size = (uint32_t)size;
+
+    long at;
+    while ((at = find_room(sr, size)) < 0 || sr->count == SNAP_MAX_STOPS) {
+        drop_oldest(sr);
+    }
+    memcpy(sr->ring + at, sr->pending, size);
+    sr->offsets[(sr->first + sr->count) % SNAP_MAX_STOPS] = (uint32_t)at;
+    sr->count++;
+    sr->bytes += size;
+    return 0;
+}
+
+const SnapRecord *snap_newest(const SnapshotRing *sr) {
+    return sr->count > 0 ? record_at(sr, sr->count - 1) : NULL;
+}
+
+const SnapDelta *snap_next_delta(const SnapRecord *rec, const SnapDelta *prev) {
+    const uint8_t *p = prev ? (const uint8_t *)(prev + 1) + SNAP_ALIGN(prev->len)
+                            : (const uint8_t *)(rec + 1);
+    return p < (const uint8_t *)rec + rec->size ? (const SnapDelta *)p : NULL;
+}
+
+void snap_pop(SnapshotRing *sr) {
+    if (sr->count > 0) {
+        sr->bytes -= snap_newest(sr)->size;
+        sr->count--;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/user.h>
+
+#define SNAP_PAGE_SIZE   4096
+#define SNAP_MAX_STOPS   4096       // Stops kept at most, whatever their size
+
+// State of the tracee at an earlier stop, relative to the stop after it:
+// the registers then, and the old bytes of every range written since.
+// delta_count SnapDelta headers follow in the ring, each followed by len
+// bytes padded to 8.
+typedef struct {
+    struct user_regs_struct regs;
+    uint32_t delta_count;
+    uint32_t size;           // Whole record, this header included
+} SnapRecord;
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint32_t reserved;
+} SnapDelta;
+
+// Recording of user-visible stops for stepping back.
+//
+// shadow mirrors the tracee's writable memory as of the newest stop, one
+// copy per page in a hash table; a page it does not hold is all zero. At
+// each stop the pages the kernel marked written are compared with their
+// copies, and only the changed bytes of each go into the undo record, so
+// a stop costs in proportion to what the program wrote.
+//
+// Records live back to back in a fixed byte ring allocated up front; the
+// oldest are dropped to make room, so the budget never grows.
+typedef struct {
+    uint8_t *ring;
+    size_t ring_size;
+    uint32_t offsets[SNAP_MAX_STOPS];    // Of each record, oldest first from first
+    int first;
+    int count;
+    size_t bytes;                        // Held by records
+
+    uint8_t *pending;                    // Record being built
+    size_t pending_size;
+    size_t pending_capacity;
+
+    uint64_t *shadow_keys;               // Page address + 1, 0 = empty
+    uint32_t *shadow_index;              // Into shadow_pages
+    int shadow_capacity;                 // Power of two
+    uint8_t *shadow_pages;
+    int shadow_count;
+    int shadow_max;                      // Pages the shadow may hold
+} SnapshotRing;
+
+void snap_init(SnapshotRing *sr);
+void snap_free(SnapshotRing *sr);
+
+// Allocate the ring and allow max_pages of shadow. Returns 0 or -1.
+int snap_alloc(SnapshotRing *sr, size_t ring_size, int max_pages);
+
+// Drop every record and the shadow, keeping the allocation
+void snap_clear(SnapshotRing *sr);
+
+// Copy of the page at addr, NULL if it is all zero. With create, a zero
+// page is added and returned; NULL then means the shadow is full.
+uint8_t *snap_shadow(SnapshotRing *sr, uint64_t addr, int create);
+
+// Build the record for the stop before this one: begin, add the old bytes
+// of each changed range, then commit, which drops the oldest records until
+// it fits. Returns 0, or -1 if out of memory, or if the record is larger
+// than the ring, which then drops every record.
+int snap_begin(SnapshotRing *sr, const struct user_regs_struct *regs);
+int snap_add(SnapshotRing *sr, uint64_t addr, const void *old, uint32_t len);
+int snap_commit(SnapshotRing *sr);
+
+// Newest record, or NULL, and the deltas after it
+const SnapRecord *snap_newest(const SnapshotRing *sr);
+const SnapDelta *snap_next_delta(const SnapRecord *rec, const SnapDelta *prev);
+static inline const uint8_t *snap_delta_bytes(const SnapDelta *d) {
+    return (const uint8_t *)(d + 1);
+}
+
+// Forget the newest record once it has been applied
+void snap_pop(SnapshotRing *sr);
+
+#endif
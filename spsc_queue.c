@@ -0,0 +1,51 @@
+#include "spsc_queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+int spsc_init(SpscQueue *q, unsigned int capacity, size_t item_size) {
+    unsigned int size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    q->items = malloc((size_t)size * item_size);
+    if (!q->items) {
+        return -1;
+    }
+    q->item_size = item_size;
+    q->mask = size - 1;
+    q->head = 0;
+    q->tail = 0;
+    return 0;
+}
+
+void spsc_free(SpscQueue *q) {
+    free(q->items);
+    q->items = NULL;
+}
+
+int spsc_push(SpscQueue *q, const void *item) {
+    unsigned int tail = q->tail;
+    unsigned int head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if (tail - head > q->mask) {
+        return -1;
+    }
+
+    memcpy(q->items + (size_t)(tail & q->mask) * q->item_size, item, q->item_size);
+    // The item must be visible before the consumer can see the new tail
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int spsc_pop(SpscQueue *q, void *item) {
+    unsigned int head = q->head;
+    unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return -1;
+    }
+
+    memcpy(item, q->items + (size_t)(head & q->mask) * q->item_size, q->item_size);
+    // Done reading the slot before the producer may reuse it
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+
+// Bounded ring of fixed-size items for exactly one producer thread and one
+// consumer thread. Each index is written by one side only and published with
+// release/acquire ordering, so neither side takes a lock. The indices sit on
+// separate cache lines to keep the two threads from trading the line.
+typedef struct {
+    unsigned char *items;
+    size_t item_size;
+    unsigned int mask;       // Capacity - 1; capacity is a power of two
+    unsigned int head __attribute__((aligned(64)));   // Next item to pop, consumer-owned
+    unsigned int tail __attribute__((aligned(64)));   // Next free slot, producer-owned
+} SpscQueue;
+
+// Capacity is rounded up to a power of two. Returns 0 or -1.
+int spsc_init(SpscQueue *q, unsigned int capacity, size_t item_size);
+void spsc_free(SpscQueue *q);
+
+// Copy item in; -1 when full. Producer only.
+int spsc_push(SpscQueue *q, const void *item);
+
+// Copy the oldest item out; -1 when empty. Consumer only.
+int spsc_pop(SpscQueue *q, void *item);
+
+#endif
@@ -0,0 +1,193 @@
+#include "symbols.h"
+#include <stdlib.h>
+#include <string.h>
+
+void sym_init(SymbolTable *st) {
+    memset(st, 0, sizeof(SymbolTable));
+}
+
+void sym_free(SymbolTable *st) {
+    if (st->owned) {
+        free(st->funcs);
+        free(st->strings);
+        free(st->names);
+    }
+    sym_init(st);
+}
+
+static int compare_funcs(const void *a, const void *b) {
+    const FuncSymbol *fa = a;
+    const FuncSymbol *fb = b;
+    if (fa->addr != fb->addr) {
+        return fa->addr < fb->addr ? -1 : 1;
+    }
+    return 0;
+}
+
+// FNV-1a over the first len bytes of name
+static uint32_t hash_name(const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Slot holding name, or the empty slot where it would go
+static uint32_t *name_slot(const SymbolTable *st, const char *name, size_t len) {
+    uint32_t mask = (uint32_t)st->name_capacity - 1;
+    for (uint32_t i = hash_name(name, len) & mask;; i = (i + 1) & mask) {
+        uint32_t *slot = &st->names[i];
+        if (*slot == 0) {
+            return slot;
+        }
+        const char *s = st->strings + st->funcs[*slot - 1].name;
+        if (strncmp(s, name, len) == 0 && s[len] == '\0') {
+            return slot;
+        }
+    }
+}
+
+// Name of symbol i if it is a defined function, else NULL. String tables
+// may share one tail between names, so each is measured on its own.
+static const char *function_name(const ElfFile *ef, const Elf64_Shdr *symtab, size_t i, size_t *len) {
+    const Elf64_Shdr *strtab = &ef->shdrs[symtab->sh_link];
+    const Elf64_Sym *s = (const Elf64_Sym *)(ef->map + symtab->sh_offset) + i;
+    if (ELF64_ST_TYPE(s->st_info) != STT_FUNC ||
+        s->st_shndx == SHN_UNDEF || s->st_value == 0 ||
+        s->st_name >= strtab->sh_size) {
+        return NULL;
+    }
+    const char *name = (const char *)(ef->map + strtab->sh_offset) + s->st_name;
+    *len = strnlen(name, strtab->sh_size - s->st_name);
+    return name;
+}
+
+// Append the defined functions of one symbol table section. A name seen
+// before shares its string; from .dynsym it is the same function again.
+static void add_symbols(SymbolTable *st, const ElfFile *ef, const Elf64_Shdr *symtab, int dynamic) {
+    const Elf64_Sym *syms = (const Elf64_Sym *)(ef->map + symtab->sh_offset);
+    size_t nsyms = symtab->sh_size / sizeof(Elf64_Sym);
+
+    for (size_t i = 0; i < nsyms; i++) {
+        size_t len;
+        const char *name = function_name(ef, symtab, i, &len);
+        if (!name) {
+            continue;
+        }
+        uint32_t *slot = name_slot(st, name, len);
+        if (*slot && dynamic) {
+            continue;
+        }
+
+        FuncSymbol *fs = &st->funcs[st->count++];
+        fs->addr = syms[i].st_value;
+        fs->size = syms[i].st_size;
+        fs->reserved = 0;
+        if (*slot) {
+            fs->name = st->funcs[*slot - 1].name;
+            continue;
+        }
+        fs->name = (uint32_t)st->strings_size;
+        memcpy(st->strings + st->strings_size, name, len);
+        st->strings[st->strings_size + len] = '\0';
+        st->strings_size += len + 1;
+        *slot = (uint32_t)st->count;
+    }
+}
+
+static const Elf64_Shdr *symbol_section(const ElfFile *ef, const char *name) {
+    const Elf64_Shdr *symtab = elf_section_header(ef, name);
+    if (!symtab || symtab->sh_link >= (Elf64_Word)ef->shnum ||
+        symtab->sh_offset + symtab->sh_size > ef->size) {
+        return NULL;
+    }
+    const Elf64_Shdr *strtab = &ef->shdrs[symtab->sh_link];
+    if (strtab->sh_offset + strtab->sh_size > ef->size) {
+        return NULL;
+    }
+    return symtab;
+}
+
+int sym_load(SymbolTable *st, const ElfFile *ef) {
+    sym_init(st);
+    st->owned = 1;
+
+    // .dynsym covers stripped binaries and adds nothing new otherwise
+    const Elf64_Shdr *sections[2] = { symbol_section(ef, ".symtab"), symbol_section(ef, ".dynsym") };
+    size_t nfuncs = 0, string_bytes = 1;
+    for (int i = 0; i < 2; i++) {
+        size_t nsyms = sections[i] ? sections[i]->sh_size / sizeof(Elf64_Sym) : 0;
+        for (size_t j = 0; j < nsyms; j++) {
+            size_t len;
+            if (function_name(ef, sections[i], j, &len)) {
+                nfuncs++;
+                string_bytes += len + 1;
+            }
+        }
+    }
+    if (nfuncs == 0) {
+        return 0;
+    }
+
+    st->name_capacity = 16;
+    while ((size_t)st->name_capacity < nfuncs * 2) {
+        st->name_capacity *= 2;
+    }
+    st->funcs = malloc(nfuncs * sizeof(FuncSymbol));
+    st->strings = malloc(string_bytes);
+    st->names = calloc(st->name_capacity, sizeof(uint32_t));
+    if (!st->funcs || !st->strings || !st->names) {
+        sym_free(st);
+        return -1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (sections[i]) {
+            add_symbols(st, ef, sections[i], i == 1);
+        }
+    }
+    qsort(st->funcs, st->count, sizeof(FuncSymbol), compare_funcs);
+
+    // Sorting moved the functions: map each name to its lowest address
+    memset(st->names, 0, st->name_capacity * sizeof(uint32_t));
+    for (int i = 0; i < st->count; i++) {
+        const char *name = st->strings + st->funcs[i].name;
+        uint32_t *slot = name_slot(st, name, strlen(name));
+        if (*slot == 0) {
+            *slot = (uint32_t)i + 1;
+        }
+    }
+    return 0;
+}
+
+const FuncSymbol *sym_lookup(const SymbolTable *st, uint64_t addr) {
+    int lo = 0, hi = st->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (st->funcs[mid].addr <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+
+    // Aliases share an address; any of them with a covering size will do
+    for (int i = lo - 1; i >= 0 && st->funcs[i].addr == st->funcs[lo - 1].addr; i--) {
+        const FuncSymbol *fs = &st->funcs[i];
+        if (addr < fs->addr + (fs->size ? fs->size : 1)) {
+            return fs;
+        }
+    }
+    return NULL;
+}
+
+const FuncSymbol *sym_find(const SymbolTable *st, const char *name) {
+    if (st->name_capacity == 0) {
+        return NULL;
+    }
+    uint32_t slot = *name_slot(st, name, strlen(name));
+    return slot ? &st->funcs[slot - 1] : NULL;
+}
+
+const char *sym_name(const SymbolTable *st, const FuncSymbol *fs) {
+    if (!fs || fs->name >= st->strings_size) return "";
+    return st->strings + fs->name;
+}
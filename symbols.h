@@ -0,0 +1,44 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "elf_file.h"
+
+typedef struct {
+    uint64_t addr;
+    uint64_t size;
+    uint32_t name;   // Offset into strings
+    uint32_t reserved;
+} FuncSymbol;
+
+// Defined functions from .symtab and .dynsym, sorted by address. Each name
+// is stored once in strings, and names maps it to its first function:
+// open addressing over a power-of-two table of funcs indices plus one
+// (0 = empty), so lookups in either direction never allocate.
+typedef struct {
+    FuncSymbol *funcs;
+    int count;
+
+    char *strings;
+    size_t strings_size;
+
+    uint32_t *names;
+    int name_capacity;
+
+    int owned;       // Arrays were malloc'd by sym_load
+} SymbolTable;
+
+void sym_init(SymbolTable *st);
+void sym_free(SymbolTable *st);
+int sym_load(SymbolTable *st, const ElfFile *ef);
+
+// Function containing addr, or NULL
+const FuncSymbol *sym_lookup(const SymbolTable *st, uint64_t addr);
+
+// Function called name, or NULL. Where names repeat (static functions in
+// different files), the one at the lowest address.
+const FuncSymbol *sym_find(const SymbolTable *st, const char *name);
+const char *sym_name(const SymbolTable *st, const FuncSymbol *fs);
+
+#endif
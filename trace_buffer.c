@@ -0,0 +1,48 @@
+#include "trace_buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+void tb_init(TraceBuffer *tb) {
+    memset(tb, 0, sizeof(TraceBuffer));
+}
+
+void tb_free(TraceBuffer *tb) {
+    free(tb->samples);
+    tb_init(tb);
+}
+
+int tb_alloc(TraceBuffer *tb, int capacity) {
+    if (tb->samples) {
+        return 0;
+    }
+
+    int size = 1;
+    while (size < capacity) size <<= 1;
+
+    tb->samples = calloc(size, sizeof(TraceSample));
+    if (!tb->samples) {
+        return -1;
+    }
+    tb->capacity = size;
+    tb->total = 0;
+    return 0;
+}
+
+void tb_clear(TraceBuffer *tb) {
+    tb->total = 0;
+}
+
+TraceSample *tb_next(TraceBuffer *tb) {
+    TraceSample *s = &tb->samples[tb->total & (tb->capacity - 1)];
+    s->seq = tb->total++;
+    return s;
+}
+
+int tb_count(const TraceBuffer *tb) {
+    return tb->total < (uint64_t)tb->capacity ? (int)tb->total : tb->capacity;
+}
+
+const TraceSample *tb_get(const TraceBuffer *tb, int i) {
+    uint64_t first = tb->total - tb_count(tb);
+    return &tb->samples[(first + i) & (tb->capacity - 1)];
+}
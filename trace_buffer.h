@@ -0,0 +1,38 @@
+#ifndef TRACE_BUFFER_H
+#define TRACE_BUFFER_H
+
+#include <stdint.h>
+
+#define TRACE_MAX_VALUES 4
+
+// Values one tracepoint hit collected
+typedef struct {
+    uint64_t seq;            // Number of the sample since the run started
+    int line;
+    uint8_t count;
+    uint8_t valid;           // Bit n set if values[n] could be read
+    uint16_t reserved;
+    int64_t values[TRACE_MAX_VALUES];
+} TraceSample;
+
+// Fixed-size ring allocated up front; recording never allocates and the
+// oldest samples are overwritten once it is full
+typedef struct {
+    TraceSample *samples;
+    int capacity;            // Power of two
+    uint64_t total;          // Samples ever written
+} TraceBuffer;
+
+void tb_init(TraceBuffer *tb);
+void tb_free(TraceBuffer *tb);
+int tb_alloc(TraceBuffer *tb, int capacity);
+void tb_clear(TraceBuffer *tb);
+
+// Slot for the next sample, with seq filled in
+TraceSample *tb_next(TraceBuffer *tb);
+
+// Samples still held, and the i-th oldest of them
+int tb_count(const TraceBuffer *tb);
+const TraceSample *tb_get(const TraceBuffer *tb, int i);
+
+#endif
@@ -0,0 +1,326 @@
+#define _GNU_SOURCE   // process_vm_readv, process_vm_writev
+#include "tracee_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+
+#define TC_REG_COUNT  ((int)(sizeof(struct user_regs_struct) / 8))
+#define TC_REGS_ALL   ((1UL << TC_REG_COUNT) - 1)
+
+#define PM_PRESENT     (1ULL << 63)   // /proc/pid/pagemap entry bits
+#define PM_SWAPPED     (1ULL << 62)
+#define PM_SOFT_DIRTY  (1ULL << 55)
+#define PM_BATCH       64             // Entries fetched per pread
+
+void tc_init(TraceeCache *tc) {
+    memset(tc, 0, sizeof(TraceeCache));
+    tc->pid = -1;
+    tc->mem_fd = -1;
+    tc->pagemap_fd = -1;
+    tc->clear_refs_fd = -1;
+    tc->gen = 1;
+}
+
+void tc_attach(TraceeCache *tc, pid_t pid) {
+    tc_detach(tc);
+    tc->pid = pid;
+    tc->vm_ok = 1;
+}
+
+void tc_detach(TraceeCache *tc) {
+    if (tc->mem_fd != -1) {
+        close(tc->mem_fd);
+        tc->mem_fd = -1;
+    }
+    if (tc->pagemap_fd != -1) {
+        close(tc->pagemap_fd);
+        tc->pagemap_fd = -1;
+    }
+    if (tc->clear_refs_fd != -1) {
+        close(tc->clear_refs_fd);
+        tc->clear_refs_fd = -1;
+    }
+    tc->pid = -1;
+    tc_invalidate(tc);
+}
+
+// One transfer between buf and the tracee, bypassing the cache. Once text
+// has refused a write, later writes go straight to /proc/pid/mem, which
+// accepts any mapped page.
+static ssize_t transfer(TraceeCache *tc, unsigned long addr, void *buf, size_t len, int write) {
+    if (tc->pid <= 0) {
+        return -1;
+    }
+
+    if (tc->vm_ok && !(write && tc->mem_fd != -1)) {
+        struct iovec local = { buf, len };
+        struct iovec remote = { (void *)addr, len };
+        tc->syscalls++;
+        ssize_t n = write ? process_vm_writev(tc->pid, &local, 1, &remote, 1, 0)
+                          : process_vm_readv(tc->pid, &local, 1, &remote, 1, 0);
+        if (n > 0) {
+            return n;
+        }
+        if (errno == ENOSYS || errno == EPERM) {
+            tc->vm_ok = 0;
+        } else if (errno != EFAULT) {
+            return -1;
+        }
+    }
+
+    if (tc->mem_fd == -1) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/mem", (int)tc->pid);
+        tc->mem_fd = open(path, O_RDWR | O_CLOEXEC);
+        if (tc->mem_fd == -1) {
+            return -1;
+        }
+    }
+    tc->syscalls++;
+    ssize_t n = write ? pwrite(tc->mem_fd, buf, len, (off_t)addr)
+                      : pread(tc->mem_fd, buf, len, (off_t)addr);
+    return n > 0 ? n : -1;
+}
+
+// Cached copy of the page at addr, fetched whole on a miss; NULL if the
+// page cannot be read
+static TcPage *cached_page(TraceeCache *tc, unsigned long addr) {
+    TcPage *page = &tc->pages[(addr / TC_PAGE_SIZE) % TC_PAGES];
+    if (page->gen == tc->gen && page->addr == addr) {
+        return page;
+    }
+    if (transfer(tc, addr, page->data, TC_PAGE_SIZE, 0) != TC_PAGE_SIZE) {
+        page->gen = 0;
+        return NULL;
+    }
+    page->addr = addr;
+    page->gen = tc->gen;
+    return page;
+}
+
+ssize_t tc_read(TraceeCache *tc, unsigned long addr, void *buf, size_t len) {
+    if (len >= TC_BULK_MIN) {
+        return transfer(tc, addr, buf, len, 0);
+    }
+
+    uint8_t *out = buf;
+    size_t done = 0;
+    while (done < len) {
+        unsigned long at = addr + done;
+        TcPage *page = cached_page(tc, at & ~(unsigned long)(TC_PAGE_SIZE - 1));
+        if (!page) {
+            ssize_t n = transfer(tc, at, out + done, len - done, 0);
+            if (n > 0) {
+                done += n;
+            }
+            break;
+        }
+        size_t offset = at - page->addr;
+        size_t n = TC_PAGE_SIZE - offset;
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(out + done, page->data + offset, n);
+        done += n;
+    }
+    return done > 0 ? (ssize_t)done : -1;
+}
+
+ssize_t tc_write(TraceeCache *tc, unsigned long addr, const void *buf, size_t len) {
+    ssize_t n = transfer(tc, addr, (void *)buf, len, 1);
+    if (n <= 0) {
+        return -1;
+    }
+
+    // Keep cached copies of the written bytes current
+    for (int i = 0; i < TC_PAGES; i++) {
+        TcPage *page = &tc->pages[i];
+        if (page->gen != tc->gen) {
+            continue;
+        }
+        unsigned long lo = addr > page->addr ? addr : page->addr;
+        unsigned long hi = addr + n < page->addr + TC_PAGE_SIZE ? addr + n : page->addr + TC_PAGE_SIZE;
+        if (lo < hi) {
+            memcpy(page->data + (lo - page->addr), (const uint8_t *)buf + (lo - addr), hi - lo);
+        }
+    }
+    return n;
+}
+
+// Forget registers read before the last resume
+static unsigned long *current_regs(TraceeCache *tc) {
+    if (tc->regs_gen != tc->gen) {
+        tc->regs_gen = tc->gen;
+        tc->regs_have = 0;
+    }
+    return (unsigned long *)&tc->regs;
+}
+
+int tc_read_reg(TraceeCache *tc, int reg, unsigned long *value) {
+    unsigned long *words = current_regs(tc);
+    if (reg < 0 || reg >= TC_REG_COUNT) {
+        return -1;
+    }
+    if (!(tc->regs_have & (1UL << reg))) {
+        errno = 0;
+        long word = ptrace(PTRACE_PEEKUSER, tc->pid, (void *)(reg * 8L), NULL);
+        if (errno != 0) {
+            return -1;
+        }
+        words[reg] = (unsigned long)word;
+        tc->regs_have |= 1UL << reg;
+    }
+    *value = words[reg];
+    return 0;
+}
+
+int tc_write_reg(TraceeCache *tc, int reg, unsigned long value) {
+    unsigned long *words = current_regs(tc);
+    if (reg < 0 || reg >= TC_REG_COUNT ||
+        ptrace(PTRACE_POKEUSER, tc->pid, (void *)(reg * 8L), (void *)value) == -1) {
+        return -1;
+    }
+    words[reg] = value;
+    tc->regs_have |= 1UL << reg;
+    return 0;
+}
+
+int tc_get_regs(TraceeCache *tc, struct user_regs_struct *regs) {
+    current_regs(tc);
+    if (tc->regs_have != TC_REGS_ALL) {
+        if (ptrace(PTRACE_GETREGS, tc->pid, NULL, &tc->regs) == -1) {
+            tc->regs_have = 0;
+            return -1;
+        }
+        tc->regs_have = TC_REGS_ALL;
+    }
+    *regs = tc->regs;
+    return 0;
+}
+
+int tc_set_regs(TraceeCache *tc, const struct user_regs_struct *regs) {
+    current_regs(tc);
+    if (ptrace(PTRACE_SETREGS, tc->pid, NULL, regs) == -1) {
+        tc->regs_have = 0;
+        return -1;
+    }
+    tc->regs = *regs;
+    tc->regs_have = TC_REGS_ALL;
+    return 0;
+}
+
+static int open_proc(pid_t pid, const char *name, int flags) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, name);
+    return open(path, flags | O_CLOEXEC);
+}
+
+static int pagemap_entry(int fd, const void *addr, uint64_t *entry) {
+    off_t at = (off_t)((uintptr_t)addr / TC_PAGE_SIZE * sizeof(uint64_t));
+    return pread(fd, entry, sizeof(*entry), at) == sizeof(*entry) ? 0 : -1;
+}
+
+// Kernels built without CONFIG_MEM_SOFT_DIRTY accept "4" in clear_refs but
+// never set the bit, so try it once on a page of our own
+static int soft_dirty_works(void) {
+    static int works = -1;
+    if (works != -1) {
+        return works;
+    }
+    works = 0;
+
+    static uint8_t probe[2 * TC_PAGE_SIZE];
+    volatile uint8_t *page = (uint8_t *)(((uintptr_t)probe + TC_PAGE_SIZE - 1) & ~(uintptr_t)(TC_PAGE_SIZE - 1));
+    int pagemap = open_proc(getpid(), "pagemap", O_RDONLY);
+    int clear_refs = open_proc(getpid(), "clear_refs", O_WRONLY);
+    uint64_t before, after;
+    page[0] = 1;
+    if (pagemap != -1 && clear_refs != -1 && write(clear_refs, "4", 1) == 1 &&
+        pagemap_entry(pagemap, (const void *)page, &before) == 0) {
+        page[0] = 2;
+        if (pagemap_entry(pagemap, (const void *)page, &after) == 0) {
+            works = !(before & PM_SOFT_DIRTY) && (after & PM_SOFT_DIRTY);
+        }
+    }
+    if (pagemap != -1) close(pagemap);
+    if (clear_refs != -1) close(clear_refs);
+    return works;
+}
+
+int tc_clear_dirty(TraceeCache *tc) {
+    if (tc->pid <= 0 || !soft_dirty_works()) {
+        return -1;
+    }
+    if (tc->clear_refs_fd == -1) {
+        tc->clear_refs_fd = open_proc(tc->pid, "clear_refs", O_WRONLY);
+        if (tc->clear_refs_fd == -1) {
+            return -1;
+        }
+    }
+    tc->syscalls++;
+    return pwrite(tc->clear_refs_fd, "4", 1, 0) == 1 ? 0 : -1;
+}
+
+static int open_pagemap(TraceeCache *tc) {
+    if (tc->pid <= 0) {
+        return -1;
+    }
+    if (tc->pagemap_fd == -1) {
+        tc->pagemap_fd = open_proc(tc->pid, "pagemap", O_RDONLY);
+    }
+    return tc->pagemap_fd == -1 ? -1 : 0;
+}
+
+int tc_page_flags(TraceeCache *tc, unsigned long addr, int count, uint8_t *flags) {
+    if (open_pagemap(tc) != 0) {
+        return -1;
+    }
+    unsigned long first = addr / TC_PAGE_SIZE;
+    for (int i = 0; i < count; i += PM_BATCH) {
+        int span = count - i < PM_BATCH ? count - i : PM_BATCH;
+        uint64_t entries[PM_BATCH];
+        tc->syscalls++;
+        ssize_t n = pread(tc->pagemap_fd, entries, span * sizeof(uint64_t),
+                          (off_t)((first + i) * sizeof(uint64_t)));
+        if (n != (ssize_t)(span * sizeof(uint64_t))) {
+            return -1;
+        }
+        for (int j = 0; j < span; j++) {
+            flags[i + j] = ((entries[j] & (PM_PRESENT | PM_SWAPPED)) ? TC_PAGE_RESIDENT : 0) |
+                           ((entries[j] & PM_SOFT_DIRTY) ? TC_PAGE_DIRTY : 0);
+        }
+    }
+    return 0;
+}
+
+int tc_dirty_pages(TraceeCache *tc, const unsigned long *pages, int count, uint8_t *dirty) {
+    if (open_pagemap(tc) != 0) {
+        return -1;
+    }
+
+    // One pread per run of adjacent pages
+    int i = 0;
+    while (i < count) {
+        unsigned long first = pages[i] / TC_PAGE_SIZE;
+        int span = 1;
+        for (int j = i + 1; j < count && pages[j] / TC_PAGE_SIZE - first < PM_BATCH; j++) {
+            span = (int)(pages[j] / TC_PAGE_SIZE - first) + 1;
+        }
+        uint64_t entries[PM_BATCH];
+        tc->syscalls++;
+        ssize_t n = pread(tc->pagemap_fd, entries, span * sizeof(uint64_t),
+                          (off_t)(first * sizeof(uint64_t)));
+        if (n != (ssize_t)(span * sizeof(uint64_t))) {
+            return -1;
+        }
+        for (; i < count && pages[i] / TC_PAGE_SIZE - first < (unsigned long)span; i++) {
+            uint64_t e = entries[pages[i] / TC_PAGE_SIZE - first];
+            dirty[i] = !(e & (PM_PRESENT | PM_SWAPPED)) || (e & PM_SOFT_DIRTY);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef TRACEE_CACHE_H
+#define TRACEE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#define TC_PAGE_SIZE 4096
+#define TC_PAGES     16      // Direct-mapped by page number
+#define TC_BULK_MIN  512     // Reads this long bypass the cache
+
+typedef struct {
+    unsigned long addr;      // Page-aligned tracee address
+    unsigned long gen;       // Valid while equal to the cache's gen
+    uint8_t data[TC_PAGE_SIZE];
+} TcPage;
+
+// Memory and registers of a stopped tracee, each fetched at most once per
+// stop. Memory moves with process_vm_readv/writev, falling back to
+// /proc/pid/mem where they are refused (writes to read-only text, or a
+// kernel without them); a read of any length is one system call. Small
+// reads fill whole pages, so the next one nearby costs nothing. Registers
+// come one PTRACE_PEEKUSER at a time until someone needs the full set.
+// tc_invalidate() drops everything and must run before every resume.
+typedef struct {
+    pid_t pid;
+    int mem_fd;              // /proc/pid/mem, opened on the first fallback
+    int pagemap_fd;          // /proc/pid/pagemap and clear_refs, opened on
+    int clear_refs_fd;       //   first use of soft-dirty tracking
+    int vm_ok;               // process_vm_readv/writev are usable
+    unsigned long gen;
+    TcPage pages[TC_PAGES];
+
+    struct user_regs_struct regs;
+    unsigned long regs_have;  // Bit n set if word n of regs is current
+    unsigned long regs_gen;
+
+    unsigned long syscalls;   // Memory transfers that reached the kernel
+} TraceeCache;
+
+void tc_init(TraceeCache *tc);
+
+// Start on a process that just execed, or stop using it
+void tc_attach(TraceeCache *tc, pid_t pid);
+void tc_detach(TraceeCache *tc);
+
+static inline void tc_invalidate(TraceeCache *tc) {
+    tc->gen++;
+}
+
+// Bytes read from the start of the range before an unmapped page stops
+// the transfer, or -1 if none could be read
+ssize_t tc_read(TraceeCache *tc, unsigned long addr, void *buf, size_t len);
+
+// Write through the cache; same return as tc_read
+ssize_t tc_write(TraceeCache *tc, unsigned long addr, const void *buf, size_t len);
+
+// Word reg of struct user_regs_struct (offsetof(...) / 8). Returns 0 or -1.
+int tc_read_reg(TraceeCache *tc, int reg, unsigned long *value);
+int tc_write_reg(TraceeCache *tc, int reg, unsigned long value);
+
+// All registers with one PTRACE_GETREGS, or from the cache. Returns 0 or -1.
+int tc_get_regs(TraceeCache *tc, struct user_regs_struct *regs);
+int tc_set_regs(TraceeCache *tc, const struct user_regs_struct *regs);
+
+// Soft-dirty tracking: after tc_clear_dirty() the kernel marks each page the
+// tracee writes, so a stop can tell which pages still hold what was read at
+// the last one. Needs CONFIG_MEM_SOFT_DIRTY; without it tc_clear_dirty()
+// fails and callers should treat every page as written.
+int tc_clear_dirty(TraceeCache *tc);
+
+// Set dirty[i] to 1 for each page-aligned address in pages (sorted) that
+// was written since the last tc_clear_dirty() or is not resident, else 0.
+// Returns 0, or -1 if the page map cannot be read.
+int tc_dirty_pages(TraceeCache *tc, const unsigned long *pages, int count, uint8_t *dirty);
+
+#define TC_PAGE_RESIDENT  0x1   // In memory or swapped out
+#define TC_PAGE_DIRTY     0x2   // Written since the last tc_clear_dirty()
+
+// Flags of count consecutive pages from page-aligned addr, read from the
+// page map in batches. Returns 0, or -1 if the page map cannot be read.
+int tc_page_flags(TraceeCache *tc, unsigned long addr, int count, uint8_t *flags);
+
+#define TC_REG(field) ((int)(offsetof(struct user_regs_struct, field) / 8))
+
+#endif
@@ -0,0 +1,1479 @@
+#include "variables.h"
+#include "dwarf_reader.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/user.h>
+
+#define DW_TAG_array_type        0x01
+#define DW_TAG_class_type        0x02
+#define DW_TAG_enumeration_type  0x04
+#define DW_TAG_formal_parameter  0x05
+#define DW_TAG_lexical_block     0x0b
+#define DW_TAG_member            0x0d
+#define DW_TAG_pointer_type      0x0f
+#define DW_TAG_reference_type    0x10
+#define DW_TAG_compile_unit      0x11
+#define DW_TAG_structure_type    0x13
+#define DW_TAG_typedef           0x16
+#define DW_TAG_union_type        0x17
+#define DW_TAG_base_type         0x24
+#define DW_TAG_const_type        0x26
+#define DW_TAG_subprogram        0x2e
+#define DW_TAG_subrange_type     0x21
+#define DW_TAG_variable          0x34
+#define DW_TAG_volatile_type     0x35
+#define DW_TAG_restrict_type     0x37
+#define DW_TAG_rvalue_ref_type   0x42
+#define DW_TAG_atomic_type       0x47
+
+#define DW_AT_sibling              0x01
+#define DW_AT_location             0x02
+#define DW_AT_name                 0x03
+#define DW_AT_byte_size            0x0b
+#define DW_AT_low_pc               0x11
+#define DW_AT_high_pc              0x12
+#define DW_AT_upper_bound          0x2f
+#define DW_AT_count                0x37
+#define DW_AT_data_member_location 0x38
+#define DW_AT_declaration          0x3c
+#define DW_AT_encoding             0x3e
+#define DW_AT_frame_base           0x40
+#define DW_AT_type                 0x49
+#define DW_AT_bit_offset           0x0c
+#define DW_AT_bit_size             0x0d
+#define DW_AT_data_bit_offset      0x6b
+#define DW_AT_specification        0x47
+#define DW_AT_str_offsets_base     0x72
+#define DW_AT_addr_base            0x73
+
+#define DW_UT_compile  0x01
+#define DW_UT_partial  0x03
+
+#define DW_OP_addr         0x03
+#define DW_OP_plus_uconst  0x23
+#define DW_OP_reg0         0x50
+#define DW_OP_reg31        0x6f
+#define DW_OP_breg0        0x70
+#define DW_OP_breg31       0x8f
+#define DW_OP_regx         0x90
+#define DW_OP_fbreg        0x91
+#define DW_OP_bregx        0x92
+#define DW_OP_call_frame_cfa 0x9c
+
+#define DW_ATE_boolean        0x02
+#define DW_ATE_float          0x04
+#define DW_ATE_signed         0x05
+#define DW_ATE_signed_char    0x06
+#define DW_ATE_unsigned       0x07
+#define DW_ATE_unsigned_char  0x08
+
+#define VAR_MAX_DEPTH  32    // DIE nesting followed inside a function
+#define VAR_MAX_DIMS   8
+#define VAR_FORMAT_DEPTH 4   // Nested aggregates shown before {...}
+
+// One attribute value. References are absolute .debug_info offsets.
+typedef struct {
+    uint64_t form;
+    uint64_t u;
+    int64_t s;
+    const char *str;
+    const unsigned char *block;
+    size_t block_len;
+} AttrValue;
+
+// DIE read up to its first attribute
+typedef struct {
+    uint32_t offset;
+    uint64_t tag;
+    int children;
+    DwarfCursor specs;       // Over the abbreviation's attribute specs
+} Die;
+
+static int decode_type(VarTable *vt, const VarUnit *u, uint64_t offset, int depth);
+static void decode_location(Variable *var, const AttrValue *v);
+static int add_variable(VarTable *vt, const Variable *var);
+
+// DWARF register number to struct user_regs_struct word, for rax..r15 and rip
+static int dwarf_reg(uint64_t n) {
+    static const int map[17] = {
+        offsetof(struct user_regs_struct, rax) / 8, offsetof(struct user_regs_struct, rdx) / 8,
+        offsetof(struct user_regs_struct, rcx) / 8, offsetof(struct user_regs_struct, rbx) / 8,
+        offsetof(struct user_regs_struct, rsi) / 8, offsetof(struct user_regs_struct, rdi) / 8,
+        offsetof(struct user_regs_struct, rbp) / 8, offsetof(struct user_regs_struct, rsp) / 8,
+        offsetof(struct user_regs_struct, r8) / 8,  offsetof(struct user_regs_struct, r9) / 8,
+        offsetof(struct user_regs_struct, r10) / 8, offsetof(struct user_regs_struct, r11) / 8,
+        offsetof(struct user_regs_struct, r12) / 8, offsetof(struct user_regs_struct, r13) / 8,
+        offsetof(struct user_regs_struct, r14) / 8, offsetof(struct user_regs_struct, r15) / 8,
+        offsetof(struct user_regs_struct, rip) / 8,
+    };
+    return n < 17 ? map[n] : -1;
+}
+
+void var_init(VarTable *vt) {
+    memset(vt, 0, sizeof(VarTable));
+}
+
+void var_free(VarTable *vt) {
+    for (int i = 0; i < vt->unit_count; i++) {
+        free(vt->units[i].abbrevs);
+    }
+    free(vt->units);
+    free(vt->funcs);
+    free(vt->vars);
+    free(vt->globals);
+    free(vt->types);
+    free(vt->members);
+    var_init(vt);
+}
+
+void var_load(VarTable *vt, const ElfFile *ef) {
+    var_free(vt);
+    vt->info = elf_section(ef, ".debug_info", &vt->info_size);
+    vt->abbrev = elf_section(ef, ".debug_abbrev", &vt->abbrev_size);
+    vt->str = elf_section(ef, ".debug_str", &vt->str_size);
+    vt->line_str = elf_section(ef, ".debug_line_str", &vt->line_str_size);
+    vt->str_offsets = elf_section(ef, ".debug_str_offsets", &vt->str_offsets_size);
+    vt->addr = elf_section(ef, ".debug_addr", &vt->addr_size);
+}
+
+static const char *section_string(const unsigned char *sec, size_t size, uint64_t off) {
+    if (!sec || off >= size) return "";
+    if (!memchr(sec + off, 0, size - off)) return "";
+    return (const char *)sec + off;
+}
+
+static const char *indexed_string(const VarTable *vt, const VarUnit *u, uint64_t index) {
+    int width = u->is64 ? 8 : 4;
+    uint64_t at = u->str_offsets_base + index * width;
+    if (!vt->str_offsets || at + width > vt->str_offsets_size) return "";
+    uint64_t off = 0;
+    memcpy(&off, vt->str_offsets + at, width);
+    return section_string(vt->str, vt->str_size, off);
+}
+
+static uint64_t indexed_address(const VarTable *vt, const VarUnit *u, uint64_t index) {
+    uint64_t at = u->addr_base + index * u->addr_size;
+    if (!vt->addr || at + u->addr_size > vt->addr_size) return 0;
+    uint64_t addr = 0;
+    memcpy(&addr, vt->addr + at, u->addr_size);
+    return addr;
+}
+
+static uint32_t read_u24(DwarfCursor *c) {
+    uint32_t low = dw_u16(c);
+    return low | (uint32_t)dw_u8(c) << 16;
+}
+
+static void read_attr(const VarTable *vt, const VarUnit *u, DwarfCursor *c,
+                      uint64_t form, int64_t implicit, AttrValue *v) {
+    memset(v, 0, sizeof(AttrValue));
+    v->form = form;
+    switch (form) {
+        case DW_FORM_addr:
+            v->u = u->addr_size == 4 ? dw_u32(c) : dw_u64(c);
+            break;
+        case DW_FORM_data1:      v->u = dw_u8(c); break;
+        case DW_FORM_data2:      v->u = dw_u16(c); break;
+        case DW_FORM_data4:      v->u = dw_u32(c); break;
+        case DW_FORM_data8:      v->u = dw_u64(c); break;
+        case DW_FORM_sdata:      v->s = dw_sleb(c); v->u = (uint64_t)v->s; return;
+        case DW_FORM_udata:      v->u = dw_uleb(c); break;
+        case DW_FORM_flag:       v->u = dw_u8(c); break;
+        case DW_FORM_flag_present: v->u = 1; break;
+        case DW_FORM_implicit_const: v->s = implicit; v->u = (uint64_t)implicit; return;
+        case DW_FORM_string:     v->str = dw_str(c); break;
+        case DW_FORM_strp:
+            v->str = section_string(vt->str, vt->str_size, dw_offset(c, u->is64));
+            break;
+        case DW_FORM_line_strp:
+            v->str = section_string(vt->line_str, vt->line_str_size, dw_offset(c, u->is64));
+            break;
+        case DW_FORM_strx:       v->str = indexed_string(vt, u, dw_uleb(c)); break;
+        case DW_FORM_strx1:      v->str = indexed_string(vt, u, dw_u8(c)); break;
+        case DW_FORM_strx2:      v->str = indexed_string(vt, u, dw_u16(c)); break;
+        case DW_FORM_strx3:      v->str = indexed_string(vt, u, read_u24(c)); break;
+        case DW_FORM_strx4:      v->str = indexed_string(vt, u, dw_u32(c)); break;
+        case DW_FORM_addrx:      v->u = indexed_address(vt, u, dw_uleb(c)); break;
+        case DW_FORM_addrx1:     v->u = indexed_address(vt, u, dw_u8(c)); break;
+        case DW_FORM_addrx2:     v->u = indexed_address(vt, u, dw_u16(c)); break;
+        case DW_FORM_addrx3:     v->u = indexed_address(vt, u, read_u24(c)); break;
+        case DW_FORM_addrx4:     v->u = indexed_address(vt, u, dw_u32(c)); break;
+        case DW_FORM_ref1:       v->u = u->offset + dw_u8(c); break;
+        case DW_FORM_ref2:       v->u = u->offset + dw_u16(c); break;
+        case DW_FORM_ref4:       v->u = u->offset + dw_u32(c); break;
+        case DW_FORM_ref8:       v->u = u->offset + dw_u64(c); break;
+        case DW_FORM_ref_udata:  v->u = u->offset + dw_uleb(c); break;
+        case DW_FORM_ref_addr:
+            v->u = u->version <= 2 ? dw_offset(c, u->addr_size == 8) : dw_offset(c, u->is64);
+            break;
+        case DW_FORM_sec_offset: v->u = dw_offset(c, u->is64); break;
+        case DW_FORM_strp_sup:
+        case DW_FORM_ref_sup4:   dw_u32(c); break;
+        case DW_FORM_ref_sup8:
+        case DW_FORM_ref_sig8:   dw_u64(c); break;
+        case DW_FORM_data16:     dw_skip(c, 16); break;
+        case DW_FORM_loclistx:
+        case DW_FORM_rnglistx:   v->u = dw_uleb(c); break;
+        case DW_FORM_exprloc:
+        case DW_FORM_block:      v->block_len = dw_uleb(c); break;
+        case DW_FORM_block1:     v->block_len = dw_u8(c); break;
+        case DW_FORM_block2:     v->block_len = dw_u16(c); break;
+        case DW_FORM_block4:     v->block_len = dw_u32(c); break;
+        case DW_FORM_indirect:
+            read_attr(vt, u, c, dw_uleb(c), implicit, v);
+            return;
+        default:
+            c->error = 1;
+            return;
+    }
+    if (v->block_len) {
+        v->block = c->p;
+        dw_skip(c, v->block_len);
+    }
+    v->s = (int64_t)v->u;
+}
+
+// Position c at the DIE at offset and decode its header. Returns 0 for a
+// DIE, 1 for a null entry ending a sibling list, -1 on bad data.
+static int read_die(const VarTable *vt, const VarUnit *u, DwarfCursor *c, Die *die) {
+    die->offset = (uint32_t)(c->p - vt->info);
+    uint64_t code = dw_uleb(c);
+    if (c->error) return -1;
+    if (code == 0) return 1;
+    if (code >= (uint64_t)u->abbrev_count || !u->abbrevs[code]) return -1;
+
+    dw_init(&die->specs, u->abbrevs[code], vt->abbrev + vt->abbrev_size - u->abbrevs[code]);
+    die->tag = dw_uleb(&die->specs);
+    die->children = dw_u8(&die->specs);
+    return die->specs.error ? -1 : 0;
+}
+
+// Next attribute of die, read from c. Returns 0, or -1 after the last one.
+static int next_attr(const VarTable *vt, const VarUnit *u, DwarfCursor *c, Die *die,
+                     uint64_t *name, AttrValue *v) {
+    *name = dw_uleb(&die->specs);
+    uint64_t form = dw_uleb(&die->specs);
+    if (die->specs.error || (*name == 0 && form == 0)) return -1;
+    int64_t implicit = form == DW_FORM_implicit_const ? dw_sleb(&die->specs) : 0;
+    read_attr(vt, u, c, form, implicit, v);
+    return c->error ? -1 : 0;
+}
+
+static int is_data_form(uint64_t form) {
+    return form == DW_FORM_data1 || form == DW_FORM_data2 || form == DW_FORM_data4 ||
+           form == DW_FORM_data8 || form == DW_FORM_sdata || form == DW_FORM_udata ||
+           form == DW_FORM_implicit_const;
+}
+
+// Cursor over one unit's DIEs, starting at offset
+static void unit_cursor(const VarTable *vt, const VarUnit *u, uint32_t offset, DwarfCursor *c) {
+    dw_init(c, vt->info + offset, u->end - offset);
+}
+
+static int load_abbrevs(const VarTable *vt, VarUnit *u, uint64_t offset) {
+    if (!vt->abbrev || offset >= vt->abbrev_size) return -1;
+    DwarfCursor c;
+    dw_init(&c, vt->abbrev + offset, vt->abbrev_size - offset);
+
+    int capacity = 0;
+    while (dw_left(&c) > 0) {
+        uint64_t code = dw_uleb(&c);
+        if (code == 0 || c.error) break;
+        if (code > 65535) return -1;
+        if (code >= (uint64_t)capacity) {
+            int cap = capacity ? capacity : 64;
+            while ((uint64_t)cap <= code) cap *= 2;
+            const unsigned char **abbrevs = realloc(u->abbrevs, cap * sizeof(*abbrevs));
+            if (!abbrevs) return -1;
+            memset(abbrevs + capacity, 0, (cap - capacity) * sizeof(*abbrevs));
+            u->abbrevs = abbrevs;
+            capacity = cap;
+        }
+        u->abbrevs[code] = c.p;
+        if ((int)code >= u->abbrev_count) u->abbrev_count = (int)code + 1;
+
+        dw_uleb(&c);    // tag
+        dw_u8(&c);      // children
+        for (;;) {
+            uint64_t name = dw_uleb(&c);
+            uint64_t form = dw_uleb(&c);
+            if (c.error || (name == 0 && form == 0)) break;
+            if (form == DW_FORM_implicit_const) dw_sleb(&c);
+        }
+    }
+    return c.error ? -1 : 0;
+}
+
+static int add_function(VarTable *vt, int *capacity, const VarFunction *f) {
+    if (vt->func_count == *capacity) {
+        int cap = *capacity ? *capacity * 2 : 64;
+        VarFunction *funcs = realloc(vt->funcs, cap * sizeof(VarFunction));
+        if (!funcs) return -1;
+        vt->funcs = funcs;
+        *capacity = cap;
+    }
+    vt->funcs[vt->func_count++] = *f;
+    return 0;
+}
+
+// Name and type of the declaration a DW_AT_specification points to
+static void declaration_of(const VarTable *vt, const VarUnit *u, uint64_t offset,
+                           const char **name, uint64_t *type) {
+    if (offset < u->first_die || offset >= u->end) return;
+    DwarfCursor c;
+    unit_cursor(vt, u, (uint32_t)offset, &c);
+    Die die;
+    if (read_die(vt, u, &c, &die) != 0) return;
+
+    uint64_t attr;
+    AttrValue v;
+    while (next_attr(vt, u, &c, &die, &attr, &v) == 0) {
+        if (attr == DW_AT_name && v.str) *name = v.str;
+        else if (attr == DW_AT_type && !*type) *type = v.u;
+    }
+}
+
+static int add_global(VarTable *vt, const Variable *var) {
+    if (vt->global_count == vt->global_capacity) {
+        int cap = vt->global_capacity ? vt->global_capacity * 2 : 64;
+        Variable *globals = realloc(vt->globals, cap * sizeof(Variable));
+        if (!globals) return -1;
+        vt->globals = globals;
+        vt->global_capacity = cap;
+    }
+    vt->globals[vt->global_count++] = *var;
+    return 0;
+}
+
+// Walk one unit's DIEs for subprograms with code and variables with a
+// fixed address, skipping every subtree that has a sibling link
+static void index_unit(VarTable *vt, int unit, int *capacity) {
+    const VarUnit *u = &vt->units[unit];
+    DwarfCursor c;
+    unit_cursor(vt, u, u->first_die, &c);
+
+    int depth = 0;
+    while (dw_left(&c) > 0) {
+        Die die;
+        int r = read_die(vt, u, &c, &die);
+        if (r < 0) return;
+        if (r == 1) {
+            if (--depth <= 0) return;
+            continue;
+        }
+
+        Variable var = { "", 0, VAR_LOC_NONE, -1, 0, -1, 0, UINT64_MAX };
+        uint64_t lo = 0, hi = 0, sibling = 0, type = 0, specification = 0, name;
+        int hi_offset = 0, has_lo = 0;
+        AttrValue v;
+        while (next_attr(vt, u, &c, &die, &name, &v) == 0) {
+            if (name == DW_AT_name) {
+                var.name = v.str ? v.str : "";
+            } else if (name == DW_AT_type) {
+                type = v.u;
+            } else if (name == DW_AT_location) {
+                decode_location(&var, &v);
+            } else if (name == DW_AT_specification) {
+                specification = v.u;
+            } else if (name == DW_AT_low_pc) {
+                lo = v.u;
+                has_lo = 1;
+            } else if (name == DW_AT_high_pc) {
+                hi = v.u;
+                hi_offset = is_data_form(v.form);
+            } else if (name == DW_AT_sibling) {
+                sibling = v.u;
+            } else if (name == DW_AT_str_offsets_base && die.tag == DW_TAG_compile_unit) {
+                vt->units[unit].str_offsets_base = v.u;
+            } else if (name == DW_AT_addr_base && die.tag == DW_TAG_compile_unit) {
+                vt->units[unit].addr_base = v.u;
+            }
+        }
+        if (c.error) return;
+
+        if (die.tag == DW_TAG_subprogram && has_lo && hi) {
+            if (hi_offset) hi += lo;
+            VarFunction f = { lo, hi, die.offset, unit, 0, -1, 0, 0, 0 };
+            if (hi > lo && add_function(vt, capacity, &f) != 0) return;
+        }
+        if (die.tag == DW_TAG_variable && depth == 1 && var.loc == VAR_LOC_ADDR) {
+            // A definition that completes an extern declaration is unnamed
+            if (specification && !var.name[0]) {
+                declaration_of(vt, u, specification, &var.name, &type);
+            }
+            var.type = decode_type(vt, u, type, 0);
+            if (var.name[0] && add_global(vt, &var) != 0) return;
+        }
+
+        if (die.children) {
+            if (sibling > die.offset && sibling < u->end) {
+                c.p = vt->info + sibling;
+            } else {
+                depth++;
+            }
+        } else if (depth == 0) {
+            return;
+        }
+    }
+}
+
+static int compare_functions(const void *a, const void *b) {
+    const VarFunction *fa = a;
+    const VarFunction *fb = b;
+    if (fa->lo != fb->lo) {
+        return fa->lo < fb->lo ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(((const Variable *)a)->name, ((const Variable *)b)->name);
+}
+
+static void build_index(VarTable *vt) {
+    vt->indexed = 1;
+    if (!vt->info || !vt->abbrev) return;
+
+    DwarfCursor c;
+    dw_init(&c, vt->info, vt->info_size);
+    int unit_capacity = 0, func_capacity = 0;
+
+    while (dw_left(&c) > 0) {
+        VarUnit u;
+        memset(&u, 0, sizeof(u));
+        u.offset = (uint32_t)(c.p - vt->info);
+        uint64_t length = dw_unit_length(&c, &u.is64);
+        if (c.error || length > (uint64_t)dw_left(&c)) break;
+        u.end = (uint32_t)(c.p - vt->info + length);
+
+        u.version = dw_u16(&c);
+        int unit_type = DW_UT_compile;
+        uint64_t abbrev_offset;
+        if (u.version >= 5) {
+            unit_type = dw_u8(&c);
+            u.addr_size = dw_u8(&c);
+            abbrev_offset = dw_offset(&c, u.is64);
+        } else {
+            abbrev_offset = dw_offset(&c, u.is64);
+            u.addr_size = dw_u8(&c);
+        }
+        u.first_die = (uint32_t)(c.p - vt->info);
+        c.p = vt->info + u.end;
+
+        // Type units and split units carry no code of their own
+        if (u.version < 2 || u.version > 5 || (u.addr_size != 4 && u.addr_size != 8) ||
+            (unit_type != DW_UT_compile && unit_type != DW_UT_partial)) {
+            continue;
+        }
+        if (load_abbrevs(vt, &u, abbrev_offset) != 0) {
+            free(u.abbrevs);
+            continue;
+        }
+
+        if (vt->unit_count == unit_capacity) {
+            int cap = unit_capacity ? unit_capacity * 2 : 16;
+            VarUnit *units = realloc(vt->units, cap * sizeof(VarUnit));
+            if (!units) {
+                free(u.abbrevs);
+                break;
+            }
+            vt->units = units;
+            unit_capacity = cap;
+        }
+        vt->units[vt->unit_count++] = u;
+        index_unit(vt, vt->unit_count - 1, &func_capacity);
+    }
+
+    qsort(vt->funcs, vt->func_count, sizeof(VarFunction), compare_functions);
+    qsort(vt->globals, vt->global_count, sizeof(Variable), compare_names);
+}
+
+static int reserve_type(VarTable *vt) {
+    if (vt->type_count == vt->type_capacity) {
+        int cap = vt->type_capacity ? vt->type_capacity * 2 : 64;
+        VarType *types = realloc(vt->types, cap * sizeof(VarType));
+        if (!types) return -1;
+        vt->types = types;
+        vt->type_capacity = cap;
+    }
+    VarType *t = &vt->types[vt->type_count];
+    memset(t, 0, sizeof(VarType));
+    t->kind = VAR_TYPE_OTHER;
+    t->target = -1;
+    t->name = "";
+    return vt->type_count++;
+}
+
+static int reserve_members(VarTable *vt, int count) {
+    if (vt->member_count + count > vt->member_capacity) {
+        int cap = vt->member_capacity ? vt->member_capacity : 64;
+        while (cap < vt->member_count + count) cap *= 2;
+        VarMember *members = realloc(vt->members, cap * sizeof(VarMember));
+        if (!members) return -1;
+        vt->members = members;
+        vt->member_capacity = cap;
+    }
+    int first = vt->member_count;
+    vt->member_count += count;
+    return first;
+}
+
+// Byte offset from a DW_AT_data_member_location, constant or
+// DW_OP_plus_uconst expression
+static int member_offset(const AttrValue *v) {
+    if (v->block) {
+        DwarfCursor e;
+        dw_init(&e, v->block, v->block_len);
+        if (dw_u8(&e) == DW_OP_plus_uconst) return (int)dw_uleb(&e);
+        return -1;
+    }
+    return (int)v->u;
+}
+
+static void decode_struct(VarTable *vt, const VarUnit *u, int index, DwarfCursor *c, int depth) {
+    // Count first so the members stay contiguous while their own types
+    // append members of other structs
+    DwarfCursor scan = *c;
+    int count = 0;
+    Die die;
+    while (read_die(vt, u, &scan, &die) == 0) {
+        uint64_t name, sibling = 0;
+        AttrValue v;
+        while (next_attr(vt, u, &scan, &die, &name, &v) == 0) {
+            if (name == DW_AT_sibling) sibling = v.u;
+        }
+        if (scan.error) break;
+        if (die.tag == DW_TAG_member) count++;
+        if (die.children) {
+            if (sibling <= die.offset || sibling >= u->end) break;
+            scan.p = vt->info + sibling;
+        }
+    }
+
+    int first = count ? reserve_members(vt, count) : 0;
+    if (first < 0) return;
+    vt->types[index].first_member = first;
+
+    int filled = 0;
+    while (filled < count && read_die(vt, u, c, &die) == 0) {
+        VarMember m = { "", 0, -1, 0, 0 };
+        uint64_t name, type = 0, sibling = 0;
+        int big_endian_bits = -1, storage = 0;
+        AttrValue v;
+        while (next_attr(vt, u, c, &die, &name, &v) == 0) {
+            if (name == DW_AT_name) m.name = v.str ? v.str : "";
+            else if (name == DW_AT_type) type = v.u;
+            else if (name == DW_AT_data_member_location) m.offset = member_offset(&v);
+            else if (name == DW_AT_bit_size) m.bit_size = (int)v.u;
+            else if (name == DW_AT_data_bit_offset) m.bit_offset = (int)v.u;
+            else if (name == DW_AT_bit_offset) big_endian_bits = (int)v.u;
+            else if (name == DW_AT_byte_size) storage = (int)v.u;
+            else if (name == DW_AT_sibling) sibling = v.u;
+        }
+        if (c->error) break;
+        if (big_endian_bits >= 0 && m.bit_size) {
+            // DWARF 2-4 count from the high bit of the storage unit
+            m.bit_offset = storage * 8 - big_endian_bits - m.bit_size;
+            if (m.bit_offset < 0) m.offset = -1;
+        }
+        if (die.tag == DW_TAG_member) {
+            m.type = decode_type(vt, u, type, depth + 1);
+            vt->members[first + filled++] = m;
+        }
+        if (die.children) {
+            if (sibling <= die.offset || sibling >= u->end) break;
+            c->p = vt->info + sibling;
+        }
+    }
+    vt->types[index].count = filled;
+}
+
+// Element counts of an array's subrange children, outermost first
+static int array_dims(const VarTable *vt, const VarUnit *u, DwarfCursor *c, int *dims) {
+    int n = 0;
+    Die die;
+    while (read_die(vt, u, c, &die) == 0) {
+        uint64_t name;
+        AttrValue v;
+        int count = 0;
+        while (next_attr(vt, u, c, &die, &name, &v) == 0) {
+            if (name == DW_AT_count && is_data_form(v.form)) count = (int)v.u;
+            else if (name == DW_AT_upper_bound && is_data_form(v.form)) count = (int)v.s + 1;
+        }
+        if (c->error || die.children) break;
+        if (die.tag == DW_TAG_subrange_type && n < VAR_MAX_DIMS) {
+            dims[n++] = count > 0 ? count : 0;
+        }
+    }
+    return n;
+}
+
+// Index of the type at a .debug_info offset, decoding it on first use.
+// Typedefs and qualifiers resolve to what they name.
+static int decode_type(VarTable *vt, const VarUnit *u, uint64_t offset, int depth) {
+    if (offset == 0 || offset >= vt->info_size || depth > 64) return -1;
+    for (int i = 0; i < vt->type_count; i++) {
+        if (vt->types[i].die == offset) return i;
+    }
+    if (offset < u->first_die || offset >= u->end) {
+        // DW_FORM_ref_addr into another unit
+        u = NULL;
+        for (int i = 0; i < vt->unit_count; i++) {
+            if (offset >= vt->units[i].first_die && offset < vt->units[i].end) u = &vt->units[i];
+        }
+        if (!u) return -1;
+    }
+
+    DwarfCursor c;
+    unit_cursor(vt, u, (uint32_t)offset, &c);
+    Die die;
+    if (read_die(vt, u, &c, &die) != 0) return -1;
+
+    const char *type_name = "";
+    uint64_t name, target = 0;
+    int size = -1, encoding = 0, declaration = 0;
+    AttrValue v;
+    while (next_attr(vt, u, &c, &die, &name, &v) == 0) {
+        if (name == DW_AT_name) type_name = v.str ? v.str : "";
+        else if (name == DW_AT_type) target = v.u;
+        else if (name == DW_AT_byte_size) size = (int)v.u;
+        else if (name == DW_AT_encoding) encoding = (int)v.u;
+        else if (name == DW_AT_declaration) declaration = 1;
+    }
+    if (c.error) return -1;
+
+    switch (die.tag) {
+        case DW_TAG_typedef:
+        case DW_TAG_const_type:
+        case DW_TAG_volatile_type:
+        case DW_TAG_restrict_type:
+        case DW_TAG_atomic_type:
+            return decode_type(vt, u, target, depth + 1);
+        default:
+            break;
+    }
+
+    int index = reserve_type(vt);
+    if (index < 0) return -1;
+    vt->types[index].die = (uint32_t)offset;
+    vt->types[index].name = type_name;
+    vt->types[index].size = size > 0 ? size : 0;
+
+    switch (die.tag) {
+        case DW_TAG_base_type:
+        case DW_TAG_enumeration_type:
+            vt->types[index].kind = VAR_TYPE_BASE;
+            vt->types[index].encoding = encoding ? encoding : DW_ATE_signed;
+            break;
+        case DW_TAG_pointer_type:
+        case DW_TAG_reference_type:
+        case DW_TAG_rvalue_ref_type: {
+            vt->types[index].kind = VAR_TYPE_POINTER;
+            vt->types[index].size = size > 0 ? size : u->addr_size;
+            // Decoding the pointee may move the types array
+            int pointee = decode_type(vt, u, target, depth + 1);
+            vt->types[index].target = pointee;
+            break;
+        }
+        case DW_TAG_structure_type:
+        case DW_TAG_union_type:
+        case DW_TAG_class_type:
+            vt->types[index].kind = VAR_TYPE_STRUCT;
+            if (die.children && !declaration) {
+                decode_struct(vt, u, index, &c, depth);
+            }
+            break;
+        case DW_TAG_array_type: {
+            int dims[VAR_MAX_DIMS];
+            int ndims = die.children ? array_dims(vt, u, &c, dims) : 0;
+            if (ndims == 0) dims[ndims++] = 0;
+            vt->types[index].kind = VAR_TYPE_ARRAY;
+
+            // int a[2][3] is an array of 2 arrays of 3
+            int element = decode_type(vt, u, target, depth + 1);
+            for (int d = ndims - 1; d >= 1; d--) {
+                int inner = reserve_type(vt);
+                if (inner < 0) break;
+                int element_size = element >= 0 ? vt->types[element].size : 0;
+                vt->types[inner].kind = VAR_TYPE_ARRAY;
+                vt->types[inner].target = element;
+                vt->types[inner].count = dims[d];
+                vt->types[inner].size = dims[d] * element_size;
+                element = inner;
+            }
+            vt->types[index].target = element;
+            vt->types[index].count = dims[0];
+            if (size <= 0) {
+                vt->types[index].size = dims[0] * (element >= 0 ? vt->types[element].size : 0);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return index;
+}
+
+// Location of a variable from a one-operation expression
+static void decode_location(Variable *var, const AttrValue *v) {
+    var->loc = VAR_LOC_NONE;
+    if (!v->block) return;   // Location list
+
+    DwarfCursor e;
+    dw_init(&e, v->block, v->block_len);
+    uint8_t op = dw_u8(&e);
+    if (op == DW_OP_fbreg) {
+        var->offset = dw_sleb(&e);
+        var->loc = VAR_LOC_FRAME;
+    } else if (op == DW_OP_addr) {
+        var->offset = (int64_t)dw_u64(&e);
+        var->loc = VAR_LOC_ADDR;
+    } else if ((op >= DW_OP_reg0 && op <= DW_OP_reg31) || op == DW_OP_regx) {
+        var->reg = dwarf_reg(op == DW_OP_regx ? dw_uleb(&e) : (uint64_t)(op - DW_OP_reg0));
+        var->loc = VAR_LOC_REG;
+    } else if ((op >= DW_OP_breg0 && op <= DW_OP_breg31) || op == DW_OP_bregx) {
+        var->reg = dwarf_reg(op == DW_OP_bregx ? dw_uleb(&e) : (uint64_t)(op - DW_OP_breg0));
+        var->offset = dw_sleb(&e);
+        var->loc = VAR_LOC_REG_OFFSET;
+    }
+    // Anything after the first operation computes something we do not follow
+    if (e.error || dw_left(&e) > 0 || ((var->loc == VAR_LOC_REG || var->loc == VAR_LOC_REG_OFFSET) && var->reg < 0)) {
+        var->loc = VAR_LOC_NONE;
+    }
+}
+
+static void decode_frame_base(VarFunction *f, const AttrValue *v) {
+    f->base_reg = -1;
+    f->base_offset = 0;
+    if (!v->block) return;
+
+    DwarfCursor e;
+    dw_init(&e, v->block, v->block_len);
+    uint8_t op = dw_u8(&e);
+    if (op >= DW_OP_breg0 && op <= DW_OP_breg31) {
+        f->base_reg = dwarf_reg(op - DW_OP_breg0);
+        f->base_offset = dw_sleb(&e);
+    } else if (op >= DW_OP_reg0 && op <= DW_OP_reg31) {
+        f->base_reg = dwarf_reg(op - DW_OP_reg0);
+    }
+}
+
+static int add_variable(VarTable *vt, const Variable *var) {
+    if (vt->var_count == vt->var_capacity) {
+        int cap = vt->var_capacity ? vt->var_capacity * 2 : 64;
+        Variable *vars = realloc(vt->vars, cap * sizeof(Variable));
+        if (!vars) return -1;
+        vt->vars = vars;
+        vt->var_capacity = cap;
+    }
+    vt->vars[vt->var_count++] = *var;
+    return 0;
+}
+
+// Parameters and locals of f, including those of nested lexical blocks,
+// each with the pc range of the block that declares it
+static void decode_function(VarTable *vt, VarFunction *f) {
+    f->decoded = 1;
+    f->first_var = vt->var_count;
+    const VarUnit *u = &vt->units[f->unit];
+
+    DwarfCursor c;
+    unit_cursor(vt, u, f->die, &c);
+    uint64_t scope_lo[VAR_MAX_DEPTH], scope_hi[VAR_MAX_DEPTH];
+    int in_scope[VAR_MAX_DEPTH];
+    int depth = 0;
+
+    while (dw_left(&c) > 0) {
+        Die die;
+        int r = read_die(vt, u, &c, &die);
+        if (r < 0) break;
+        if (r == 1) {
+            if (--depth <= 0) break;
+            continue;
+        }
+
+        Variable var = { "", die.tag == DW_TAG_formal_parameter, VAR_LOC_NONE, -1, 0, -1, 0, 0 };
+        uint64_t name, type = 0, lo = 0, hi = 0, sibling = 0;
+        int has_lo = 0, hi_offset = 0;
+        AttrValue v;
+        while (next_attr(vt, u, &c, &die, &name, &v) == 0) {
+            if (name == DW_AT_name) var.name = v.str ? v.str : "";
+            else if (name == DW_AT_type) type = v.u;
+            else if (name == DW_AT_location) decode_location(&var, &v);
+            else if (name == DW_AT_frame_base && depth == 0) decode_frame_base(f, &v);
+            else if (name == DW_AT_sibling) sibling = v.u;
+            else if (name == DW_AT_low_pc) {
+                lo = v.u;
+                has_lo = 1;
+            } else if (name == DW_AT_high_pc) {
+                hi = v.u;
+                hi_offset = is_data_form(v.form);
+            }
+        }
+        if (c.error) break;
+
+        if (depth > 0 && in_scope[depth - 1] && var.name[0] != '\0' &&
+            (die.tag == DW_TAG_variable || die.tag == DW_TAG_formal_parameter)) {
+            var.type = decode_type(vt, u, type, 0);
+            var.lo = scope_lo[depth - 1];
+            var.hi = scope_hi[depth - 1];
+            if (add_variable(vt, &var) != 0) break;
+        }
+
+        if (!die.children) {
+            if (depth == 0) break;
+            continue;
+        }
+        // Only the function itself and its blocks hold variables in scope
+        in_scope[depth] = depth == 0 || (in_scope[depth - 1] && die.tag == DW_TAG_lexical_block);
+        if (!in_scope[depth] || depth == VAR_MAX_DEPTH - 1) {
+            if (sibling > die.offset && sibling < u->end) {
+                c.p = vt->info + sibling;
+                continue;
+            }
+            if (depth == VAR_MAX_DEPTH - 1) break;
+        }
+        if (has_lo && hi) {
+            scope_lo[depth] = lo;
+            scope_hi[depth] = hi_offset ? lo + hi : hi;
+        } else {
+            // A block with DW_AT_ranges: use the enclosing scope
+            scope_lo[depth] = depth ? scope_lo[depth - 1] : f->lo;
+            scope_hi[depth] = depth ? scope_hi[depth - 1] : f->hi;
+        }
+        depth++;
+    }
+    f->var_count = vt->var_count - f->first_var;
+}
+
+const VarFunction *var_function(VarTable *vt, uint64_t pc) {
+    if (!vt->indexed) {
+        build_index(vt);
+    }
+
+    // Last function starting at or below pc
+    int lo = 0, hi = vt->func_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (vt->funcs[mid].lo <= pc) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0 || pc >= vt->funcs[lo - 1].hi) {
+        return NULL;
+    }
+
+    VarFunction *f = &vt->funcs[lo - 1];
+    if (!f->decoded) {
+        decode_function(vt, f);
+    }
+    return f;
+}
+
+typedef struct {
+    char *buf;
+    int size;
+    int len;
+} FormatOut;
+
+static int out_full(const FormatOut *o) {
+    return o->len >= o->size - 1;
+}
+
+static void out_printf(FormatOut *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out_printf(FormatOut *o, const char *fmt, ...) {
+    if (out_full(o)) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->size - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    o->len += n;
+    if (o->len > o->size - 1) o->len = o->size - 1;
+}
+
+static int is_char_type(const VarType *t) {
+    return t->kind == VAR_TYPE_BASE && t->size == 1 &&
+           (t->encoding == DW_ATE_signed_char || t->encoding == DW_ATE_unsigned_char);
+}
+
+static void format_char(FormatOut *o, uint8_t ch, char quote) {
+    switch (ch) {
+        case '\n': out_printf(o, "\\n"); break;
+        case '\t': out_printf(o, "\\t"); break;
+        case '\r': out_printf(o, "\\r"); break;
+        case '\\': out_printf(o, "\\\\"); break;
+        default:
+            if (ch == (uint8_t)quote) out_printf(o, "\\%c", quote);
+            else if (isprint(ch)) out_printf(o, "%c", ch);
+            else out_printf(o, "\\%03o", ch);
+            break;
+    }
+}
+
+static void format_base(FormatOut *o, const VarType *t, const uint8_t *bytes) {
+    uint64_t raw = 0;
+    if (t->size <= 8) memcpy(&raw, bytes, t->size);
+
+    if (t->encoding == DW_ATE_float) {
+        if (t->size == 4) {
+            float f;
+            memcpy(&f, bytes, 4);
+            out_printf(o, "%g", f);
+        } else if (t->size == 8) {
+            double d;
+            memcpy(&d, bytes, 8);
+            out_printf(o, "%g", d);
+        } else if (t->size == 16 || t->size == 10) {
+            long double ld = 0;
+            memcpy(&ld, bytes, 10);
+            out_printf(o, "%Lg", ld);
+        } else {
+            out_printf(o, "?");
+        }
+        return;
+    }
+    if (t->size > 8 || t->size == 0) {
+        out_printf(o, "?");
+        return;
+    }
+    if (t->encoding == DW_ATE_boolean) {
+        out_printf(o, raw ? "true" : "false");
+        return;
+    }
+
+    int is_signed = t->encoding == DW_ATE_signed || t->encoding == DW_ATE_signed_char;
+    if (is_signed) {
+        int shift = 64 - t->size * 8;
+        int64_t value = shift ? (int64_t)(raw << shift) >> shift : (int64_t)raw;
+        out_printf(o, "%lld", (long long)value);
+    } else {
+        out_printf(o, "%llu", (unsigned long long)raw);
+    }
+    if (is_char_type(t)) {
+        out_printf(o, " '");
+        format_char(o, (uint8_t)raw, '\'');
+        out_printf(o, "'");
+    }
+}
+
+static void format_bits(const VarTable *vt, FormatOut *o, const VarMember *m,
+                        const uint8_t *bytes, int avail) {
+    int first = m->offset + m->bit_offset / 8;
+    int shift = m->bit_offset % 8;
+    int length = (shift + m->bit_size + 7) / 8;
+    if (m->bit_size > 57 || first + length > avail) {
+        out_printf(o, "?");
+        return;
+    }
+    uint64_t raw = 0;
+    memcpy(&raw, bytes + first, length);
+    raw = (raw >> shift) & ((1ULL << m->bit_size) - 1);
+
+    const VarType *t = m->type >= 0 ? &vt->types[m->type] : NULL;
+    if (t && (t->encoding == DW_ATE_signed || t->encoding == DW_ATE_signed_char)) {
+        int back = 64 - m->bit_size;
+        out_printf(o, "%lld", (long long)((int64_t)(raw << back) >> back));
+    } else {
+        out_printf(o, "%llu", (unsigned long long)raw);
+    }
+}
+
+static void format_value(const VarTable *vt, FormatOut *o, int type, const uint8_t *bytes,
+                         int avail, int depth) {
+    if (type < 0 || type >= vt->type_count) {
+        out_printf(o, "?");
+        return;
+    }
+    const VarType *t = &vt->types[type];
+    if (t->kind != VAR_TYPE_ARRAY && t->kind != VAR_TYPE_STRUCT && t->size > avail) {
+        out_printf(o, "??");
+        return;
+    }
+
+    switch (t->kind) {
+        case VAR_TYPE_BASE:
+            format_base(o, t, bytes);
+            break;
+        case VAR_TYPE_POINTER: {
+            uint64_t p = 0;
+            memcpy(&p, bytes, t->size <= 8 ? t->size : 8);
+            out_printf(o, "0x%llx", (unsigned long long)p);
+            break;
+        }
+        case VAR_TYPE_ARRAY: {
+            const VarType *et = t->target >= 0 ? &vt->types[t->target] : NULL;
+            if (!et || et->size == 0 || t->count == 0) {
+                out_printf(o, "{...}");
+                break;
+            }
+            if (is_char_type(et)) {
+                int n = 0;
+                out_printf(o, "\"");
+                while (n < t->count && n < avail && bytes[n] != 0 && !out_full(o)) {
+                    format_char(o, bytes[n++], '"');
+                }
+                out_printf(o, n < t->count && n >= avail ? "\"..." : "\"");
+                break;
+            }
+            if (depth >= VAR_FORMAT_DEPTH) {
+                out_printf(o, "{...}");
+                break;
+            }
+            out_printf(o, "{");
+            for (int i = 0; i < t->count && !out_full(o); i++) {
+                int at = i * et->size;
+                if (at >= avail) {
+                    out_printf(o, "...");
+                    break;
+                }
+                if (i) out_printf(o, ", ");
+                format_value(vt, o, t->target, bytes + at, avail - at, depth + 1);
+            }
+            out_printf(o, "}");
+            break;
+        }
+        case VAR_TYPE_STRUCT:
+            if (depth >= VAR_FORMAT_DEPTH || t->count == 0) {
+                out_printf(o, "{...}");
+                break;
+            }
+            out_printf(o, "{");
+            for (int i = 0; i < t->count && !out_full(o); i++) {
+                const VarMember *m = &vt->members[t->first_member + i];
+                out_printf(o, "%s%s = ", i ? ", " : "", m->name);
+                if (m->offset < 0 || m->offset > avail) {
+                    out_printf(o, "?");
+                } else if (m->bit_size) {
+                    format_bits(vt, o, m, bytes, avail);
+                } else {
+                    format_value(vt, o, m->type, bytes + m->offset, avail - m->offset, depth + 1);
+                }
+            }
+            out_printf(o, "}");
+            break;
+        default:
+            out_printf(o, "?");
+            break;
+    }
+}
+
+int var_format(const VarTable *vt, int type, const uint8_t *bytes, int avail,
+               char *out, int out_size) {
+    if (out_size <= 0) return 0;
+    FormatOut o = { out, out_size, 0 };
+    out[0] = '\0';
+    format_value(vt, &o, type, bytes, avail < 0 ? 0 : avail, 0);
+
+    // Mark a value cut short by the buffer
+    if (out_full(&o) && out_size > 4) {
+        memcpy(out + out_size - 4, "...", 4);
+    }
+    return o.len;
+}
+
+// Expressions over variables: identifiers, integer literals, unary * & -,
+// postfix . -> [], binary + - with C pointer arithmetic, and parentheses.
+// An lvalue is an address with a type; an rvalue is a scalar in value.
+typedef struct {
+    int type;            // -1 for a plain integer
+    int is_lvalue;
+    uint64_t addr;
+    int64_t value;
+} VarValue;
+
+typedef struct {
+    VarTable *vt;
+    uint64_t pc;
+    const VarEnv *env;
+    const char *p;
+    char *error;
+    int error_size;
+    int failed;
+} EvalState;
+
+static int eval_fail(EvalState *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static int eval_fail(EvalState *s, const char *fmt, ...) {
+    if (!s->failed) {
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(s->error, s->error_size, fmt, ap);
+        va_end(ap);
+        s->failed = 1;
+    }
+    return -1;
+}
+
+static void skip_space(EvalState *s) {
+    while (isspace((unsigned char)*s->p)) s->p++;
+}
+
+// Copy an identifier at s->p into name; returns its length, 0 if none
+static int read_ident(EvalState *s, char *name, int name_size) {
+    skip_space(s);
+    int n = 0;
+    if (!isalpha((unsigned char)*s->p) && *s->p != '_') return 0;
+    while (isalnum((unsigned char)s->p[n]) || s->p[n] == '_') {
+        if (n < name_size - 1) name[n] = s->p[n];
+        n++;
+    }
+    name[n < name_size - 1 ? n : name_size - 1] = '\0';
+    s->p += n;
+    return n;
+}
+
+const Variable *var_lookup(VarTable *vt, uint64_t pc, const char *name) {
+    const VarFunction *f = var_function(vt, pc);
+
+    // Innermost declaration in scope shadows the rest
+    const Variable *best = NULL;
+    for (int i = 0; f && i < f->var_count; i++) {
+        const Variable *var = &vt->vars[f->first_var + i];
+        if (pc < var->lo || pc >= var->hi || strcmp(var->name, name) != 0) continue;
+        if (!best || var->hi - var->lo <= best->hi - best->lo) best = var;
+    }
+    if (best) return best;
+
+    Variable key;
+    key.name = name;
+    return bsearch(&key, vt->globals, vt->global_count, sizeof(Variable), compare_names);
+}
+
+// Pointer type to target, made up for & since the program may not have one
+static int pointer_to(VarTable *vt, int target) {
+    for (int i = 0; i < vt->type_count; i++) {
+        const VarType *t = &vt->types[i];
+        if (t->die == 0 && t->kind == VAR_TYPE_POINTER && t->target == target) return i;
+    }
+    int index = reserve_type(vt);
+    if (index < 0) return -1;
+    vt->types[index].kind = VAR_TYPE_POINTER;
+    vt->types[index].size = 8;
+    vt->types[index].target = target;
+    vt->types[index].name = "";
+    return index;
+}
+
+static const VarType *value_type(const EvalState *s, const VarValue *v) {
+    return v->type >= 0 ? &s->vt->types[v->type] : NULL;
+}
+
+// Scalar held by v, reading it from the tracee if it is an lvalue.
+// Arrays decay to a pointer to their first element.
+static int load_scalar(EvalState *s, VarValue *v) {
+    if (!v->is_lvalue) return 0;
+    const VarType *t = value_type(s, v);
+    if (t && t->kind == VAR_TYPE_ARRAY) {
+        int pointer = pointer_to(s->vt, t->target);
+        if (pointer < 0) return eval_fail(s, "Out of memory");
+        v->type = pointer;
+        v->value = (int64_t)v->addr;
+        v->is_lvalue = 0;
+        return 0;
+    }
+    if (!t || (t->kind != VAR_TYPE_BASE && t->kind != VAR_TYPE_POINTER) ||
+        t->size <= 0 || t->size > 8) {
+        return eval_fail(s, "Not a number or pointer");
+    }
+
+    uint64_t raw = 0;
+    if (s->env->read_mem(s->env->ctx, v->addr, &raw, t->size) != t->size) {
+        return eval_fail(s, "Cannot read 0x%llx", (unsigned long long)v->addr);
+    }
+    int shift = 64 - t->size * 8;
+    if (shift && (t->encoding == DW_ATE_signed || t->encoding == DW_ATE_signed_char)) {
+        v->value = (int64_t)(raw << shift) >> shift;
+    } else {
+        v->value = (int64_t)raw;
+    }
+    v->is_lvalue = 0;
+    return 0;
+}
+
+static int variable_value(EvalState *s, const Variable *var, VarValue *v) {
+    v->type = var->type;
+    v->is_lvalue = 1;
+    switch (var->loc) {
+        case VAR_LOC_FRAME:
+            if (!s->env->frame_base) return eval_fail(s, "%s: no frame", var->name);
+            v->addr = s->env->frame_base + var->offset;
+            return 0;
+        case VAR_LOC_REG_OFFSET:
+            v->addr = s->env->regs[var->reg] + var->offset;
+            return 0;
+        case VAR_LOC_ADDR:
+            v->addr = (uint64_t)var->offset + s->env->load_bias;
+            return 0;
+        case VAR_LOC_REG:
+            v->is_lvalue = 0;
+            v->value = (int64_t)s->env->regs[var->reg];
+            return 0;
+        default:
+            return eval_fail(s, "%s is optimized out", var->name);
+    }
+}
+
+// Member name of struct type, searching anonymous structs and unions inside
+static const VarMember *find_member(const VarTable *vt, int type, const char *name, int *offset) {
+    const VarType *t = &vt->types[type];
+    for (int i = 0; i < t->count; i++) {
+        const VarMember *m = &vt->members[t->first_member + i];
+        if (m->offset < 0) continue;
+        if (strcmp(m->name, name) == 0) {
+            *offset += m->offset;
+            return m;
+        }
+        if (m->name[0] == '\0' && m->type >= 0 && vt->types[m->type].kind == VAR_TYPE_STRUCT) {
+            int inner = *offset + m->offset;
+            const VarMember *found = find_member(vt, m->type, name, &inner);
+            if (found) {
+                *offset = inner;
+                return found;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int select_member(EvalState *s, VarValue *v, const char *name) {
+    const VarType *t = value_type(s, v);
+    if (!t || t->kind != VAR_TYPE_STRUCT) return eval_fail(s, "%s: not a struct", name);
+    if (!v->is_lvalue) return eval_fail(s, "%s: struct is not in memory", name);
+
+    int offset = 0;
+    const VarMember *m = find_member(s->vt, v->type, name, &offset);
+    if (!m) return eval_fail(s, "No member %s", name);
+    v->type = m->type;
+    v->addr += offset;
+    if (!m->bit_size) return 0;
+
+    // Bit fields become plain values
+    int shift = m->bit_offset % 8;
+    int length = (shift + m->bit_size + 7) / 8;
+    uint64_t raw = 0;
+    if (m->bit_size > 57) return eval_fail(s, "%s: bit field too wide", name);
+    if (s->env->read_mem(s->env->ctx, v->addr + m->bit_offset / 8, &raw, length) != length) {
+        return eval_fail(s, "Cannot read 0x%llx", (unsigned long long)v->addr);
+    }
+    raw = (raw >> shift) & ((1ULL << m->bit_size) - 1);
+    const VarType *mt = m->type >= 0 ? &s->vt->types[m->type] : NULL;
+    int back = 64 - m->bit_size;
+    if (mt && (mt->encoding == DW_ATE_signed || mt->encoding == DW_ATE_signed_char)) {
+        v->value = (int64_t)(raw << back) >> back;
+    } else {
+        v->value = (int64_t)raw;
+    }
+    v->is_lvalue = 0;
+    return 0;
+}
+
+static int dereference(EvalState *s, VarValue *v) {
+    if (load_scalar(s, v) != 0) return -1;
+    const VarType *t = value_type(s, v);
+    if (!t || t->kind != VAR_TYPE_POINTER) return eval_fail(s, "Not a pointer");
+    if (t->target < 0) return eval_fail(s, "Cannot dereference a void pointer");
+    v->type = t->target;
+    v->addr = (uint64_t)v->value;
+    v->is_lvalue = 1;
+    return 0;
+}
+
+// Size of what a pointer value points at, for arithmetic
+static int pointee_size(EvalState *s, const VarValue *v) {
+    const VarType *t = value_type(s, v);
+    if (!t || t->kind != VAR_TYPE_POINTER) return 0;
+    if (t->target < 0) return 1;     // void *, as GNU C does
+    return s->vt->types[t->target].size;
+}
+
+static int parse_sum(EvalState *s, VarValue *v);
+
+static int parse_primary(EvalState *s, VarValue *v) {
+    skip_space(s);
+    memset(v, 0, sizeof(*v));
+    v->type = -1;
+    if (*s->p == '(') {
+        s->p++;
+        if (parse_sum(s, v) != 0) return -1;
+        skip_space(s);
+        if (*s->p != ')') return eval_fail(s, "Expected )");
+        s->p++;
+        return 0;
+    }
+    if (isdigit((unsigned char)*s->p)) {
+        char *end;
+        v->value = (int64_t)strtoull(s->p, &end, 0);
+        s->p = end;
+        return 0;
+    }
+
+    char name[64];
+    if (!read_ident(s, name, sizeof(name))) {
+        return eval_fail(s, *s->p ? "Unexpected '%c'" : "Expression ends early", *s->p);
+    }
+    const Variable *var = var_lookup(s->vt, s->pc, name);
+    if (!var) return eval_fail(s, "No symbol %s in scope", name);
+    return variable_value(s, var, v);
+}
+
+static int parse_postfix(EvalState *s, VarValue *v) {
+    if (parse_primary(s, v) != 0) return -1;
+    for (;;) {
+        skip_space(s);
+        char name[64];
+        if (*s->p == '.') {
+            s->p++;
+            if (!read_ident(s, name, sizeof(name))) return eval_fail(s, "Expected a member after .");
+            if (select_member(s, v, name) != 0) return -1;
+        } else if (s->p[0] == '-' && s->p[1] == '>') {
+            s->p += 2;
+            if (!read_ident(s, name, sizeof(name))) return eval_fail(s, "Expected a member after ->");
+            if (dereference(s, v) != 0 || select_member(s, v, name) != 0) return -1;
+        } else if (*s->p == '[') {
+            s->p++;
+            VarValue index;
+            if (parse_sum(s, &index) != 0 || load_scalar(s, &index) != 0) return -1;
+            skip_space(s);
+            if (*s->p != ']') return eval_fail(s, "Expected ]");
+            s->p++;
+            if (load_scalar(s, v) != 0) return -1;
+            int size = pointee_size(s, v);
+            if (!size) return eval_fail(s, "Subscript of a non-pointer");
+            v->value += index.value * size;
+            if (dereference(s, v) != 0) return -1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+static int parse_unary(EvalState *s, VarValue *v) {
+    skip_space(s);
+    char op = *s->p;
+    if (op != '*' && op != '&' && op != '-') return parse_postfix(s, v);
+    s->p++;
+    if (parse_unary(s, v) != 0) return -1;
+
+    if (op == '*') return dereference(s, v);
+    if (op == '-') {
+        if (load_scalar(s, v) != 0) return -1;
+        v->value = -v->value;
+        v->type = -1;
+        return 0;
+    }
+    if (!v->is_lvalue) return eval_fail(s, "Cannot take the address of a value");
+    int pointer = pointer_to(s->vt, v->type);
+    if (pointer < 0) return eval_fail(s, "Out of memory");
+    v->type = pointer;
+    v->value = (int64_t)v->addr;
+    v->is_lvalue = 0;
+    return 0;
+}
+
+static int parse_sum(EvalState *s, VarValue *v) {
+    if (parse_unary(s, v) != 0) return -1;
+    for (;;) {
+        skip_space(s);
+        char op = *s->p;
+        if ((op != '+' && op != '-') || s->p[1] == '>') return 0;
+        s->p++;
+        VarValue rhs;
+        if (parse_unary(s, &rhs) != 0) return -1;
+        if (load_scalar(s, v) != 0 || load_scalar(s, &rhs) != 0) return -1;
+
+        int lsize = pointee_size(s, v);
+        int rsize = pointee_size(s, &rhs);
+        if (lsize && rsize) {
+            if (op == '+') return eval_fail(s, "Cannot add two pointers");
+            v->value = (v->value - rhs.value) / lsize;
+            v->type = -1;
+        } else if (lsize) {
+            v->value += (op == '+' ? rhs.value : -rhs.value) * lsize;
+        } else if (rsize && op == '+') {
+            v->value = rhs.value + v->value * rsize;
+            v->type = rhs.type;
+        } else {
+            v->value = op == '+' ? v->value + rhs.value : v->value - rhs.value;
+            if (!value_type(s, v) || value_type(s, v)->kind != VAR_TYPE_BASE) v->type = -1;
+        }
+    }
+}
+
+int var_eval(VarTable *vt, uint64_t pc, const char *text, const VarEnv *env,
+             char *out, int out_size) {
+    EvalState s = { vt, pc, env, text, out, out_size, 0 };
+    VarValue v;
+    if (parse_sum(&s, &v) != 0) return -1;
+    skip_space(&s);
+    if (*s.p) return eval_fail(&s, "Unexpected '%c'", *s.p);
+
+    const VarType *t = value_type(&s, &v);
+    if (!t) {
+        snprintf(out, out_size, "%lld", (long long)v.value);
+        return 0;
+    }
+    uint8_t bytes[VAR_EVAL_BYTES];
+    int avail;
+    if (v.is_lvalue) {
+        int want = t->size < VAR_EVAL_BYTES ? t->size : VAR_EVAL_BYTES;
+        avail = want ? env->read_mem(env->ctx, v.addr, bytes, want) : 0;
+        if (avail < 0) {
+            return eval_fail(&s, "Cannot read 0x%llx", (unsigned long long)v.addr);
+        }
+    } else {
+        memcpy(bytes, &v.value, 8);
+        avail = 8;
+    }
+    var_format(vt, v.type, bytes, avail, out, out_size);
+    return 0;
+}
+
+uint64_t var_binding(VarTable *vt, uint64_t pc, const char *text, const VarEnv *env) {
+    // FNV-1a over what each identifier stands for
+    uint64_t hash = 14695981039346656037ULL;
+    EvalState s = { vt, pc, env, text, NULL, 0, 0 };
+    char prev = '\0';
+    while (*s.p) {
+        char name[64];
+        if (!read_ident(&s, name, sizeof(name))) {
+            if (!isspace((unsigned char)*s.p)) prev = *s.p;
+            // Skip whole numbers so 0x10 is not read as the name x10
+            if (isdigit((unsigned char)*s.p)) {
+                while (isalnum((unsigned char)*s.p)) s.p++;
+            } else if (*s.p) {
+                s.p++;
+            }
+            continue;
+        }
+        if (prev == '.' || prev == '>') {
+            prev = '\0';
+            continue;    // Member names bind to nothing
+        }
+        prev = '\0';
+
+        // Indexes stay put while the arrays grow; pointers may not
+        const Variable *var = var_lookup(vt, pc, name);
+        uint64_t words[2] = { 0, 0 };
+        if (var && var >= vt->globals && var < vt->globals + vt->global_count) {
+            words[0] = (uint64_t)(var - vt->globals) << 1 | 1;
+        } else if (var) {
+            words[0] = (uint64_t)(var - vt->vars + 1) << 1;
+        }
+        if (var && var->loc == VAR_LOC_FRAME) {
+            words[1] = env->frame_base;
+        } else if (var && (var->loc == VAR_LOC_REG || var->loc == VAR_LOC_REG_OFFSET)) {
+            words[1] = env->regs[var->reg];
+        } else if (var && var->loc == VAR_LOC_ADDR) {
+            words[1] = env->load_bias;
+        }
+        const uint8_t *b = (const uint8_t *)words;
+        for (size_t i = 0; i < sizeof(words); i++) {
+            hash = (hash ^ b[i]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,161 @@
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "elf_file.h"
+
+typedef enum {
+    VAR_TYPE_BASE,       // Integer, character, boolean or floating point
+    VAR_TYPE_POINTER,
+    VAR_TYPE_ARRAY,
+    VAR_TYPE_STRUCT,     // Unions too, with every member at offset 0
+    VAR_TYPE_OTHER       // Functions, void and anything not decoded
+} VarTypeKind;
+
+// Type with typedefs and qualifiers stripped. Cached by DIE offset, so a
+// type shared by many variables is decoded once.
+typedef struct {
+    VarTypeKind kind;
+    uint32_t die;        // .debug_info offset; 0 for inner array dimensions
+    int size;            // Bytes
+    int encoding;        // BASE: DW_ATE_* value
+    int target;          // POINTER, ARRAY: pointee or element type, -1 = void
+    int count;           // ARRAY: elements (0 if unknown); STRUCT: members
+    int first_member;    // STRUCT: index into members
+    const char *name;    // Points into the ELF mapping; "" if anonymous
+} VarType;
+
+typedef struct {
+    const char *name;
+    int offset;          // Byte offset within the struct, -1 if unknown
+    int type;
+    int bit_size;        // Bit fields: width, and offset from the struct start
+    int bit_offset;
+} VarMember;
+
+typedef enum {
+    VAR_LOC_NONE,        // Location list or expression we cannot follow
+    VAR_LOC_FRAME,       // Frame base + offset (DW_OP_fbreg)
+    VAR_LOC_REG,         // Held in a register (DW_OP_regN)
+    VAR_LOC_REG_OFFSET,  // Register + offset (DW_OP_bregN)
+    VAR_LOC_ADDR         // Link-time address (DW_OP_addr, static locals)
+} VarLocKind;
+
+typedef struct {
+    const char *name;
+    int is_param;
+    VarLocKind loc;
+    int reg;             // REG, REG_OFFSET: user_regs_struct word
+    int64_t offset;      // FRAME, REG_OFFSET: displacement; ADDR: address
+    int type;            // Index into types, -1 if unknown
+    uint64_t lo, hi;     // Link-time pcs where it is in scope
+} Variable;
+
+// Subprogram with code. Its variables are decoded the first time a stop
+// lands in it and kept for the rest of the session.
+typedef struct {
+    uint64_t lo, hi;     // Link-time pc range [lo, hi)
+    uint32_t die;
+    int unit;            // Index into units
+    int decoded;
+    int base_reg;        // Frame base: -1 = CFA, else user_regs_struct word
+    int64_t base_offset; //   plus this
+    int first_var;
+    int var_count;
+} VarFunction;
+
+// Compilation unit header and its abbreviations, indexed by code
+typedef struct {
+    uint32_t offset;     // Of the unit header in .debug_info
+    uint32_t end;
+    uint32_t first_die;
+    int version;
+    int is64;
+    int addr_size;
+    uint64_t str_offsets_base;
+    uint64_t addr_base;
+    const unsigned char **abbrevs;   // Code -> tag, children flag, specs
+    int abbrev_count;
+} VarUnit;
+
+// Local variables and parameters from .debug_info. Loading only finds the
+// sections; the unit and function index is built on the first lookup.
+typedef struct {
+    const unsigned char *info;
+    size_t info_size;
+    const unsigned char *abbrev;
+    size_t abbrev_size;
+    const unsigned char *str;
+    size_t str_size;
+    const unsigned char *line_str;
+    size_t line_str_size;
+    const unsigned char *str_offsets;
+    size_t str_offsets_size;
+    const unsigned char *addr;
+    size_t addr_size;
+
+    int indexed;
+    VarUnit *units;
+    int unit_count;
+    VarFunction *funcs;      // Sorted by lo
+    int func_count;
+
+    Variable *vars;
+    int var_count;
+    int var_capacity;
+    Variable *globals;       // File-scope variables, sorted by name
+    int global_count;
+    int global_capacity;
+    VarType *types;
+    int type_count;
+    int type_capacity;
+    VarMember *members;
+    int member_count;
+    int member_capacity;
+} VarTable;
+
+void var_init(VarTable *vt);
+void var_free(VarTable *vt);
+
+// Remember the debug sections of ef, which must stay mapped. A binary
+// without .debug_info gives a table that finds nothing.
+void var_load(VarTable *vt, const ElfFile *ef);
+
+// Function containing link-time pc with its variables decoded, or NULL
+const VarFunction *var_function(VarTable *vt, uint64_t pc);
+
+// Render size bytes of a value of type (fewer if the read fell short) as C
+// would write it: numbers, 'c' characters, "strings" for char arrays,
+// {a, b} for arrays and {x = 1, y = 2} for structs. Returns the length.
+int var_format(const VarTable *vt, int type, const uint8_t *bytes, int avail,
+               char *out, int out_size);
+
+// What evaluating an expression needs from the stopped tracee. read_mem
+// returns the bytes read, or -1. regs holds struct user_regs_struct words.
+typedef struct {
+    int (*read_mem)(void *ctx, uint64_t addr, void *buf, int size);
+    void *ctx;
+    const unsigned long *regs;
+    uint64_t frame_base;     // Of the function containing pc, 0 if unknown
+    uint64_t load_bias;
+} VarEnv;
+
+#define VAR_EVAL_BYTES 256   // Most of a value an expression shows
+
+// Variable name visible at link-time pc: the innermost local in scope,
+// else a global. NULL if there is none.
+const Variable *var_lookup(VarTable *vt, uint64_t pc, const char *name);
+
+// Evaluate a C expression over the variables visible at pc, such as
+// "p->next->val", "arr[i]" or "*&s.name", and render the result as
+// var_format() does. Returns 0, or -1 with a message in out.
+int var_eval(VarTable *vt, uint64_t pc, const char *text, const VarEnv *env,
+             char *out, int out_size);
+
+// Hash of what the identifiers in text refer to at pc: which variable, and
+// the frame base or register that locates it. While it and the memory an
+// evaluation read stay the same, the result does too.
+uint64_t var_binding(VarTable *vt, uint64_t pc, const char *text, const VarEnv *env);
+
+#endif
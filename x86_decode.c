@@ -0,0 +1,963 @@
+#include "x86_decode.h"
+#include <stdio.h>
+#include <string.h>
+
+// Per-opcode properties of the one-byte map
+#define OP_MODRM   0x01
+#define OP_IMM8    0x02
+#define OP_IMMZ    0x04   // 16 or 32 bits depending on operand size
+#define OP_IMM16   0x08
+#define OP_REL8    0x10
+#define OP_REL32   0x20
+#define OP_INVALID 0x40
+#define OP_SPECIAL 0x80   // Handled by explicit code
+
+static uint8_t one_byte[256];
+static uint8_t two_byte[256];
+static int tables_ready = 0;
+
+static void set_range(uint8_t *table, int lo, int hi, uint8_t flags) {
+    for (int i = lo; i <= hi; i++) {
+        table[i] = flags;
+    }
+}
+
+static void init_tables(void) {
+    // ALU block 00-3F: r/m forms at x0-x3/x8-xB, accumulator imm at x4/x5/xC/xD
+    for (int base = 0x00; base < 0x40; base += 8) {
+        set_range(one_byte, base, base + 3, OP_MODRM);
+        one_byte[base + 4] = OP_IMM8;
+        one_byte[base + 5] = OP_IMMZ;
+        one_byte[base + 6] = OP_INVALID;
+        one_byte[base + 7] = OP_INVALID;
+    }
+    one_byte[0x0f] = OP_SPECIAL;
+    one_byte[0x26] = one_byte[0x2e] = one_byte[0x36] = one_byte[0x3e] = OP_SPECIAL;
+
+    set_range(one_byte, 0x40, 0x4f, OP_SPECIAL);   // REX
+    set_range(one_byte, 0x50, 0x5f, 0);
+    one_byte[0x60] = one_byte[0x61] = OP_INVALID;
+    one_byte[0x62] = OP_SPECIAL;                    // EVEX
+    one_byte[0x63] = OP_MODRM;
+    set_range(one_byte, 0x64, 0x67, OP_SPECIAL);
+    one_byte[0x68] = OP_IMMZ;
+    one_byte[0x69] = OP_MODRM | OP_IMMZ;
+    one_byte[0x6a] = OP_IMM8;
+    one_byte[0x6b] = OP_MODRM | OP_IMM8;
+    set_range(one_byte, 0x6c, 0x6f, 0);
+    set_range(one_byte, 0x70, 0x7f, OP_REL8);
+    one_byte[0x80] = OP_MODRM | OP_IMM8;
+    one_byte[0x81] = OP_MODRM | OP_IMMZ;
+    one_byte[0x82] = OP_INVALID;
+    one_byte[0x83] = OP_MODRM | OP_IMM8;
+    set_range(one_byte, 0x84, 0x8f, OP_MODRM);
+    set_range(one_byte, 0x90, 0x9f, 0);
+    one_byte[0x9a] = OP_INVALID;
+    set_range(one_byte, 0xa0, 0xa3, OP_SPECIAL);   // moffs
+    set_range(one_byte, 0xa4, 0xaf, 0);
+    one_byte[0xa8] = OP_IMM8;
+    one_byte[0xa9] = OP_IMMZ;
+    set_range(one_byte, 0xb0, 0xb7, OP_IMM8);
+    set_range(one_byte, 0xb8, 0xbf, OP_SPECIAL);   // imm32/imm64
+    one_byte[0xc0] = one_byte[0xc1] = OP_MODRM | OP_IMM8;
+    one_byte[0xc2] = OP_IMM16;
+    one_byte[0xc3] = 0;
+    one_byte[0xc4] = one_byte[0xc5] = OP_SPECIAL;  // VEX
+    one_byte[0xc6] = OP_MODRM | OP_IMM8;
+    one_byte[0xc7] = OP_MODRM | OP_IMMZ;
+    one_byte[0xc8] = OP_SPECIAL;                    // enter
+    one_byte[0xc9] = 0;
+    one_byte[0xca] = OP_IMM16;
+    one_byte[0xcb] = one_byte[0xcc] = 0;
+    one_byte[0xcd] = OP_IMM8;
+    one_byte[0xce] = OP_INVALID;
+    one_byte[0xcf] = 0;
+    set_range(one_byte, 0xd0, 0xd3, OP_MODRM);
+    set_range(one_byte, 0xd4, 0xd6, OP_INVALID);
+    one_byte[0xd7] = 0;
+    set_range(one_byte, 0xd8, 0xdf, OP_MODRM);
+    set_range(one_byte, 0xe0, 0xe3, OP_REL8);
+    set_range(one_byte, 0xe4, 0xe7, OP_IMM8);
+    one_byte[0xe8] = one_byte[0xe9] = OP_REL32;
+    one_byte[0xea] = OP_INVALID;
+    one_byte[0xeb] = OP_REL8;
+    set_range(one_byte, 0xec, 0xef, 0);
+    one_byte[0xf0] = one_byte[0xf2] = one_byte[0xf3] = OP_SPECIAL;
+    one_byte[0xf1] = one_byte[0xf4] = one_byte[0xf5] = 0;
+    one_byte[0xf6] = one_byte[0xf7] = OP_SPECIAL;  // test has an immediate
+    set_range(one_byte, 0xf8, 0xfd, 0);
+    one_byte[0xfe] = one_byte[0xff] = OP_MODRM;
+
+    // 0F map: ModRM unless listed
+    set_range(two_byte, 0x00, 0xff, OP_MODRM);
+    two_byte[0x04] = two_byte[0x0a] = two_byte[0x0c] = OP_INVALID;
+    two_byte[0x05] = two_byte[0x06] = two_byte[0x07] = 0;
+    two_byte[0x08] = two_byte[0x09] = two_byte[0x0b] = two_byte[0x0e] = 0;
+    two_byte[0x0f] = OP_MODRM | OP_IMM8;           // 3DNow! suffix byte
+    set_range(two_byte, 0x30, 0x37, 0);
+    two_byte[0x38] = two_byte[0x3a] = OP_SPECIAL;
+    set_range(two_byte, 0x70, 0x73, OP_MODRM | OP_IMM8);
+    two_byte[0x77] = 0;
+    set_range(two_byte, 0x80, 0x8f, OP_REL32);
+    two_byte[0xa0] = two_byte[0xa1] = two_byte[0xa2] = 0;
+    two_byte[0xa8] = two_byte[0xa9] = two_byte[0xaa] = 0;
+    two_byte[0xa4] = two_byte[0xac] = OP_MODRM | OP_IMM8;
+    two_byte[0xba] = OP_MODRM | OP_IMM8;
+    two_byte[0xc2] = OP_MODRM | OP_IMM8;
+    set_range(two_byte, 0xc4, 0xc6, OP_MODRM | OP_IMM8);
+    set_range(two_byte, 0xc8, 0xcf, 0);
+
+    tables_ready = 1;
+}
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    int error;
+} ByteCursor;
+
+static uint8_t next_byte(ByteCursor *c) {
+    if (c->p >= c->end) {
+        c->error = 1;
+        return 0;
+    }
+    return *c->p++;
+}
+
+static int64_t read_signed(ByteCursor *c, int size) {
+    uint64_t v = 0;
+    for (int i = 0; i < size; i++) {
+        v |= (uint64_t)next_byte(c) << (8 * i);
+    }
+    if (size < 8 && (v >> (8 * size - 1)) & 1) {
+        v |= ~(uint64_t)0 << (8 * size);
+    }
+    return (int64_t)v;
+}
+
+static void read_modrm(ByteCursor *c, X86Insn *insn) {
+    insn->has_modrm = 1;
+    insn->modrm = next_byte(c);
+
+    int mod = insn->modrm >> 6;
+    int rm = insn->modrm & 7;
+    if (mod == 3) {
+        return;
+    }
+
+    if (rm == 4) {
+        insn->has_sib = 1;
+        insn->sib = next_byte(c);
+        if (mod == 0 && (insn->sib & 7) == 5) {
+            insn->disp_size = 4;
+        }
+    } else if (mod == 0 && rm == 5) {
+        insn->disp_size = 4;   // RIP-relative
+    }
+
+    if (mod == 1) insn->disp_size = 1;
+    else if (mod == 2) insn->disp_size = 4;
+
+    if (insn->disp_size) {
+        insn->disp = read_signed(c, insn->disp_size);
+    }
+}
+
+static int operand_size_z(const X86Insn *insn) {
+    if (insn->rex & 0x08) return 4;
+    return insn->prefix_66 ? 2 : 4;
+}
+
+static void classify(X86Insn *insn) {
+    uint64_t next = insn->addr + insn->length;
+    int reg = (insn->modrm >> 3) & 7;
+
+    insn->flow = X86_FLOW_NONE;
+    if (insn->vex) {
+        return;
+    }
+
+    if (insn->map == X86_MAP_ONE) {
+        uint8_t op = insn->opcode;
+        if ((op >= 0x70 && op <= 0x7f) || (op >= 0xe0 && op <= 0xe3)) {
+            insn->flow = X86_FLOW_JCC;
+            insn->target = next + insn->imm;
+        } else if (op == 0xeb || op == 0xe9) {
+            insn->flow = X86_FLOW_JMP;
+            insn->target = next + insn->imm;
+        } else if (op == 0xe8) {
+            insn->flow = X86_FLOW_CALL;
+            insn->target = next + insn->imm;
+        } else if (op == 0xc2 || op == 0xc3 || op == 0xca || op == 0xcb || op == 0xcf) {
+            insn->flow = X86_FLOW_RET;
+        } else if (op == 0xff && (reg == 2 || reg == 3)) {
+            insn->flow = X86_FLOW_CALL_IND;
+        } else if (op == 0xff && (reg == 4 || reg == 5)) {
+            insn->flow = X86_FLOW_JMP_IND;
+        } else if (op == 0xcc || op == 0xcd || op == 0xf1 || op == 0xf4) {
+            insn->flow = X86_FLOW_TRAP;
+        }
+    } else if (insn->map == X86_MAP_0F) {
+        if (insn->opcode >= 0x80 && insn->opcode <= 0x8f) {
+            insn->flow = X86_FLOW_JCC;
+            insn->target = next + insn->imm;
+        } else if (insn->opcode == 0x0b) {
+            insn->flow = X86_FLOW_TRAP;
+        }
+    }
+}
+
+// VEX/EVEX: payload bytes, then opcode and ModRM
+static void decode_vex(ByteCursor *c, X86Insn *insn, uint8_t lead) {
+    uint8_t map;
+    if (lead == 0xc5) {
+        uint8_t b1 = next_byte(c);
+        insn->vex = 2;
+        insn->vex_l = (b1 >> 2) & 1;
+        insn->vex_vvvv = (~b1 >> 3) & 0xf;
+        insn->rex = 0x40 | ((~b1 & 0x80) ? 0x04 : 0);
+        map = X86_MAP_0F;
+    } else if (lead == 0xc4) {
+        uint8_t b1 = next_byte(c);
+        uint8_t b2 = next_byte(c);
+        insn->vex = 3;
+        insn->vex_w = b2 >> 7;
+        insn->vex_l = (b2 >> 2) & 1;
+        insn->vex_vvvv = (~b2 >> 3) & 0xf;
+        insn->rex = 0x40 | ((~b1 >> 5) & 0x7) | (insn->vex_w << 3);
+        map = b1 & 0x1f;
+    } else {
+        uint8_t p0 = next_byte(c);
+        uint8_t p1 = next_byte(c);
+        uint8_t p2 = next_byte(c);
+        insn->vex = 4;
+        insn->vex_w = p1 >> 7;
+        insn->vex_l = (p2 >> 5) & 3;
+        insn->vex_vvvv = (~p1 >> 3) & 0xf;
+        insn->rex = 0x40 | ((~p0 >> 5) & 0x7) | (insn->vex_w << 3);
+        map = p0 & 0x7;
+    }
+
+    if (map < X86_MAP_0F || map > X86_MAP_0F3A) {
+        c->error = 1;
+        return;
+    }
+    insn->map = map;
+    insn->opcode = next_byte(c);
+
+    // vzeroupper/vzeroall are the only VEX forms without ModRM
+    if (!(map == X86_MAP_0F && insn->opcode == 0x77 && insn->vex != 4)) {
+        read_modrm(c, insn);
+    }
+
+    int imm8 = (map == X86_MAP_0F3A) ||
+               (map == X86_MAP_0F && ((insn->opcode >= 0x70 && insn->opcode <= 0x73) ||
+                                      insn->opcode == 0xc2 ||
+                                      (insn->opcode >= 0xc4 && insn->opcode <= 0xc6)));
+    if (imm8) {
+        insn->imm_size = 1;
+        insn->imm = read_signed(c, 1);
+    }
+}
+
+int x86_decode(const uint8_t *code, size_t avail, uint64_t addr, X86Insn *insn) {
+    if (!tables_ready) {
+        init_tables();
+    }
+
+    memset(insn, 0, sizeof(X86Insn));
+    insn->addr = addr;
+
+    ByteCursor c;
+    c.p = code;
+    c.end = code + (avail > 15 ? 15 : avail);
+    c.error = 0;
+
+    uint8_t b;
+    for (;;) {
+        b = next_byte(&c);
+        if (c.error) return -1;
+
+        if (b == 0x66) insn->prefix_66 = 1;
+        else if (b == 0x67) insn->prefix_67 = 1;
+        else if (b == 0xf2) insn->prefix_f2 = 1;
+        else if (b == 0xf3) insn->prefix_f3 = 1;
+        else if (b == 0xf0) insn->prefix_lock = 1;
+        else if (b == 0x26 || b == 0x2e || b == 0x36 || b == 0x3e || b == 0x64 || b == 0x65) insn->segment = b;
+        else if (b >= 0x40 && b <= 0x4f) {
+            insn->rex = b;
+            // REX only counts immediately before the opcode
+            b = next_byte(&c);
+            if (c.error) return -1;
+            if ((b >= 0x40 && b <= 0x4f) || b == 0x66 || b == 0x67 || b == 0xf0 ||
+                b == 0xf2 || b == 0xf3 || b == 0x26 || b == 0x2e || b == 0x36 ||
+                b == 0x3e || b == 0x64 || b == 0x65) {
+                insn->rex = 0;
+                c.p--;
+                continue;
+            }
+            break;
+        }
+        else break;
+    }
+
+    if (b == 0xc4 || b == 0xc5 || b == 0x62) {
+        if (insn->rex) return -1;
+        decode_vex(&c, insn, b);
+    } else if (b == 0x0f) {
+        uint8_t op = next_byte(&c);
+        if (op == 0x38 || op == 0x3a) {
+            insn->map = (op == 0x38) ? X86_MAP_0F38 : X86_MAP_0F3A;
+            insn->opcode = next_byte(&c);
+            read_modrm(&c, insn);
+            if (insn->map == X86_MAP_0F3A) {
+                insn->imm_size = 1;
+                insn->imm = read_signed(&c, 1);
+            }
+        } else {
+            insn->map = X86_MAP_0F;
+            insn->opcode = op;
+            uint8_t flags = two_byte[op];
+            if (flags & OP_INVALID) return -1;
+            if (flags & OP_MODRM) read_modrm(&c, insn);
+            if (flags & OP_IMM8) {
+                insn->imm_size = 1;
+                insn->imm = read_signed(&c, 1);
+            } else if (flags & OP_REL32) {
+                insn->imm_size = 4;
+                insn->imm = read_signed(&c, 4);
+            }
+        }
+    } else {
+        insn->map = X86_MAP_ONE;
+        insn->opcode = b;
+        uint8_t flags = one_byte[b];
+        if (flags & OP_INVALID) return -1;
+
+        if (flags & OP_SPECIAL) {
+            if (b >= 0xa0 && b <= 0xa3) {
+                insn->imm_size = insn->prefix_67 ? 4 : 8;
+                insn->imm = read_signed(&c, insn->imm_size);
+            } else if (b >= 0xb8 && b <= 0xbf) {
+                insn->imm_size = (insn->rex & 0x08) ? 8 : operand_size_z(insn);
+                insn->imm = read_signed(&c, insn->imm_size);
+            } else if (b == 0xc8) {
+                insn->imm_size = 2;
+                insn->imm = read_signed(&c, 2);
+                insn->imm2_size = 1;
+                insn->imm2 = read_signed(&c, 1);
+            } else if (b == 0xf6 || b == 0xf7) {
+                read_modrm(&c, insn);
+                if (((insn->modrm >> 3) & 7) < 2) {
+                    insn->imm_size = (b == 0xf6) ? 1 : operand_size_z(insn);
+                    insn->imm = read_signed(&c, insn->imm_size);
+                }
+            } else {
+                return -1;
+            }
+        } else {
+            if (flags & OP_MODRM) read_modrm(&c, insn);
+            if (flags & (OP_IMM8 | OP_REL8)) {
+                insn->imm_size = 1;
+            } else if (flags & OP_IMMZ) {
+                insn->imm_size = operand_size_z(insn);
+            } else if (flags & OP_IMM16) {
+                insn->imm_size = 2;
+            } else if (flags & OP_REL32) {
+                insn->imm_size = 4;
+            }
+            if (insn->imm_size) {
+                insn->imm = read_signed(&c, insn->imm_size);
+            }
+        }
+    }
+
+    if (c.error) return -1;
+
+    insn->length = (int)(c.p - code);
+    classify(insn);
+    return insn->length;
+}
+
+// AT&T syntax output, in the style of objdump
+
+static const char *const reg64[16] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+static const char *const reg32[16] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+static const char *const reg16[16] = {
+    "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+    "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"
+};
+static const char *const reg8[16] = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+static const char *const cond_names[16] = {
+    "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"
+};
+static const char *const alu_names[8] = { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" };
+static const char *const shift_names[8] = { "rol", "ror", "rcl", "rcr", "shl", "shr", "shl", "sar" };
+
+#define X86_SIZE_XMM 16      // Operand size for SSE registers
+
+// One instruction being printed: operands are collected in Intel order
+// (destination first) and written out reversed
+typedef struct {
+    const X86Insn *insn;
+    char mnemonic[24];
+    char ops[3][48];
+    int op_count;
+    int has_reg;             // Some operand is a register, so no size suffix
+    int has_mem;
+    int size;                // Operand size for the suffix
+    int no_suffix;
+    int segment_prefix;      // Write the segment override before the mnemonic
+} Fmt;
+
+static const char *reg_name(const X86Insn *insn, int n, int size) {
+    static const char *const xmm[16] = {
+        "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+        "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"
+    };
+    static const char *const high8[4] = { "ah", "ch", "dh", "bh" };
+    switch (size) {
+        case 8:  return reg64[n];
+        case 4:  return reg32[n];
+        case 2:  return reg16[n];
+        case X86_SIZE_XMM: return xmm[n];
+        default: return !insn->rex && n >= 4 && n < 8 ? high8[n - 4] : reg8[n];
+    }
+}
+
+static int operand_size_v(const X86Insn *insn) {
+    if (insn->rex & 0x08) return 8;
+    return insn->prefix_66 ? 2 : 4;
+}
+
+static void fmt_reg(Fmt *f, int n, int size) {
+    snprintf(f->ops[f->op_count++], sizeof(f->ops[0]), "%%%s", reg_name(f->insn, n, size));
+    f->has_reg = 1;
+}
+
+static void fmt_imm(Fmt *f, int64_t value, int size) {
+    uint64_t v = (uint64_t)value;
+    if (size < 8) {
+        v &= ((uint64_t)1 << (8 * size)) - 1;
+    }
+    snprintf(f->ops[f->op_count++], sizeof(f->ops[0]), "$0x%llx", (unsigned long long)v);
+}
+
+static void fmt_signed_hex(char *out, size_t size, int64_t v) {
+    if (v < 0) {
+        snprintf(out, size, "-0x%llx", (unsigned long long)-(uint64_t)v);
+    } else {
+        snprintf(out, size, "0x%llx", (unsigned long long)v);
+    }
+}
+
+static const char *segment_name(uint8_t prefix) {
+    switch (prefix) {
+        case 0x26: return "es";
+        case 0x2e: return "cs";
+        case 0x36: return "ss";
+        case 0x3e: return "ds";
+        case 0x64: return "fs";
+        default:   return "gs";
+    }
+}
+
+// The ModRM r/m operand: a register of size, or a memory reference
+static void fmt_rm(Fmt *f, int size) {
+    const X86Insn *insn = f->insn;
+    int mod = insn->modrm >> 6;
+    int rm = (insn->modrm & 7) | ((insn->rex & 0x01) << 3);
+    if (mod == 3) {
+        fmt_reg(f, rm, size);
+        return;
+    }
+    f->has_mem = 1;
+
+    char *out = f->ops[f->op_count++];
+    size_t room = sizeof(f->ops[0]);
+    int len = 0;
+    if (insn->segment && !f->segment_prefix) {
+        len += snprintf(out + len, room - len, "%%%s:", segment_name(insn->segment));
+    }
+
+    const char *const *regs = insn->prefix_67 ? reg32 : reg64;
+    char disp[24] = "";
+    if (insn->disp_size) {
+        fmt_signed_hex(disp, sizeof(disp), insn->disp);
+    }
+    if (!insn->has_sib && mod == 0 && (insn->modrm & 7) == 5) {
+        snprintf(out + len, room - len, "%s(%%rip)", disp);
+        return;
+    }
+    if (!insn->has_sib) {
+        snprintf(out + len, room - len, "%s(%%%s)", disp, regs[rm]);
+        return;
+    }
+
+    int base = (insn->sib & 7) | ((insn->rex & 0x01) << 3);
+    int index = ((insn->sib >> 3) & 7) | ((insn->rex & 0x02) << 2);
+    int scale = 1 << (insn->sib >> 6);
+    int no_base = mod == 0 && (insn->sib & 7) == 5;
+    if (no_base && index == 4) {
+        // Absolute address, e.g. %fs:0x28
+        snprintf(out + len, room - len, "0x%llx", (unsigned long long)(uint32_t)insn->disp);
+        return;
+    }
+    len += snprintf(out + len, room - len, "%s(", disp);
+    if (!no_base) {
+        len += snprintf(out + len, room - len, "%%%s", regs[base]);
+    }
+    if (index != 4) {
+        len += snprintf(out + len, room - len, ",%%%s,%d", regs[index], scale);
+    }
+    snprintf(out + len, room - len, ")");
+}
+
+static void fmt_reg_field(Fmt *f, int size) {
+    fmt_reg(f, ((f->insn->modrm >> 3) & 7) | ((f->insn->rex & 0x04) << 1), size);
+}
+
+static void fmt_target(Fmt *f) {
+    snprintf(f->ops[f->op_count++], sizeof(f->ops[0]), "%llx", (unsigned long long)f->insn->target);
+}
+
+static void set_mnemonic(Fmt *f, const char *a, const char *b) {
+    snprintf(f->mnemonic, sizeof(f->mnemonic), "%s%s", a, b ? b : "");
+}
+
+// Scalar/packed SSE: ps, ss (F3), pd (66), sd (F2)
+static const char *sse_suffix(const X86Insn *insn) {
+    if (insn->prefix_f3) return "ss";
+    if (insn->prefix_f2) return "sd";
+    if (insn->prefix_66) return "pd";
+    return "ps";
+}
+
+// 66 0F integer SSE2 instructions with the xmm, xmm/m128 form
+static const char *packed_int_name(uint8_t op) {
+    switch (op) {
+        case 0x60: return "punpcklbw";
+        case 0x61: return "punpcklwd";
+        case 0x62: return "punpckldq";
+        case 0x64: return "pcmpgtb";
+        case 0x65: return "pcmpgtw";
+        case 0x66: return "pcmpgtd";
+        case 0x68: return "punpckhbw";
+        case 0x6c: return "punpcklqdq";
+        case 0x6d: return "punpckhqdq";
+        case 0x74: return "pcmpeqb";
+        case 0x75: return "pcmpeqw";
+        case 0x76: return "pcmpeqd";
+        case 0xd4: return "paddq";
+        case 0xd7: return "pmovmskb";
+        case 0xda: return "pminub";
+        case 0xdb: return "pand";
+        case 0xde: return "pmaxub";
+        case 0xdf: return "pandn";
+        case 0xeb: return "por";
+        case 0xef: return "pxor";
+        case 0xf8: return "psubb";
+        case 0xf9: return "psubw";
+        case 0xfa: return "psubd";
+        case 0xfb: return "psubq";
+        case 0xfc: return "paddb";
+        case 0xfd: return "paddw";
+        case 0xfe: return "paddd";
+        default:   return NULL;
+    }
+}
+
+static int format_0f(Fmt *f) {
+    const X86Insn *insn = f->insn;
+    uint8_t op = insn->opcode;
+    int reg = (insn->modrm >> 3) & 7;
+    int v = operand_size_v(insn);
+
+    if (op >= 0x80 && op <= 0x8f) {
+        set_mnemonic(f, "j", cond_names[op & 0xf]);
+        fmt_target(f);
+    } else if (op >= 0x40 && op <= 0x4f) {
+        set_mnemonic(f, "cmov", cond_names[op & 0xf]);
+        fmt_reg_field(f, v);
+        fmt_rm(f, v);
+    } else if (op >= 0x90 && op <= 0x9f) {
+        set_mnemonic(f, "set", cond_names[op & 0xf]);
+        fmt_rm(f, 1);
+        f->no_suffix = 1;
+    } else if (op == 0xb6 || op == 0xb7 || op == 0xbe || op == 0xbf) {
+        static const char size_letter[9] = { 0, 'b', 'w', 0, 'l', 0, 0, 0, 'q' };
+        int from = (op & 1) ? 2 : 1;
+        snprintf(f->mnemonic, sizeof(f->mnemonic), "mov%c%c%c", op < 0xb8 ? 'z' : 's',
+                 size_letter[from], size_letter[v]);
+        fmt_reg_field(f, v);
+        fmt_rm(f, from);
+        f->no_suffix = 1;
+    } else if (op == 0xaf) {
+        set_mnemonic(f, "imul", NULL);
+        fmt_reg_field(f, v);
+        fmt_rm(f, v);
+    } else if (op == 0x1e && insn->prefix_f3 && insn->modrm == 0xfa) {
+        set_mnemonic(f, "endbr64", NULL);
+    } else if (op == 0x18 && reg < 4 && (insn->modrm >> 6) != 3) {
+        static const char *const prefetches[4] = { "prefetchnta", "prefetcht0", "prefetcht1", "prefetcht2" };
+        set_mnemonic(f, prefetches[reg], NULL);
+        fmt_rm(f, 1);
+        f->no_suffix = 1;
+    } else if (op == 0x1f || (op >= 0x18 && op <= 0x1e)) {
+        // Padding such as "cs nopw 0x0(%rax,%rax,1)"
+        set_mnemonic(f, "nop", NULL);
+        f->segment_prefix = 1;
+        fmt_rm(f, v);
+    } else if (op == 0x05) {
+        set_mnemonic(f, "syscall", NULL);
+    } else if (op == 0x0b) {
+        set_mnemonic(f, "ud2", NULL);
+    } else if (op == 0xa2) {
+        set_mnemonic(f, "cpuid", NULL);
+    } else if (op == 0x31) {
+        set_mnemonic(f, "rdtsc", NULL);
+    } else if (op >= 0xc8 && op <= 0xcf) {
+        set_mnemonic(f, "bswap", NULL);
+        fmt_reg(f, (op & 7) | ((insn->rex & 0x01) << 3), v);
+    } else if (op == 0xa3 || op == 0xab || op == 0xb3 || op == 0xbb) {
+        static const char *const bit_ops[4] = { "bt", "bts", "btr", "btc" };
+        set_mnemonic(f, bit_ops[(op >> 3) & 3], NULL);
+        fmt_rm(f, v);
+        fmt_reg_field(f, v);
+    } else if (op == 0xba && reg >= 4) {
+        static const char *const bit_ops[4] = { "bt", "bts", "btr", "btc" };
+        set_mnemonic(f, bit_ops[reg - 4], NULL);
+        fmt_rm(f, v);
+        fmt_imm(f, insn->imm, 1);
+    } else if (op == 0xbc || op == 0xbd) {
+        set_mnemonic(f, insn->prefix_f3 ? (op == 0xbc ? "tzcnt" : "lzcnt") : (op == 0xbc ? "bsf" : "bsr"), NULL);
+        fmt_reg_field(f, v);
+        fmt_rm(f, v);
+    } else if (op == 0xb0 || op == 0xb1) {
+        set_mnemonic(f, "cmpxchg", NULL);
+        fmt_rm(f, op == 0xb0 ? 1 : v);
+        fmt_reg_field(f, op == 0xb0 ? 1 : v);
+    } else if (op == 0xc0 || op == 0xc1) {
+        set_mnemonic(f, "xadd", NULL);
+        fmt_rm(f, op == 0xc0 ? 1 : v);
+        fmt_reg_field(f, op == 0xc0 ? 1 : v);
+    } else if (op == 0x10 || op == 0x11) {
+        set_mnemonic(f, "movu", sse_suffix(insn));
+        if (insn->prefix_f3 || insn->prefix_f2) set_mnemonic(f, "mov", sse_suffix(insn));
+        if (op == 0x10) { fmt_reg_field(f, X86_SIZE_XMM); fmt_rm(f, X86_SIZE_XMM); }
+        else            { fmt_rm(f, X86_SIZE_XMM); fmt_reg_field(f, X86_SIZE_XMM); }
+    } else if (op == 0x28 || op == 0x29) {
+        set_mnemonic(f, "mova", insn->prefix_66 ? "pd" : "ps");
+        if (op == 0x28) { fmt_reg_field(f, X86_SIZE_XMM); fmt_rm(f, X86_SIZE_XMM); }
+        else            { fmt_rm(f, X86_SIZE_XMM); fmt_reg_field(f, X86_SIZE_XMM); }
+    } else if (op == 0x2a && (insn->prefix_f3 || insn->prefix_f2)) {
+        set_mnemonic(f, "cvtsi2", insn->prefix_f3 ? "ss" : "sd");
+        fmt_reg_field(f, X86_SIZE_XMM);
+        fmt_rm(f, (insn->rex & 0x08) ? 8 : 4);
+    } else if ((op == 0x2c || op == 0x2d) && (insn->prefix_f3 || insn->prefix_f2)) {
+        set_mnemonic(f, op == 0x2c ? "cvtt" : "cvt", insn->prefix_f3 ? "ss2si" : "sd2si");
+        fmt_reg_field(f, (insn->rex & 0x08) ? 8 : 4);
+        fmt_rm(f, X86_SIZE_XMM);
+    } else if (op == 0x2e || op == 0x2f) {
+        set_mnemonic(f, op == 0x2e ? "ucomis" : "comis", insn->prefix_66 ? "d" : "s");
+        fmt_reg_field(f, X86_SIZE_XMM);
+        fmt_rm(f, X86_SIZE_XMM);
+    } else if (op == 0x5a) {
+        set_mnemonic(f, "cvt", insn->prefix_f3 ? "ss2sd" : insn->prefix_f2 ? "sd2ss" :
+                               insn->prefix_66 ? "pd2ps" : "ps2pd");
+        fmt_reg_field(f, X86_SIZE_XMM);
+        fmt_rm(f, X86_SIZE_XMM);
+    } else if (op >= 0x51 && op <= 0x5f && op != 0x5b && op != 0x52 && op != 0x53) {
+        static const char *const arith[16] = {
+            NULL, "sqrt", NULL, NULL, "and", "andn", "or", "xor",
+            "add", "mul", NULL, NULL, "sub", "min", "div", "max"
+        };
+        set_mnemonic(f, arith[op & 0xf], sse_suffix(insn));
+        fmt_reg_field(f, X86_SIZE_XMM);
+        fmt_rm(f, X86_SIZE_XMM);
+    } else if (op == 0x6e && insn->prefix_66) {
+        set_mnemonic(f, (insn->rex & 0x08) ? "movq" : "movd", NULL);
+        fmt_reg_field(f, X86_SIZE_XMM);
+        fmt_rm(f, (insn->rex & 0x08) ? 8 : 4);
+    } else if (op == 0x7e && insn->prefix_66) {
+        set_mnemonic(f, (insn->rex & 0x08) ? "movq" : "movd", NULL);
+        fmt_rm(f, (insn->rex & 0x08) ? 8 : 4);
+        fmt_reg_field(f, X86_SIZE_XMM);
+    } else if ((op == 0x7e && insn->prefix_f3) || (op == 0xd6 && insn->prefix_66)) {
+        set_mnemonic(f, "movq", NULL);
+        if (op == 0x7e) { fmt_reg_field(f, X86_SIZE_XMM); fmt_rm(f, X86_SIZE_XMM); }
+        else            { fmt_rm(f, X86_SIZE_XMM); fmt_reg_field(f, X86_SIZE_XMM); }
+    } else if ((op == 0x6f || op == 0x7f) && (insn->prefix_66 || insn->prefix_f3)) {
+        set_mnemonic(f, insn->prefix_66 ? "movdqa" : "movdqu", NULL);
+        if (op == 0x6f) { fmt_reg_field(f, X86_SIZE_XMM); fmt_rm(f, X86_SIZE_XMM); }
+        else            { fmt_rm(f, X86_SIZE_XMM); fmt_reg_field(f, X86_SIZE_XMM); }
+    } else if (insn->prefix_66 && packed_int_name(op)) {
+        set_mnemonic(f, packed_int_name(op), NULL);
+        if (op == 0xd7) {
+            fmt_reg_field(f, 4);
+        } else {
+            fmt_reg_field(f, X86_SIZE_XMM);
+        }
+        fmt_rm(f, X86_SIZE_XMM);
+    } else if (op == 0x70 && insn->prefix_66) {
+        set_mnemonic(f, "pshufd", NULL);
+        fmt_reg_field(f, X86_SIZE_XMM);
+        fmt_rm(f, X86_SIZE_XMM);
+        fmt_imm(f, insn->imm, 1);
+    } else {
+        return -1;
+    }
+    (void)reg;
+    if (f->has_mem && !f->has_reg) {
+        f->size = v;
+    }
+    return 0;
+}
+
+static int format_one_byte(Fmt *f) {
+    const X86Insn *insn = f->insn;
+    uint8_t op = insn->opcode;
+    int reg = (insn->modrm >> 3) & 7;
+    int v = operand_size_v(insn);
+    int low = op & 7;
+    int b = (insn->rex & 0x01) << 3;
+    f->size = v;
+
+    if (op < 0x40 && low < 6) {
+        set_mnemonic(f, alu_names[op >> 3], NULL);
+        switch (low) {
+            case 0: fmt_rm(f, 1); fmt_reg_field(f, 1); f->size = 1; break;
+            case 1: fmt_rm(f, v); fmt_reg_field(f, v); break;
+            case 2: fmt_reg_field(f, 1); fmt_rm(f, 1); f->size = 1; break;
+            case 3: fmt_reg_field(f, v); fmt_rm(f, v); break;
+            case 4: fmt_reg(f, 0, 1); fmt_imm(f, insn->imm, 1); break;
+            case 5: fmt_reg(f, 0, v); fmt_imm(f, insn->imm, v); break;
+        }
+    } else if (op >= 0x50 && op <= 0x57) {
+        set_mnemonic(f, "push", NULL);
+        fmt_reg(f, low | b, insn->prefix_66 ? 2 : 8);
+    } else if (op >= 0x58 && op <= 0x5f) {
+        set_mnemonic(f, "pop", NULL);
+        fmt_reg(f, low | b, insn->prefix_66 ? 2 : 8);
+    } else if (op == 0x63) {
+        set_mnemonic(f, v == 8 ? "movslq" : "movsxd", NULL);
+        fmt_reg_field(f, v);
+        fmt_rm(f, 4);
+        f->no_suffix = 1;
+    } else if (op == 0x68 || op == 0x6a) {
+        set_mnemonic(f, "push", NULL);
+        fmt_imm(f, insn->imm, 8);
+        f->no_suffix = 1;
+    } else if (op == 0x69 || op == 0x6b) {
+        set_mnemonic(f, "imul", NULL);
+        fmt_reg_field(f, v);
+        fmt_rm(f, v);
+        fmt_imm(f, insn->imm, v);
+    } else if (op >= 0x70 && op <= 0x7f) {
+        set_mnemonic(f, "j", cond_names[op & 0xf]);
+        fmt_target(f);
+    } else if (op == 0x80 || op == 0x81 || op == 0x83) {
+        int size = op == 0x80 ? 1 : v;
+        set_mnemonic(f, alu_names[reg], NULL);
+        fmt_rm(f, size);
+        fmt_imm(f, insn->imm, size);
+        f->size = size;
+    } else if (op >= 0x84 && op <= 0x87) {
+        int size = (op & 1) ? v : 1;
+        set_mnemonic(f, op < 0x86 ? "test" : "xchg", NULL);
+        fmt_rm(f, size);
+        fmt_reg_field(f, size);
+        f->size = size;
+    } else if (op >= 0x88 && op <= 0x8b) {
+        int size = (op & 1) ? v : 1;
+        set_mnemonic(f, "mov", NULL);
+        if (op < 0x8a) { fmt_rm(f, size); fmt_reg_field(f, size); }
+        else           { fmt_reg_field(f, size); fmt_rm(f, size); }
+        f->size = size;
+    } else if (op == 0x8d) {
+        set_mnemonic(f, "lea", NULL);
+        fmt_reg_field(f, v);
+        fmt_rm(f, v);
+    } else if (op == 0x8f) {
+        set_mnemonic(f, "pop", NULL);
+        fmt_rm(f, 8);
+        f->no_suffix = 1;
+    } else if (op == 0x90 && !b) {
+        set_mnemonic(f, insn->prefix_f3 ? "pause" : "nop", NULL);
+        if (insn->prefix_66 && !insn->prefix_f3) set_mnemonic(f, "xchg", NULL), fmt_reg(f, 0, 2), fmt_reg(f, 0, 2);
+    } else if (op >= 0x90 && op <= 0x97) {
+        set_mnemonic(f, "xchg", NULL);
+        fmt_reg(f, low | b, v);
+        fmt_reg(f, 0, v);
+    } else if (op == 0x98) {
+        set_mnemonic(f, v == 8 ? "cltq" : v == 2 ? "cbtw" : "cwtl", NULL);
+    } else if (op == 0x99) {
+        set_mnemonic(f, v == 8 ? "cqto" : v == 2 ? "cwtd" : "cltd", NULL);
+    } else if (op == 0xa8 || op == 0xa9) {
+        set_mnemonic(f, "test", NULL);
+        fmt_reg(f, 0, op == 0xa8 ? 1 : v);
+        fmt_imm(f, insn->imm, op == 0xa8 ? 1 : v);
+    } else if ((op >= 0xa4 && op <= 0xa7) || (op >= 0xaa && op <= 0xaf)) {
+        static const char *const strings[12] = {
+            "movsb", "movs", "cmpsb", "cmps", NULL, NULL, "stos", "stos", "lods", "lods", "scas", "scas"
+        };
+        int size = (op & 1) ? v : 1;
+        const char *rep = insn->prefix_f3 ? (op == 0xa6 || op == 0xa7 || op >= 0xae ? "repz " : "rep ") :
+                          insn->prefix_f2 ? "repnz " : "";
+        snprintf(f->mnemonic, sizeof(f->mnemonic), "%s%s", rep, strings[op - 0xa4]);
+        if (op == 0xaa || op == 0xab) {
+            fmt_reg(f, 0, size);
+            snprintf(f->ops[f->op_count++], sizeof(f->ops[0]), "%%es:(%%rdi)");
+            // Written out reversed: the accumulator is the source
+            char tmp[48];
+            memcpy(tmp, f->ops[0], sizeof(tmp));
+            memcpy(f->ops[0], f->ops[1], sizeof(tmp));
+            memcpy(f->ops[1], tmp, sizeof(tmp));
+        } else if (op == 0xa4 || op == 0xa5) {
+            snprintf(f->ops[f->op_count++], sizeof(f->ops[0]), "%%es:(%%rdi)");
+            snprintf(f->ops[f->op_count++], sizeof(f->ops[0]), "%%ds:(%%rsi)");
+            if (op == 0xa5) snprintf(f->mnemonic, sizeof(f->mnemonic), "%smovs%c", rep, "  w l   q"[size]);
+        }
+        f->no_suffix = 1;
+    } else if (op >= 0xb0 && op <= 0xb7) {
+        set_mnemonic(f, "mov", NULL);
+        fmt_reg(f, low | b, 1);
+        fmt_imm(f, insn->imm, 1);
+    } else if (op >= 0xb8 && op <= 0xbf) {
+        set_mnemonic(f, insn->imm_size == 8 ? "movabs" : "mov", NULL);
+        fmt_reg(f, low | b, v);
+        fmt_imm(f, insn->imm, v);
+    } else if (op == 0xc0 || op == 0xc1 || (op >= 0xd0 && op <= 0xd3)) {
+        int size = (op & 1) ? v : 1;
+        set_mnemonic(f, shift_names[reg], NULL);
+        fmt_rm(f, size);
+        if (op <= 0xc1) fmt_imm(f, insn->imm, 1);
+        else if (op >= 0xd2) {
+            // The count in %cl says nothing about the operand size
+            int has_reg = f->has_reg;
+            fmt_reg(f, 1, 1);
+            f->has_reg = has_reg;
+        }
+        f->size = size;
+    } else if (op == 0xc2 || op == 0xc3) {
+        set_mnemonic(f, insn->prefix_f3 ? "repz ret" : "ret", NULL);
+        if (op == 0xc2) fmt_imm(f, insn->imm, 2);
+    } else if (op == 0xc6 || op == 0xc7) {
+        int size = op == 0xc6 ? 1 : v;
+        set_mnemonic(f, "mov", NULL);
+        fmt_rm(f, size);
+        fmt_imm(f, insn->imm, size);
+        f->size = size;
+    } else if (op == 0xc8) {
+        set_mnemonic(f, "enter", NULL);
+        fmt_imm(f, insn->imm2, 1);
+        fmt_imm(f, insn->imm, 2);
+    } else if (op == 0xc9) {
+        set_mnemonic(f, "leave", NULL);
+    } else if (op == 0xcc) {
+        set_mnemonic(f, "int3", NULL);
+    } else if (op == 0xcd) {
+        set_mnemonic(f, "int", NULL);
+        fmt_imm(f, insn->imm, 1);
+    } else if (op == 0xe8 || op == 0xe9 || op == 0xeb) {
+        set_mnemonic(f, op == 0xe8 ? "call" : "jmp", NULL);
+        fmt_target(f);
+    } else if (op >= 0xe0 && op <= 0xe3) {
+        static const char *const loops[4] = { "loopne", "loope", "loop", "jrcxz" };
+        set_mnemonic(f, loops[op - 0xe0], NULL);
+        fmt_target(f);
+    } else if (op == 0xf4) {
+        set_mnemonic(f, "hlt", NULL);
+    } else if (op == 0xf6 || op == 0xf7) {
+        static const char *const group3[8] = { "test", "test", "not", "neg", "mul", "imul", "div", "idiv" };
+        int size = op == 0xf6 ? 1 : v;
+        set_mnemonic(f, group3[reg], NULL);
+        fmt_rm(f, size);
+        if (reg < 2) fmt_imm(f, insn->imm, size);
+        f->size = size;
+    } else if (op >= 0xf8 && op <= 0xfd) {
+        static const char *const flags[6] = { "clc", "stc", "cli", "sti", "cld", "std" };
+        set_mnemonic(f, flags[op - 0xf8], NULL);
+    } else if (op == 0xfe && reg < 2) {
+        set_mnemonic(f, reg ? "dec" : "inc", NULL);
+        fmt_rm(f, 1);
+        f->size = 1;
+    } else if (op == 0xff) {
+        static const char *const group5[8] = { "inc", "dec", "call", NULL, "jmp", NULL, "push", NULL };
+        if (!group5[reg]) return -1;
+        set_mnemonic(f, group5[reg], NULL);
+        if (reg == 2 || reg == 4) {
+            // Indirect: objdump marks the operand with *
+            fmt_rm(f, 8);
+            memmove(f->ops[0] + 1, f->ops[0], sizeof(f->ops[0]) - 1);
+            f->ops[0][0] = '*';
+            f->no_suffix = 1;
+        } else {
+            fmt_rm(f, reg == 6 ? 8 : v);
+            f->no_suffix = reg == 6;
+        }
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int x86_format(const X86Insn *insn, char *out, size_t size) {
+    Fmt f;
+    memset(&f, 0, sizeof(f));
+    f.insn = insn;
+
+    int r;
+    if (insn->vex) {
+        r = -1;
+    } else if (insn->map == X86_MAP_ONE) {
+        r = format_one_byte(&f);
+    } else if (insn->map == X86_MAP_0F) {
+        r = format_0f(&f);
+    } else {
+        r = -1;
+    }
+    if (r != 0) {
+        static const char *const maps[4] = { "", "0f ", "0f38 ", "0f3a " };
+        return snprintf(out, size, "(%sopcode %s%02x)", insn->vex ? "vex " : "",
+                        maps[insn->map & 3], insn->opcode);
+    }
+
+    // Only an operand size nothing else shows needs a suffix: movl $0x0,-0x4(%rbp)
+    if (f.has_mem && !f.has_reg && !f.no_suffix && f.size) {
+        size_t len = strlen(f.mnemonic);
+        if (len + 1 < sizeof(f.mnemonic)) {
+            f.mnemonic[len] = "?bw?l???q"[f.size > 8 ? 0 : f.size];
+            f.mnemonic[len + 1] = '\0';
+        }
+    }
+    // Prefixes the operands cannot show go in front: "lock incl", "cs nopw"
+    char name[40];
+    if (insn->prefix_lock) {
+        snprintf(name, sizeof(name), "lock %s", f.mnemonic);
+    } else if (insn->segment && f.segment_prefix) {
+        snprintf(name, sizeof(name), "%s %s", segment_name(insn->segment), f.mnemonic);
+    } else {
+        snprintf(name, sizeof(name), "%s", f.mnemonic);
+    }
+    int len = snprintf(out, size, f.op_count ? "%-6s " : "%s", name);
+    for (int i = f.op_count - 1; i >= 0 && len < (int)size; i--) {
+        len += snprintf(out + len, size - len, "%s%s", f.ops[i], i ? "," : "");
+    }
+    // RIP-relative operands also show the address they reach
+    if (insn->has_modrm && (insn->modrm >> 6) == 0 && (insn->modrm & 7) == 5 &&
+        !insn->has_sib && len < (int)size) {
+        len += snprintf(out + len, size - len, "  # %llx",
+                        (unsigned long long)(insn->addr + insn->length + insn->disp));
+    }
+    return len;
+}
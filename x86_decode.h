@@ -0,0 +1,57 @@
+#ifndef X86_DECODE_H
+#define X86_DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// How an instruction transfers control
+typedef enum {
+    X86_FLOW_NONE,       // Falls through to the next instruction
+    X86_FLOW_JMP,        // Direct jump, target known
+    X86_FLOW_JCC,        // Direct conditional branch (jcc, loop, jrcxz)
+    X86_FLOW_CALL,       // Direct call, target known
+    X86_FLOW_CALL_IND,   // Call through register or memory
+    X86_FLOW_JMP_IND,    // Jump through register or memory
+    X86_FLOW_RET,        // Near/far return, iret
+    X86_FLOW_TRAP        // int3, int n, ud2, hlt
+} X86Flow;
+
+#define X86_MAP_ONE   0   // One-byte opcode map
+#define X86_MAP_0F    1
+#define X86_MAP_0F38  2
+#define X86_MAP_0F3A  3
+
+typedef struct {
+    uint64_t addr;
+    int length;
+    X86Flow flow;
+    uint64_t target;     // For direct JMP/JCC/CALL
+
+    // Decoded encoding fields
+    uint8_t prefix_66, prefix_67, prefix_f2, prefix_f3, prefix_lock;
+    uint8_t segment;     // Segment override prefix byte, or 0
+    uint8_t rex;         // REX byte, or 0
+    uint8_t vex;         // 0, 2 (C5), 3 (C4) or 4 (EVEX)
+    uint8_t vex_l, vex_w, vex_vvvv;
+    uint8_t map;
+    uint8_t opcode;
+    uint8_t has_modrm, modrm;
+    uint8_t has_sib, sib;
+    int disp_size;
+    int64_t disp;
+    int imm_size;
+    int64_t imm;
+    int imm2_size;       // enter has a second immediate
+    int64_t imm2;
+} X86Insn;
+
+// Decode one instruction at code[0..avail). Returns its length, or -1 if
+// the bytes are truncated or not a valid 64-bit mode encoding.
+int x86_decode(const uint8_t *code, size_t avail, uint64_t addr, X86Insn *insn);
+
+// Write insn in AT&T syntax as objdump does, e.g. "mov    -0x14(%rbp),%eax"
+// or "call   401136". Branch targets are bare hex addresses. Forms the
+// printer does not know come out as "(opcode 0f 38)". Returns the length.
+int x86_format(const X86Insn *insn, char *out, size_t size);
+
+#endif